@@ -131,8 +131,11 @@
 /* If ON, CPU will call the instruction hook callback before every
  * instruction.
  */
-#define M68K_INSTRUCTION_HOOK       OPT_OFF
-#define M68K_INSTRUCTION_CALLBACK() your_instruction_hook_function()
+#define M68K_INSTRUCTION_HOOK       OPT_SPECIFY_HANDLER
+#define M68K_INSTRUCTION_CALLBACK() (m68k_instructions_count++)
+
+/* Instructions executed, read and cleared every frame by frame_counters */
+extern unsigned int m68k_instructions_count;
 
 
 /* If ON, the CPU will emulate the 4-byte prefetch queue of a real 68000 */
@@ -90,17 +90,15 @@ void pd4990a_addretrace()
 
 void pd4990a_init(void) {
 	time_t ltime;
-	struct tm *today;
-	
-	pd4990a.seconds = 0x00;		/* BCD */
-	pd4990a.minutes = 0x00;		/* BCD */
-	pd4990a.hours = 0x00;		/* BCD */
-	pd4990a.days = 0x09;		/* BCD */
-	pd4990a.month = 9;			/* Hexadecimal form */
-	pd4990a.year = 0x73;		/* BCD */
-	pd4990a.weekday = 1;		/* BCD */
 	
+	time(&ltime);
+	pd4990a_set_time(localtime(&ltime));
+}
+
+/* Restarts the chip at the given date, the core init uses the local time */
+void pd4990a_set_time(const struct tm *today) {
 	retraces = 0;		/* Assumes 60 retraces a second */
+	testwaits = 0;
 	testbit = 0;		/* Pulses a bit in order to simulate */
 	reading=0;
 	writing=0;
@@ -110,9 +108,6 @@ void pd4990a_init(void) {
 	outputbit = 0;
 	bitno = 0;
 	
-	time(&ltime);
-	today = localtime(&ltime);
-	
 	pd4990a.seconds = ((today->tm_sec / 10) << 4) + (today->tm_sec % 10);
 	pd4990a.minutes = ((today->tm_min / 10) << 4) + (today->tm_min % 10);
 	pd4990a.hours = ((today->tm_hour / 10) << 4) + (today->tm_hour % 10);
@@ -3,8 +3,10 @@
  */
 
 #include <stdint.h>
+#include <time.h>
 
 void pd4990a_init(void);
+void pd4990a_set_time(const struct tm *today);	// Restarts the chip at that date
 void pd4990a_addretrace(void);				// To be call at 60Hz
 int pd4990a_read_testbit(void);				// TP out
 int pd4990a_read_databit(void);				// Data out
@@ -120,6 +120,7 @@
 #include "ym2610.h"
 #include "ym_delta_t.h"
 #include "ym_ssg.h"
+#include "../../lru_stamps.h"
 
 #ifndef INLINE
 #ifdef _MSC_VER
@@ -129,6 +130,15 @@
 #endif /* _MSC_VER */
 #endif /* INLINE */
 
+/* for the few functions that must be specialized on their constant arguments */
+#ifndef FORCE_INLINE
+#ifdef _MSC_VER
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE __inline__ __attribute__((always_inline))
+#endif /* _MSC_VER */
+#endif /* FORCE_INLINE */
+
 /* select bit size of output : 8 or 16 */
 #define FM_SAMPLE_BITS 16
 
@@ -248,6 +258,8 @@ static const uint8_t eg_inc[19*RATE_STEPS]={
 	/*18 */ 0,0, 0,0, 0,0, 0,0, /* infinity rates for attack and decay(s) */
 };
 
+#define EG_SEL_INFINITE (18*RATE_STEPS)
+
 #define O(a) (a*RATE_STEPS)
 
 /*note that there is no O(17) in this table - it's directly in the code */
@@ -1070,315 +1082,536 @@ static INLINE void advance_lfo(FM_OPN *OPN)
 	}
 }
 
+/* advance the envelope of one operator, returns 1 when the SSG-EG restarts the phase generator */
 /* changed from static inline to static here to work around gcc 4.2.1 codegen bug */
-static void advance_eg_channel(FM_OPN *OPN, FM_SLOT *SLOT)
+static int advance_eg_slot(FM_SLOT *SLOT, uint32_t eg_cnt)
 {
 	unsigned int out;
 	unsigned int swap_flag;
-	unsigned int i;
+	int phase_restart = 0;
 	
+	/* reset SSG-EG swap flag */
+	swap_flag = 0;
 	
-	i = 4; /* four operators per channel */
-	do
+	switch(SLOT->state)
 	{
-		/* reset SSG-EG swap flag */
-		swap_flag = 0;
-		
-		switch(SLOT->state)
-		{
-			case EG_ATT:        /* attack phase */
-				if ( !(OPN->eg_cnt & ((1<<SLOT->eg_sh_ar)-1) ) )
+		case EG_ATT:        /* attack phase */
+			if ( !(eg_cnt & ((1<<SLOT->eg_sh_ar)-1) ) )
+			{
+				SLOT->volume += (~SLOT->volume *
+								 (eg_inc[SLOT->eg_sel_ar + ((eg_cnt>>SLOT->eg_sh_ar)&7)])
+								 ) >>4;
+				
+				if (SLOT->volume <= MIN_ATT_INDEX)
 				{
-					SLOT->volume += (~SLOT->volume *
-									 (eg_inc[SLOT->eg_sel_ar + ((OPN->eg_cnt>>SLOT->eg_sh_ar)&7)])
-									 ) >>4;
-					
-					if (SLOT->volume <= MIN_ATT_INDEX)
-					{
-						SLOT->volume = MIN_ATT_INDEX;
-						SLOT->state = EG_DEC;
-					}
+					SLOT->volume = MIN_ATT_INDEX;
+					SLOT->state = EG_DEC;
 				}
-				break;
-				
-			case EG_DEC:    /* decay phase */
+			}
+			break;
+			
+		case EG_DEC:    /* decay phase */
+		{
+			if (SLOT->ssg&0x08) /* SSG EG type envelope selected */
 			{
-				if (SLOT->ssg&0x08) /* SSG EG type envelope selected */
+				if ( !(eg_cnt & ((1<<SLOT->eg_sh_d1r)-1) ) )
 				{
-					if ( !(OPN->eg_cnt & ((1<<SLOT->eg_sh_d1r)-1) ) )
-					{
-						SLOT->volume += 4 * eg_inc[SLOT->eg_sel_d1r + ((OPN->eg_cnt>>SLOT->eg_sh_d1r)&7)];
-						
-						if ( SLOT->volume >= (int32_t)(SLOT->sl) )
-							SLOT->state = EG_SUS;
-					}
+					SLOT->volume += 4 * eg_inc[SLOT->eg_sel_d1r + ((eg_cnt>>SLOT->eg_sh_d1r)&7)];
+					
+					if ( SLOT->volume >= (int32_t)(SLOT->sl) )
+						SLOT->state = EG_SUS;
 				}
-				else
+			}
+			else
+			{
+				if ( !(eg_cnt & ((1<<SLOT->eg_sh_d1r)-1) ) )
 				{
-					if ( !(OPN->eg_cnt & ((1<<SLOT->eg_sh_d1r)-1) ) )
-					{
-						SLOT->volume += eg_inc[SLOT->eg_sel_d1r + ((OPN->eg_cnt>>SLOT->eg_sh_d1r)&7)];
-						
-						if ( SLOT->volume >= (int32_t)(SLOT->sl) )
-							SLOT->state = EG_SUS;
-					}
+					SLOT->volume += eg_inc[SLOT->eg_sel_d1r + ((eg_cnt>>SLOT->eg_sh_d1r)&7)];
+					
+					if ( SLOT->volume >= (int32_t)(SLOT->sl) )
+						SLOT->state = EG_SUS;
 				}
 			}
-				break;
-				
-			case EG_SUS:    /* sustain phase */
-				if (SLOT->ssg&0x08) /* SSG EG type envelope selected */
+		}
+			break;
+			
+		case EG_SUS:    /* sustain phase */
+			if (SLOT->ssg&0x08) /* SSG EG type envelope selected */
+			{
+				if ( !(eg_cnt & ((1<<SLOT->eg_sh_d2r)-1) ) )
 				{
-					if ( !(OPN->eg_cnt & ((1<<SLOT->eg_sh_d2r)-1) ) )
+					SLOT->volume += 4 * eg_inc[SLOT->eg_sel_d2r + ((eg_cnt>>SLOT->eg_sh_d2r)&7)];
+					
+					if ( SLOT->volume >= ENV_QUIET )
 					{
-						SLOT->volume += 4 * eg_inc[SLOT->eg_sel_d2r + ((OPN->eg_cnt>>SLOT->eg_sh_d2r)&7)];
+						SLOT->volume = MAX_ATT_INDEX;
 						
-						if ( SLOT->volume >= ENV_QUIET )
+						if (SLOT->ssg&0x01) /* bit 0 = hold */
 						{
-							SLOT->volume = MAX_ATT_INDEX;
-							
-							if (SLOT->ssg&0x01) /* bit 0 = hold */
+							if (SLOT->ssgn&1)   /* have we swapped once ??? */
 							{
-								if (SLOT->ssgn&1)   /* have we swapped once ??? */
-								{
-									/* yes, so do nothing, just hold current level */
-								}
-								else
-									swap_flag = (SLOT->ssg&0x02) | 1 ; /* bit 1 = alternate */
-								
+								/* yes, so do nothing, just hold current level */
 							}
 							else
-							{
-								/* same as KEY-ON operation */
-								
-								/* restart of the Phase Generator should be here */
-								SLOT->phase = 0;
-								
-								{
-									/* phase -> Attack */
-									SLOT->volume = 511;
-									SLOT->state = EG_ATT;
-								}
-								
-								swap_flag = (SLOT->ssg&0x02); /* bit 1 = alternate */
-							}
+								swap_flag = (SLOT->ssg&0x02) | 1 ; /* bit 1 = alternate */
+							
 						}
-					}
-				}
-				else
-				{
-					if ( !(OPN->eg_cnt & ((1<<SLOT->eg_sh_d2r)-1) ) )
-					{
-						SLOT->volume += eg_inc[SLOT->eg_sel_d2r + ((OPN->eg_cnt>>SLOT->eg_sh_d2r)&7)];
-						
-						if ( SLOT->volume >= MAX_ATT_INDEX )
+						else
 						{
-							SLOT->volume = MAX_ATT_INDEX;
-							/* do not change SLOT->state (verified on real chip) */
+							/* same as KEY-ON operation */
+							
+							/* restart of the Phase Generator should be here,
+							 the caller owns the phase counter while rendering a block */
+							phase_restart = 1;
+							
+							{
+								/* phase -> Attack */
+								SLOT->volume = 511;
+								SLOT->state = EG_ATT;
+							}
+							
+							swap_flag = (SLOT->ssg&0x02); /* bit 1 = alternate */
 						}
 					}
-					
 				}
-				break;
-				
-			case EG_REL:    /* release phase */
-				if ( !(OPN->eg_cnt & ((1<<SLOT->eg_sh_rr)-1) ) )
+			}
+			else
+			{
+				if ( !(eg_cnt & ((1<<SLOT->eg_sh_d2r)-1) ) )
 				{
-					/* SSG-EG affects Release phase also (Nemesis) */
-					SLOT->volume += eg_inc[SLOT->eg_sel_rr + ((OPN->eg_cnt>>SLOT->eg_sh_rr)&7)];
+					SLOT->volume += eg_inc[SLOT->eg_sel_d2r + ((eg_cnt>>SLOT->eg_sh_d2r)&7)];
 					
 					if ( SLOT->volume >= MAX_ATT_INDEX )
 					{
 						SLOT->volume = MAX_ATT_INDEX;
-						SLOT->state = EG_OFF;
+						/* do not change SLOT->state (verified on real chip) */
 					}
 				}
-				break;
 				
-		}
-		
-		
-		out = ((uint32_t)SLOT->volume);
-		
-		/* negate output (changes come from alternate bit, init comes from attack bit) */
-		if ((SLOT->ssg&0x08) && (SLOT->ssgn&2) && (SLOT->state > EG_REL))
-			out ^= MAX_ATT_INDEX;
-		
-		/* we need to store the result here because we are going to change ssgn
-		 in next instruction */
-		SLOT->vol_out = out + SLOT->tl;
-		
-		/* reverse SLOT inversion flag */
-		SLOT->ssgn ^= swap_flag;
-		
-		SLOT++;
-		i--;
-	}while (i);
+			}
+			break;
+			
+		case EG_REL:    /* release phase */
+			if ( !(eg_cnt & ((1<<SLOT->eg_sh_rr)-1) ) )
+			{
+				/* SSG-EG affects Release phase also (Nemesis) */
+				SLOT->volume += eg_inc[SLOT->eg_sel_rr + ((eg_cnt>>SLOT->eg_sh_rr)&7)];
+				
+				if ( SLOT->volume >= MAX_ATT_INDEX )
+				{
+					SLOT->volume = MAX_ATT_INDEX;
+					SLOT->state = EG_OFF;
+				}
+			}
+			break;
+			
+	}
+	
 	
+	out = ((uint32_t)SLOT->volume);
+	
+	/* negate output (changes come from alternate bit, init comes from attack bit) */
+	if ((SLOT->ssg&0x08) && (SLOT->ssgn&2) && (SLOT->state > EG_REL))
+		out ^= MAX_ATT_INDEX;
+	
+	/* we need to store the result here because we are going to change ssgn
+	 in next instruction */
+	SLOT->vol_out = out + SLOT->tl;
+	
+	/* reverse SLOT inversion flag */
+	SLOT->ssgn ^= swap_flag;
+	
+	return phase_restart;
+}
+
+/* 1 when envelope generator ticks can't change the operator output until the next register write */
+static INLINE int eg_slot_is_static(FM_SLOT *SLOT)
+{
+	switch(SLOT->state)
+	{
+		case EG_OFF:
+			return 1;
+		case EG_ATT:
+			return SLOT->eg_sel_ar == EG_SEL_INFINITE && SLOT->volume > MIN_ATT_INDEX;
+		case EG_DEC:
+			return !(SLOT->ssg&0x08) && SLOT->eg_sel_d1r == EG_SEL_INFINITE && SLOT->volume < (int32_t)SLOT->sl;
+		case EG_SUS:
+			return !(SLOT->ssg&0x08) && (SLOT->eg_sel_d2r == EG_SEL_INFINITE || SLOT->volume >= MAX_ATT_INDEX);
+	}
+	return 0;
 }
 
+#pragma mark - FM block rendering
+
+/*
+ FM channels are rendered by blocks of samples instead of one sample at a time.
+ Each block goes through stages that work on structure of arrays lanes:
+  - LFO outputs and envelope generator ticks, shared by all channels
+  - envelopes (with AM) of the four operators of a channel
+  - phases of the four operators of a channel
+  - operators and algorithm routing, the only stage with a sample to sample dependency
+ Envelopes only change on envelope generator ticks and phases are a plain
+ arithmetic progression without PM, so most lanes are simple fills the compiler
+ vectorizes. The result is bit exact with evaluating the chip sample by sample.
+ */
 
+#define FM_BLOCK_SAMPLES        64  /* at most 64 so SSG-EG phase restarts fit a 64 bits mask */
+#define FM_BLOCK_EG_TICKS       (FM_BLOCK_SAMPLES * 4)
+#define FM_BLOCK_NO_PM          0xff /* lfo_kc value of samples without phase modulation */
 
-#define volume_calc(OP) ((OP)->vol_out + (AM & (OP)->AMmask))
+typedef struct
+{
+	int       length;
+	uint32_t  lfo_am[FM_BLOCK_SAMPLES];
+	int32_t   lfo_pm[FM_BLOCK_SAMPLES];
+	int       eg_ticks;
+	uint8_t   eg_tick_sample[FM_BLOCK_EG_TICKS];   /* sample computed right after each envelope generator tick */
+	uint32_t  eg_tick_cnt[FM_BLOCK_EG_TICKS];      /* eg_cnt of each tick */
+	uint32_t  lfo_block_fnum;                      /* blk/fnum of the lfo_fc and lfo_kc lanes */
+	int32_t   lfo_fc[FM_BLOCK_SAMPLES];            /* LFO modulated phase increment before detune */
+	uint8_t   lfo_kc[FM_BLOCK_SAMPLES];            /* LFO modulated key code, FM_BLOCK_NO_PM without modulation */
+	uint64_t  phase_restart[4];                    /* per operator, samples where SSG-EG restarts the phase */
+	uint32_t  env[4][FM_BLOCK_SAMPLES];            /* per operator, envelope output with AM */
+	uint32_t  phase[4][FM_BLOCK_SAMPLES];          /* per operator, phase counter used by the sample */
+	int32_t   out_lt[FM_BLOCK_SAMPLES];            /* FM mix of the block */
+	int32_t   out_rt[FM_BLOCK_SAMPLES];
+} FM_BLOCK;
+
+/* number of samples of the next block, keeps the envelope ticks in the block arrays */
+static int fm_block_length(FM_OPN *OPN, int remaining)
+{
+	uint32_t ticks_per_sample = OPN->eg_timer_add / OPN->eg_timer_overflow + 1;
+	int length = FM_BLOCK_EG_TICKS / ticks_per_sample;
+	
+	if (length > FM_BLOCK_SAMPLES)
+		length = FM_BLOCK_SAMPLES;
+	if (length < 1)
+		length = 1;
+	return (length < remaining) ? length : remaining;
+}
 
-static INLINE void update_phase_lfo_slot(FM_OPN *OPN, FM_SLOT *SLOT, int32_t pms, uint32_t block_fnum)
+/* LFO and envelope generator timing for the whole block */
+static void fm_block_timing(FM_OPN *OPN, FM_BLOCK *block)
 {
-	uint32_t fnum_lfo  = ((block_fnum & 0x7f0) >> 4) * 32 * 8;
-	int32_t  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + pms + OPN->LFO_PM ];
+	int n;
+	int ticks = 0;
 	
-	if (lfo_fn_table_index_offset)    /* LFO phase modulation active */
+	for (n = 0; n < block->length; n++)
 	{
-		uint8_t blk;
-		uint32_t fn;
-		int kc, fc;
-		
-		block_fnum = block_fnum*2 + lfo_fn_table_index_offset;
-		
-		blk = (block_fnum&0x7000) >> 12;
-		fn  = block_fnum & 0xfff;
-		
-		/* keyscale code */
-		kc = (blk<<2) | opn_fktable[fn >> 8];
-		
-		/* phase increment counter */
-		fc = (OPN->fn_table[fn]>>(7-blk)) + SLOT->DT[kc];
-		
-		/* detects frequency overflow (credits to Nemesis) */
-		if (fc < 0) fc += OPN->fn_max;
+		advance_lfo(OPN);
+		block->lfo_am[n] = OPN->LFO_AM;
+		block->lfo_pm[n] = OPN->LFO_PM;
 		
-		/* update phase */
-		SLOT->phase += (fc * SLOT->mul) >> 1;
+		OPN->eg_timer += OPN->eg_timer_add;
+		while (OPN->eg_timer >= OPN->eg_timer_overflow)
+		{
+			OPN->eg_timer -= OPN->eg_timer_overflow;
+			OPN->eg_cnt++;
+			block->eg_tick_sample[ticks] = n;
+			block->eg_tick_cnt[ticks] = OPN->eg_cnt;
+			ticks++;
+		}
+	}
+	block->eg_ticks = ticks;
+}
+
+/* envelope output with AM of samples start to end of a block */
+static INLINE void fm_block_fill_env(uint32_t *env, const uint32_t *lfo_am, int start, int end, uint32_t vol_out, uint8_t ams, uint32_t AMmask)
+{
+	int n;
+	
+	if (AMmask)
+	{
+		for (n = start; n < end; n++)
+			env[n] = vol_out + (lfo_am[n] >> ams);
 	}
-	else    /* LFO phase modulation  = zero */
+	else
 	{
-		SLOT->phase += SLOT->Incr;
+		for (n = start; n < end; n++)
+			env[n] = vol_out;
 	}
 }
 
-static INLINE void update_phase_lfo_channel(FM_OPN *OPN, FM_CH *CH)
+/* envelope lane of one operator, ticks happen before the sample is computed */
+static void fm_block_envelope(FM_BLOCK *block, FM_SLOT *SLOT, uint8_t ams, uint32_t *env, uint64_t *phase_restart)
 {
-	uint32_t block_fnum = CH->block_fnum;
+	int n = 0, t;
+	int eg_static = eg_slot_is_static(SLOT);
+	uint32_t vol_out = SLOT->vol_out;
+	uint64_t restart = 0;
 	
-	uint32_t fnum_lfo  = ((block_fnum & 0x7f0) >> 4) * 32 * 8;
-	int32_t  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + CH->pms + OPN->LFO_PM ];
-	
-	if (lfo_fn_table_index_offset)    /* LFO phase modulation active */
+	for (t = 0; t < block->eg_ticks; t++)
 	{
-		uint8_t blk;
-		uint32_t fn;
-		int kc, fc, finc;
-		
-		block_fnum = block_fnum*2 + lfo_fn_table_index_offset;
-		
-		blk = (block_fnum&0x7000) >> 12;
-		fn  = block_fnum & 0xfff;
-		
-		/* keyscale code */
-		kc = (blk<<2) | opn_fktable[fn >> 8];
-		
-		/* phase increment counter */
-		fc = (OPN->fn_table[fn]>>(7-blk));
+		int tick_sample = block->eg_tick_sample[t];
 		
-		/* detects frequency overflow (credits to Nemesis) */
-		finc = fc + CH->SLOT[SLOT1].DT[kc];
+		/* the envelope holds until the next tick */
+		fm_block_fill_env(env, block->lfo_am, n, tick_sample, vol_out, ams, SLOT->AMmask);
+		n = tick_sample;
 		
-		if (finc < 0) finc += OPN->fn_max;
-		CH->SLOT[SLOT1].phase += (finc*CH->SLOT[SLOT1].mul) >> 1;
+		if (advance_eg_slot(SLOT, block->eg_tick_cnt[t]))
+			restart |= (uint64_t)1 << tick_sample;
+		vol_out = SLOT->vol_out;
 		
-		finc = fc + CH->SLOT[SLOT2].DT[kc];
-		if (finc < 0) finc += OPN->fn_max;
-		CH->SLOT[SLOT2].phase += (finc*CH->SLOT[SLOT2].mul) >> 1;
-		
-		finc = fc + CH->SLOT[SLOT3].DT[kc];
-		if (finc < 0) finc += OPN->fn_max;
-		CH->SLOT[SLOT3].phase += (finc*CH->SLOT[SLOT3].mul) >> 1;
-		
-		finc = fc + CH->SLOT[SLOT4].DT[kc];
-		if (finc < 0) finc += OPN->fn_max;
-		CH->SLOT[SLOT4].phase += (finc*CH->SLOT[SLOT4].mul) >> 1;
-	}
-	else    /* LFO phase modulation  = zero */
-	{
-		CH->SLOT[SLOT1].phase += CH->SLOT[SLOT1].Incr;
-		CH->SLOT[SLOT2].phase += CH->SLOT[SLOT2].Incr;
-		CH->SLOT[SLOT3].phase += CH->SLOT[SLOT3].Incr;
-		CH->SLOT[SLOT4].phase += CH->SLOT[SLOT4].Incr;
+		/* the first tick refreshes vol_out, the next ones would give the same output */
+		if (eg_static)
+			break;
 	}
+	fm_block_fill_env(env, block->lfo_am, n, block->length, vol_out, ams, SLOT->AMmask);
+	
+	*phase_restart = restart;
 }
 
-static INLINE void chan_calc(FM_OPN *OPN, FM_CH *CH, int chnum)
+/* LFO modulated frequency of a blk/fnum, shared by the operators of a channel outside of 3 slot mode */
+static void fm_block_lfo_fnum(FM_OPN *OPN, FM_BLOCK *block, int32_t pms, uint32_t block_fnum)
 {
-	unsigned int eg_out;
-	
-	uint32_t AM = OPN->LFO_AM >> CH->ams;
-	
+	int n;
+	uint32_t fnum_lfo  = ((block_fnum & 0x7f0) >> 4) * 32 * 8;
 	
-	OPN->m2 = OPN->c1 = OPN->c2 = OPN->mem = 0;
+	if (block->lfo_block_fnum == block_fnum)
+		return;
+	block->lfo_block_fnum = block_fnum;
 	
-	*CH->mem_connect = CH->mem_value;   /* restore delayed sample (MEM) value to m2 or c2 */
+	for (n = 0; n < block->length; n++)
+	{
+		int32_t lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + pms + block->lfo_pm[n] ];
+		
+		if (lfo_fn_table_index_offset)    /* LFO phase modulation active */
+		{
+			uint32_t lfo_block_fnum = block_fnum*2 + lfo_fn_table_index_offset;
+			uint8_t blk = (lfo_block_fnum&0x7000) >> 12;
+			uint32_t fn  = lfo_block_fnum & 0xfff;
+			
+			/* keyscale code */
+			block->lfo_kc[n] = (blk<<2) | opn_fktable[fn >> 8];
+			
+			/* phase increment counter */
+			block->lfo_fc[n] = (OPN->fn_table[fn]>>(7-blk));
+		}
+		else    /* LFO phase modulation  = zero */
+		{
+			block->lfo_kc[n] = FM_BLOCK_NO_PM;
+			block->lfo_fc[n] = 0;
+		}
+	}
+}
+
+/* phase lane of one operator, the counter is advanced after each sample */
+static void fm_block_phase(FM_OPN *OPN, FM_BLOCK *block, FM_SLOT *SLOT, int32_t pms, uint64_t phase_restart, uint32_t *phase)
+{
+	int n;
+	int length = block->length;
+	uint32_t p = SLOT->phase;
+	uint32_t incr = SLOT->Incr;
 	
-	eg_out = volume_calc(&CH->SLOT[SLOT1]);
+	if (!pms && !phase_restart)
+	{
+		/* plain progression, no dependency between samples */
+		for (n = 0; n < length; n++)
+			phase[n] = p + (uint32_t)n * incr;
+		p += (uint32_t)length * incr;
+	}
+	else if (!pms)
 	{
-		int32_t out = CH->op1_out[0] + CH->op1_out[1];
-		CH->op1_out[0] = CH->op1_out[1];
+		for (n = 0; n < length; n++)
+		{
+			if ((phase_restart >> n) & 1)
+				p = 0;
+			phase[n] = p;
+			p += incr;
+		}
+	}
+	else
+	{
+		const int32_t *lfo_fc = block->lfo_fc;
+		const uint8_t *lfo_kc = block->lfo_kc;
+		uint32_t pm_incr = incr;
+		int32_t last_fc = 0;
+		uint8_t last_kc = FM_BLOCK_NO_PM;
 		
-		if( !CH->connect1 )
+		for (n = 0; n < length; n++)
 		{
-			/* algorithm 5  */
-			OPN->mem = OPN->c1 = OPN->c2 = CH->op1_out[0];
+			if ((phase_restart >> n) & 1)
+				p = 0;
+			phase[n] = p;
+			
+			/* LFO output holds for many samples, only recompute the step when it changes */
+			if (lfo_kc[n] != last_kc || lfo_fc[n] != last_fc)
+			{
+				last_kc = lfo_kc[n];
+				last_fc = lfo_fc[n];
+				if (last_kc == FM_BLOCK_NO_PM)
+					pm_incr = incr;
+				else
+				{
+					int fc = last_fc + SLOT->DT[last_kc];
+					
+					/* detects frequency overflow (credits to Nemesis) */
+					if (fc < 0) fc += OPN->fn_max;
+					
+					pm_incr = (fc * SLOT->mul) >> 1;
+				}
+			}
+			p += pm_incr;
 		}
+	}
+	SLOT->phase = p;
+}
+
+/*
+ operators of one channel for a given algorithm, algo is a constant once inlined
+ so the routing of setup_connection() becomes plain register additions:
+ M1 = SLOT1 (one sample delay), M2 = SLOT3, C1 = SLOT2, C2 = SLOT4
+ */
+static FORCE_INLINE void fm_block_algorithm(FM_BLOCK *block, FM_CH *CH, unsigned int pan_lt, unsigned int pan_rt, const int algo)
+{
+	int n;
+	const uint32_t *env1 = block->env[SLOT1], *env2 = block->env[SLOT2], *env3 = block->env[SLOT3], *env4 = block->env[SLOT4];
+	const uint32_t *phase1 = block->phase[SLOT1], *phase2 = block->phase[SLOT2], *phase3 = block->phase[SLOT3], *phase4 = block->phase[SLOT4];
+	int32_t op1_out0 = CH->op1_out[0];
+	int32_t op1_out1 = CH->op1_out[1];
+	int32_t mem_value = CH->mem_value;
+	uint8_t FB = CH->FB;
+	
+	for (n = 0; n < block->length; n++)
+	{
+		int32_t m2 = 0, c1 = 0, c2 = 0, mem = 0, out = 0;
+		unsigned int eg_out;
+		
+		/* restore delayed sample (MEM) value to m2 or c2 */
+		if (algo <= 2 || algo == 5)
+			m2 = mem_value;
+		else if (algo == 3)
+			c2 = mem_value;
 		else
+			mem = mem_value;    /* not used */
+		
+		eg_out = env1[n];
+		{
+			int32_t op_out = op1_out0 + op1_out1;
+			op1_out0 = op1_out1;
+			
+			switch (algo)
+			{
+				case 1: mem += op1_out0; break;
+				case 2: c2 += op1_out0; break;
+				case 5: mem = c1 = c2 = op1_out0; break;
+				case 7: out += op1_out0; break;
+				default: c1 += op1_out0; break;
+			}
+			
+			op1_out1 = 0;
+			if( eg_out < ENV_QUIET )    /* SLOT 1 */
+			{
+				if (!FB)
+					op_out=0;
+				
+				op1_out1 = op_calc1(phase1[n], eg_out, (op_out<<FB) );
+			}
+		}
+		
+		eg_out = env3[n];
+		if( eg_out < ENV_QUIET )        /* SLOT 3 */
 		{
-			/* other algorithms */
-			*CH->connect1 += CH->op1_out[0];
+			int32_t op_out = op_calc(phase3[n], eg_out, m2);
+			if (algo <= 4)
+				c2 += op_out;
+			else
+				out += op_out;
 		}
 		
-		CH->op1_out[1] = 0;
-		if( eg_out < ENV_QUIET )    /* SLOT 1 */
+		eg_out = env2[n];
+		if( eg_out < ENV_QUIET )        /* SLOT 2 */
 		{
-			if (!CH->FB)
-				out=0;
-			
-			CH->op1_out[1] = op_calc1(CH->SLOT[SLOT1].phase, eg_out, (out<<CH->FB) );
+			int32_t op_out = op_calc(phase2[n], eg_out, c1);
+			if (algo <= 3)
+				mem += op_out;
+			else
+				out += op_out;
 		}
+		
+		eg_out = env4[n];
+		if( eg_out < ENV_QUIET )        /* SLOT 4 */
+			out += op_calc(phase4[n], eg_out, c2);
+		
+		/* store current MEM */
+		mem_value = mem;
+		
+		/* the shift right was verified on real chip */
+		block->out_lt[n] += (out >> 1) & pan_lt;
+		block->out_rt[n] += (out >> 1) & pan_rt;
 	}
 	
-	eg_out = volume_calc(&CH->SLOT[SLOT3]);
-	if( eg_out < ENV_QUIET )        /* SLOT 3 */
-		*CH->connect3 += op_calc(CH->SLOT[SLOT3].phase, eg_out, OPN->m2);
-	
-	eg_out = volume_calc(&CH->SLOT[SLOT2]);
-	if( eg_out < ENV_QUIET )        /* SLOT 2 */
-		*CH->connect2 += op_calc(CH->SLOT[SLOT2].phase, eg_out, OPN->c1);
-	
-	eg_out = volume_calc(&CH->SLOT[SLOT4]);
-	if( eg_out < ENV_QUIET )        /* SLOT 4 */
-		*CH->connect4 += op_calc(CH->SLOT[SLOT4].phase, eg_out, OPN->c2);
-	
-	
-	/* store current MEM */
-	CH->mem_value = OPN->mem;
-	
-	/* update phase counters AFTER output calculations */
-	if(CH->pms)
+	CH->op1_out[0] = op1_out0;
+	CH->op1_out[1] = op1_out1;
+	CH->mem_value = mem_value;
+}
+
+/*
+ 1 when the channel can't output anything during the block: released operators are
+ above ENV_QUIET whatever the AM, and no feedback or delayed (MEM) output is pending.
+ Algorithms 4, 6 and 7 never read MEM, it just holds its value.
+ */
+static INLINE int fm_channel_is_silent(FM_CH *CH)
+{
+	return CH->SLOT[SLOT1].state == EG_OFF && CH->SLOT[SLOT2].state == EG_OFF
+		&& CH->SLOT[SLOT3].state == EG_OFF && CH->SLOT[SLOT4].state == EG_OFF
+		&& CH->op1_out[0] == 0 && CH->op1_out[1] == 0
+		&& (CH->mem_value == 0 || CH->ALGO == 4 || CH->ALGO == 6 || CH->ALGO == 7);
+}
+
+/* envelopes, phases and operators of one channel, mixed into the block output, returns 0 for a silent channel */
+static int fm_block_channel(FM_OPN *OPN, FM_BLOCK *block, FM_CH *CH, int chnum)
+{
+	static const uint8_t slots[4] = { SLOT1, SLOT2, SLOT3, SLOT4 };
+	int s;
+	unsigned int pan_lt = OPN->pan[chnum * 2];
+	unsigned int pan_rt = OPN->pan[chnum * 2 + 1];
+	int three_slot = (OPN->ST.mode & 0xC0) && (chnum == 2);
+	int silent = fm_channel_is_silent(CH);
+	
+	block->lfo_block_fnum = ~0u;
+	for (s = 0; s < 4; s++)
 	{
+		FM_SLOT *SLOT = &CH->SLOT[slots[s]];
+		uint32_t block_fnum = CH->block_fnum;
+		
 		/* add support for 3 slot mode */
-		if ((OPN->ST.mode & 0xC0) && (chnum == 2))
+		if (three_slot && slots[s] != SLOT4)
+			block_fnum = OPN->SL3.block_fnum[(slots[s] == SLOT1) ? 1 : (slots[s] == SLOT2) ? 2 : 0];
+		
+		if (silent)
 		{
-			update_phase_lfo_slot(OPN, &CH->SLOT[SLOT1], CH->pms, OPN->SL3.block_fnum[1]);
-			update_phase_lfo_slot(OPN, &CH->SLOT[SLOT2], CH->pms, OPN->SL3.block_fnum[2]);
-			update_phase_lfo_slot(OPN, &CH->SLOT[SLOT3], CH->pms, OPN->SL3.block_fnum[0]);
-			update_phase_lfo_slot(OPN, &CH->SLOT[SLOT4], CH->pms, CH->block_fnum);
+			/* only keep the operator state going: EG_OFF is static and has no phase restart */
+			if (block->eg_ticks)
+				advance_eg_slot(SLOT, block->eg_tick_cnt[0]);
+			if (!CH->pms)
+			{
+				SLOT->phase += (uint32_t)block->length * SLOT->Incr;
+				continue;
+			}
+			block->phase_restart[slots[s]] = 0;
 		}
-		else update_phase_lfo_channel(OPN, CH);
+		else
+			fm_block_envelope(block, SLOT, CH->ams, block->env[slots[s]], &block->phase_restart[slots[s]]);
+		if (CH->pms)
+			fm_block_lfo_fnum(OPN, block, CH->pms, block_fnum);
+		fm_block_phase(OPN, block, SLOT, CH->pms, block->phase_restart[slots[s]], block->phase[slots[s]]);
 	}
-	else    /* no LFO phase modulation */
+	if (silent)
+		return 0;
+	
+	switch (CH->ALGO)
 	{
-		CH->SLOT[SLOT1].phase += CH->SLOT[SLOT1].Incr;
-		CH->SLOT[SLOT2].phase += CH->SLOT[SLOT2].Incr;
-		CH->SLOT[SLOT3].phase += CH->SLOT[SLOT3].Incr;
-		CH->SLOT[SLOT4].phase += CH->SLOT[SLOT4].Incr;
+		case 0: fm_block_algorithm(block, CH, pan_lt, pan_rt, 0); break;
+		case 1: fm_block_algorithm(block, CH, pan_lt, pan_rt, 1); break;
+		case 2: fm_block_algorithm(block, CH, pan_lt, pan_rt, 2); break;
+		case 3: fm_block_algorithm(block, CH, pan_lt, pan_rt, 3); break;
+		case 4: fm_block_algorithm(block, CH, pan_lt, pan_rt, 4); break;
+		case 5: fm_block_algorithm(block, CH, pan_lt, pan_rt, 5); break;
+		case 6: fm_block_algorithm(block, CH, pan_lt, pan_rt, 6); break;
+		default: fm_block_algorithm(block, CH, pan_lt, pan_rt, 7); break;
 	}
+	return 1;
 }
 
 /* update phase increment and envelope generator */
@@ -1962,6 +2195,7 @@ typedef struct
 	int8_t        vol_mul;        /* volume in "0.75dB" steps */
 	uint8_t       vol_shift;      /* volume in "-6dB" steps   */
 	int32_t       *pan;           /* &out_adpcm[OPN_xxxx]     */
+	uint16_t      cache_entry;    /* decoded sample played, ADPCMA_CACHE_NONE when decoding the ROM */
 } ADPCM_CH;
 
 #pragma mark YM2610 device
@@ -1975,8 +2209,7 @@ typedef struct
 	uint8_t       addr_A1;            /* address line A1      */
 	
 	/* ADPCM-A unit */
-	uint8_t       	*read_byte;
-	uint32_t 		read_byte_size;
+	YM_PCM_ROM    pcm_rom;            /* ADPCM-A samples      */
 	uint8_t       adpcmTL;            /* adpcmA total level   */
 	ADPCM_CH    adpcm[6];           /* adpcm channels       */
 	uint32_t      adpcmreg[0x30];     /* registers            */
@@ -1992,6 +2225,266 @@ static ym2610_state ym2610_device;
 /* different from the usual ADPCM table */
 static int step_inc[8] = { -1*16, -1*16, -1*16, -1*16, 2*16, 5*16, 7*16, 9*16 };
 
+#pragma mark ADPCM-A decode cache
+
+/*
+ ADPCM-A channels always start decoding at the start address with a cleared
+ accumulator and step, so the decoded 12-bit output only depends on the
+ (start, end) pair. It is kept in a cache bounded by a memory budget, filled
+ while the sample plays for the first time and evicted in LRU order.
+ Playing a cached sample is a table read instead of a nibble decode.
+ */
+
+#define ADPCMA_CACHE_ENTRIES        1024
+#define ADPCMA_CACHE_BUCKETS        256
+#define ADPCMA_CACHE_NONE           0xffff
+#define ADPCMA_CACHE_DECODE_AHEAD   1024    /* nibbles decoded past the playing position */
+#define ADPCMA_END_MASK             ((1<<21)-1)
+
+typedef struct
+{
+	uint32_t  start;          /* key, start and end addresses */
+	uint32_t  end;
+	uint32_t  length;         /* nibbles played before the end address */
+	uint32_t  decoded;        /* nibbles already in pcm */
+	int32_t   acc;            /* decoder state after the decoded nibbles */
+	int32_t   step;
+	int16_t   *pcm;           /* accumulator after each nibble, NULL for a free entry */
+	uint16_t  next;           /* bucket chain */
+} ADPCMA_CACHE_ENTRY;
+
+static struct
+{
+	size_t              budget;     /* 0 when disabled */
+	size_t              bytes;
+	uint32_t            use_counter;
+	uint16_t            buckets[ADPCMA_CACHE_BUCKETS];
+	ADPCMA_CACHE_ENTRY  entries[ADPCMA_CACHE_ENTRIES];
+	uint32_t            last_use[ADPCMA_CACHE_ENTRIES];
+	ym2610_adpcma_cache_stats_t stats;
+} adpcma_cache;
+
+static INLINE uint32_t adpcma_cache_bucket(uint32_t start, uint32_t end)
+{
+	return ((start >> ADPCMA_ADDRESS_SHIFT) * 31 + (end >> ADPCMA_ADDRESS_SHIFT)) & (ADPCMA_CACHE_BUCKETS - 1);
+}
+
+static void adpcma_cache_remove(uint16_t index)
+{
+	ADPCMA_CACHE_ENTRY *entry = &adpcma_cache.entries[index];
+	uint16_t *link = &adpcma_cache.buckets[adpcma_cache_bucket(entry->start, entry->end)];
+	
+	while (*link != index)
+		link = &adpcma_cache.entries[*link].next;
+	*link = entry->next;
+	
+	adpcma_cache.bytes -= entry->length * sizeof(int16_t);
+	free(entry->pcm);
+	entry->pcm = NULL;
+}
+
+static INLINE void adpcma_cache_touch(uint16_t index)
+{
+	lru_stamps_touch(&adpcma_cache.use_counter, adpcma_cache.last_use, ADPCMA_CACHE_ENTRIES, index);
+}
+
+static uint16_t adpcma_cache_free_entry(void)
+{
+	int i;
+	
+	for (i = 0; i < ADPCMA_CACHE_ENTRIES; i++)
+	{
+		if (adpcma_cache.entries[i].pcm == NULL)
+			return i;
+	}
+	return ADPCMA_CACHE_NONE;
+}
+
+/* least recently used entry no channel is playing */
+static uint16_t adpcma_cache_lru_entry(void)
+{
+	uint16_t victim = ADPCMA_CACHE_NONE;
+	int i, c;
+	
+	for (i = 0; i < ADPCMA_CACHE_ENTRIES; i++)
+	{
+		ADPCMA_CACHE_ENTRY *entry = &adpcma_cache.entries[i];
+		int playing = 0;
+		
+		if (entry->pcm == NULL)
+			continue;
+		for (c = 0; c < 6; c++)
+			playing |= ym2610_device.adpcm[c].flag && ym2610_device.adpcm[c].cache_entry == i;
+		if (!playing && (victim == ADPCMA_CACHE_NONE || adpcma_cache.last_use[i] < adpcma_cache.last_use[victim]))
+			victim = i;
+	}
+	return victim;
+}
+
+/* entry of a sample starting to play, ADPCMA_CACHE_NONE when it can't be cached */
+static uint16_t adpcma_cache_lookup(uint32_t start, uint32_t end)
+{
+	uint32_t length = ((end<<1) - (start<<1)) & ADPCMA_END_MASK;
+	uint32_t bucket = adpcma_cache_bucket(start, end);
+	size_t size = length * sizeof(int16_t);
+	uint16_t index;
+	ADPCMA_CACHE_ENTRY *entry;
+	
+	if (adpcma_cache.budget == 0)
+		return ADPCMA_CACHE_NONE;
+	
+	for (index = adpcma_cache.buckets[bucket]; index != ADPCMA_CACHE_NONE; index = adpcma_cache.entries[index].next)
+	{
+		entry = &adpcma_cache.entries[index];
+		if (entry->start == start && entry->end == end)
+		{
+			adpcma_cache.stats.hits++;
+			adpcma_cache_touch(index);
+			return index;
+		}
+	}
+	
+	/* empty, larger than a quarter of the budget or reading past the ROM: decode as usual */
+	if (length == 0 || size > adpcma_cache.budget / 4 || ((start<<1) + length + 1) >> 1 > ym2610_device.pcm_rom.size)
+	{
+		adpcma_cache.stats.uncached++;
+		return ADPCMA_CACHE_NONE;
+	}
+	adpcma_cache.stats.misses++;
+	
+	while (adpcma_cache.bytes + size > adpcma_cache.budget || (index = adpcma_cache_free_entry()) == ADPCMA_CACHE_NONE)
+	{
+		uint16_t victim = adpcma_cache_lru_entry();
+		
+		if (victim == ADPCMA_CACHE_NONE)
+			return ADPCMA_CACHE_NONE;
+		adpcma_cache_remove(victim);
+		adpcma_cache.stats.evictions++;
+	}
+	
+	entry = &adpcma_cache.entries[index];
+	entry->pcm = (int16_t *)malloc(size);
+	if (entry->pcm == NULL)
+		return ADPCMA_CACHE_NONE;
+	entry->start    = start;
+	entry->end      = end;
+	entry->length   = length;
+	entry->decoded  = 0;
+	entry->acc      = 0;
+	entry->step     = 0;
+	adpcma_cache_touch(index);
+	entry->next     = adpcma_cache.buckets[bucket];
+	adpcma_cache.buckets[bucket] = index;
+	adpcma_cache.bytes += size;
+	return index;
+}
+
+/* decodes the sample at least up to nibble until, the same way ADPCMA_calc_chan does */
+static void adpcma_cache_decode(ADPCMA_CACHE_ENTRY *entry, uint32_t until)
+{
+	YM_PCM_ROM *rom = &ym2610_device.pcm_rom;
+	uint32_t addr = (entry->start<<1) + entry->decoded;
+	int32_t acc = entry->acc;
+	int32_t step = entry->step;
+	uint32_t n;
+	
+	until += ADPCMA_CACHE_DECODE_AHEAD;
+	if (until > entry->length)
+		until = entry->length;
+	
+	for (n = entry->decoded; n < until; n++, addr++)
+	{
+		uint8_t byte = ym_pcm_rom_read(rom, addr>>1);
+		uint8_t data = (addr&1) ? byte & 0x0f : (byte >> 4) & 0x0f;
+		
+		acc += jedi_table[step + data];
+		acc &= 0xfff;
+		if (acc & 0x800)
+			acc |= ~0xfff;
+		
+		step += step_inc[data & 7];
+		Limit( step, 48*16, 0*16 );
+		
+		entry->pcm[n] = (int16_t)acc;
+	}
+	entry->decoded = until;
+	entry->acc = acc;
+	entry->step = step;
+}
+
+/* back to ROM decoding, the cached path doesn't keep the step */
+static void adpcma_cache_detach(ADPCM_CH *ch)
+{
+	ADPCMA_CACHE_ENTRY *entry = &adpcma_cache.entries[ch->cache_entry];
+	uint32_t addr = entry->start<<1;
+	int32_t step = 0;
+	
+	for (; addr != ch->now_addr; addr++)
+	{
+		uint8_t byte = ym_pcm_rom_read(&ym2610_device.pcm_rom, addr>>1);
+		uint8_t data = (addr&1) ? byte & 0x0f : (byte >> 4) & 0x0f;
+		step += step_inc[data & 7];
+		Limit( step, 48*16, 0*16 );
+	}
+	ch->adpcm_step = step;
+	if (ch->now_addr&1)
+		ch->now_data = ym_pcm_rom_read(&ym2610_device.pcm_rom, ch->now_addr>>1);
+	ch->cache_entry = ADPCMA_CACHE_NONE;
+}
+
+static void adpcma_cache_flush(void)
+{
+	int i;
+	
+	for (i = 0; i < ADPCMA_CACHE_ENTRIES; i++)
+	{
+		free(adpcma_cache.entries[i].pcm);
+		adpcma_cache.entries[i].pcm = NULL;
+	}
+	for (i = 0; i < ADPCMA_CACHE_BUCKETS; i++)
+		adpcma_cache.buckets[i] = ADPCMA_CACHE_NONE;
+	for (i = 0; i < 6; i++)
+		ym2610_device.adpcm[i].cache_entry = ADPCMA_CACHE_NONE;
+	adpcma_cache.bytes = 0;
+	adpcma_cache.use_counter = 0;
+}
+
+
+/* ADPCM A : calculate one channel output from its decoded sample */
+static INLINE void ADPCMA_calc_chan_cached( ADPCM_CH *ch )
+{
+	ch->now_step += ch->step;
+	if ( ch->now_step >= (1<<ADPCM_SHIFT) )
+	{
+		ADPCMA_CACHE_ENTRY *entry = &adpcma_cache.entries[ch->cache_entry];
+		uint32_t step = ch->now_step >> ADPCM_SHIFT;
+		uint32_t played = ch->now_addr - (entry->start<<1) + step;
+		
+		ch->now_step &= (1<<ADPCM_SHIFT)-1;
+		
+		/* end check, the end address is never decoded */
+		if ( played > entry->length )
+		{
+			ch->now_addr = (entry->start<<1) + entry->length;
+			ch->adpcm_acc = entry->pcm[entry->length - 1];
+			ch->flag = 0;
+			ch->cache_entry = ADPCMA_CACHE_NONE;
+			ym2610_device.adpcm_arrivedEndAddress |= ch->flagMask;
+			return;
+		}
+		if ( played > entry->decoded )
+			adpcma_cache_decode(entry, played);
+		
+		ch->now_addr += step;
+		ch->adpcm_acc = entry->pcm[played - 1];
+		
+		/* calc pcm * volume data */
+		ch->adpcm_out = ((ch->adpcm_acc * ch->vol_mul) >> ch->vol_shift) & ~3;  /* multiply, shift and mask out 2 LSB bits */
+	}
+	
+	/* output for work of output channels (out_adpcm[OPNxxxx])*/
+	*(ch->pan) += ch->adpcm_out;
+}
 
 /* ADPCM A (Non control type) : calculate one channel output */
 static INLINE void ADPCMA_calc_chan( ADPCM_CH *ch )
@@ -1999,6 +2492,11 @@ static INLINE void ADPCMA_calc_chan( ADPCM_CH *ch )
 	uint32_t step;
 	uint8_t  data;
 	
+	if ( ch->cache_entry != ADPCMA_CACHE_NONE )
+	{
+		ADPCMA_calc_chan_cached(ch);
+		return;
+	}
 	
 	ch->now_step += ch->step;
 	if ( ch->now_step >= (1<<ADPCM_SHIFT) )
@@ -2028,7 +2526,7 @@ static INLINE void ADPCMA_calc_chan( ADPCM_CH *ch )
 				data = ch->now_data & 0x0f;
 			else
 			{
-				ch->now_data = ym2610_device.read_byte[ch->now_addr>>1];
+				ch->now_data = ym_pcm_rom_read(&ym2610_device.pcm_rom, ch->now_addr>>1);
 				data = (ch->now_data >> 4) & 0x0f;
 			}
 			
@@ -2080,6 +2578,7 @@ void FM_ADPCMAWrite(int r,int v)
 						ym2610_device.adpcm[c].adpcm_step= 0;
 						ym2610_device.adpcm[c].adpcm_out = 0;
 						ym2610_device.adpcm[c].flag      = 1;
+						ym2610_device.adpcm[c].cache_entry = adpcma_cache_lookup(ym2610_device.adpcm[c].start, ym2610_device.adpcm[c].end);
 					}
 				}
 			}
@@ -2088,7 +2587,10 @@ void FM_ADPCMAWrite(int r,int v)
 				/* KEY OFF */
 				for( c = 0; c < 6; c++ )
 					if( (v>>c)&1 )
+					{
 						ym2610_device.adpcm[c].flag = 0;
+						ym2610_device.adpcm[c].cache_entry = ADPCMA_CACHE_NONE;
+					}
 			}
 			break;
 		case 0x01:  /* B0-5 = TL */
@@ -2150,6 +2652,9 @@ void FM_ADPCMAWrite(int r,int v)
 			case 0x28:
 				ym2610_device.adpcm[c].end    = ( (ym2610_device.adpcmreg[0x28 + c]*0x0100 | ym2610_device.adpcmreg[0x20 + c]) << ADPCMA_ADDRESS_SHIFT);
 				ym2610_device.adpcm[c].end   += (1<<ADPCMA_ADDRESS_SHIFT) - 1;
+				/* a playing sample now stops at another address */
+				if( ym2610_device.adpcm[c].cache_entry != ADPCMA_CACHE_NONE )
+					adpcma_cache_detach(&ym2610_device.adpcm[c]);
 				break;
 		}
 	}
@@ -2198,12 +2703,44 @@ void ssg_needs_update() {
 	ym2610_update_request();
 }
 
+#pragma mark - Activity
+
+static ym2610_activity_t ym2610_activity;
+
+static INLINE uint8_t count_bits(int mask)
+{
+	uint8_t count = 0;
+	
+	for( ; mask; mask &= mask - 1 )
+		count++;
+	return count;
+}
+
+/* keeps the peak voice counts since the last ym2610_take_activity */
+static void ym2610_activity_add(int fm, int adpcma_mask, int adpcmb, int ssg, int samples)
+{
+	uint8_t adpcma = count_bits(adpcma_mask);
+	
+	if( fm > ym2610_activity.fm ) ym2610_activity.fm = fm;
+	if( adpcma > ym2610_activity.adpcm_a ) ym2610_activity.adpcm_a = adpcma;
+	if( adpcmb > ym2610_activity.adpcm_b ) ym2610_activity.adpcm_b = adpcmb;
+	if( ssg > ym2610_activity.ssg ) ym2610_activity.ssg = ssg;
+	ym2610_activity.samples += samples;
+}
+
+void ym2610_take_activity(ym2610_activity_t *activity)
+{
+	*activity = ym2610_activity;
+	memset(&ym2610_activity, 0, sizeof(ym2610_activity_t));
+}
+
 #pragma mark - YM2610 API
 
-void ym2610_init(int clock, int rate, void *pcmroma, size_t pcmsizea, void *pcmromb,
-		size_t pcmsizeb, FM_TIMERHANDLER timer_handler, FM_IRQHANDLER IRQHandler)
+void ym2610_init(int clock, int rate, FM_TIMERHANDLER timer_handler, FM_IRQHANDLER IRQHandler)
 {
 	ym2610_state *F2610 = &ym2610_device;
+	/* the SSG volume table would leak when initializing again */
+	ssg_release(&F2610->OPN.ST.ssg);
 	memset(F2610, 0, sizeof(ym2610_state));
 	
 	init_tables();
@@ -2216,13 +2753,8 @@ void ym2610_init(int clock, int rate, void *pcmroma, size_t pcmsizea, void *pcmr
 	/* Extend handler */
 	F2610->OPN.ST.timer_handler = timer_handler;
 	F2610->OPN.ST.IRQ_Handler   = IRQHandler;
-	ssg_init(&F2610->OPN.ST.ssg);
-	/* ADPCM */
-	F2610->read_byte = (uint8_t *) pcmroma;
-	F2610->read_byte_size = (uint32_t)pcmsizea;
+	ssg_init(&F2610->OPN.ST.ssg, rate);
 	/* DELTA-T */
-	F2610->deltaT.read_byte = (uint8_t *) pcmromb;
-	F2610->deltaT.read_byte_size = (uint32_t)pcmsizeb;
 	F2610->deltaT.write_byte = NULL;
 	
 	F2610->deltaT.status_set_handler = &adpcmb_status_change_handler;
@@ -2231,10 +2763,49 @@ void ym2610_init(int clock, int rate, void *pcmroma, size_t pcmsizea, void *pcmr
 	F2610->deltaT.status_change_EOS_bit = 0x80; /* status flag: set bit7 on End Of Sample */
 	
 	Init_ADPCMATable();
+	/* decoded samples belong to the previous PCM ROMs */
+	adpcma_cache_flush();
 
 	ym2610_reset();
 }
 
+static void ym2610_set_pcm_rom(YM_PCM_ROM *rom, const YM_PCM_ROM *pcm_rom)
+{
+	if( rom == &ym2610_device.pcm_rom
+	   && (rom->size != pcm_rom->size || rom->read_block != pcm_rom->read_block || rom->param != pcm_rom->param
+		   || (rom->read_block == NULL && rom->window != pcm_rom->window)) )
+	{
+		/* decoded samples belong to the previous PCM ROMs */
+		adpcma_cache_flush();
+	}
+	*rom = *pcm_rom;
+}
+
+/* PCM ROMs can change with the cartridge, the chip must be reset after */
+void ym2610_set_pcm_roms(void *pcmroma, size_t pcmsizea, void *pcmromb, size_t pcmsizeb)
+{
+	YM_PCM_ROM rom;
+	
+	/* ADPCM */
+	ym_pcm_rom_set_flat(&rom, (const uint8_t *) pcmroma, (uint32_t)pcmsizea);
+	ym2610_set_pcm_rom(&ym2610_device.pcm_rom, &rom);
+	/* DELTA-T */
+	ym_pcm_rom_set_flat(&rom, (const uint8_t *) pcmromb, (uint32_t)pcmsizeb);
+	ym2610_set_pcm_rom(&ym2610_device.deltaT.pcm_rom, &rom);
+}
+
+void ym2610_set_pcm_rom_blocks(size_t pcmsizea, void *parama, size_t pcmsizeb, void *paramb, uint32_t block_shift, FM_READBLOCK read_block)
+{
+	YM_PCM_ROM rom;
+	
+	/* ADPCM */
+	ym_pcm_rom_set_blocks(&rom, (uint32_t)pcmsizea, block_shift, read_block, parama);
+	ym2610_set_pcm_rom(&ym2610_device.pcm_rom, &rom);
+	/* DELTA-T */
+	ym_pcm_rom_set_blocks(&rom, (uint32_t)pcmsizeb, block_shift, read_block, paramb);
+	ym2610_set_pcm_rom(&ym2610_device.deltaT.pcm_rom, &rom);
+}
+
 /* reset one of chip */
 void ym2610_reset(void) {
 	int i;
@@ -2242,10 +2813,29 @@ void ym2610_reset(void) {
 	FM_OPN *OPN   = &F2610->OPN;
 	YM_DELTAT *DELTAT = &F2610->deltaT;
 	
+	/* runtime state as left by ym2610_init, its tables and the PCM ROMs are kept */
+	memset(F2610->REGS, 0, sizeof(F2610->REGS));
+	memset(F2610->CH, 0, sizeof(F2610->CH));
+	memset(F2610->adpcm, 0, sizeof(F2610->adpcm));
+	memset(F2610->adpcmreg, 0, sizeof(F2610->adpcmreg));
+	F2610->addr_A1 = 0;
+	OPN->ST.address = 0;
+	OPN->ST.fn_h = 0;
+	memset(&OPN->SL3, 0, sizeof(FM_3SLOT));
+	OPN->lfo_cnt = 0;
+	OPN->lfo_inc = 0;
+	OPN->LFO_AM = 0;
+	OPN->LFO_PM = 0;
+	OPN->m2 = OPN->c1 = OPN->c2 = OPN->mem = 0;
+	memset(OPN->out_fm, 0, sizeof(OPN->out_fm));
+	memset(OPN->out_adpcm, 0, sizeof(OPN->out_adpcm));
+	memset(OPN->out_delta, 0, sizeof(OPN->out_delta));
+	
 	/* Reset Prescaler */
 	OPNSetPres( OPN, 6*24, 6*24, 4*2); /* OPN 1/6 , SSG 1/4 */
 	/* reset SSG section */
 	ssg_reset(&OPN->ST.ssg);
+	memset(&ym2610_activity, 0, sizeof(ym2610_activity_t));
 	/* status clear */
 	FM_IRQMASK_SET(&OPN->ST,0x03);
 	FM_BUSY_CLEAR(&OPN->ST);
@@ -2269,6 +2859,8 @@ void ym2610_reset(void) {
 		OPNWriteReg(OPN,i|0x100,0);
 	}
 	for(i = 0x26 ; i >= 0x20 ; i-- ) OPNWriteReg(OPN,i,0);
+	/* timer A and B periods go through OPNWriteMode, OPNWriteReg has no 0x2x case */
+	for(i = 0x26 ; i >= 0x24 ; i-- ) OPNWriteMode(OPN,i,0);
 	/**** ADPCM work initial ****/
 	for( i = 0; i < 6 ; i++ )
 	{
@@ -2285,6 +2877,7 @@ void ym2610_reset(void) {
 		F2610->adpcm[i].adpcm_acc = 0;
 		F2610->adpcm[i].adpcm_step= 0;
 		F2610->adpcm[i].adpcm_out = 0;
+		F2610->adpcm[i].cache_entry = ADPCMA_CACHE_NONE;
 	}
 	F2610->adpcmTL = 0x3f;
 	
@@ -2408,7 +3001,7 @@ int ym2610_write(int a, uint8_t v)
 uint8_t ym2610_read(int a)
 {
 	ym2610_state *F2610 = &ym2610_device;
-	int addr = F2610->OPN.ST.address;
+	int addr;
 	uint8_t ret = 0;
 	
 	switch( a&3)
@@ -2417,6 +3010,8 @@ uint8_t ym2610_read(int a)
 			ret = FM_STATUS_FLAG(&F2610->OPN.ST) & 0x83;
 			break;
 		case 1: /* data 0 */
+			/* the address is only read here, the synthesis may be writing it from the sound thread otherwise */
+			addr = F2610->OPN.ST.address;
 			if( addr < 16 ) ret = ssg_read(&F2610->OPN.ST.ssg);
 			if( addr == 0xff ) ret = 0x01;
 			break;
@@ -2444,27 +3039,70 @@ int ym2610_timerOver(int c)
 	}
 	else
 	{   /* Timer A */
-		ym2610_update_request();
 		/* timer update */
 		TimerAOver( &(F2610->OPN.ST) );
 		/* CSM mode key,TL controll */
 		if( F2610->OPN.ST.mode & 0x80 )
 		{   /* CSM mode total level latch and auto key on */
+			/* only CSM changes the synthesis state */
+			ym2610_update_request();
 			CSMKeyControll( F2610->OPN.type, &(F2610->CH[2]) );
 		}
 	}
 	return F2610->OPN.ST.irq;
 }
 
+void ym2610_set_adpcma_cache_budget(size_t bytes)
+{
+	if (bytes < adpcma_cache.budget || bytes == 0)
+		adpcma_cache_flush();
+	adpcma_cache.budget = bytes;
+}
+
+void ym2610_release_adpcma_cache(void)
+{
+	adpcma_cache_flush();
+	memset(&adpcma_cache.stats, 0, sizeof(ym2610_adpcma_cache_stats_t));
+}
+
+ym2610_adpcma_cache_stats_t ym2610_get_adpcma_cache_stats(void)
+{
+	ym2610_adpcma_cache_stats_t stats = adpcma_cache.stats;
+	
+	stats.bytes = adpcma_cache.bytes;
+	return stats;
+}
+
+/* true when ADPCM A or B channels are reading PCM ROMs */
+int ym2610_adpcm_active(void)
+{
+	ym2610_state *F2610 = &ym2610_device;
+	int j;
+	
+	if( F2610->deltaT.portstate&0x80 )
+		return 1;
+	for( j = 0; j < 6; j++ )
+	{
+		if( F2610->adpcm[j].flag )
+			return 1;
+	}
+	return 0;
+}
+
 /* Generate samples for one of the YM2610s */
-void ym2610_update(int length)
+void ym2610_update(FMSAMPLE *buffer, int length)
 {
 	ym2610_state *F2610 = &ym2610_device;
 	FM_OPN *OPN   = &F2610->OPN;
 	YM_DELTAT *DELTAT = &F2610->deltaT;
 	int i,j;
 	FM_CH   *cch[4];
-	int32_t *out_fm = OPN->out_fm;
+	FM_BLOCK block;
+	/* SSG registers can't change during the update, writes force an update first */
+	int ssg_active = ssg_active_channels(&OPN->ST.ssg);
+	int ssg_silent = ssg_is_silent(&OPN->ST.ssg);
+	int32_t ssg_silent_out = ssg_silent_output(&OPN->ST.ssg);
+	int32_t ssg_out[FM_BLOCK_SAMPLES];
 	
 	cch[0] = &F2610->CH[1];
 	cch[1] = &F2610->CH[2];
@@ -2500,72 +3138,88 @@ void ym2610_update(int length)
 	refresh_fc_eg_chan( OPN, cch[3] );
 	
 	/* buffering */
-	for(i=0; i < length ; i++)
+	for(i=0; i < length ; i += block.length)
 	{
-		advance_lfo(OPN);
-		
-		/* clear output acc. */
-		OPN->out_adpcm[OUTD_LEFT] = OPN->out_adpcm[OUTD_RIGHT] = OPN->out_adpcm[OUTD_CENTER] = 0;
-		OPN->out_delta[OUTD_LEFT] = OPN->out_delta[OUTD_RIGHT] = OPN->out_delta[OUTD_CENTER] = 0;
-		/* clear outputs */
-		out_fm[1] = 0;
-		out_fm[2] = 0;
-		out_fm[4] = 0;
-		out_fm[5] = 0;
+		int n;
+		int fm_active = 0;
+		int adpcma_active = 0;
+		int adpcmb_active = (DELTAT->portstate&0x80) != 0;
 		
-		/* advance envelope generator */
-		OPN->eg_timer += OPN->eg_timer_add;
-		while (OPN->eg_timer >= OPN->eg_timer_overflow)
-		{
-			OPN->eg_timer -= OPN->eg_timer_overflow;
-			OPN->eg_cnt++;
-			
-			advance_eg_channel(OPN, &cch[0]->SLOT[SLOT1]);
-			advance_eg_channel(OPN, &cch[1]->SLOT[SLOT1]);
-			advance_eg_channel(OPN, &cch[2]->SLOT[SLOT1]);
-			advance_eg_channel(OPN, &cch[3]->SLOT[SLOT1]);
-		}
+		block.length = fm_block_length(OPN, length - i);
+		fm_block_timing(OPN, &block);
 		
 		/* calculate FM */
-		chan_calc(OPN, cch[0], 1 ); /*remapped to 1*/
-		chan_calc(OPN, cch[1], 2 ); /*remapped to 2*/
-		chan_calc(OPN, cch[2], 4 ); /*remapped to 4*/
-		chan_calc(OPN, cch[3], 5 ); /*remapped to 5*/
+		memset(block.out_lt, 0, block.length * sizeof(int32_t));
+		memset(block.out_rt, 0, block.length * sizeof(int32_t));
+		fm_active += fm_block_channel(OPN, &block, cch[0], 1 ); /*remapped to 1*/
+		fm_active += fm_block_channel(OPN, &block, cch[1], 2 ); /*remapped to 2*/
+		fm_active += fm_block_channel(OPN, &block, cch[2], 4 ); /*remapped to 4*/
+		fm_active += fm_block_channel(OPN, &block, cch[3], 5 ); /*remapped to 5*/
 		
-		/* deltaT ADPCM */
-		if( DELTAT->portstate&0x80 )
-			ADPCMB_CALC(DELTAT);
-		
-		/* ADPCMA */
+		/* ADPCM-A channels only start on a register write, so none can start within the block */
 		for( j = 0; j < 6; j++ )
 		{
 			if( F2610->adpcm[j].flag )
-				ADPCMA_calc_chan(&F2610->adpcm[j]);
+				adpcma_active |= 1 << j;
+		}
+		
+		ym2610_activity_add(fm_active, adpcma_active, adpcmb_active, ssg_active, block.length);
+		
+		if( !fm_active && !adpcma_active && !adpcmb_active && ssg_silent )
+		{
+			/* whole chip is silent, the output is the constant level of the SSG */
+			int lt = ssg_silent_out >> FINAL_SH;
+			
+			Limit( lt, MAXOUT, MINOUT );
+			ssg_skip_samples(&OPN->ST.ssg, block.length);
+			for(n=0; n < block.length; n++)
+			{
+				*buffer++ = lt;
+				*buffer++ = lt;
+				
+				/* timer A control */
+				INTERNAL_TIMER_A( &OPN->ST , cch[1] )
+			}
+			ym2610_activity.silent_samples += block.length;
+			continue;
 		}
 		
-		/* buffering */
+		/* SSG at its native rate, resampled for the whole block */
+		ssg_render(&OPN->ST.ssg, ssg_out, block.length);
+		
+		for(n=0; n < block.length; n++)
 		{
 			int lt,rt;
 			
+			/* clear output acc. */
+			OPN->out_adpcm[OUTD_LEFT] = OPN->out_adpcm[OUTD_RIGHT] = OPN->out_adpcm[OUTD_CENTER] = 0;
+			OPN->out_delta[OUTD_LEFT] = OPN->out_delta[OUTD_RIGHT] = OPN->out_delta[OUTD_CENTER] = 0;
+			
+			/* deltaT ADPCM */
+			if( DELTAT->portstate&0x80 )
+				ADPCMB_CALC(DELTAT);
+			
+			/* ADPCMA, a channel stops by itself at its end address */
+			if( adpcma_active )
+			{
+				for( j = 0; j < 6; j++ )
+				{
+					if( F2610->adpcm[j].flag )
+						ADPCMA_calc_chan(&F2610->adpcm[j]);
+				}
+			}
+			
+			/* buffering */
 			lt =  OPN->out_adpcm[OUTD_LEFT]  + OPN->out_adpcm[OUTD_CENTER];
 			rt =  OPN->out_adpcm[OUTD_RIGHT] + OPN->out_adpcm[OUTD_CENTER];
 			lt += (OPN->out_delta[OUTD_LEFT]  + OPN->out_delta[OUTD_CENTER])>>9;
 			rt += (OPN->out_delta[OUTD_RIGHT] + OPN->out_delta[OUTD_CENTER])>>9;
 			
+			lt += block.out_lt[n];
+			rt += block.out_rt[n];
 			
-			lt += ((out_fm[1]>>1) & OPN->pan[2]);   /* the shift right was verified on real chip */
-			rt += ((out_fm[1]>>1) & OPN->pan[3]);
-			lt += ((out_fm[2]>>1) & OPN->pan[4]);
-			rt += ((out_fm[2]>>1) & OPN->pan[5]);
-			
-			lt += ((out_fm[4]>>1) & OPN->pan[8]);
-			rt += ((out_fm[4]>>1) & OPN->pan[9]);
-			lt += ((out_fm[5]>>1) & OPN->pan[10]);
-			rt += ((out_fm[5]>>1) & OPN->pan[11]);
-			
-			int32_t out_ssg = ssg_update_one_sample(&OPN->ST.ssg);
-			lt += out_ssg;
-			rt += out_ssg;
+			lt += ssg_out[n];
+			rt += ssg_out[n];
 			
 			lt >>= FINAL_SH;
 			rt >>= FINAL_SH;
@@ -2577,12 +3231,13 @@ void ym2610_update(int length)
 			SAVE_ALL_CHANNELS
 #endif
 			
-			/* buffering */
-			ym2610_update_audio_buffer(lt, rt);
+			/* interleaved stereo output */
+			*buffer++ = lt;
+			*buffer++ = rt;
+			
+			/* timer A control */
+			INTERNAL_TIMER_A( &OPN->ST , cch[1] )
 		}
-		
-		/* timer A control */
-		INTERNAL_TIMER_A( &OPN->ST , cch[1] )
 	}
 	INTERNAL_TIMER_B(&OPN->ST,length)
 	
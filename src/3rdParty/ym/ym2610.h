@@ -9,19 +9,55 @@
 #define _YM2610_H_
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include "ym_pcm_rom.h"
 
 typedef void(*FM_TIMERHANDLER) (int channel, int count, double stepTime);
 typedef void(*FM_IRQHANDLER) (int irq);
 
-void ym2610_init(int baseclock, int rate, void *pcmroma, size_t pcmsizea, void *pcmromb, size_t pcmsizeb, FM_TIMERHANDLER TimerHandler, FM_IRQHANDLER IRQHandler);
+/* builds the tables once, then a reset only reinitializes the registers */
+void ym2610_init(int baseclock, int rate, FM_TIMERHANDLER TimerHandler, FM_IRQHANDLER IRQHandler);
+void ym2610_set_pcm_roms(void *pcmroma, size_t pcmsizea, void *pcmromb, size_t pcmsizeb);
+/* PCM ROMs kept in blocks of 1<<block_shift bytes, read_block is called with parama or paramb */
+void ym2610_set_pcm_rom_blocks(size_t pcmsizea, void *parama, size_t pcmsizeb, void *paramb, uint32_t block_shift, FM_READBLOCK read_block);
 void ym2610_reset(void);
-void ym2610_update(int length);
 int ym2610_write(int addr, uint8_t value);
 uint8_t ym2610_read(int addr);
 int ym2610_timerOver(int channel);
+int ym2610_adpcm_active(void);
 
 typedef int16_t FMSAMPLE;
 
+/* renders length interleaved stereo samples */
+void ym2610_update(FMSAMPLE *buffer, int length);
+
+/* peak number of voices producing sound, silent channels are skipped while rendering */
+typedef struct {
+	uint8_t fm;             /* out of 4 */
+	uint8_t adpcm_a;        /* out of 6 */
+	uint8_t adpcm_b;        /* out of 1 */
+	uint8_t ssg;            /* out of 3 */
+	uint32_t samples;
+	uint32_t silent_samples;    /* samples rendered with the whole chip silent */
+} ym2610_activity_t;
+
+/* activity since the previous call */
+void ym2610_take_activity(ym2610_activity_t *activity);
+
+typedef struct {
+	uint64_t hits;          /* key ons of a sample already decoded */
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t uncached;      /* samples too big for the budget or reading past the ROM */
+	size_t bytes;           /* decoded samples in memory */
+} ym2610_adpcma_cache_stats_t;
+
+/* decoded ADPCM-A samples are kept within bytes, 0 disables the cache */
+void ym2610_set_adpcma_cache_budget(size_t bytes);
+void ym2610_release_adpcma_cache(void);
+ym2610_adpcma_cache_stats_t ym2610_get_adpcma_cache_stats(void);
+
 /* You need to implement those methods */
 /*
  for busy flag emulation , function YM2610_FM_GET_TIME_NOW() should be
@@ -30,6 +66,5 @@ typedef int16_t FMSAMPLE;
  */
 extern double ym2610_fm_get_time_now(void);
 extern void ym2610_update_request(void);
-extern void ym2610_update_audio_buffer(FMSAMPLE lt, FMSAMPLE rt);
 
 #endif /* _YM2610_H_ */
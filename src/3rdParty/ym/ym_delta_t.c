@@ -66,6 +66,8 @@
 
 #include "ym_delta_t.h"
 
+#include <string.h>
+
 #define YM_DELTAT_SHIFT    (16)
 
 #define YM_DELTAT_DELTA_MAX (24576)
@@ -117,7 +119,7 @@ uint8_t ADPCMB_read(YM_DELTAT *adpcmb)
 		
 		if (adpcmb->now_addr != (adpcmb->end << 1))
 		{
-			v = adpcmb->read_byte[adpcmb->now_addr>>1];
+			v = ym_pcm_rom_read(&adpcmb->pcm_rom, adpcmb->now_addr>>1);
 			
 			/*logerror("YM Delta-T memory read  $%08x, v=$%02x\n", now_addr >> 1, v);*/
 			
@@ -399,6 +401,11 @@ void ADPCMB_reset(int panidx, YM_DELTAT *adpcmb)
 	adpcmb->prev_acc  = 0;
 	adpcmb->adpcmd    = 127;
 	adpcmb->adpcml    = 0;
+	adpcmb->delta     = 0;
+	adpcmb->now_data  = 0;
+	adpcmb->CPU_data  = 0;
+	adpcmb->memread   = 0;
+	memset(adpcmb->reg, 0, sizeof(adpcmb->reg));
 //	emulation_mode = uint8_t(mode);
 	adpcmb->portstate = 0x20;
 	adpcmb->control2  = 0x01; /* default setting depends on the emulation mode. MSX demo called "facdemo_4" doesn't setup control2 register at all and still works */
@@ -422,7 +429,7 @@ void ADPCMB_postload(YM_DELTAT *adpcmb, uint8_t *regs)
 	adpcmb->reg[0] = regs[0];
 	
 	/* current rom data */
-	adpcmb->now_data = adpcmb->read_byte[adpcmb->now_addr >> 1];
+	adpcmb->now_data = ym_pcm_rom_read(&adpcmb->pcm_rom, adpcmb->now_addr >> 1);
 	
 }
 
@@ -466,7 +473,7 @@ static inline void YM_DELTAT_synthesis_from_external_memory(YM_DELTAT *DELTAT)
 			if( DELTAT->now_addr&1 ) data = DELTAT->now_data & 0x0f;
 			else
 			{
-				DELTAT->now_data = DELTAT->read_byte[DELTAT->now_addr>>1];
+				DELTAT->now_data = ym_pcm_rom_read(&DELTAT->pcm_rom, DELTAT->now_addr>>1);
 				data = DELTAT->now_data >> 4;
 			}
 			
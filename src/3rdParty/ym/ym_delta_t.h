@@ -10,14 +10,15 @@
 
 #include <stdint.h>
 
+#include "ym_pcm_rom.h"
+
 typedef uint8_t (*FM_READBYTE)(void *device, uint32_t offset);
 typedef void (*FM_WRITEBYTE)(void *device, uint32_t offset, uint8_t data);
 typedef void (*STATUS_CHANGE_HANDLER)(void *chip, uint8_t status_bits);
 
 /* DELTA-T (adpcm type B) struct */
 typedef struct {
-	uint8_t *read_byte;
-	uint32_t read_byte_size;
+	YM_PCM_ROM pcm_rom;      /* ADPCM-B samples */
 	FM_WRITEBYTE write_byte;
 	int32_t   *output_pointer;/* pointer of output pointers   */
 	int32_t   *pan;           /* pan : &output_pointer[pan]   */
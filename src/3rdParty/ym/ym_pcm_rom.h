@@ -0,0 +1,64 @@
+//
+//  ym_pcm_rom.h
+//  neogeo_libretro
+//
+//  ADPCM ROM access for the YM2610 ADPCM-A and Delta-T units
+//
+
+#ifndef ym_pcm_rom_h
+#define ym_pcm_rom_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ A PCM ROM is read through a window over one of its blocks.
+ A flat ROM is a single block covering the whole address space, so the window never moves.
+ A ROM kept in blocks asks read_block for the block holding an offset when the window
+ doesn't cover it; the returned bytes must stay valid until the next read_block call.
+ */
+
+typedef const uint8_t *(*FM_READBLOCK)(void *param, uint32_t block);
+
+typedef struct {
+	const uint8_t *window;      /* bytes of the current block */
+	uint32_t      block;        /* current block index        */
+	uint32_t      block_shift;  /* log2 of the block size     */
+	uint32_t      size;         /* ROM size in bytes          */
+	FM_READBLOCK  read_block;   /* NULL for a flat ROM        */
+	void          *param;
+} YM_PCM_ROM;
+
+static inline void ym_pcm_rom_set_flat(YM_PCM_ROM *rom, const uint8_t *data, uint32_t size)
+{
+	rom->window      = data;
+	rom->block       = 0;
+	rom->block_shift = 31;
+	rom->size        = size;
+	rom->read_block  = NULL;
+	rom->param       = NULL;
+}
+
+static inline void ym_pcm_rom_set_blocks(YM_PCM_ROM *rom, uint32_t size, uint32_t block_shift, FM_READBLOCK read_block, void *param)
+{
+	rom->window      = NULL;
+	rom->block       = 0xffffffff;  /* no block fetched yet */
+	rom->block_shift = block_shift;
+	rom->size        = size;
+	rom->read_block  = read_block;
+	rom->param       = param;
+}
+
+static inline uint8_t ym_pcm_rom_read(YM_PCM_ROM *rom, uint32_t offset)
+{
+	uint32_t block = offset >> rom->block_shift;
+
+	if (block != rom->block)
+	{
+		rom->window = rom->read_block(rom->param, block);
+		rom->block  = block;
+	}
+	return rom->window[offset & ((1u << rom->block_shift) - 1)];
+}
+
+#endif /* ym_pcm_rom_h */
@@ -588,9 +588,17 @@
 #include <stdlib.h>
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SSG_RESAMPLER_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SSG_RESAMPLER_NEON 1
+#endif
+
 #pragma mark - defines
 
-#define logerror printf
+#define logerror(...) fprintf(stderr, __VA_ARGS__)
 
 /*************************************
  *
@@ -850,6 +858,40 @@ static INLINE void build_single_table(double rl, const ay_ym_param *par, int nor
 	
 }
 
+/* channels at fixed volume 0 never reach the mixer, whatever their tone and noise do */
+static INLINE int active_channels_mask(SSG *device)
+{
+	int mask = 0, chan;
+	
+	for (chan = 0; chan < NUM_CHANNELS; chan++)
+	{
+		if (TONE_ENVELOPE(chan) != 0 || TONE_VOLUME(chan) != 0)
+			mask |= 1 << chan;
+	}
+	return mask;
+}
+
+/* ticks until the next tone, noise or envelope counter event, at least 1 */
+static INLINE int ticks_to_next_event(SSG *device)
+{
+	int ticks = NOISE_PERIOD() - device->m_count_noise;
+	int chan;
+
+	for (chan = 0; chan < NUM_CHANNELS; chan++)
+	{
+		int tone_ticks = TONE_PERIOD(chan) - device->m_count[chan];
+		if (tone_ticks < ticks)
+			ticks = tone_ticks;
+	}
+	if (device->m_holding == 0)
+	{
+		int env_ticks = ENVELOPE_PERIOD() * device->m_step - device->m_count_env;
+		if (env_ticks < ticks)
+			ticks = env_ticks;
+	}
+	return ticks < 1 ? 1 : ticks;
+}
+
 int32_t mix_3D(SSG *device)
 {
 	int indx = 0, chan;
@@ -896,8 +938,6 @@ void ay8910_write_reg(SSG *device, int r, int v)
 			/* No action required */
 			break;
 		case AY_ECOARSE:
-			if ( (v & 0x0f) > 0)
-				printf("ECoarse\n");
 			/* No action required */
 			break;
 		case AY_ENABLE:
@@ -919,8 +959,6 @@ void ay8910_write_reg(SSG *device, int r, int v)
 			device->m_last_enable = device->m_regs[AY_ENABLE];
 			break;
 		case AY_ESHAPE:
-			if ( (v & 0x0f) > 0)
-				printf("EShape\n");
 			device->m_attack = (device->m_regs[AY_ESHAPE] & 0x04) ? device->m_env_step_mask : 0x00;
 			if ((device->m_regs[AY_ESHAPE] & 0x08) == 0)
 			{
@@ -978,6 +1016,12 @@ void sound_stream_update(SSG *device, int32_t **outputs, int samples)
 {
 	int32_t *buf[NUM_CHANNELS];
 	int chan;
+	int active = active_channels_mask(device);
+
+	if (active)
+		device->m_quiet_ticks = 0;
+	else if (device->m_quiet_ticks < SSG_RESAMPLER_MAX_TAPS)
+		device->m_quiet_ticks += samples;
 
 	buf[0] = outputs[0];
 	buf[1] = NULL;
@@ -1038,7 +1082,8 @@ void sound_stream_update(SSG *device, int32_t **outputs, int samples)
 
 		for (chan = 0; chan < NUM_CHANNELS; chan++)
 		{
-			device->m_vol_enabled[chan] = (device->m_output[chan] | TONE_ENABLEQ(chan)) & (NOISE_OUTPUT() | NOISE_ENABLEQ(chan));
+			if (active & (1 << chan))
+				device->m_vol_enabled[chan] = (device->m_output[chan] | TONE_ENABLEQ(chan)) & (NOISE_OUTPUT() | NOISE_ENABLEQ(chan));
 		}
 
 		/* update envelope */
@@ -1095,10 +1140,35 @@ void sound_stream_update(SSG *device, int32_t **outputs, int samples)
 //				}
 //		}
 //		else
+		if (buf[0] != NULL)
 		{
-			*(buf[0]++) = mix_3D(device);
+			*(buf[0]++) = active ? mix_3D(device) : device->m_vol3d_table[0];
 		}
 		samples--;
+
+		/* nothing changes until a counter reaches its period, the output just repeats up to there */
+		{
+			int run = ticks_to_next_event(device) - 1;
+			int i;
+
+			if (run > samples)
+				run = samples;
+			if (run > 0)
+			{
+				for (chan = 0; chan < NUM_CHANNELS; chan++)
+					device->m_count[chan] += run;
+				device->m_count_noise += run;
+				if (device->m_holding == 0)
+					device->m_count_env += run;
+				if (buf[0] != NULL)
+				{
+					int32_t out = buf[0][-1];
+					for (i = 0; i < run; i++)
+						*(buf[0]++) = out;
+				}
+				samples -= run;
+			}
+		}
 	}
 }
 
@@ -1167,6 +1237,8 @@ void ay8910_reset_ym(SSG *device)
 	device->m_count_env = 0;
 	device->m_prescale_noise = 0;
 	device->m_last_enable = -1;  /* force a write */
+	for (i = 0; i < NUM_CHANNELS; i++)
+		device->m_vol_enabled[i] = 0;
 	for (i = 0; i < AY_PORTA; i++)
 		ay8910_write_reg(device,i,0);
 	device->m_ready = 1;
@@ -1253,10 +1325,188 @@ uint8_t ay8910_read_ym(SSG *device)
 	return device->m_regs[r];
 }
 
+#pragma mark - Resampler
+
+#define SSG_RESAMPLER_KAISER_BETA 7.0   /* about 70 dB of stop band attenuation */
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	int k;
+	
+	for (k = 1; k < 32; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static void resampler_reset(SSG *device)
+{
+	int i;
+	
+	/* start with a silent history, the output is delayed by half the filter length */
+	device->m_resampler_filled = device->m_resampler_taps > 0 ? device->m_resampler_taps - 1 : 0;
+	for (i = 0; i < device->m_resampler_filled; i++)
+		device->m_resampler_buffer[i] = device->m_vol3d_table[0];
+	device->m_resampler_pos = 0;
+	device->m_quiet_ticks = device->m_resampler_taps;
+}
+
+/*
+ Windowed sinc low pass at the output Nyquist frequency, with a tap count that
+ scales with the decimation ratio: at 44.1 kHz the transition band goes from
+ 16 kHz to 28 kHz so aliases only fold back above 16 kHz.
+ */
+static void resampler_setup(SSG *device)
+{
+	double ratio, cutoff, half;
+	int taps, phase, i;
+	
+	if (device->m_clock <= 0 || device->m_output_rate <= 0)
+		return;
+	
+	/* The envelope is pacing twice as fast for the YM2149 as for the AY-3-8910, */
+	/* this is handled by the step parameter so the native rate is clock / 8. */
+	ratio = (device->m_clock / 8.0) / device->m_output_rate;
+	device->m_resampler_step = (uint64_t)(ratio * 4294967296.0 + 0.5);
+	
+	cutoff = ratio > 1.0 ? 0.5 / ratio : 0.5;
+	taps = (int)ceil(16.0 * (ratio > 1.0 ? ratio : 1.0));
+	taps = (taps + 3) & ~3;
+	if (taps > SSG_RESAMPLER_MAX_TAPS)
+	{
+		logerror("SSG: output rate %i is too low for the resampler\n", device->m_output_rate);
+		taps = SSG_RESAMPLER_MAX_TAPS;
+	}
+	device->m_resampler_taps = taps;
+	half = taps / 2.0;
+	
+	for (phase = 0; phase < SSG_RESAMPLER_PHASES; phase++)
+	{
+		double h[SSG_RESAMPLER_MAX_TAPS], sum = 0.0;
+		double frac = (double)phase / SSG_RESAMPLER_PHASES;
+		int32_t *coefs = device->m_resampler_coefs[phase];
+		int32_t total = 0;
+		
+		for (i = 0; i < taps; i++)
+		{
+			double t = i - (half - 1.0) - frac;
+			double x = 2.0 * cutoff * t;
+			double w = t / half;
+			double sinc = (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+			
+			h[i] = 2.0 * cutoff * sinc * (w * w < 1.0 ? bessel_i0(SSG_RESAMPLER_KAISER_BETA * sqrt(1.0 - w * w)) / bessel_i0(SSG_RESAMPLER_KAISER_BETA) : 0.0);
+			sum += h[i];
+		}
+		
+		/* unity gain for every phase, the rounding error goes to the center tap */
+		for (i = 0; i < taps; i++)
+		{
+			coefs[i] = (int32_t)floor(h[i] / sum * (1 << SSG_RESAMPLER_COEF_BITS) + 0.5);
+			total += coefs[i];
+		}
+		coefs[taps / 2 - 1] += (1 << SSG_RESAMPLER_COEF_BITS) - total;
+		for (; i < SSG_RESAMPLER_MAX_TAPS; i++)
+			coefs[i] = 0;
+	}
+	
+	resampler_reset(device);
+}
+
+/* generates the native samples of the next output samples, returns how many can be resampled */
+static int resampler_fill(SSG *device, int samples)
+{
+	int32_t *buffer = device->m_resampler_buffer;
+	int start = (int)(device->m_resampler_pos >> 32);
+	int taps = device->m_resampler_taps;
+	int count, needed;
+	
+	/* drop the native samples that are out of the filter */
+	if (start > 0)
+	{
+		memmove(buffer, buffer + start, (device->m_resampler_filled - start) * sizeof(int32_t));
+		device->m_resampler_filled -= start;
+		device->m_resampler_pos -= (uint64_t)start << 32;
+	}
+	
+	count = (int)(((uint64_t)(SSG_RESAMPLER_BUFFER - taps - 1) << 32) / device->m_resampler_step);
+	if (count > samples)
+		count = samples;
+	
+	needed = (int)((device->m_resampler_pos + (count - 1) * device->m_resampler_step) >> 32) + taps;
+	if (needed > device->m_resampler_filled)
+	{
+		int32_t *ref[1] = { buffer + device->m_resampler_filled };
+		sound_stream_update(device, ref, needed - device->m_resampler_filled);
+		device->m_resampler_filled = needed;
+	}
+	return count;
+}
+
+/* one output sample, taps is a multiple of 4 */
+static INLINE int32_t resampler_dot(const int32_t *x, const int32_t *h, int taps)
+{
+	int i;
+#if SSG_RESAMPLER_SSE2
+	/* no 32 bits mullo in SSE2: even and odd lanes go through 32x32->64 multiplies, only low halves are kept */
+	__m128i even = _mm_setzero_si128(), odd = _mm_setzero_si128();
+	
+	for (i = 0; i < taps; i += 4)
+	{
+		__m128i xv = _mm_loadu_si128((const __m128i *)(x + i));
+		__m128i hv = _mm_loadu_si128((const __m128i *)(h + i));
+		even = _mm_add_epi32(even, _mm_mul_epu32(xv, hv));
+		odd = _mm_add_epi32(odd, _mm_mul_epu32(_mm_srli_epi64(xv, 32), _mm_srli_epi64(hv, 32)));
+	}
+	even = _mm_add_epi32(even, odd);
+	even = _mm_add_epi32(even, _mm_shuffle_epi32(even, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtsi128_si32(even);
+#elif SSG_RESAMPLER_NEON
+	int32x4_t acc = vdupq_n_s32(0);
+	int32x2_t sum;
+	
+	for (i = 0; i < taps; i += 4)
+		acc = vmlaq_s32(acc, vld1q_s32(x + i), vld1q_s32(h + i));
+	sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+	return vget_lane_s32(vpadd_s32(sum, sum), 0);
+#else
+	int32_t acc[4] = { 0, 0, 0, 0 };
+	
+	for (i = 0; i < taps; i += 4)
+	{
+		acc[0] += x[i] * h[i];
+		acc[1] += x[i + 1] * h[i + 1];
+		acc[2] += x[i + 2] * h[i + 2];
+		acc[3] += x[i + 3] * h[i + 3];
+	}
+	return acc[0] + acc[1] + acc[2] + acc[3];
+#endif
+}
+
+static void resampler_run(SSG *device, int32_t *output, int count)
+{
+	const int32_t *buffer = device->m_resampler_buffer;
+	int taps = device->m_resampler_taps;
+	uint64_t pos = device->m_resampler_pos;
+	uint64_t step = device->m_resampler_step;
+	int n;
+	
+	for (n = 0; n < count; n++)
+	{
+		const int32_t *h = device->m_resampler_coefs[(pos >> (32 - SSG_RESAMPLER_PHASE_BITS)) & (SSG_RESAMPLER_PHASES - 1)];
+		output[n] = (resampler_dot(buffer + (pos >> 32), h, taps) + (1 << (SSG_RESAMPLER_COEF_BITS - 1))) >> SSG_RESAMPLER_COEF_BITS;
+		pos += step;
+	}
+	device->m_resampler_pos = pos;
+}
+
 #pragma mark - API
 
-void ssg_init(SSG *device) {
+void ssg_init(SSG *device, int output_rate) {
 	memset(device, 0, sizeof(SSG));
+	device->m_output_rate = output_rate;
 	device->m_streams = 1;
 	device->m_ioports = 0;
 	device->m_env_step_mask = 0x1f;
@@ -1271,8 +1521,14 @@ void ssg_init(SSG *device) {
 	device_start(device);
 }
 
+void ssg_release(SSG *device) {
+	free(device->m_vol3d_table);
+	device->m_vol3d_table = NULL;
+}
+
 void ssg_reset(SSG *device) {
 	ay8910_reset_ym(device);
+	resampler_reset(device);
 }
 
 uint8_t ssg_read(SSG *device) {
@@ -1284,31 +1540,41 @@ void ssg_write(SSG *device, int addr, uint8_t data) {
 }
 
 void ssg_set_clock(SSG *device, int clock) {
-//	device->m_step = 8000000 / clock;
-	printf("*** TODO: SSG set clock %i -> step %i \n", clock, device->m_step);
+	/* every chip reset sets the prescaler again, the filter only depends on the clock */
+	if (device->m_clock == clock && device->m_resampler_taps)
+		return;
+	device->m_clock = clock;
+	resampler_setup(device);
 }
 
-int32_t ssg_update_one_sample(SSG *device) {
-	int32_t output[3] = {0, 0, 0};
-	int32_t* ref1[1] = {output};
-	
-	/*
-	 Ugly hack
-	 Data from Mame:
-	 SSG rate = SSG_Clock/8 (2MHz / 8)
-	 FM rate = FM_Clock/72 (8 MHz / 72)
-	 => ratio is 2.25
-	 1 YM FM sample = 2.25 SSG samples ...
-	 Mame is using 2 speparated audio stream, not me ;(
-	 */
-	static uint8_t toggleMore = 0;
-	
-	int samples = toggleMore == 3 ? 3 : 2;
-	sound_stream_update(device, ref1, samples);
-	
-	toggleMore++;
-	if (toggleMore > 3) toggleMore = 0;
-	
-	return (output[0] + output[1] + output[2]) / samples;
+void ssg_render(SSG *device, int32_t *buffer, int samples) {
+	while (samples > 0) {
+		int count = resampler_fill(device, samples);
+		resampler_run(device, buffer, count);
+		buffer += count;
+		samples -= count;
+	}
+}
+
+bool ssg_is_silent(SSG *device) {
+	return active_channels_mask(device) == 0 && device->m_quiet_ticks >= device->m_resampler_taps;
 }
 
+int ssg_active_channels(SSG *device) {
+	int mask = active_channels_mask(device);
+	return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1);
+}
+
+int32_t ssg_silent_output(SSG *device) {
+	/* coefficients of each phase sum to 1 so a constant goes through the resampler unchanged */
+	return device->m_vol3d_table[0];
+}
+
+void ssg_skip_samples(SSG *device, int samples) {
+	// generators keep running so the channels restart in phase, only the filter is skipped
+	while (samples > 0) {
+		int count = resampler_fill(device, samples);
+		device->m_resampler_pos += count * device->m_resampler_step;
+		samples -= count;
+	}
+}
@@ -69,6 +69,16 @@ typedef struct
 
 static const uint8_t NUM_CHANNELS = 3;
 
+/*
+ * The SSG is generated at its native rate (clock / 8) then decimated
+ * to the output rate by a fixed point polyphase FIR
+ */
+#define SSG_RESAMPLER_PHASE_BITS    6
+#define SSG_RESAMPLER_PHASES        (1 << SSG_RESAMPLER_PHASE_BITS)
+#define SSG_RESAMPLER_MAX_TAPS      256     /* enough down to an output rate of 1/16 of the native rate */
+#define SSG_RESAMPLER_COEF_BITS     13      /* 3 channels at full volume * coefficients fit 32 bits */
+#define SSG_RESAMPLER_BUFFER        2048    /* native samples, history included */
+
 typedef struct {
 //	psg_type_t m_type;
 	int m_streams;
@@ -101,18 +111,37 @@ typedef struct {
 	int32_t *m_vol3d_table;
 	int m_flags;          /* Flags */
 	int m_res_load[3];    /* Load on channel in ohms */
+	/* native rate to output rate */
+	int m_clock;
+	int m_output_rate;
+	int m_quiet_ticks;                /* native samples since a channel was last audible */
+	uint64_t m_resampler_step;        /* native samples per output sample, 32.32 */
+	uint64_t m_resampler_pos;         /* next output sample position in m_resampler_buffer, 32.32 */
+	int m_resampler_taps;             /* multiple of 4 */
+	int m_resampler_filled;           /* native samples in m_resampler_buffer */
+	int32_t m_resampler_coefs[SSG_RESAMPLER_PHASES][SSG_RESAMPLER_MAX_TAPS];
+	int32_t m_resampler_buffer[SSG_RESAMPLER_BUFFER];
 //	devcb_read8 m_port_a_read_cb;
 //	devcb_read8 m_port_b_read_cb;
 //	devcb_write8 m_port_a_write_cb;
 //	devcb_write8 m_port_b_write_cb;
 } SSG;
 
-void ssg_init(SSG *device);
+void ssg_init(SSG *device, int output_rate);
+void ssg_release(SSG *device);
 void ssg_reset(SSG *device);
 uint8_t ssg_read(SSG *device);
 void ssg_write(SSG *device, int addr, uint8_t data);
 void ssg_set_clock(SSG *device, int clock);
-int32_t ssg_update_one_sample(SSG *device);
+/* renders samples at the output rate */
+void ssg_render(SSG *device, int32_t *buffer, int samples);
+
+/* all channels at fixed volume 0 long enough for the resampler, the output is then ssg_silent_output() */
+bool ssg_is_silent(SSG *device);
+int ssg_active_channels(SSG *device);
+int32_t ssg_silent_output(SSG *device);
+/* advances the generators by samples output samples without resampling them */
+void ssg_skip_samples(SSG *device, int samples);
 
 extern void ssg_needs_update(void);
 
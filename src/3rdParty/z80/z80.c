@@ -210,6 +210,8 @@ enum {
 #define HALT Z80.halt
 
 static int z80_ICount;
+Uint32 z80_instructions_count;
+Uint32 z80_idle_cycles;
 Z80_Regs Z80;
 static Uint32 EA;
 
@@ -459,6 +461,7 @@ INLINE void BURNODD(int cycles, int opcodes, int cyclesum)
 	{
 		R += (cycles / cyclesum) * opcodes;
 		z80_ICount -= (cycles / cyclesum) * cyclesum;
+		z80_idle_cycles += (cycles / cyclesum) * cyclesum;
 	}
 }
 
@@ -3562,6 +3565,7 @@ int z80_execute(int cycles)
 		PRVPC = PCD;
 		CALL_DEBUGGER(PCD);
 		R++;
+		z80_instructions_count++;
 		EXEC_INLINE(op,ROP());
 	} while( z80_ICount > 0 );
 
@@ -3579,6 +3583,7 @@ static void z80_burn(int cycles)
 		int n = (cycles + 3) / 4;
 		R += n;
 		z80_ICount -= 4 * n;
+		z80_idle_cycles += 4 * n;
 	}
 }
 
@@ -60,6 +60,10 @@ void z80_exit ( void );
 int  z80_execute ( int cycles );
 void z80_set_irq_line ( int irqline, int state );
 
+/* Read and cleared every frame by frame_counters */
+extern Uint32 z80_instructions_count;	/* instructions executed, shortcut loops count once */
+extern Uint32 z80_idle_cycles;			/* cycles burned by the HALT and busy loop shortcuts */
+
 #ifdef ENABLE_DEBUGGER
 unsigned z80_dasm ( char *buffer, offs_t pc, const UINT8 *oprom, const UINT8 *opram );
 #endif
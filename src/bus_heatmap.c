@@ -0,0 +1,205 @@
+#include "bus_heatmap.h"
+#include "log.h"
+#include "memory_input_output.h"
+#include "memory_mapping.h"
+#include "neogeo.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BUS_HEATMAP_LINE_SIZE 256
+
+#ifdef NEOGEO_BUS_HEATMAP
+
+typedef void (*bus_heatmap_print_t)(void *context, const char *line);
+
+// Regions and I/O registers are added as they are first accessed
+static const memory_region_t *regions[BUS_HEATMAP_REGIONS];
+static bus_heatmap_counts_t region_counts[BUS_HEATMAP_REGIONS];
+static uint32_t regions_count = 0;
+
+static uint32_t io_addresses[BUS_HEATMAP_IO_REGISTERS];
+static bus_heatmap_counts_t io_counts[BUS_HEATMAP_IO_REGISTERS];
+static uint32_t io_registers_count = 0;
+
+static bus_heatmap_counts_t page_counts[BUS_HEATMAP_PAGES];
+
+static uint64_t bus_heatmap_total(const bus_heatmap_counts_t counts);
+static void bus_heatmap_format_counts(char *line, size_t size, const char *name, const bus_heatmap_counts_t counts);
+static void bus_heatmap_report(bus_heatmap_print_t print, void *context, bool all_pages);
+static void bus_heatmap_print_log(void *context, const char *line);
+static void bus_heatmap_print_file(void *context, const char *line);
+
+#pragma mark - Public
+
+bool bus_heatmap_compiled() {
+	return true;
+}
+
+void bus_heatmap_reset() {
+	regions_count = 0;
+	io_registers_count = 0;
+	memset(region_counts, 0, sizeof(region_counts));
+	memset(io_counts, 0, sizeof(io_counts));
+	memset(page_counts, 0, sizeof(page_counts));
+}
+
+void bus_heatmap_count(uint32_t address, const memory_region_t *region, bus_heatmap_access_t access, bus_heatmap_width_t width) {
+	page_counts[(address >> BUS_HEATMAP_PAGE_SHIFT) & (BUS_HEATMAP_PAGES - 1)][access][width]++;
+
+	uint32_t index = 0;
+	while (index < regions_count && regions[index] != region) {
+		index++;
+	}
+	if (index == regions_count && regions_count < BUS_HEATMAP_REGIONS) {
+		regions[regions_count++] = region;
+	}
+	if (index < regions_count) {
+		region_counts[index][access][width]++;
+	}
+
+	if (region != NULL && address >= IO_PORTS_START && address <= IO_PORTS_END) {
+		index = 0;
+		while (index < io_registers_count && io_addresses[index] != address) {
+			index++;
+		}
+		if (index == io_registers_count && io_registers_count < BUS_HEATMAP_IO_REGISTERS) {
+			io_addresses[io_registers_count++] = address;
+		}
+		if (index < io_registers_count) {
+			io_counts[index][access][width]++;
+		}
+	}
+}
+
+void bus_heatmap_log_report() {
+	bus_heatmap_report(&bus_heatmap_print_log, NULL, false);
+}
+
+bool bus_heatmap_write_report(const char *path) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		LOG(LOG_ERROR, "bus_heatmap_write_report: can't create %s\n", path);
+		return false;
+	}
+	bus_heatmap_report(&bus_heatmap_print_file, file, true);
+	fclose(file);
+	return true;
+}
+
+#pragma mark - Private
+
+static uint64_t bus_heatmap_total(const bus_heatmap_counts_t counts) {
+	uint64_t total = 0;
+	for (uint8_t access = 0; access < BUS_HEATMAP_ACCESSES_COUNT; access++) {
+		for (uint8_t width = 0; width < BUS_HEATMAP_WIDTHS_COUNT; width++) {
+			total += counts[access][width];
+		}
+	}
+	return total;
+}
+
+// name total then reads and writes by width
+static void bus_heatmap_format_counts(char *line, size_t size, const char *name, const bus_heatmap_counts_t counts) {
+	snprintf(line, size, "%-20s %12llu  r8 %llu r16 %llu r32 %llu  w8 %llu w16 %llu w32 %llu",
+			 name, (unsigned long long)bus_heatmap_total(counts),
+			 (unsigned long long)counts[BUS_HEATMAP_READ][BUS_HEATMAP_BYTE], (unsigned long long)counts[BUS_HEATMAP_READ][BUS_HEATMAP_WORD],
+			 (unsigned long long)counts[BUS_HEATMAP_READ][BUS_HEATMAP_DWORD], (unsigned long long)counts[BUS_HEATMAP_WRITE][BUS_HEATMAP_BYTE],
+			 (unsigned long long)counts[BUS_HEATMAP_WRITE][BUS_HEATMAP_WORD], (unsigned long long)counts[BUS_HEATMAP_WRITE][BUS_HEATMAP_DWORD]);
+}
+
+static void bus_heatmap_report(bus_heatmap_print_t print, void *context, bool all_pages) {
+	char line[BUS_HEATMAP_LINE_SIZE];
+	char name[32];
+
+	// few regions and registers, selection sorts by total
+	bool printed[BUS_HEATMAP_PAGES];
+	print(context, "68K bus accesses by region");
+	memset(printed, 0, sizeof(printed));
+	for (uint32_t round = 0; round < regions_count; round++) {
+		uint32_t hottest = 0;
+		while (printed[hottest]) {
+			hottest++;
+		}
+		for (uint32_t index = hottest + 1; index < regions_count; index++) {
+			if (printed[index] == false && bus_heatmap_total(region_counts[index]) > bus_heatmap_total(region_counts[hottest])) {
+				hottest = index;
+			}
+		}
+		printed[hottest] = true;
+		bus_heatmap_format_counts(line, sizeof(line), regions[hottest] ? cpu_68k_memory_region_name(regions[hottest]) : "unmapped", region_counts[hottest]);
+		print(context, line);
+	}
+
+	print(context, "68K bus accesses by I/O register");
+	memset(printed, 0, sizeof(printed));
+	for (uint32_t round = 0; round < io_registers_count; round++) {
+		uint32_t hottest = 0;
+		while (printed[hottest]) {
+			hottest++;
+		}
+		for (uint32_t index = hottest + 1; index < io_registers_count; index++) {
+			if (printed[index] == false && bus_heatmap_total(io_counts[index]) > bus_heatmap_total(io_counts[hottest])) {
+				hottest = index;
+			}
+		}
+		printed[hottest] = true;
+		const char *register_name = memory_input_output_register_name(io_addresses[hottest]);
+		snprintf(name, sizeof(name), "%06X %s", io_addresses[hottest], register_name ? register_name : "unmapped");
+		bus_heatmap_format_counts(line, sizeof(line), name, io_counts[hottest]);
+		print(context, line);
+	}
+
+	// hottest pages, or all the pages accessed in address order
+	print(context, all_pages ? "68K bus accesses by 4 KB page" : "68K bus hottest 4 KB pages");
+	memset(printed, 0, sizeof(printed));
+	for (uint32_t round = 0; round < (all_pages ? BUS_HEATMAP_PAGES : BUS_HEATMAP_REPORT_PAGES); round++) {
+		uint32_t page = round;
+		if (all_pages == false) {
+			uint64_t hottest_total = 0;
+			for (uint32_t index = 0; index < BUS_HEATMAP_PAGES; index++) {
+				uint64_t total = bus_heatmap_total(page_counts[index]);
+				if (printed[index] == false && total > hottest_total) {
+					hottest_total = total;
+					page = index;
+				}
+			}
+			if (hottest_total == 0) {
+				break;
+			}
+			printed[page] = true;
+		}
+		if (bus_heatmap_total(page_counts[page]) == 0) {
+			continue;
+		}
+		snprintf(name, sizeof(name), "%06X-%06X", page << BUS_HEATMAP_PAGE_SHIFT, ((page + 1) << BUS_HEATMAP_PAGE_SHIFT) - 1);
+		bus_heatmap_format_counts(line, sizeof(line), name, page_counts[page]);
+		print(context, line);
+	}
+}
+
+static void bus_heatmap_print_log(void *context, const char *line) {
+	LOG(LOG_INFO, "%s\n", line);
+}
+
+static void bus_heatmap_print_file(void *context, const char *line) {
+	fprintf((FILE *)context, "%s\n", line);
+}
+
+#else
+
+bool bus_heatmap_compiled() {
+	return false;
+}
+
+void bus_heatmap_reset() {
+}
+
+void bus_heatmap_log_report() {
+}
+
+bool bus_heatmap_write_report(const char *path) {
+	return false;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef bus_heatmap_h
+#define bus_heatmap_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "memory_region.h"
+
+/*
+ *	68K bus accesses counted by memory region, by 4 KB page and by I/O register, for each direction and width
+ *	Only built with NEOGEO_BUS_HEATMAP defined (cmake -DNEOGEO_BUS_HEATMAP=ON), m68k_interface.c feeds it
+ *	Instruction fetches go through the same bus and are counted as reads
+ */
+
+#define BUS_HEATMAP_PAGE_SHIFT 12
+#define BUS_HEATMAP_PAGES (1 << (24 - BUS_HEATMAP_PAGE_SHIFT))	// 24 bits address bus
+#define BUS_HEATMAP_REGIONS 24
+#define BUS_HEATMAP_IO_REGISTERS 64
+#define BUS_HEATMAP_REPORT_PAGES 32								// hottest pages in the log
+
+typedef enum bus_heatmap_access {
+	BUS_HEATMAP_READ,
+	BUS_HEATMAP_WRITE,
+	BUS_HEATMAP_ACCESSES_COUNT
+} bus_heatmap_access_t;
+
+typedef enum bus_heatmap_width {
+	BUS_HEATMAP_BYTE,
+	BUS_HEATMAP_WORD,
+	BUS_HEATMAP_DWORD,
+	BUS_HEATMAP_WIDTHS_COUNT
+} bus_heatmap_width_t;
+
+typedef uint64_t bus_heatmap_counts_t[BUS_HEATMAP_ACCESSES_COUNT][BUS_HEATMAP_WIDTHS_COUNT];
+
+#ifdef NEOGEO_BUS_HEATMAP
+
+// region is NULL for accesses outside of the memory map
+#define BUS_HEATMAP_COUNT(address, region, access, width) bus_heatmap_count(address, region, access, width)
+
+void bus_heatmap_count(uint32_t address, const memory_region_t *region, bus_heatmap_access_t access, bus_heatmap_width_t width);
+
+#else
+
+#define BUS_HEATMAP_COUNT(address, region, access, width)
+
+#endif
+
+// false when built without NEOGEO_BUS_HEATMAP, the reports are then empty
+bool bus_heatmap_compiled(void);
+void bus_heatmap_reset(void);
+
+// Regions sorted by accesses, I/O registers and the hottest pages
+void bus_heatmap_log_report(void);
+// Same report followed by every page accessed
+bool bus_heatmap_write_report(const char *path);
+
+#endif /* bus_heatmap_h */
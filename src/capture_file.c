@@ -0,0 +1,118 @@
+#include "capture_file.h"
+#include "endian.h"
+#include "log.h"
+
+#include <string.h>
+
+#pragma mark - Writing
+
+bool capture_file_create(capture_file_t *capture, const char *path, const void *header, size_t header_size) {
+	memset(capture, 0, sizeof(capture_file_t));
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		LOG(LOG_ERROR, "capture_file_create: can't create %s\n", path);
+		return false;
+	}
+	setvbuf(file, NULL, _IOFBF, CAPTURE_FILE_BUFFER_SIZE);
+	if (fwrite(header, header_size, 1, file) != 1) {
+		LOG(LOG_ERROR, "capture_file_create: can't write %s\n", path);
+		fclose(file);
+		return false;
+	}
+
+	capture->file = file;
+	capture->header_size = header_size;
+	return true;
+}
+
+void capture_file_add(capture_file_t *capture, uint64_t position, uint8_t kind, const uint8_t *payload, size_t payload_size) {
+	if (capture->file == NULL) {
+		return;
+	}
+	uint64_t delta = position > capture->last_position ? position - capture->last_position : 0;
+	capture->last_position += delta;
+
+	uint8_t bytes[11];
+	size_t count = 0;
+	bytes[count++] = kind;
+	do {
+		uint8_t byte = delta & 0x7F;
+		delta >>= 7;
+		bytes[count++] = delta ? (byte | 0x80) : byte;
+	} while (delta);
+	fwrite(bytes, 1, count, capture->file);
+	if (payload_size) {
+		fwrite(payload, 1, payload_size, capture->file);
+	}
+}
+
+bool capture_file_close(capture_file_t *capture) {
+	bool result = true;
+	if (capture->file != NULL) {
+		result = fclose(capture->file) == 0;
+	}
+	memset(capture, 0, sizeof(capture_file_t));
+	return result;
+}
+
+#pragma mark - Reading
+
+bool capture_file_open(capture_file_t *capture, const char *path, void *header, size_t header_size,
+					   const char *magic, uint32_t version, const char *name) {
+	memset(capture, 0, sizeof(capture_file_t));
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		LOG(LOG_ERROR, "capture_file_open: can't open %s\n", path);
+		return false;
+	}
+	if (fread(header, header_size, 1, file) != 1 || memcmp(header, magic, CAPTURE_FILE_MAGIC_SIZE) != 0) {
+		LOG(LOG_ERROR, "capture_file_open: %s is not a %s\n", path, name);
+		fclose(file);
+		return false;
+	}
+	uint32_t header_version;
+	memcpy(&header_version, (uint8_t *)header + CAPTURE_FILE_MAGIC_SIZE, sizeof(uint32_t));
+	header_version = LITTLE_ENDIAN_DWORD(header_version);
+	if (header_version != version) {
+		LOG(LOG_ERROR, "capture_file_open: unsupported %s version %u\n", name, header_version);
+		fclose(file);
+		return false;
+	}
+	memcpy((uint8_t *)header + CAPTURE_FILE_MAGIC_SIZE, &header_version, sizeof(uint32_t));
+
+	setvbuf(file, NULL, _IOFBF, CAPTURE_FILE_BUFFER_SIZE);
+	capture->file = file;
+	capture->header_size = header_size;
+	return true;
+}
+
+bool capture_file_next(capture_file_t *capture, uint8_t *kind, uint64_t *position) {
+	int byte = fgetc(capture->file);
+	if (byte == EOF) {
+		return false;
+	}
+	*kind = (uint8_t)byte;
+	uint64_t delta = 0;
+	for (unsigned shift = 0; ; shift += 7) {
+		byte = fgetc(capture->file);
+		if (byte == EOF || shift > 63) {
+			return false;
+		}
+		delta |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			break;
+		}
+	}
+	capture->last_position += delta;
+	*position = capture->last_position;
+	return true;
+}
+
+bool capture_file_read(capture_file_t *capture, uint8_t *payload, size_t payload_size) {
+	return fread(payload, 1, payload_size, capture->file) == payload_size;
+}
+
+void capture_file_rewind(capture_file_t *capture) {
+	fseek(capture->file, (long)capture->header_size, SEEK_SET);
+	capture->last_position = 0;
+}
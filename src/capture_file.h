@@ -0,0 +1,40 @@
+#ifndef capture_file_h
+#define capture_file_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ *	Event log files written by the YM2610 (.ymlog) and video (.vidlog) captures
+ *	A little endian header starting with an 8 bytes magic and a 32 bits version,
+ *	then events: one event byte, the positions (samples, lines) since the previous event
+ *	as a LEB128 varint, and the payload of the event kind
+ */
+
+#define CAPTURE_FILE_MAGIC_SIZE			8
+#define CAPTURE_FILE_BUFFER_SIZE		(256 * 1024)
+
+typedef struct capture_file {
+	FILE *file;
+	uint64_t last_position;
+	size_t header_size;
+} capture_file_t;
+
+// The header is written as is, its fields already little endian
+bool capture_file_create(capture_file_t *capture, const char *path, const void *header, size_t header_size);
+// Positions before the previous event's are moved to it
+void capture_file_add(capture_file_t *capture, uint64_t position, uint8_t kind, const uint8_t *payload, size_t payload_size);
+// false when the file can't be written completely
+bool capture_file_close(capture_file_t *capture);
+
+// Checks the magic and version, the version in header is converted to the host order, name is used in errors
+bool capture_file_open(capture_file_t *capture, const char *path, void *header, size_t header_size,
+					   const char *magic, uint32_t version, const char *name);
+// Event byte and position, false at the end of the file or on a truncated varint
+bool capture_file_next(capture_file_t *capture, uint8_t *kind, uint64_t *position);
+bool capture_file_read(capture_file_t *capture, uint8_t *payload, size_t payload_size);
+void capture_file_rewind(capture_file_t *capture);
+
+#endif /* capture_file_h */
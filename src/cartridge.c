@@ -1,25 +1,58 @@
 #include "endian.h"
 #include "cartridge.h"
+#include "cartridge_image.h"
 #include "common_tools.h"
+#include "frame_counters.h"
 #include "log.h"
 #include "memory_mapping.h"
+#include "pcm_blocks.h"
+#include "profile.h"
 #include "rom_region.h"
+#include "video.h"
 
+#include "zip_workers.h"
 #include "3rdParty/miniz/miniz.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
 
 // Cartridge ROMS - https://wiki.neogeodev.org/index.php?title=Cartridges
 
 typedef struct cartridge {
-	rom_region_t p_roms[4];		// 68K programs
-	rom_region_t c_roms[8];		// Sprites tiles
+	rom_region_t p_rom;			// 68K programs: fixed bank followed by switchable banks
+	size_t p1_size;
+	size_t p2_size;
+	rom_region_t c_roms[8];		// Sprites tiles, each pair shares one allocation owned by the odd ROM
 	rom_region_t s_roms[2];		// Fix sprite tiles
 	rom_region_t m1_rom;		// Z80 program
-	rom_region_t v1_roms[4];	// Sound samples
-	rom_region_t v2_roms[4];	// Sound samples
+	rom_region_t v1_roms[4];	// Sound samples, inside pcm_roms[0]
+	rom_region_t v2_roms[4];	// Sound samples, inside pcm_roms[1]
+	rom_region_t pcm_roms[2];	// V1 then V2 ROMs concatenated for the YM2610 ADPCM A/B
+	uint32_t c_rom_pair_tiles[4];	// Sprites tiles count per C ROMs pair
+	uint32_t sprite_tiles_count;
 } cartridge_t;
 
+typedef enum cartridge_rom_kind {
+	CARTRIDGE_ROM_UNUSED = 0,
+	CARTRIDGE_ROM_P,
+	CARTRIDGE_ROM_S,
+	CARTRIDGE_ROM_C,
+	CARTRIDGE_ROM_M,
+	CARTRIDGE_ROM_V1,
+	CARTRIDGE_ROM_V2
+} cartridge_rom_kind_t;
+
+// One archive entry to extract, found while reading the zip central directory
+typedef struct cartridge_rom_entry {
+	mz_uint file_index;
+	cartridge_rom_kind_t kind;
+	uint8_t index;			// 0 based ROM number inside its kind
+	size_t size;
+	uint8_t *destination;
+} cartridge_rom_entry_t;
+
+#define CARTRIDGE_MAX_ROM_ENTRIES 32
 
 cartridge_t plugged_cartridge;
 memory_region_t p_rom_bank1;
@@ -27,24 +60,75 @@ memory_region_t p_rom_bank2;
 memory_region_t serialized_c_roms;
 memory_region_t m1_rom;
 
+static uint8_t *empty_p_rom_bank = NULL;
+static cartridge_image_t mapped_image;		// ROMs are used in place when a cartridge image is plugged
+static size_t sprites_memory_budget = 0;
+static bool pcm_compression = false;
+static bool pcm_roms_in_blocks = false;		// PCM ROMs are compressed once loaded, then only read through pcm_blocks
+static pcm_blocks_t pcm_blocks[2];
+
+// Loading progress, updated from the inflating workers
+static atomic_uint p_rom_pending_entries;
+static atomic_uint c_rom_pair_pending_entries[4];
+static atomic_uint c_rom_pending_pairs;
+static atomic_uint pcm_rom_pending_entries;
+
+// Sprites and PCM ROMs are inflated in the background, entries and jobs live until the workers are joined
+static cartridge_rom_entry_t rom_entries[CARTRIDGE_MAX_ROM_ENTRIES];
+static zip_workers_job_t rom_jobs[CARTRIDGE_MAX_ROM_ENTRIES];
+static zip_workers_t *background_workers = NULL;
+static char *background_path = NULL;
+static uint64_t background_start = 0;
+static pthread_mutex_t loading_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t loading_condition = PTHREAD_COND_INITIALIZER;
+static cartridge_loading_stats_t loading_stats;
+
+atomic_bool cartridge_sprites_loaded;
+atomic_bool cartridge_pcm_roms_loaded;
+
 static void init_cartridge_p_rom(void);
 static void init_cartridge_p_rom2(void);
 static void init_cartridge_m1_rom(void);
 static uint16_t cartridge_game_ngh(void);
 static bool cartridge_p_rom_check(void);
-static void cartridge_serialize_c_rom(void);
+static void cartridge_finalize_load(void);
+static cartridge_rom_kind_t cartridge_rom_kind_for_name(const char *file_name, uint8_t *index);
+static bool cartridge_allocate_roms(cartridge_rom_entry_t *entries, size_t entries_count);
+static bool cartridge_rom_needed_at_boot(cartridge_rom_kind_t kind);
+static int cartridge_rom_entry_compare_order(const void *a, const void *b);
+static void cartridge_rom_entry_inflated(zip_workers_job_t *job);
+static void cartridge_background_loading_finished(bool success, void *context);
+static void cartridge_wait_background_loading(void);
+static void cartridge_set_loaded(atomic_bool *loaded);
+static uint64_t cartridge_wait_loaded(atomic_bool *loaded);
+static void cartridge_convert_p_rom(void);
+static void cartridge_count_sprite_tiles(void);
+static bool cartridge_allocate_sprites(void);
+static void cartridge_serialize_c_rom_pair(uint8_t pair);
+static void cartridge_release_c_rom_pair(uint8_t pair);
+static void cartridge_release_c_roms(void);
+static void cartridge_compress_pcm_roms(void);
 
 #pragma mark - Public
 
 void cartridge_init() {
-	memset(&plugged_cartridge.p_roms[0], 0, sizeof(memory_region_t));
-	memset(&plugged_cartridge.p_roms[1], 0, sizeof(memory_region_t));
+	memset(&plugged_cartridge, 0, sizeof(cartridge_t));
+	empty_p_rom_bank = calloc(1, ROM_BANK1_SIZE);
+	atomic_init(&cartridge_sprites_loaded, true);
+	atomic_init(&cartridge_pcm_roms_loaded, true);
 	init_cartridge_p_rom();
 	init_cartridge_p_rom2();
 	init_cartridge_m1_rom();
 }
 
 bool cartridge_load_roms(const char *path) {
+	if (cartridge_plugged_in()) {
+		cartridge_unload();
+	}
+	
+	uint64_t load_start = monotonic_time_usec();
+	PROFILE(p_load, PROFILE_ROM_LOAD);
+	
 	mz_zip_archive zip_archive;
 	mz_zip_zero_struct(&zip_archive);
 	mz_bool status = mz_zip_reader_init_file(&zip_archive, path, 0);
@@ -52,281 +136,376 @@ bool cartridge_load_roms(const char *path) {
 		LOG(LOG_ERROR, "cartridge_load_roms: can't open game file at %s - %s \n", path, mz_zip_get_error_string(zip_archive.m_last_error));
 		return false;
 	}
-		
+	
+	// First pass: find and size every ROM from the central directory
+	cartridge_rom_entry_t *entries = rom_entries;
+	zip_workers_job_t *jobs = rom_jobs;
+	size_t entries_count = 0;
 	mz_uint files_count = mz_zip_reader_get_num_files(&zip_archive);
 	
 	for (mz_uint file_index = 0; file_index < files_count; file_index++) {
-		char file_name[128];
-		mz_zip_reader_get_filename(&zip_archive, file_index, file_name, 128);
-		
-		void *p;
-		size_t pSize;
-		p = mz_zip_reader_extract_to_heap(&zip_archive, file_index, &pSize, MZ_ZIP_FLAG_IGNORE_PATH);
-		if (!p) {
-			LOG(LOG_ERROR, "cartridge_load_roms: can't extract game rom file %s\n", file_name);
+		mz_zip_archive_file_stat file_stat;
+		if (!mz_zip_reader_file_stat(&zip_archive, file_index, &file_stat)) {
+			LOG(LOG_ERROR, "cartridge_load_roms: can't read game rom file #%u\n", file_index);
 			mz_zip_reader_end(&zip_archive);
 			return false;
 		}
 		
-		bool found = false;
-		//P_ROM
-		for (uint8_t i = 1; i <= 2; i++) {
-			char element[4];
-			sprintf(element, "p%d.", i);
-			if (strcasestr(file_name, element) != NULL) {
-				LOG(LOG_DEBUG, "cartridge_load_roms found P_ROM %d %s - loaded at %p\n", i, file_name, p);
-				void *prom = p;
-				size_t prom_size = pSize;
-				if (prom_size > ROM_BANK1_SIZE) {
-					LOG(LOG_ERROR, "cartridge_load_roms P_ROM is too big: splitting\n");
-					// why MAME, why???
-					if (i == 1)
-					{
-						uint32_t offset = ROM_BANK1_SIZE;
-						if (prom_size == 2 * ROM_BANK1_SIZE) {
-							prom_size = pSize - offset;
-							prom = malloc(prom_size);
-							memcpy(prom, p + offset, prom_size);
-							
-							void *prom_2 = malloc(ROM_BANK1_SIZE);
-							memcpy(prom_2, p, ROM_BANK1_SIZE);
-							byte_swap_p_rom_if_needed(prom_2, ROM_BANK1_SIZE);
-							plugged_cartridge.p_roms[i].data = prom_2;
-							plugged_cartridge.p_roms[i].size = ROM_BANK1_SIZE;
-							free(p);
-							byte_swap_p_rom_if_needed(prom, prom_size);
-							plugged_cartridge.p_roms[i-1].data = prom;
-							plugged_cartridge.p_roms[i-1].size = prom_size;
-							found = true;
-							break;
-						}
-						else {
-							free(p);
-							break;
-						}
-					}
-					else
-					{
-						uint32_t offset = 0;
-						uint8_t rom_offset = 0;
-						while (offset < prom_size)
-						{
-							prom = malloc(ROM_BANK1_SIZE);
-							memcpy(prom, p + offset, ROM_BANK1_SIZE);
-							byte_swap_p_rom_if_needed(prom, ROM_BANK1_SIZE);
-							plugged_cartridge.p_roms[i-1 + rom_offset].data = prom;
-							plugged_cartridge.p_roms[i-1 + rom_offset].size = ROM_BANK1_SIZE;
-							offset += ROM_BANK1_SIZE;
-							rom_offset++;
-						}
-						found = true;
-						break;
-					}
-				}
-				else
-				{
-					byte_swap_p_rom_if_needed(prom, prom_size);
-					plugged_cartridge.p_roms[i-1].data = prom;
-					plugged_cartridge.p_roms[i-1].size = prom_size;
-					found = true;
-					break;
-				}
-			}
-		}
-		if (found == true) {
-			continue;
-		}
-		
-		//S_ROM
-		for (uint8_t i = 1; i <= 2; i++) {
-			char element[4];
-			sprintf(element, "s%d.", i);
-			if (strcasestr(file_name, element) != NULL) {
-				LOG(LOG_DEBUG, "cartridge_load_roms found S_ROM %d %s\n", i, file_name);
-				plugged_cartridge.s_roms[i-1].data = p;
-				plugged_cartridge.s_roms[i-1].size = pSize;
-				found = true;
-				break;
-			}
-		}
-		if (found == true) {
-			continue;
-		}
-		
-		//C_ROM
-		for (uint8_t i = 1; i <= 8; i++) {
-			char element[4];
-			sprintf(element, "c%d.", i);
-			if (strcasestr(file_name, element) != NULL) {
-				LOG(LOG_DEBUG, "cartridge_load_roms found C_ROM %d %s %lld bytes\n", i, file_name, pSize);
-				plugged_cartridge.c_roms[i-1].data = p;
-				plugged_cartridge.c_roms[i-1].size = pSize;
-				found = true;
-				break;
-			}
-		}
-		if (found == true) {
-			continue;
-		}
-		
-		// M ROM
-		if (strcasestr(file_name, "m1.") != NULL) {
-			LOG(LOG_DEBUG, "cartridge_load_roms found M_ROM 1 %s %lld bytes\n", file_name, pSize);
-			plugged_cartridge.m1_rom.data = p;
-			plugged_cartridge.m1_rom.size = pSize;
+		uint8_t index = 0;
+		cartridge_rom_kind_t kind = cartridge_rom_kind_for_name(file_stat.m_filename, &index);
+		if (kind == CARTRIDGE_ROM_UNUSED || file_stat.m_is_directory) {
+			LOG(LOG_DEBUG, "cartridge_load_roms: unused file %s\n", file_stat.m_filename);
 			continue;
 		}
-		
-		//V1_ROM
-		if (strcasestr(file_name, "v1.") != NULL) {
-			LOG(LOG_DEBUG, "cartridge_load_roms found V1_ROM 1 %s %lld bytes\n", file_name, pSize);
-			plugged_cartridge.v1_roms[0].data = p;
-			plugged_cartridge.v1_roms[0].size = pSize;
+		if (entries_count == CARTRIDGE_MAX_ROM_ENTRIES) {
+			LOG(LOG_ERROR, "cartridge_load_roms: too many ROM files, ignoring %s\n", file_stat.m_filename);
 			continue;
 		}
 		
-		for (uint8_t i = 1; i <= 4; i++) {
-			char element[5];
-			sprintf(element, "v1%d.", i);
-			if (strcasestr(file_name, element) != NULL) {
-				LOG(LOG_DEBUG, "cartridge_load_roms found V1_ROM %d %s %lld bytes\n", i, file_name, pSize);
-				plugged_cartridge.v1_roms[i-1].data = p;
-				plugged_cartridge.v1_roms[i-1].size = pSize;
-				found = true;
-				break;
-			}
-		}
-		if (found == true) {
-			continue;
+		LOG(LOG_DEBUG, "cartridge_load_roms found %s %llu bytes\n", file_stat.m_filename, (unsigned long long)file_stat.m_uncomp_size);
+		cartridge_rom_entry_t *entry = &entries[entries_count++];
+		entry->file_index = file_index;
+		entry->kind = kind;
+		entry->index = index;
+		entry->size = (size_t)file_stat.m_uncomp_size;
+		entry->destination = NULL;
+	}
+	
+	// workers open their own readers
+	mz_zip_reader_end(&zip_archive);
+	uint64_t directory_end = monotonic_time_usec();
+	
+	// Allocate final ROM regions
+	if (cartridge_allocate_roms(entries, entries_count) == false
+		|| cartridge_allocate_sprites() == false) {
+		cartridge_unload();
+		return false;
+	}
+	uint64_t allocation_end = monotonic_time_usec();
+	
+	// Second pass: inflate each file at its final place, boot ROMs first then biggest files first
+	// P ROM conversion and C ROMs pairs serialization run as soon as their files are inflated
+	qsort(entries, entries_count, sizeof(cartridge_rom_entry_t), cartridge_rom_entry_compare_order);
+	size_t boot_entries_count = 0;
+	atomic_init(&p_rom_pending_entries, 0);
+	atomic_init(&c_rom_pending_pairs, 0);
+	atomic_init(&pcm_rom_pending_entries, 0);
+	for (uint8_t pair = 0; pair < 4; pair++) {
+		atomic_init(&c_rom_pair_pending_entries[pair], 0);
+	}
+	for (size_t i = 0; i < entries_count; i++) {
+		if (cartridge_rom_needed_at_boot(entries[i].kind)) {
+			boot_entries_count++;
 		}
-		
-		//V2_ROM
-		if (strcasestr(file_name, "v2.") != NULL) {
-			LOG(LOG_DEBUG, "cartridge_load_roms found V2_ROM 1 %s %lld bytes\n", file_name, pSize);
-			plugged_cartridge.v2_roms[0].data = p;
-			plugged_cartridge.v2_roms[0].size = pSize;
-			continue;
+		if (entries[i].kind == CARTRIDGE_ROM_P) {
+			atomic_fetch_add(&p_rom_pending_entries, 1);
 		}
-		
-		for (uint8_t i = 1; i <= 4; i++) {
-			char element[5];
-			sprintf(element, "v2%d.", i);
-			if (strcasestr(file_name, element) != NULL) {
-				LOG(LOG_DEBUG, "cartridge_load_roms found V2_ROM %d %s %lld bytes\n", i, file_name, pSize);
-				plugged_cartridge.v2_roms[i-1].data = p;
-				plugged_cartridge.v2_roms[i-1].size = pSize;
-				found = true;
-				break;
+		else if (entries[i].kind == CARTRIDGE_ROM_C) {
+			if (atomic_fetch_add(&c_rom_pair_pending_entries[entries[i].index / 2], 1) == 0) {
+				atomic_fetch_add(&c_rom_pending_pairs, 1);
 			}
 		}
-		if (found == true) {
-			continue;
+		else if (entries[i].kind == CARTRIDGE_ROM_V1 || entries[i].kind == CARTRIDGE_ROM_V2) {
+			atomic_fetch_add(&pcm_rom_pending_entries, 1);
 		}
-		
-		// Nothing catched ?
-		mz_free(p);
-		LOG(LOG_DEBUG, "cartridge_load_roms: unused file %s\n", file_name);
+		jobs[i].file_index = entries[i].file_index;
+		jobs[i].destination = entries[i].destination;
+		jobs[i].size = entries[i].size;
+		jobs[i].completion = &cartridge_rom_entry_inflated;
+		jobs[i].context = &entries[i];
 	}
 	
-	if (plugged_cartridge.p_roms[0].data == NULL
-		|| plugged_cartridge.s_roms[0].data == NULL
-		|| plugged_cartridge.c_roms[0].data == NULL
-		|| plugged_cartridge.c_roms[1].data == NULL) {
-		LOG(LOG_DEBUG, "cartridge_load_roms: seems that minimum roms are not found\n");
-		mz_zip_reader_end(&zip_archive);
+	// P, S and M ROMs are enough for the BIOS to boot
+	unsigned threads_count = zip_workers_default_threads_count();
+	zip_workers_t *workers = zip_workers_start(path, jobs, boot_entries_count, threads_count, NULL, NULL);
+	if (zip_workers_wait(workers) == false) {
+		LOG(LOG_ERROR, "cartridge_load_roms: can't extract game roms from %s\n", path);
+		cartridge_unload();
 		return false;
 	}
+	uint64_t inflate_end = monotonic_time_usec();
+	
+	// Post treatment for internal architecture
 	
 	if (cartridge_p_rom_check() == false) {
 		LOG(LOG_DEBUG, "cartridge_load_roms: P ROM header is missing NEO-GEO ref\n");
-		mz_zip_reader_end(&zip_archive);
+		cartridge_unload();
 		return false;
 	}
+	cartridge_finalize_load();
 	
-	mz_zip_reader_end(&zip_archive);
+	// Sprites and PCM ROMs keep loading while the BIOS boots
+	pthread_mutex_lock(&loading_mutex);
+	memset(&loading_stats, 0, sizeof(cartridge_loading_stats_t));
+	pthread_mutex_unlock(&loading_mutex);
+	background_start = monotonic_time_usec();
+	background_path = strdup(path);
+	atomic_store(&cartridge_sprites_loaded, atomic_load(&c_rom_pending_pairs) == 0);
+	atomic_store(&cartridge_pcm_roms_loaded, atomic_load(&pcm_rom_pending_entries) == 0);
+	pcm_roms_in_blocks = pcm_compression && atomic_load(&pcm_rom_pending_entries) > 0;
+	if (background_path != NULL) {
+		background_workers = zip_workers_start(background_path, jobs + boot_entries_count, entries_count - boot_entries_count,
+											   threads_count, &cartridge_background_loading_finished, NULL);
+	}
+	if (background_workers == NULL) {
+		// No pool, inflate the rest now so that nothing waits for workers that never run
+		LOG(LOG_WARN, "cartridge_load_roms: can't start background workers, loading sprites and PCM ROMs now\n");
+		bool success = zip_workers_run(path, jobs + boot_entries_count, entries_count - boot_entries_count);
+		cartridge_background_loading_finished(success, NULL);
+	}
+	uint64_t load_end = monotonic_time_usec();
 	
-	// Post treatment for internal architecture
+	LOG(LOG_INFO, "cartridge_load_roms: P %zu KB, S %zu KB, M %zu KB, sprites %zu KB, PCM A %zu KB, PCM B %zu KB\n",
+		plugged_cartridge.p_rom.size / 1024, plugged_cartridge.s_roms[0].size / 1024, plugged_cartridge.m1_rom.size / 1024,
+		serialized_c_roms.size / 1024, plugged_cartridge.pcm_roms[0].size / 1024, plugged_cartridge.pcm_roms[1].size / 1024);
+	LOG(LOG_INFO, "cartridge_load_roms: directory %.1f ms, allocation %.1f ms, boot ROMs %.1f ms (%u threads), finalize %.1f ms - ready to boot in %.1f ms\n",
+		(directory_end - load_start) / 1000.0, (allocation_end - directory_end) / 1000.0,
+		(inflate_end - allocation_end) / 1000.0, threads_count,
+		(load_end - inflate_end) / 1000.0, (load_end - load_start) / 1000.0);
+	PROFILE_END(p_load);
 	
-	memset(p_rom_bank1.data, 0, ROM_BANK1_SIZE);
-	uint32_t p1Offset = 0;
-	for (int i = 0; i < 4; i++) {
-		if (plugged_cartridge.p_roms[i].data != NULL
-			&& p1Offset < ROM_BANK1_SIZE) {
-			memcpy(p_rom_bank1.data + p1Offset, plugged_cartridge.p_roms[i].data, plugged_cartridge.p_roms[i].size);
-			p1Offset += plugged_cartridge.p_roms[i].size;
-		}
+	return true;
+}
+
+bool cartridge_load_image(const char *path) {
+	if (cartridge_plugged_in()) {
+		cartridge_unload();
 	}
-	memset(p_rom_bank2.data, 0, ROM_BANK1_SIZE);
-	memcpy(p_rom_bank2.data, plugged_cartridge.p_roms[1].data, plugged_cartridge.p_roms[1].size);
 	
-	m1_rom.data = plugged_cartridge.m1_rom.data;
-	m1_rom.size = plugged_cartridge.m1_rom.size;
-	m1_rom.end_address = (uint32_t)m1_rom.size - 1;
+	uint64_t load_start = monotonic_time_usec();
+	PROFILE(p_load, PROFILE_ROM_LOAD);
+	if (cartridge_image_map(path, &mapped_image) == false) {
+		return false;
+	}
 	
-	uint16_t ngh = cartridge_game_ngh();
-	LOG(LOG_INFO, "Cartridge NGH: %04d\n", ngh);
+	rom_region_t *sections = mapped_image.sections;
+	if (sections[CARTRIDGE_IMAGE_P_ROM].size < 2 * ROM_BANK1_SIZE
+		|| sections[CARTRIDGE_IMAGE_SPRITES].size < CHARACTER_TILE_BYTES
+		|| sections[CARTRIDGE_IMAGE_FIX].size == 0) {
+		LOG(LOG_ERROR, "cartridge_load_image: %s misses some ROMs\n", path);
+		cartridge_unload();
+		return false;
+	}
+	
+	// Everything is already converted, regions point straight into the image
+	plugged_cartridge.p_rom = sections[CARTRIDGE_IMAGE_P_ROM];
+	plugged_cartridge.s_roms[0] = sections[CARTRIDGE_IMAGE_FIX];
+	plugged_cartridge.m1_rom = sections[CARTRIDGE_IMAGE_M1_ROM];
+	plugged_cartridge.pcm_roms[0] = sections[CARTRIDGE_IMAGE_PCM_A];
+	plugged_cartridge.pcm_roms[1] = sections[CARTRIDGE_IMAGE_PCM_B];
+	plugged_cartridge.v1_roms[0] = plugged_cartridge.pcm_roms[0];
+	plugged_cartridge.v2_roms[0] = plugged_cartridge.pcm_roms[1];
 	
-	cartridge_serialize_c_rom();
+	serialized_c_roms.data = sections[CARTRIDGE_IMAGE_SPRITES].data;
+	serialized_c_roms.size = sections[CARTRIDGE_IMAGE_SPRITES].size;
+	plugged_cartridge.sprite_tiles_count = (uint32_t)(serialized_c_roms.size / CHARACTER_TILE_BYTES);
+	plugged_cartridge.c_rom_pair_tiles[0] = plugged_cartridge.sprite_tiles_count;
+	
+	if (cartridge_p_rom_check() == false) {
+		LOG(LOG_DEBUG, "cartridge_load_image: P ROM header is missing NEO-GEO ref\n");
+		cartridge_unload();
+		return false;
+	}
+	cartridge_finalize_load();
 	
+	LOG(LOG_INFO, "cartridge_load_image: %s mapped, %zu MB - %.1f ms\n", path, mapped_image.mapping_size / (1024*1024), (monotonic_time_usec() - load_start) / 1000.0);
+	PROFILE_END(p_load);
 	return true;
 }
 
-void cartridge_unload(void) {
-	for (uint8_t i = 0; i < 2; i++) {
-		if (plugged_cartridge.p_roms[i].data != NULL) {
-			mz_free(plugged_cartridge.p_roms[i].data);
+bool cartridge_write_image(const char *path) {
+	cartridge_require_sprites();
+	cartridge_require_pcm_roms();
+	if (cartridge_plugged_in() == false || serialized_c_roms.data == NULL) {
+		LOG(LOG_ERROR, "cartridge_write_image: needs a cartridge with serialized sprites\n");
+		return false;
+	}
+	
+	cartridge_image_t image;
+	memset(&image, 0, sizeof(cartridge_image_t));
+	image.sections[CARTRIDGE_IMAGE_P_ROM] = plugged_cartridge.p_rom;
+	image.sections[CARTRIDGE_IMAGE_SPRITES].data = serialized_c_roms.data;
+	image.sections[CARTRIDGE_IMAGE_SPRITES].size = serialized_c_roms.size;
+	image.sections[CARTRIDGE_IMAGE_FIX] = plugged_cartridge.s_roms[0];
+	image.sections[CARTRIDGE_IMAGE_M1_ROM] = plugged_cartridge.m1_rom;
+	image.sections[CARTRIDGE_IMAGE_PCM_A] = plugged_cartridge.pcm_roms[0];
+	image.sections[CARTRIDGE_IMAGE_PCM_B] = plugged_cartridge.pcm_roms[1];
+	image.ngh = cartridge_game_ngh();
+	
+	// the image stores the PCM ROMs uncompressed
+	bool expanded = true;
+	for (uint8_t i = 0; i < 2 && pcm_roms_in_blocks; i++) {
+		rom_region_t *section = &image.sections[CARTRIDGE_IMAGE_PCM_A + i];
+		if (pcm_blocks[i].data != NULL) {
+			section->data = malloc(section->size);
+			expanded = expanded && section->data != NULL;
+			if (section->data != NULL) {
+				pcm_blocks_expand(&pcm_blocks[i], section->data);
+			}
 		}
-		if (plugged_cartridge.s_roms[i].data != NULL) {
-			mz_free(plugged_cartridge.s_roms[i].data);
-			plugged_cartridge.s_roms[i].size = 0;
+	}
+	bool written = expanded && cartridge_image_write(path, &image);
+	if (expanded == false) {
+		LOG(LOG_ERROR, "cartridge_write_image: can't expand the PCM ROMs\n");
+	}
+	for (uint8_t i = 0; i < 2 && pcm_roms_in_blocks; i++) {
+		if (pcm_blocks[i].data != NULL) {
+			free(image.sections[CARTRIDGE_IMAGE_PCM_A + i].data);
 		}
 	}
-	
-	memset(p_rom_bank1.data, 0, ROM_BANK1_SIZE);
-	memset(p_rom_bank2.data, 0, ROM_BANK1_SIZE);
+	return written;
+}
 
-	for (uint8_t i = 0; i < 8; i++) {
-		if (plugged_cartridge.c_roms[i].data != NULL) {
-			mz_free(plugged_cartridge.c_roms[i].data);
-			plugged_cartridge.c_roms[i].size = 0;
-		}
+void cartridge_unload(void) {
+	cartridge_wait_background_loading();
+	p_rom_bank1.data = empty_p_rom_bank;
+	p_rom_bank2.data = empty_p_rom_bank;
+	if (mapped_image.mapping != NULL) {
+		// nothing to free, ROMs live in the image
+		cartridge_image_unmap(&mapped_image);
+		memset(&plugged_cartridge, 0, sizeof(cartridge_t));
+		serialized_c_roms.data = NULL;
 	}
+	free(plugged_cartridge.p_rom.data);
+	plugged_cartridge.p_rom.data = NULL;
+	plugged_cartridge.p_rom.size = 0;
+	plugged_cartridge.p1_size = 0;
+	plugged_cartridge.p2_size = 0;
+	
+	for (uint8_t i = 0; i < 2; i++) {
+		free(plugged_cartridge.s_roms[i].data);
+		plugged_cartridge.s_roms[i].data = NULL;
+		plugged_cartridge.s_roms[i].size = 0;
+		
+		free(plugged_cartridge.pcm_roms[i].data);
+		plugged_cartridge.pcm_roms[i].data = NULL;
+		plugged_cartridge.pcm_roms[i].size = 0;
+	}
+	cartridge_log_pcm_blocks_stats();
+	for (uint8_t i = 0; i < 2; i++) {
+		pcm_blocks_release(&pcm_blocks[i]);
+	}
+	pcm_roms_in_blocks = false;
+	memset(plugged_cartridge.v1_roms, 0, sizeof(plugged_cartridge.v1_roms));
+	memset(plugged_cartridge.v2_roms, 0, sizeof(plugged_cartridge.v2_roms));
+	
+	free(plugged_cartridge.m1_rom.data);
+	plugged_cartridge.m1_rom.data = NULL;
+	plugged_cartridge.m1_rom.size = 0;
+	m1_rom.data = NULL;
+	m1_rom.size = 0;
+	m1_rom.end_address = 0;
+	
+	cartridge_release_c_roms();
+	plugged_cartridge.sprite_tiles_count = 0;
+	
+	tile_cache_log_stats();
+	tile_cache_release();
 	
 	free(serialized_c_roms.data);
+	serialized_c_roms.data = NULL;
+	serialized_c_roms.size = 0;
 }
 
 bool cartridge_plugged_in() {
-	return plugged_cartridge.c_roms[0].data != NULL;
+	return plugged_cartridge.sprite_tiles_count > 0;
 }
 
 rom_region_t * cartridge_get_first_fix_rom() {
 	return &plugged_cartridge.s_roms[0];
 }
 
-rom_region_t cartridge_create_pcm_rom(int index) {
-	rom_region_t *source = plugged_cartridge.v1_roms;
-	if (index > 0) {
-		source = plugged_cartridge.v2_roms;
+rom_region_t * cartridge_get_pcm_rom(int index) {
+	return &plugged_cartridge.pcm_roms[index > 0 ? 1 : 0];
+}
+
+uint32_t cartridge_get_pcm_rom_crc(int index) {
+	cartridge_require_pcm_roms();
+	index = index > 0 ? 1 : 0;
+	if (pcm_blocks[index].data != NULL) {
+		return pcm_blocks[index].crc;
 	}
-	rom_region_t result;
-	result.data = NULL;
-	result.size = 0;
-	for (int i = 0; i < 4; i++) {
-		if (source[i].data != NULL) {
-			result.size += source[i].size;
-		}
+	rom_region_t *pcm_rom = &plugged_cartridge.pcm_roms[index];
+	if (pcm_rom->data == NULL || pcm_rom->size == 0) {
+		return 0;
 	}
-	if (result.size > 0) {
-		result.data = malloc(result.size);
-		size_t offset = 0;
-		for (int i = 0; i < 4; i++) {
-			if (source[i].data != NULL) {
-				memcpy(result.data + offset, source[i].data, source[i].size);
-				offset += source[i].size;
-			}
+	return (uint32_t)mz_crc32(MZ_CRC32_INIT, pcm_rom->data, pcm_rom->size);
+}
+
+#pragma mark PCM blocks
+
+void cartridge_set_pcm_compression(bool enabled) {
+	pcm_compression = enabled;
+}
+
+bool cartridge_pcm_roms_compressed() {
+	return pcm_roms_in_blocks;
+}
+
+const uint8_t *cartridge_read_pcm_block(int index, uint32_t block) {
+	cartridge_require_pcm_roms();
+	index = index > 0 ? 1 : 0;
+	if (pcm_blocks[index].data != NULL) {
+		return pcm_blocks_read(&pcm_blocks[index], block);
+	}
+	// the ROM couldn't be compressed and is still flat
+	rom_region_t *pcm_rom = &plugged_cartridge.pcm_roms[index];
+	size_t start = (size_t)block << PCM_BLOCK_SHIFT;
+	if (pcm_rom->data == NULL || start >= pcm_rom->size) {
+		static const uint8_t zeros[PCM_BLOCK_SIZE];
+		return zeros;
+	}
+	return pcm_rom->data + start;
+}
+
+void cartridge_log_pcm_blocks_stats() {
+	if (pcm_roms_in_blocks == false) {
+		return;
+	}
+	for (uint8_t i = 0; i < 2; i++) {
+		pcm_blocks_stats_t stats = pcm_blocks_get_stats(&pcm_blocks[i]);
+		if (stats.size == 0) {
+			continue;
 		}
+		LOG(LOG_INFO, "cartridge: PCM %c %zu KB in %zu KB, %zu KB saved - %llu fetches, %llu misses (%.2f%% miss rate), %llu prefetches, %llu used\n",
+			i ? 'B' : 'A', stats.size / 1024, stats.stored_size / 1024, stats.size > stats.stored_size ? (stats.size - stats.stored_size) / 1024 : 0,
+			(unsigned long long)stats.fetches, (unsigned long long)stats.misses, stats.fetches ? (100.0 * stats.misses) / stats.fetches : 0.0,
+			(unsigned long long)stats.prefetches, (unsigned long long)stats.prefetch_hits);
 	}
-	return result;
+}
+
+#pragma mark Background loading
+
+void cartridge_wait_sprites() {
+	uint64_t stall_usec = cartridge_wait_loaded(&cartridge_sprites_loaded);
+	pthread_mutex_lock(&loading_mutex);
+	loading_stats.sprites_stalls++;
+	loading_stats.sprites_stall_usec += stall_usec;
+	pthread_mutex_unlock(&loading_mutex);
+	LOG(LOG_INFO, "cartridge: emulation stalled %.1f ms waiting for sprites\n", stall_usec / 1000.0);
+}
+
+void cartridge_wait_pcm_roms() {
+	uint64_t stall_usec = cartridge_wait_loaded(&cartridge_pcm_roms_loaded);
+	pthread_mutex_lock(&loading_mutex);
+	loading_stats.pcm_stalls++;
+	loading_stats.pcm_stall_usec += stall_usec;
+	pthread_mutex_unlock(&loading_mutex);
+	LOG(LOG_INFO, "cartridge: emulation stalled %.1f ms waiting for PCM ROMs\n", stall_usec / 1000.0);
+}
+
+// background_usec is written by the last worker, the stats are only accessed under loading_mutex
+cartridge_loading_stats_t cartridge_get_loading_stats() {
+	pthread_mutex_lock(&loading_mutex);
+	cartridge_loading_stats_t stats = loading_stats;
+	pthread_mutex_unlock(&loading_mutex);
+	return stats;
+}
+
+#pragma mark Sprites tiles
+
+void cartridge_set_sprites_memory_budget(size_t bytes) {
+	sprites_memory_budget = bytes;
 }
 
 #pragma mark - Private
@@ -348,8 +527,7 @@ static uint32_t cartridge_p_rom_read_dword(uint32_t offset) {
 }
 
 static void init_cartridge_p_rom() {
-	p_rom_bank1.data = malloc(ROM_BANK1_SIZE);
-	memset(p_rom_bank1.data, 0, ROM_BANK1_SIZE);
+	p_rom_bank1.data = empty_p_rom_bank;
 	p_rom_bank1.start_address = ROM_BANK1_START;
 	p_rom_bank1.end_address = ROM_BANK1_END;
 	p_rom_bank1.size = ROM_BANK1_SIZE;
@@ -381,11 +559,19 @@ static void cartridge_p_rom2_write_byte(uint32_t offset, uint8_t data) {
 		case 0:
 		case 1:
 		case 2:
-		case 3:
+		case 3: {
 			LOG(LOG_DEBUG, "cartridge_p_rom2_write_byte bank switch #%u\n", data);
-			memset(p_rom_bank2.data, 0, ROM_BANK1_SIZE);
-			memcpy(p_rom_bank2.data, plugged_cartridge.p_roms[data+1].data, plugged_cartridge.p_roms[data+1].size);
+			frame_counters.p_rom_bank_switches++;
+			// banks follow the fixed 1MB of the P ROM image
+			size_t bank_offset = ROM_BANK1_SIZE * ((size_t)data + 1);
+			if (bank_offset + ROM_BANK1_SIZE <= plugged_cartridge.p_rom.size) {
+				p_rom_bank2.data = plugged_cartridge.p_rom.data + bank_offset;
+			}
+			else {
+				p_rom_bank2.data = empty_p_rom_bank;
+			}
 			break;
+		}
 		default:
 			LOG(LOG_DEBUG, "cartridge_p_rom2_write_byte unknown bank switch\n");
 			break;
@@ -403,8 +589,7 @@ static void cartridge_p_rom2_write_dword(uint32_t offset, uint32_t data) {
 }
 
 static void init_cartridge_p_rom2() {
-	p_rom_bank2.data = malloc(ROM_BANK1_SIZE);
-	memset(p_rom_bank2.data, 0, ROM_BANK1_SIZE);
+	p_rom_bank2.data = empty_p_rom_bank;
 	p_rom_bank2.start_address = ROM_BANK2_START;
 	p_rom_bank2.end_address = ROM_BANK2_END;
 	p_rom_bank2.size = ROM_BANK1_SIZE;
@@ -458,8 +643,21 @@ static uint16_t cartridge_game_ngh() {
 	return ngh;
 }
 
+// Point the CPUs memory regions to the plugged ROMs
+static void cartridge_finalize_load() {
+	p_rom_bank1.data = plugged_cartridge.p_rom.data;
+	p_rom_bank2.data = plugged_cartridge.p_rom.data + ROM_BANK1_SIZE;
+	
+	m1_rom.data = plugged_cartridge.m1_rom.data;
+	m1_rom.size = plugged_cartridge.m1_rom.size;
+	m1_rom.end_address = (uint32_t)m1_rom.size - 1;
+	
+	uint16_t ngh = cartridge_game_ngh();
+	LOG(LOG_INFO, "Cartridge NGH: %04d\n", ngh);
+}
+
 static bool cartridge_p_rom_check() {
-	char *p = (char *)plugged_cartridge.p_roms[0].data;
+	char *p = (char *)plugged_cartridge.p_rom.data;
 	if (p == NULL) {
 		return false;
 	}
@@ -475,6 +673,402 @@ static bool cartridge_p_rom_check() {
 	return true;
 }
 
+static cartridge_rom_kind_t cartridge_rom_kind_for_name(const char *file_name, uint8_t *index) {
+	char element[5];
+	
+	//P_ROM
+	for (uint8_t i = 1; i <= 2; i++) {
+		sprintf(element, "p%d.", i);
+		if (strcasestr(file_name, element) != NULL) {
+			*index = i - 1;
+			return CARTRIDGE_ROM_P;
+		}
+	}
+	
+	//S_ROM
+	for (uint8_t i = 1; i <= 2; i++) {
+		sprintf(element, "s%d.", i);
+		if (strcasestr(file_name, element) != NULL) {
+			*index = i - 1;
+			return CARTRIDGE_ROM_S;
+		}
+	}
+	
+	//C_ROM
+	for (uint8_t i = 1; i <= 8; i++) {
+		sprintf(element, "c%d.", i);
+		if (strcasestr(file_name, element) != NULL) {
+			*index = i - 1;
+			return CARTRIDGE_ROM_C;
+		}
+	}
+	
+	// M ROM
+	if (strcasestr(file_name, "m1.") != NULL) {
+		*index = 0;
+		return CARTRIDGE_ROM_M;
+	}
+	
+	//V1_ROM
+	if (strcasestr(file_name, "v1.") != NULL) {
+		*index = 0;
+		return CARTRIDGE_ROM_V1;
+	}
+	for (uint8_t i = 1; i <= 4; i++) {
+		sprintf(element, "v1%d.", i);
+		if (strcasestr(file_name, element) != NULL) {
+			*index = i - 1;
+			return CARTRIDGE_ROM_V1;
+		}
+	}
+	
+	//V2_ROM
+	if (strcasestr(file_name, "v2.") != NULL) {
+		*index = 0;
+		return CARTRIDGE_ROM_V2;
+	}
+	for (uint8_t i = 1; i <= 4; i++) {
+		sprintf(element, "v2%d.", i);
+		if (strcasestr(file_name, element) != NULL) {
+			*index = i - 1;
+			return CARTRIDGE_ROM_V2;
+		}
+	}
+	
+	return CARTRIDGE_ROM_UNUSED;
+}
+
+static bool cartridge_allocate_pcm_rom(rom_region_t *roms, rom_region_t *pcm_rom) {
+	pcm_rom->size = 0;
+	for (uint8_t i = 0; i < 4; i++) {
+		pcm_rom->size += roms[i].size;
+	}
+	if (pcm_rom->size == 0) {
+		pcm_rom->data = NULL;
+		return true;
+	}
+	pcm_rom->data = malloc(pcm_rom->size);
+	if (pcm_rom->data == NULL) {
+		return false;
+	}
+	size_t offset = 0;
+	for (uint8_t i = 0; i < 4; i++) {
+		if (roms[i].size > 0) {
+			roms[i].data = pcm_rom->data + offset;
+			offset += roms[i].size;
+		}
+	}
+	return true;
+}
+
+/*
+ *	Size every ROM region from the archive entries then allocate them,
+ *	so each entry can be inflated directly at its final place
+ */
+static bool cartridge_allocate_roms(cartridge_rom_entry_t *entries, size_t entries_count) {
+	for (size_t i = 0; i < entries_count; i++) {
+		cartridge_rom_entry_t *entry = &entries[i];
+		switch (entry->kind) {
+			case CARTRIDGE_ROM_P:
+				if (entry->index == 0) {
+					plugged_cartridge.p1_size = entry->size;
+				}
+				else {
+					plugged_cartridge.p2_size = entry->size;
+				}
+				break;
+			case CARTRIDGE_ROM_S:
+				plugged_cartridge.s_roms[entry->index].size = entry->size;
+				break;
+			case CARTRIDGE_ROM_C:
+				plugged_cartridge.c_roms[entry->index].size = entry->size;
+				break;
+			case CARTRIDGE_ROM_M:
+				plugged_cartridge.m1_rom.size = entry->size;
+				break;
+			case CARTRIDGE_ROM_V1:
+				plugged_cartridge.v1_roms[entry->index].size = entry->size;
+				break;
+			case CARTRIDGE_ROM_V2:
+				plugged_cartridge.v2_roms[entry->index].size = entry->size;
+				break;
+			default:
+				break;
+		}
+	}
+	
+	if (plugged_cartridge.p1_size == 0
+		|| plugged_cartridge.s_roms[0].size == 0
+		|| plugged_cartridge.c_roms[0].size == 0
+		|| plugged_cartridge.c_roms[1].size == 0) {
+		LOG(LOG_DEBUG, "cartridge_load_roms: seems that minimum roms are not found\n");
+		return false;
+	}
+	
+	// P ROM image: fixed 1MB bank then switchable banks
+	// a 2MB P1 holds the fixed bank in its second half (MAME layout), and the first half becomes the first switchable bank
+	if (plugged_cartridge.p1_size > ROM_BANK1_SIZE && plugged_cartridge.p1_size != 2 * ROM_BANK1_SIZE) {
+		LOG(LOG_ERROR, "cartridge_load_roms: unsupported P1 ROM size %zu\n", plugged_cartridge.p1_size);
+		return false;
+	}
+	size_t banks_size = plugged_cartridge.p1_size - (plugged_cartridge.p1_size > ROM_BANK1_SIZE ? ROM_BANK1_SIZE : plugged_cartridge.p1_size);
+	size_t p2_offset = ROM_BANK1_SIZE + banks_size;
+	banks_size += plugged_cartridge.p2_size;
+	banks_size = (banks_size + ROM_BANK1_SIZE - 1) & ~((size_t)ROM_BANK1_SIZE - 1);
+	if (banks_size == 0) {
+		banks_size = ROM_BANK1_SIZE;
+	}
+	plugged_cartridge.p_rom.size = ROM_BANK1_SIZE + banks_size;
+	plugged_cartridge.p_rom.data = calloc(1, plugged_cartridge.p_rom.size);
+	
+	// S and M ROMs
+	for (uint8_t i = 0; i < 2; i++) {
+		if (plugged_cartridge.s_roms[i].size > 0) {
+			plugged_cartridge.s_roms[i].data = malloc(plugged_cartridge.s_roms[i].size);
+			if (plugged_cartridge.s_roms[i].data == NULL) {
+				return false;
+			}
+		}
+	}
+	if (plugged_cartridge.m1_rom.size > 0) {
+		plugged_cartridge.m1_rom.data = malloc(plugged_cartridge.m1_rom.size);
+	}
+	
+	// C ROMs, one allocation per pair
+	for (uint8_t pair = 0; pair < 4; pair++) {
+		rom_region_t *odd_rom = &plugged_cartridge.c_roms[pair * 2];
+		rom_region_t *even_rom = &plugged_cartridge.c_roms[pair * 2 + 1];
+		size_t pair_size = odd_rom->size + even_rom->size;
+		if (pair_size == 0) {
+			continue;
+		}
+		uint8_t *pair_data = malloc(pair_size);
+		if (pair_data == NULL) {
+			LOG(LOG_ERROR, "cartridge_load_roms: can't allocate %zu MB for C ROMs pair %u\n", pair_size / (1024*1024), pair + 1);
+			return false;
+		}
+		odd_rom->data = pair_data;
+		even_rom->data = pair_data + odd_rom->size;
+		if (odd_rom->size == 0) {
+			// keep ownership on the odd ROM
+			odd_rom->data = pair_data;
+			even_rom->data = pair_data;
+		}
+	}
+	
+	// PCM ROMs
+	if (cartridge_allocate_pcm_rom(plugged_cartridge.v1_roms, &plugged_cartridge.pcm_roms[0]) == false
+		|| cartridge_allocate_pcm_rom(plugged_cartridge.v2_roms, &plugged_cartridge.pcm_roms[1]) == false) {
+		LOG(LOG_ERROR, "cartridge_load_roms: can't allocate PCM ROMs\n");
+		return false;
+	}
+	
+	if (plugged_cartridge.p_rom.data == NULL
+		|| (plugged_cartridge.m1_rom.size > 0 && plugged_cartridge.m1_rom.data == NULL)) {
+		LOG(LOG_ERROR, "cartridge_load_roms: can't allocate program ROMs\n");
+		return false;
+	}
+	
+	for (size_t i = 0; i < entries_count; i++) {
+		cartridge_rom_entry_t *entry = &entries[i];
+		switch (entry->kind) {
+			case CARTRIDGE_ROM_P:
+				entry->destination = plugged_cartridge.p_rom.data + (entry->index == 0 ? 0 : p2_offset);
+				break;
+			case CARTRIDGE_ROM_S:
+				entry->destination = plugged_cartridge.s_roms[entry->index].data;
+				break;
+			case CARTRIDGE_ROM_C:
+				entry->destination = plugged_cartridge.c_roms[entry->index].data;
+				break;
+			case CARTRIDGE_ROM_M:
+				entry->destination = plugged_cartridge.m1_rom.data;
+				break;
+			case CARTRIDGE_ROM_V1:
+				entry->destination = plugged_cartridge.v1_roms[entry->index].data;
+				break;
+			case CARTRIDGE_ROM_V2:
+				entry->destination = plugged_cartridge.v2_roms[entry->index].data;
+				break;
+			default:
+				break;
+		}
+	}
+	
+	return true;
+}
+
+static bool cartridge_rom_needed_at_boot(cartridge_rom_kind_t kind) {
+	return kind == CARTRIDGE_ROM_P || kind == CARTRIDGE_ROM_S || kind == CARTRIDGE_ROM_M;
+}
+
+// Boot ROMs first, then biggest files first
+static int cartridge_rom_entry_compare_order(const void *a, const void *b) {
+	const cartridge_rom_entry_t *entry_a = a;
+	const cartridge_rom_entry_t *entry_b = b;
+	bool boot_a = cartridge_rom_needed_at_boot(entry_a->kind);
+	bool boot_b = cartridge_rom_needed_at_boot(entry_b->kind);
+	if (boot_a != boot_b) {
+		return boot_a ? -1 : 1;
+	}
+	if (entry_a->size == entry_b->size) {
+		return 0;
+	}
+	return entry_a->size > entry_b->size ? -1 : 1;
+}
+
+// Called from the zip workers
+static void cartridge_rom_entry_inflated(zip_workers_job_t *job) {
+	cartridge_rom_entry_t *entry = job->context;
+	switch (entry->kind) {
+		case CARTRIDGE_ROM_P:
+			if (atomic_fetch_sub(&p_rom_pending_entries, 1) == 1) {
+				cartridge_convert_p_rom();
+			}
+			break;
+		case CARTRIDGE_ROM_S:
+			video_convert_fix_rom(entry->destination, entry->size);
+			break;
+		case CARTRIDGE_ROM_C: {
+			uint8_t pair = entry->index / 2;
+			if (atomic_fetch_sub(&c_rom_pair_pending_entries[pair], 1) != 1) {
+				break;
+			}
+			if (tile_cache_enabled == false) {
+				cartridge_serialize_c_rom_pair(pair);
+				cartridge_release_c_rom_pair(pair);
+			}
+			if (atomic_fetch_sub(&c_rom_pending_pairs, 1) == 1) {
+				cartridge_set_loaded(&cartridge_sprites_loaded);
+			}
+			break;
+		}
+		case CARTRIDGE_ROM_V1:
+		case CARTRIDGE_ROM_V2:
+			if (atomic_fetch_sub(&pcm_rom_pending_entries, 1) == 1) {
+				cartridge_compress_pcm_roms();
+				cartridge_set_loaded(&cartridge_pcm_roms_loaded);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+#pragma mark Background loading
+
+static void cartridge_background_loading_finished(bool success, void *context) {
+	uint64_t background_usec = monotonic_time_usec() - background_start;
+	pthread_mutex_lock(&loading_mutex);
+	loading_stats.background_usec = background_usec;
+	pthread_mutex_unlock(&loading_mutex);
+#ifdef NEOGEO_PROFILE
+	// wall time of the workers, the emulation keeps running meanwhile
+	profile_add(PROFILE_ROM_LOAD, background_usec * 1000);
+#endif
+	if (success) {
+		LOG(LOG_INFO, "cartridge_load_roms: sprites and PCM ROMs loaded in background in %.1f ms - peak RSS %zu MB\n",
+			background_usec / 1000.0, peak_resident_memory_size() / (1024*1024));
+		return;
+	}
+	
+	// Every worker is done, blank whatever could not be inflated
+	LOG(LOG_ERROR, "cartridge_load_roms: can't extract sprites or PCM ROMs from %s\n", background_path != NULL ? background_path : "the game");
+	if (atomic_load(&cartridge_sprites_loaded) == false) {
+		if (serialized_c_roms.data != NULL) {
+			memset(serialized_c_roms.data, 0, serialized_c_roms.size);
+		}
+		for (uint8_t pair = 0; pair < 4; pair++) {
+			if (plugged_cartridge.c_roms[pair * 2].data != NULL) {
+				memset(plugged_cartridge.c_roms[pair * 2].data, 0, plugged_cartridge.c_roms[pair * 2].size + plugged_cartridge.c_roms[pair * 2 + 1].size);
+			}
+		}
+		cartridge_set_loaded(&cartridge_sprites_loaded);
+	}
+	if (atomic_load(&cartridge_pcm_roms_loaded) == false) {
+		for (uint8_t i = 0; i < 2; i++) {
+			if (plugged_cartridge.pcm_roms[i].data != NULL) {
+				memset(plugged_cartridge.pcm_roms[i].data, 0, plugged_cartridge.pcm_roms[i].size);
+			}
+		}
+		cartridge_compress_pcm_roms();
+		cartridge_set_loaded(&cartridge_pcm_roms_loaded);
+	}
+}
+
+// Runs on the worker done with the last PCM ROM, before the emulation can read them
+static void cartridge_compress_pcm_roms() {
+	if (pcm_roms_in_blocks == false) {
+		return;
+	}
+	uint64_t start = monotonic_time_usec();
+	size_t stored_size = 0;
+	for (uint8_t i = 0; i < 2; i++) {
+		rom_region_t *pcm_rom = &plugged_cartridge.pcm_roms[i];
+		if (pcm_blocks_compress(&pcm_blocks[i], pcm_rom->data, pcm_rom->size) == false) {
+			// keep reading this ROM flat
+			continue;
+		}
+		stored_size += pcm_blocks_get_stats(&pcm_blocks[i]).stored_size;
+		// the size stays, it is the size of the uncompressed ROM
+		free(pcm_rom->data);
+		pcm_rom->data = NULL;
+	}
+	// the V ROMs pointed into the freed PCM ROMs
+	memset(plugged_cartridge.v1_roms, 0, sizeof(plugged_cartridge.v1_roms));
+	memset(plugged_cartridge.v2_roms, 0, sizeof(plugged_cartridge.v2_roms));
+	LOG(LOG_INFO, "cartridge: PCM ROMs compressed from %zu KB to %zu KB in %.1f ms\n",
+		(plugged_cartridge.pcm_roms[0].size + plugged_cartridge.pcm_roms[1].size) / 1024, stored_size / 1024, (monotonic_time_usec() - start) / 1000.0);
+}
+
+static void cartridge_wait_background_loading() {
+	if (background_workers != NULL) {
+		zip_workers_wait(background_workers);
+		background_workers = NULL;
+	}
+	free(background_path);
+	background_path = NULL;
+	atomic_store(&cartridge_sprites_loaded, true);
+	atomic_store(&cartridge_pcm_roms_loaded, true);
+}
+
+static void cartridge_set_loaded(atomic_bool *loaded) {
+	pthread_mutex_lock(&loading_mutex);
+	atomic_store_explicit(loaded, true, memory_order_release);
+	pthread_cond_broadcast(&loading_condition);
+	pthread_mutex_unlock(&loading_mutex);
+}
+
+// Blocks the emulation until the background workers are done with the data, returns the stall duration
+static uint64_t cartridge_wait_loaded(atomic_bool *loaded) {
+	uint64_t stall_start = monotonic_time_usec();
+	pthread_mutex_lock(&loading_mutex);
+	while (atomic_load_explicit(loaded, memory_order_acquire) == false) {
+		pthread_cond_wait(&loading_condition, &loading_mutex);
+	}
+	pthread_mutex_unlock(&loading_mutex);
+	return monotonic_time_usec() - stall_start;
+}
+
+#pragma mark P ROM conversion
+
+static void cartridge_convert_p_rom() {
+	uint8_t *p_rom = plugged_cartridge.p_rom.data;
+	if (plugged_cartridge.p1_size == 2 * ROM_BANK1_SIZE) {
+		// why MAME, why???
+		uint64_t *low = (uint64_t *)p_rom;
+		uint64_t *high = (uint64_t *)(p_rom + ROM_BANK1_SIZE);
+		for (size_t i = 0; i < ROM_BANK1_SIZE / sizeof(uint64_t); i++) {
+			uint64_t tmp = low[i];
+			low[i] = high[i];
+			high[i] = tmp;
+		}
+	}
+	
+	// P1 header tells if the whole image needs swapping
+	byte_swap_p_rom_if_needed(p_rom, plugged_cartridge.p_rom.size);
+}
+
 /*
  *	Prepare all sprites to be easily displayed on framebuffer
  *	Unit data will be half byte pixel color index
@@ -483,86 +1077,140 @@ static bool cartridge_p_rom_check() {
 
 static const uint8_t ROM_TILE_BLOCK_BYTES = 16;		// 16 bytes per block per rom ( x 4 blocks x 2 ROMs = 128 bytes per tile)
 
-static void cartridge_serialize_c_rom() {
-	size_t characters_ram_size = 0;
-	uint8_t rom_pairs_count = 0;
-	for (uint8_t i = 0; i < 8; i++) {
-		if (plugged_cartridge.c_roms[i].data != NULL) {
-			characters_ram_size += plugged_cartridge.c_roms[i].size;
-			rom_pairs_count++;
+static void decode_c_rom_tile(const uint8_t *odd_tile_base, const uint8_t *even_tile_base, uint8_t *serialized_data_p) {
+	uint8_t left_block = 3;
+	uint8_t right_block = 1;
+	for (uint8_t vertical_block_pass = 0; vertical_block_pass < 2; ++vertical_block_pass) {
+		// blocks 3/1 then 4/2
+		left_block += vertical_block_pass;
+		right_block += vertical_block_pass;
+		for (uint8_t scanline = 0; scanline < 8; scanline++) {
+			// 8 scanlines per block
+			for (uint8_t horizontal_block_pass = 0; horizontal_block_pass < 2; ++horizontal_block_pass) {
+				// draw left then right block
+				uint8_t block_index = horizontal_block_pass == 0 ? left_block - 1 : right_block - 1;
+				
+				const uint8_t *odd_left_block_base = odd_tile_base + (block_index * ROM_TILE_BLOCK_BYTES) + (scanline * 2);
+				const uint8_t *even_left_block_base = even_tile_base + (block_index * ROM_TILE_BLOCK_BYTES) + (scanline * 2);
+				
+				uint8_t plane_0 = odd_left_block_base[0];
+				uint8_t plane_1 = odd_left_block_base[1];
+				uint8_t plane_2 = even_left_block_base[0];
+				uint8_t plane_3 = even_left_block_base[1];
+				
+				for (uint8_t row = 0; row < 8; row++) {
+					uint8_t pixel_color_index = 0;
+					pixel_color_index |= (plane_0 >> row) & 0x01;
+					pixel_color_index |= ((plane_1 >> row) & 0x01) << 1;
+					pixel_color_index |= ((plane_2 >> row) & 0x01) << 2;
+					pixel_color_index |= ((plane_3 >> row) & 0x01) << 3;
+					if (row & 1) {
+						*serialized_data_p |= pixel_color_index << 4;
+						++serialized_data_p;
+					}
+					else {
+						*serialized_data_p = pixel_color_index;
+					}
+				}
+			}
 		}
 	}
-	
-	rom_pairs_count /= 2;
-	
-	if (serialized_c_roms.data != NULL) {
-		free(serialized_c_roms.data);
+}
+
+void cartridge_decode_sprite_tile(uint32_t tile_index, uint8_t *destination) {
+	uint8_t pair = 0;
+	while (tile_index >= plugged_cartridge.c_rom_pair_tiles[pair]) {
+		tile_index -= plugged_cartridge.c_rom_pair_tiles[pair];
+		pair++;
+		if (pair == 4) {
+			memset(destination, 0, CHARACTER_TILE_BYTES);
+			return;
+		}
 	}
 	
-	serialized_c_roms.data = malloc(characters_ram_size);
-	serialized_c_roms.size = characters_ram_size;
-	LOG(LOG_DEBUG, "cartridge_serialize_c_rom allocating %lld MB at %p\n", characters_ram_size / (1024*1024), serialized_c_roms.data);
-	
-	uint8_t *serialized_data_p = serialized_c_roms.data;
-	
-	for (uint8_t pair = 0; pair < rom_pairs_count; ++pair) {
-		LOG(LOG_DEBUG, "cartridge_serialize_c_rom serializing C ROM pair %u - %u\n", pair * 2 + 1, pair * 2 + 2);
-		uint8_t *odd_data = plugged_cartridge.c_roms[pair * 2].data;
-		uint8_t *even_data = plugged_cartridge.c_roms[pair * 2 + 1].data;
-		
-		size_t roms_size = plugged_cartridge.c_roms[pair * 2].size;
-		if (roms_size != plugged_cartridge.c_roms[pair * 2 + 1].size) {
-			LOG(LOG_ERROR, "cartridge_serialize_c_rom %d and %d C ROMS are not even\n",  pair * 2 + 1, pair * 2 + 2);
+	size_t tile_offset = (size_t)tile_index * CHARACTER_TILE_BYTES/2;
+	decode_c_rom_tile(plugged_cartridge.c_roms[pair * 2].data + tile_offset,
+					  plugged_cartridge.c_roms[pair * 2 + 1].data + tile_offset,
+					  destination);
+}
+
+void cartridge_serialize_c_rom(const uint8_t *odd_data, const uint8_t *even_data, uint32_t tiles_count, uint8_t *destination) {
+	for (uint32_t tile_index = 0; tile_index < tiles_count; ++tile_index) {
+		size_t tile_offset = (size_t)tile_index * CHARACTER_TILE_BYTES/2;
+		decode_c_rom_tile(odd_data + tile_offset, even_data + tile_offset, destination);
+		destination += CHARACTER_TILE_BYTES;
+	}
+}
+
+static void cartridge_count_sprite_tiles() {
+	plugged_cartridge.sprite_tiles_count = 0;
+	for (uint8_t pair = 0; pair < 4; ++pair) {
+		rom_region_t *odd_rom = &plugged_cartridge.c_roms[pair * 2];
+		rom_region_t *even_rom = &plugged_cartridge.c_roms[pair * 2 + 1];
+		plugged_cartridge.c_rom_pair_tiles[pair] = 0;
+		if (odd_rom->data == NULL || even_rom->data == NULL) {
+			continue;
 		}
 		
-		size_t tiles_to_serialize = roms_size * 2 / CHARACTER_TILE_BYTES;
-		LOG(LOG_DEBUG, "cartridge_serialize_c_rom will serializing %u tiles\n", tiles_to_serialize);
-		
-		for (size_t tile_index = 0; tile_index < tiles_to_serialize; ++tile_index) {
-			uint8_t *odd_tile_base = odd_data + (tile_index * CHARACTER_TILE_BYTES/2);
-			uint8_t *even_tile_base = even_data + (tile_index * CHARACTER_TILE_BYTES/2);
-			
-			uint8_t left_block = 3;
-			uint8_t right_block = 1;
-			for (uint8_t vertical_block_pass = 0; vertical_block_pass < 2; ++vertical_block_pass) {
-				// blocks 3/1 then 4/2
-				left_block += vertical_block_pass;
-				right_block += vertical_block_pass;
-				for (uint8_t scanline = 0; scanline < 8; scanline++) {
-					// 8 scanlines per block
-					for (uint8_t horizontal_block_pass = 0; horizontal_block_pass < 2; ++horizontal_block_pass) {
-						// draw left then right block
-						uint8_t block_index = horizontal_block_pass == 0 ? left_block - 1 : right_block - 1;
-						
-						uint8_t *odd_left_block_base = odd_tile_base + (block_index * ROM_TILE_BLOCK_BYTES) + (scanline * 2);
-						uint8_t *even_left_block_base = even_tile_base + (block_index * ROM_TILE_BLOCK_BYTES) + (scanline * 2);
-						
-						uint8_t plane_0 = odd_left_block_base[0];
-						uint8_t plane_1 = odd_left_block_base[1];
-						uint8_t plane_2 = even_left_block_base[0];
-						uint8_t plane_3 = even_left_block_base[1];
-						
-						for (uint8_t row = 0; row < 8; row++) {
-							uint8_t pixel_color_index = 0;
-							pixel_color_index |= (plane_0 >> row) & 0x01;
-							pixel_color_index |= ((plane_1 >> row) & 0x01) << 1;
-							pixel_color_index |= ((plane_2 >> row) & 0x01) << 2;
-							pixel_color_index |= ((plane_3 >> row) & 0x01) << 3;
-							if (row & 1) {
-								*serialized_data_p |= pixel_color_index << 4;
-								++serialized_data_p;
-							}
-							else {
-								*serialized_data_p |= pixel_color_index;
-							}
-						}
-					}
-				}
+		size_t roms_size = odd_rom->size;
+		if (roms_size != even_rom->size) {
+			LOG(LOG_ERROR, "cartridge_count_sprite_tiles %d and %d C ROMS are not even\n",  pair * 2 + 1, pair * 2 + 2);
+			if (even_rom->size < roms_size) {
+				roms_size = even_rom->size;
 			}
 		}
+		
+		plugged_cartridge.c_rom_pair_tiles[pair] = (uint32_t)(roms_size * 2 / CHARACTER_TILE_BYTES);
+		plugged_cartridge.sprite_tiles_count += plugged_cartridge.c_rom_pair_tiles[pair];
+	}
+	LOG(LOG_DEBUG, "cartridge_count_sprite_tiles %u tiles\n", plugged_cartridge.sprite_tiles_count);
+}
+
+// Choose between serialized sprites and the tile cache, before C ROMs are inflated
+static bool cartridge_allocate_sprites() {
+	cartridge_count_sprite_tiles();
+	size_t sprites_size = (size_t)plugged_cartridge.sprite_tiles_count * CHARACTER_TILE_BYTES;
+	
+	free(serialized_c_roms.data);
+	serialized_c_roms.data = NULL;
+	serialized_c_roms.size = sprites_size;
+	
+	// Serializing needs the raw C ROMs and the serialized sprites at the same time
+	if (sprites_memory_budget == 0 || sprites_size * 2 <= sprites_memory_budget) {
+		serialized_c_roms.data = malloc(sprites_size);
+		LOG(LOG_DEBUG, "cartridge_allocate_sprites allocating %zu MB at %p\n", sprites_size / (1024*1024), serialized_c_roms.data);
+		return serialized_c_roms.data != NULL;
 	}
 	
-	uint64_t bytes = serialized_data_p - serialized_c_roms.data + 1;
-	uint64_t tiles_count = bytes / CHARACTER_TILE_BYTES;
-	LOG(LOG_DEBUG, "cartridge_serialize_c_rom parsed %u tiles\n", tiles_count);
+	LOG(LOG_INFO, "cartridge_load_roms: %zu MB of sprites exceed the memory budget, decoding tiles on demand\n", sprites_size / (1024*1024));
+	return tile_cache_init(TILE_CACHE_SIZE);
+}
+
+static void cartridge_serialize_c_rom_pair(uint8_t pair) {
+	uint32_t first_tile = 0;
+	for (uint8_t i = 0; i < pair; i++) {
+		first_tile += plugged_cartridge.c_rom_pair_tiles[i];
+	}
+	
+	const uint8_t *odd_data = plugged_cartridge.c_roms[pair * 2].data;
+	const uint8_t *even_data = plugged_cartridge.c_roms[pair * 2 + 1].data;
+	uint8_t *serialized_data_p = serialized_c_roms.data + ((size_t)first_tile * CHARACTER_TILE_BYTES);
+	cartridge_serialize_c_rom(odd_data, even_data, plugged_cartridge.c_rom_pair_tiles[pair], serialized_data_p);
+	
+	LOG(LOG_DEBUG, "cartridge_serialize_c_rom_pair serialized C ROM pair %u - %u: %u tiles\n", pair * 2 + 1, pair * 2 + 2, plugged_cartridge.c_rom_pair_tiles[pair]);
+}
+
+static void cartridge_release_c_rom_pair(uint8_t pair) {
+	// odd ROMs own their pair allocation
+	free(plugged_cartridge.c_roms[pair * 2].data);
+	plugged_cartridge.c_roms[pair * 2].data = NULL;
+	plugged_cartridge.c_roms[pair * 2 + 1].data = NULL;
+}
+
+static void cartridge_release_c_roms() {
+	for (uint8_t pair = 0; pair < 4; pair++) {
+		cartridge_release_c_rom_pair(pair);
+		plugged_cartridge.c_roms[pair * 2].size = 0;
+		plugged_cartridge.c_roms[pair * 2 + 1].size = 0;
+	}
 }
@@ -3,6 +3,9 @@
 
 #include "memory_region.h"
 #include "rom_region.h"
+#include "tile_cache.h"
+
+#include <stdatomic.h>
 
 static const uint8_t CHARACTER_TILE_BYTES = 128;
 
@@ -10,15 +13,84 @@ extern memory_region_t p_rom_bank1;		// Init Vector table - https://wiki.neogeod
 										// + program ROM - https://wiki.neogeodev.org/index.php?title=P_ROM
 extern memory_region_t p_rom_bank2;
 extern memory_region_t serialized_c_roms;	// serialized sprites from C ROMs ready for display, half byte per pixel
+											// data is NULL when sprites tiles are decoded on demand in the tile cache
 
 extern memory_region_t m1_rom;	// Music ROM - https://wiki.neogeodev.org/index.php?title=M1_ROM
 
 void cartridge_init(void);
 bool cartridge_load_roms(const char *path);
+// Native cartridge image, see cartridge_image.h
+bool cartridge_load_image(const char *path);
+bool cartridge_write_image(const char *path);
 void cartridge_unload(void);
 bool cartridge_plugged_in(void);
 
 rom_region_t * cartridge_get_first_fix_rom(void);
-rom_region_t cartridge_create_pcm_rom(int index);
+rom_region_t * cartridge_get_pcm_rom(int index);
+// Waits for the PCM ROMs, compressed ones included
+uint32_t cartridge_get_pcm_rom_crc(int index);
+
+#pragma mark - Background loading
+
+/*
+ *	Only P, S and M ROMs are loaded before the BIOS boots, sprites and PCM ROMs are inflated in the background
+ *	The emulation stalls when it needs them before they are loaded
+ */
+
+typedef struct cartridge_loading_stats {
+	uint64_t background_usec;		// sprites and PCM ROMs inflating time
+	uint32_t sprites_stalls;
+	uint64_t sprites_stall_usec;
+	uint32_t pcm_stalls;
+	uint64_t pcm_stall_usec;
+} cartridge_loading_stats_t;
+
+extern atomic_bool cartridge_sprites_loaded;
+extern atomic_bool cartridge_pcm_roms_loaded;
+
+void cartridge_wait_sprites(void);
+void cartridge_wait_pcm_roms(void);
+cartridge_loading_stats_t cartridge_get_loading_stats(void);
+
+static inline void cartridge_require_sprites(void) {
+	if (!atomic_load_explicit(&cartridge_sprites_loaded, memory_order_acquire)) {
+		cartridge_wait_sprites();
+	}
+}
+
+static inline void cartridge_require_pcm_roms(void) {
+	if (!atomic_load_explicit(&cartridge_pcm_roms_loaded, memory_order_acquire)) {
+		cartridge_wait_pcm_roms();
+	}
+}
+
+#pragma mark - PCM blocks
+
+/*
+ *	With compression on, PCM ROMs inflated from a zip are compressed in blocks once loaded (see pcm_blocks.h)
+ *	Their data is then NULL and they are read a block at a time, cartridge images are always read in place
+ */
+
+void cartridge_set_pcm_compression(bool enabled);
+// Known as soon as the cartridge is loaded, before the PCM ROMs are
+bool cartridge_pcm_roms_compressed(void);
+// Waits for the PCM ROMs, the block is valid until the next read of the same ROM
+const uint8_t *cartridge_read_pcm_block(int index, uint32_t block);
+void cartridge_log_pcm_blocks_stats(void);
+
+#pragma mark - Sprites tiles
+
+// 0 means no limit, serialized sprites are always used
+void cartridge_set_sprites_memory_budget(size_t bytes);
+void cartridge_decode_sprite_tile(uint32_t tile_index, uint8_t *destination);
+// Decodes tiles_count tiles of a C ROMs pair, CHARACTER_TILE_BYTES each
+void cartridge_serialize_c_rom(const uint8_t *odd_data, const uint8_t *even_data, uint32_t tiles_count, uint8_t *destination);
+
+static inline const uint8_t *cartridge_sprite_tile(uint32_t tile_index) {
+	if (tile_cache_enabled) {
+		return tile_cache_fetch(tile_index);
+	}
+	return serialized_c_roms.data + (tile_index * CHARACTER_TILE_BYTES);
+}
 
 #endif /* cartridge_h */
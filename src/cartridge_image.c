@@ -0,0 +1,203 @@
+#include "cartridge_image.h"
+#include "endian.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define CARTRIDGE_IMAGE_USE_MMAP 0
+#else
+#define CARTRIDGE_IMAGE_USE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static size_t cartridge_image_align(size_t offset);
+static bool cartridge_image_read_header(const uint8_t *data, size_t size, cartridge_image_t *image);
+#if !CARTRIDGE_IMAGE_USE_MMAP
+static bool cartridge_image_load_file(const char *path, cartridge_image_t *image);
+#endif
+
+#pragma mark - Public
+
+bool cartridge_image_probe(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return false;
+	}
+	char magic[CARTRIDGE_IMAGE_MAGIC_SIZE];
+	bool found = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+		&& memcmp(magic, CARTRIDGE_IMAGE_MAGIC, CARTRIDGE_IMAGE_MAGIC_SIZE) == 0;
+	fclose(file);
+	return found;
+}
+
+bool cartridge_image_write(const char *path, const cartridge_image_t *image) {
+	cartridge_image_header_t header;
+	memset(&header, 0, sizeof(cartridge_image_header_t));
+	memcpy(header.magic, CARTRIDGE_IMAGE_MAGIC, CARTRIDGE_IMAGE_MAGIC_SIZE);
+	header.version = LITTLE_ENDIAN_DWORD(CARTRIDGE_IMAGE_VERSION);
+	header.sections_count = LITTLE_ENDIAN_DWORD(CARTRIDGE_IMAGE_SECTIONS_COUNT);
+	header.ngh = LITTLE_ENDIAN_WORD(image->ngh);
+
+	size_t offset = cartridge_image_align(sizeof(cartridge_image_header_t));
+	for (uint8_t i = 0; i < CARTRIDGE_IMAGE_SECTIONS_COUNT; i++) {
+		size_t size = image->sections[i].size;
+		if (offset + size > UINT32_MAX) {
+			LOG(LOG_ERROR, "cartridge_image_write: ROMs are too big for an image (%zu MB)\n", (offset + size) / (1024*1024));
+			return false;
+		}
+		header.sections[i].offset = LITTLE_ENDIAN_DWORD((uint32_t)(size ? offset : 0));
+		header.sections[i].size = LITTLE_ENDIAN_DWORD((uint32_t)size);
+		offset = cartridge_image_align(offset + size);
+	}
+
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		LOG(LOG_ERROR, "cartridge_image_write: can't create %s\n", path);
+		return false;
+	}
+
+	static const uint8_t padding[CARTRIDGE_IMAGE_ALIGNMENT];
+	bool written = fwrite(&header, sizeof(cartridge_image_header_t), 1, file) == 1;
+	size_t position = sizeof(cartridge_image_header_t);
+	for (uint8_t i = 0; i < CARTRIDGE_IMAGE_SECTIONS_COUNT && written; i++) {
+		size_t size = image->sections[i].size;
+		if (size == 0) {
+			continue;
+		}
+		size_t padding_size = cartridge_image_align(position) - position;
+		written = fwrite(padding, 1, padding_size, file) == padding_size
+			&& fwrite(image->sections[i].data, 1, size, file) == size;
+		position += padding_size + size;
+	}
+
+	if (fclose(file) != 0 || written == false) {
+		LOG(LOG_ERROR, "cartridge_image_write: can't write %s\n", path);
+		remove(path);
+		return false;
+	}
+
+	LOG(LOG_INFO, "cartridge_image_write: %s - %zu MB\n", path, position / (1024*1024));
+	return true;
+}
+
+bool cartridge_image_map(const char *path, cartridge_image_t *image) {
+	memset(image, 0, sizeof(cartridge_image_t));
+
+#if CARTRIDGE_IMAGE_USE_MMAP
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		LOG(LOG_ERROR, "cartridge_image_map: can't open %s\n", path);
+		return false;
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(cartridge_image_header_t)) {
+		LOG(LOG_ERROR, "cartridge_image_map: %s is not a cartridge image\n", path);
+		close(fd);
+		return false;
+	}
+	size_t size = (size_t)file_stat.st_size;
+	void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps its own reference on the file
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		LOG(LOG_ERROR, "cartridge_image_map: can't map %s\n", path);
+		return false;
+	}
+	image->mapping = mapping;
+	image->mapping_size = size;
+#else
+	if (cartridge_image_load_file(path, image) == false) {
+		return false;
+	}
+#endif
+
+	if (cartridge_image_read_header(image->mapping, image->mapping_size, image) == false) {
+		LOG(LOG_ERROR, "cartridge_image_map: %s is not a valid cartridge image\n", path);
+		cartridge_image_unmap(image);
+		return false;
+	}
+	return true;
+}
+
+void cartridge_image_unmap(cartridge_image_t *image) {
+	if (image->mapping != NULL) {
+#if CARTRIDGE_IMAGE_USE_MMAP
+		munmap(image->mapping, image->mapping_size);
+#else
+		free(image->mapping);
+#endif
+	}
+	memset(image, 0, sizeof(cartridge_image_t));
+}
+
+#pragma mark - Private
+
+static size_t cartridge_image_align(size_t offset) {
+	return (offset + CARTRIDGE_IMAGE_ALIGNMENT - 1) & ~((size_t)CARTRIDGE_IMAGE_ALIGNMENT - 1);
+}
+
+static bool cartridge_image_read_header(const uint8_t *data, size_t size, cartridge_image_t *image) {
+	const cartridge_image_header_t *header = (const cartridge_image_header_t *)data;
+	if (memcmp(header->magic, CARTRIDGE_IMAGE_MAGIC, CARTRIDGE_IMAGE_MAGIC_SIZE) != 0) {
+		return false;
+	}
+	uint32_t version = LITTLE_ENDIAN_DWORD(header->version);
+	if (version != CARTRIDGE_IMAGE_VERSION) {
+		LOG(LOG_ERROR, "cartridge_image: unsupported image version %u\n", version);
+		return false;
+	}
+	if (LITTLE_ENDIAN_DWORD(header->sections_count) != CARTRIDGE_IMAGE_SECTIONS_COUNT) {
+		return false;
+	}
+	image->ngh = LITTLE_ENDIAN_WORD(header->ngh);
+
+	for (uint8_t i = 0; i < CARTRIDGE_IMAGE_SECTIONS_COUNT; i++) {
+		size_t offset = LITTLE_ENDIAN_DWORD(header->sections[i].offset);
+		size_t section_size = LITTLE_ENDIAN_DWORD(header->sections[i].size);
+		if (section_size == 0) {
+			image->sections[i].data = NULL;
+			image->sections[i].size = 0;
+			continue;
+		}
+		if ((offset % CARTRIDGE_IMAGE_ALIGNMENT) != 0 || offset + section_size > size) {
+			LOG(LOG_ERROR, "cartridge_image: section %u is out of the file\n", i);
+			return false;
+		}
+		image->sections[i].data = (uint8_t *)data + offset;
+		image->sections[i].size = section_size;
+	}
+	return true;
+}
+
+#if !CARTRIDGE_IMAGE_USE_MMAP
+// No mapping here, the whole image is read at once
+static bool cartridge_image_load_file(const char *path, cartridge_image_t *image) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		LOG(LOG_ERROR, "cartridge_image_map: can't open %s\n", path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size < (long)sizeof(cartridge_image_header_t)) {
+		fclose(file);
+		return false;
+	}
+	image->mapping = malloc((size_t)size);
+	image->mapping_size = (size_t)size;
+	bool read = image->mapping != NULL && fread(image->mapping, 1, (size_t)size, file) == (size_t)size;
+	fclose(file);
+	if (read == false) {
+		LOG(LOG_ERROR, "cartridge_image_map: can't read %s\n", path);
+		cartridge_image_unmap(image);
+	}
+	return read;
+}
+#endif
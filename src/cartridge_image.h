@@ -0,0 +1,63 @@
+#ifndef cartridge_image_h
+#define cartridge_image_h
+
+#include "rom_region.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *	Native cartridge image (.ngi)
+ *	ROMs are stored uncompressed and already converted for the emulator:
+ *	word swapped P ROM banks, serialized sprites tiles and row major fix tiles.
+ *	Every section starts on a page boundary so the file can be mapped and used in place.
+ *	Header fields are little endian.
+ */
+
+#define CARTRIDGE_IMAGE_MAGIC			"NEOGEOIM"
+#define CARTRIDGE_IMAGE_MAGIC_SIZE		8
+#define CARTRIDGE_IMAGE_VERSION			1
+#define CARTRIDGE_IMAGE_ALIGNMENT		4096
+
+typedef enum cartridge_image_section_kind {
+	CARTRIDGE_IMAGE_P_ROM = 0,		// fixed 1MB bank then switchable banks
+	CARTRIDGE_IMAGE_SPRITES,		// serialized sprites tiles, 128 bytes per tile
+	CARTRIDGE_IMAGE_FIX,			// S1 ROM, row major tiles
+	CARTRIDGE_IMAGE_M1_ROM,
+	CARTRIDGE_IMAGE_PCM_A,			// V1 ROMs concatenated
+	CARTRIDGE_IMAGE_PCM_B,			// V2 ROMs concatenated
+	CARTRIDGE_IMAGE_SECTIONS_COUNT
+} cartridge_image_section_kind_t;
+
+typedef struct cartridge_image_section {
+	uint32_t offset;
+	uint32_t size;
+} cartridge_image_section_t;
+
+typedef struct cartridge_image_header {
+	char magic[CARTRIDGE_IMAGE_MAGIC_SIZE];
+	uint32_t version;
+	uint32_t sections_count;
+	uint16_t ngh;
+	uint16_t reserved[3];
+	cartridge_image_section_t sections[CARTRIDGE_IMAGE_SECTIONS_COUNT];
+} cartridge_image_header_t;
+
+typedef struct cartridge_image {
+	rom_region_t sections[CARTRIDGE_IMAGE_SECTIONS_COUNT];
+	uint16_t ngh;
+	void *mapping;			// whole file, NULL when nothing is mapped
+	size_t mapping_size;
+} cartridge_image_t;
+
+// true when the file starts with a cartridge image header
+bool cartridge_image_probe(const char *path);
+
+bool cartridge_image_write(const char *path, const cartridge_image_t *image);
+
+// Sections point inside the read only mapping until cartridge_image_unmap
+bool cartridge_image_map(const char *path, cartridge_image_t *image);
+void cartridge_image_unmap(cartridge_image_t *image);
+
+#endif /* cartridge_image_h */
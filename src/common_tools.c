@@ -2,6 +2,11 @@
 #include "endian.h"
 #include "log.h"
 
+#include <time.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
 void byte_swap_p_rom_if_needed(uint8_t * rom, size_t length)
 {
 	int i, j;
@@ -31,3 +36,34 @@ bool is_p_rom_init_vector(uint8_t *rom)
 	LOG(LOG_DEBUG, "vector 0 0x%08X - 1 0x%08X\n", p[0], p[1]);
 	return p[0] == BIG_ENDIAN_DWORD(vector0) && p[1] == BIG_ENDIAN_DWORD(vector1);
 }
+
+uint64_t monotonic_time_usec(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+uint64_t monotonic_time_nsec(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+size_t peak_resident_memory_size(void)
+{
+#ifdef _WIN32
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;			// bytes on Darwin
+#else
+	return (size_t)usage.ru_maxrss * 1024;	// kilobytes elsewhere
+#endif
+#endif
+}
@@ -8,4 +8,11 @@
 void byte_swap_p_rom_if_needed(uint8_t * mem, size_t length);
 bool is_p_rom_init_vector(uint8_t *rom);
 
+// Monotonic clock in microseconds, for measurements only
+uint64_t monotonic_time_usec(void);
+uint64_t monotonic_time_nsec(void);
+
+// Peak resident set size of the process in bytes, 0 when unavailable
+size_t peak_resident_memory_size(void);
+
 #endif /* common_tools_h */
@@ -0,0 +1,102 @@
+#include "frame_counters.h"
+#include "log.h"
+
+#include "3rdParty/musashi/m68k.h"
+#include "3rdParty/z80/z80.h"
+
+#include <stdio.h>
+#include <string.h>
+
+frame_counters_t frame_counters;
+
+static frame_counters_t history[FRAME_COUNTERS_HISTORY];
+static uint32_t history_count = 0;
+static uint32_t history_next = 0;
+static FILE *csv_file = NULL;
+
+static void frame_counters_write_csv(const frame_counters_t *counters);
+
+#pragma mark - Public
+
+void frame_counters_reset() {
+	memset(&frame_counters, 0, sizeof(frame_counters_t));
+	m68k_instructions_count = 0;
+	z80_instructions_count = 0;
+	z80_idle_cycles = 0;
+	history_count = 0;
+	history_next = 0;
+}
+
+void frame_counters_end_frame() {
+	frame_counters.m68k_instructions = m68k_instructions_count;
+	frame_counters.z80_instructions = z80_instructions_count;
+	frame_counters.z80_idle_cycles = z80_idle_cycles;
+	m68k_instructions_count = 0;
+	z80_instructions_count = 0;
+	z80_idle_cycles = 0;
+
+	history[history_next] = frame_counters;
+	history_next = (history_next + 1) % FRAME_COUNTERS_HISTORY;
+	history_count += history_count < FRAME_COUNTERS_HISTORY;
+	if (csv_file != NULL) {
+		frame_counters_write_csv(&frame_counters);
+	}
+
+	uint32_t frame = frame_counters.frame;
+	memset(&frame_counters, 0, sizeof(frame_counters_t));
+	frame_counters.frame = frame + 1;
+}
+
+frame_counters_t frame_counters_get_last() {
+	if (history_count == 0) {
+		frame_counters_t empty;
+		memset(&empty, 0, sizeof(frame_counters_t));
+		return empty;
+	}
+	return history[(history_next + FRAME_COUNTERS_HISTORY - 1) % FRAME_COUNTERS_HISTORY];
+}
+
+size_t frame_counters_get_history(frame_counters_t *destination, size_t count) {
+	count = count < history_count ? count : history_count;
+	uint32_t index = (history_next + FRAME_COUNTERS_HISTORY - (uint32_t)count) % FRAME_COUNTERS_HISTORY;
+	for (size_t i = 0; i < count; i++) {
+		destination[i] = history[index];
+		index = (index + 1) % FRAME_COUNTERS_HISTORY;
+	}
+	return count;
+}
+
+double frame_counters_sprites_per_line(const frame_counters_t *counters) {
+	return counters->sprites_lines ? (double)counters->sprites_total / counters->sprites_lines : 0;
+}
+
+bool frame_counters_set_csv(const char *path) {
+	if (csv_file != NULL) {
+		fclose(csv_file);
+		csv_file = NULL;
+	}
+	if (path == NULL) {
+		return true;
+	}
+	csv_file = fopen(path, "w");
+	if (csv_file == NULL) {
+		LOG(LOG_ERROR, "frame_counters_set_csv: can't create %s\n", path);
+		return false;
+	}
+	fprintf(csv_file, "frame,m68k_instructions,m68k_cycles,z80_instructions,z80_cycles,z80_idle_cycles,scheduler_slices,"
+			"sprites_per_line,sprites_max_per_line,vram_writes,palette_writes,p_rom_bank_switches,ym2610_writes,adpcma_key_ons,adpcmb_key_ons,"
+			"fm_voices,adpcma_voices,adpcmb_voices,ssg_voices,silent_samples\n");
+	return true;
+}
+
+#pragma mark - Private
+
+static void frame_counters_write_csv(const frame_counters_t *counters) {
+	fprintf(csv_file, "%u,%u,%u,%u,%u,%u,%u,%.2f,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+			counters->frame, counters->m68k_instructions, counters->m68k_cycles,
+			counters->z80_instructions, counters->z80_cycles, counters->z80_idle_cycles, counters->scheduler_slices,
+			frame_counters_sprites_per_line(counters), counters->sprites_max_per_line,
+			counters->vram_writes, counters->palette_writes, counters->p_rom_bank_switches,
+			counters->ym2610_writes, counters->adpcma_key_ons, counters->adpcmb_key_ons,
+			counters->fm_voices, counters->adpcma_voices, counters->adpcmb_voices, counters->ssg_voices, counters->silent_samples);
+}
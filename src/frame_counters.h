@@ -0,0 +1,53 @@
+#ifndef frame_counters_h
+#define frame_counters_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *	What the emulated machine did each frame, always counted
+ *	The emulation increments frame_counters, frame_counters_end_frame moves it to the history
+ *	and to the CSV file when there is one. Meant to correlate frame time spikes with what the game does
+ */
+
+#define FRAME_COUNTERS_HISTORY 600		// 10 seconds of frames
+
+typedef struct frame_counters {
+	uint32_t frame;						// frames since the reset
+	uint32_t m68k_instructions;
+	uint32_t m68k_cycles;
+	uint32_t z80_instructions;
+	uint32_t z80_cycles;
+	uint32_t z80_idle_cycles;			// part of z80_cycles skipped by the HALT and busy loop shortcuts
+	uint32_t scheduler_slices;			// 68K runs between two timer events
+	uint32_t sprites_lines;				// lines whose sprites list was built
+	uint32_t sprites_total;				// sprites of all those lines
+	uint16_t sprites_max_per_line;
+	uint32_t vram_writes;
+	uint32_t palette_writes;
+	uint32_t p_rom_bank_switches;
+	uint32_t ym2610_writes;				// data writes, address latches aren't counted
+	uint32_t adpcma_key_ons;			// voices started
+	uint32_t adpcmb_key_ons;
+	uint8_t fm_voices;					// peak YM2610 voices producing sound
+	uint8_t adpcma_voices;
+	uint8_t adpcmb_voices;
+	uint8_t ssg_voices;
+	uint32_t silent_samples;			// samples rendered with the whole YM2610 silent
+} frame_counters_t;
+
+extern frame_counters_t frame_counters;		// frame being emulated
+
+void frame_counters_reset(void);
+void frame_counters_end_frame(void);
+
+frame_counters_t frame_counters_get_last(void);
+// Copies up to count of the last frames, oldest first, returns how many were copied
+size_t frame_counters_get_history(frame_counters_t *destination, size_t count);
+double frame_counters_sprites_per_line(const frame_counters_t *counters);
+
+// One CSV line per frame from now on, NULL closes the file
+bool frame_counters_set_csv(const char *path);
+
+#endif /* frame_counters_h */
@@ -1,7 +1,10 @@
 #include <stdio.h>
 
 #include "libretro.h"
+#include "bus_heatmap.h"
 #include "cartridge.h"
+#include "cartridge_image.h"
+#include "frame_counters.h"
 #include "libretro_core.h"
 #include "neogeo.h"
 #include "log.h"
@@ -16,6 +19,7 @@
 
 void retro_set_environment(retro_environment_t cb) {
 	libretroCallbacks.environment = cb;
+	retro_core_set_variables();
 }
 
 void retro_set_video_refresh(retro_video_refresh_t cb) {
@@ -58,7 +62,8 @@ void retro_init(void) {
 }
 
 void retro_deinit(void) {
-
+	retro_core_wait_system_roms();
+	log_set_async(false);
 }
 
 unsigned retro_api_version(void) {
@@ -68,14 +73,14 @@ unsigned retro_api_version(void) {
 void retro_get_system_info(struct retro_system_info *info) {
 	info->library_name = "Neogeo";
 	info->library_version = "0.1";
-	info->valid_extensions = "zip";
+	info->valid_extensions = "zip|ngi";
 	info->need_fullpath = true;
 	info->block_extract = true;
 }
 
 void retro_get_system_av_info(struct retro_system_av_info *info) {
 	info->timing.fps = 60;
-	info->timing.sample_rate = 44100;
+	info->timing.sample_rate = audioSampleRate;
 	info->geometry.base_width = 320;
 	info->geometry.base_height = 224;
 	info->geometry.max_width = 320;
@@ -128,6 +133,7 @@ void retro_cheat_set(unsigned index, bool enabled, const char *code) {
 }
 
 bool retro_load_game(const struct retro_game_info *game) {
+	retro_core_wait_system_roms();
 	bool is_hardware_ready = neogeo_is_system_ready();
 	if (is_hardware_ready == false) {
 		LOG(LOG_ERROR, "retro_load_game: system not ready\n");
@@ -140,7 +146,14 @@ bool retro_load_game(const struct retro_game_info *game) {
 		return true;
 	}
 	LOG(LOG_INFO, "loading game from %s\n", game->path);
-	bool cartridge_valid = cartridge_load_roms(game->path);
+	retro_core_apply_variables(game->path);
+	bool cartridge_valid;
+	if (cartridge_image_probe(game->path)) {
+		cartridge_valid = cartridge_load_image(game->path);
+	}
+	else {
+		cartridge_valid = cartridge_load_roms(game->path);
+	}
 	if (cartridge_valid == false) {
 		LOG(LOG_ERROR, "invalid game from %s\n", game->path);
 		return false;
@@ -154,7 +167,12 @@ bool retro_load_game_special(unsigned game_type, const struct retro_game_info *i
 }
 
 void retro_unload_game(void) {
-
+	bus_heatmap_log_report();
+	sound_unload();
+	video_set_capture(NULL);
+	frame_counters_set_csv(NULL);
+	// joins the background loading workers
+	cartridge_unload();
 }
 
 unsigned retro_get_region(void) {
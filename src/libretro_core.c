@@ -2,12 +2,19 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include "aux_inputs.h"
+#include "cartridge.h"
+#include "common_tools.h"
+#include "frame_counters.h"
 #include "joypads.h"
 #include "libretro_core.h"
 #include "log.h"
 #include "neogeo.h"
+#include "profile.h"
+#include "sound.h"
+#include "video.h"
 #include "3rdParty/miniz/miniz.h"
 
 libretro_callbacks_t libretroCallbacks;
@@ -23,9 +30,32 @@ static const uint8_t joypads_map[] = {
 	RETRO_DEVICE_ID_JOYPAD_X, JOYPAD_PORT_MASK_D
 };
 
+static const struct retro_variable core_variables[] = {
+	{ "neogeo_sprites_memory_budget", "Sprites memory budget; unlimited|512 MB|256 MB|128 MB|64 MB|32 MB" },
+	{ "neogeo_ym2610_render_block", "YM2610 render block; frame|256 samples|128 samples|64 samples" },
+	{ "neogeo_adpcma_cache", "ADPCM-A decode cache; off|8 MB|16 MB|32 MB" },
+	{ "neogeo_sound_thread", "YM2610 synthesis thread; off|on" },
+	{ "neogeo_audio_sample_rate", "Audio sample rate; 44100|48000|32000|22050|native" },
+	{ "neogeo_ym2610_capture", "YM2610 register log next to the game; off|on" },
+	{ "neogeo_video_capture", "Video command log next to the game; off|on" },
+	{ "neogeo_pcm_compression", "Compressed V ROMs in memory; off|on" },
+	{ "neogeo_frame_counters", "Per frame counters CSV next to the game; off|on" },
+	{ "neogeo_log_level", "Log level; debug|info|warn|error" },
+	{ "neogeo_log_async", "Log from a background thread; off|on" },
+#ifdef NEOGEO_PROFILE
+	{ "neogeo_profile_log", "Profiler log interval; off|60 frames|600 frames|3600 frames" },
+#endif
+	{ NULL, NULL }
+};
+
+// BIOS files are extracted while the frontend loads the game
+static pthread_t system_roms_thread;
+static bool system_roms_loading = false;
+
 #pragma mark - private defines
 
 bool load_system_roms(const char *path);
+static void *load_system_roms_thread(void *path);
 
 #pragma mark - Public
 
@@ -45,10 +75,24 @@ void retro_core_create_neogeo(const char *systemDirectory) {
 	char *full_path;
 	full_path = malloc(strlen(systemDirectory) + strlen("/neogeo/") + strlen("neogeo.zip") + 2);
 	sprintf(full_path, "%s/neogeo/neogeo.zip", systemDirectory);
+	if (pthread_create(&system_roms_thread, NULL, load_system_roms_thread, full_path) == 0) {
+		system_roms_loading = true;
+		return;
+	}
 	load_system_roms(full_path);
 	free(full_path);
 }
 
+void retro_core_wait_system_roms(void) {
+	if (system_roms_loading == false) {
+		return;
+	}
+	uint64_t wait_start = monotonic_time_usec();
+	pthread_join(system_roms_thread, NULL);
+	system_roms_loading = false;
+	LOG(LOG_INFO, "retro core: waited %.1f ms for system ROMs\n", (monotonic_time_usec() - wait_start) / 1000.0);
+}
+
 void retro_core_poll_joypad_1(void) {
 	joypad_port1 = JOYPAD_INIT;
 	for (uint8_t i = 0; i < sizeof(joypads_map); i += 2) {
@@ -79,6 +123,144 @@ void retro_core_poll_joypad_2(void) {
 	aux_input_select_player(Player2, pressed);
 }
 
+#pragma mark - Core options
+
+void retro_core_set_variables(void) {
+	libretroCallbacks.environment(RETRO_ENVIRONMENT_SET_VARIABLES, (void *)core_variables);
+}
+
+bool retro_core_variable_is_valid(const char *key, const char *value) {
+	for (const struct retro_variable *variable = core_variables; variable->key != NULL; variable++) {
+		if (strcmp(variable->key, key) != 0) {
+			continue;
+		}
+		// "Description; value|value|..."
+		const char *values = strstr(variable->value, "; ");
+		size_t length = strlen(value);
+		for (const char *option = values + 2; ; option++) {
+			const char *end = strchr(option, '|');
+			size_t option_length = end != NULL ? (size_t)(end - option) : strlen(option);
+			if (option_length == length && strncmp(option, value, length) == 0) {
+				return true;
+			}
+			if (end == NULL) {
+				return false;
+			}
+			option = end;
+		}
+	}
+	return false;
+}
+
+static const char *retro_core_variable_value(const char *key) {
+	struct retro_variable variable;
+	variable.key = key;
+	variable.value = NULL;
+	if (libretroCallbacks.environment(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) == false) {
+		return NULL;
+	}
+	return variable.value;
+}
+
+void retro_core_apply_variables(const char *game_path) {
+	// first so the lines below follow the new level, hosts without the options keep theirs
+	const char *value = retro_core_variable_value("neogeo_log_level");
+	if (value != NULL) {
+		log_set_level(strcmp(value, "error") == 0 ? LOG_ERROR : strcmp(value, "warn") == 0 ? LOG_WARN : strcmp(value, "info") == 0 ? LOG_INFO : LOG_DEBUG);
+	}
+	value = retro_core_variable_value("neogeo_log_async");
+	if (value != NULL) {
+		log_set_async(strcmp(value, "on") == 0);
+	}
+	LOG(LOG_DEBUG, "retro core: log level %d, %s\n", log_runtime_level, atomic_load(&log_async_enabled) ? "async" : "sync");
+
+	value = retro_core_variable_value("neogeo_sprites_memory_budget");
+	size_t sprites_budget = 0;
+	if (value != NULL && strcmp(value, "unlimited") != 0) {
+		sprites_budget = (size_t)atoi(value) * 1024 * 1024;
+	}
+	LOG(LOG_DEBUG, "retro core: sprites memory budget %zu MB\n", sprites_budget / (1024 * 1024));
+	cartridge_set_sprites_memory_budget(sprites_budget);
+	
+	value = retro_core_variable_value("neogeo_ym2610_render_block");
+	uint32_t block_samples = 0;
+	if (value != NULL && strcmp(value, "frame") != 0) {
+		block_samples = (uint32_t)atoi(value);
+	}
+	LOG(LOG_DEBUG, "retro core: YM2610 render block %u samples\n", block_samples);
+	sound_set_ym2610_block_size(block_samples);
+	
+	value = retro_core_variable_value("neogeo_adpcma_cache");
+	size_t adpcma_cache_budget = 0;
+	if (value != NULL && strcmp(value, "off") != 0) {
+		adpcma_cache_budget = (size_t)atoi(value) * 1024 * 1024;
+	}
+	LOG(LOG_DEBUG, "retro core: ADPCM-A cache %zu MB\n", adpcma_cache_budget / (1024 * 1024));
+	sound_set_adpcma_cache_budget(adpcma_cache_budget);
+	
+	value = retro_core_variable_value("neogeo_sound_thread");
+	bool sound_thread = value != NULL && strcmp(value, "on") == 0;
+	LOG(LOG_DEBUG, "retro core: YM2610 synthesis thread %s\n", sound_thread ? "on" : "off");
+	sound_set_thread_enabled(sound_thread);
+	
+	value = retro_core_variable_value("neogeo_audio_sample_rate");
+	uint32_t sample_rate = AUDIO_SAMPLE_RATE_DEFAULT;
+	if (value != NULL) {
+		sample_rate = strcmp(value, "native") == 0 ? AUDIO_SAMPLE_RATE_NATIVE : (uint32_t)atoi(value);
+	}
+	LOG(LOG_DEBUG, "retro core: audio sample rate %u Hz\n", sample_rate);
+	sound_set_sample_rate(sample_rate);
+	
+	value = retro_core_variable_value("neogeo_ym2610_capture");
+	if (value != NULL && strcmp(value, "on") == 0) {
+		char *capture_path = malloc(strlen(game_path) + strlen(".ymlog") + 1);
+		sprintf(capture_path, "%s.ymlog", game_path);
+		LOG(LOG_DEBUG, "retro core: YM2610 capture to %s\n", capture_path);
+		sound_set_ym2610_capture(capture_path);
+		free(capture_path);
+	}
+	else {
+		sound_set_ym2610_capture(NULL);
+	}
+	
+	value = retro_core_variable_value("neogeo_video_capture");
+	if (value != NULL && strcmp(value, "on") == 0) {
+		char *capture_path = malloc(strlen(game_path) + strlen(".vidlog") + 1);
+		sprintf(capture_path, "%s.vidlog", game_path);
+		LOG(LOG_DEBUG, "retro core: video capture to %s\n", capture_path);
+		video_set_capture(capture_path);
+		free(capture_path);
+	}
+	else {
+		video_set_capture(NULL);
+	}
+	
+	value = retro_core_variable_value("neogeo_pcm_compression");
+	bool pcm_compression = value != NULL && strcmp(value, "on") == 0;
+	LOG(LOG_DEBUG, "retro core: compressed V ROMs %s\n", pcm_compression ? "on" : "off");
+	cartridge_set_pcm_compression(pcm_compression);
+	
+	value = retro_core_variable_value("neogeo_frame_counters");
+	if (value != NULL && strcmp(value, "on") == 0) {
+		char *counters_path = malloc(strlen(game_path) + strlen(".counters.csv") + 1);
+		sprintf(counters_path, "%s.counters.csv", game_path);
+		LOG(LOG_DEBUG, "retro core: frame counters to %s\n", counters_path);
+		frame_counters_set_csv(counters_path);
+		free(counters_path);
+	}
+	else {
+		frame_counters_set_csv(NULL);
+	}
+	
+	value = retro_core_variable_value("neogeo_profile_log");
+	uint32_t profile_interval = 0;
+	if (value != NULL && strcmp(value, "off") != 0) {
+		profile_interval = (uint32_t)atoi(value);
+	}
+	LOG(LOG_DEBUG, "retro core: profiler log every %u frames\n", profile_interval);
+	profile_set_log_interval(profile_interval);
+}
+
 #pragma mark - Private
 
 bool load_system_roms(const char *path) {
@@ -163,6 +345,14 @@ bool load_system_roms(const char *path) {
 	return neo_res;
 }
 
+static void *load_system_roms_thread(void *path) {
+	uint64_t load_start = monotonic_time_usec();
+	load_system_roms(path);
+	LOG(LOG_INFO, "retro core: system ROMs loaded in %.1f ms\n", (monotonic_time_usec() - load_start) / 1000.0);
+	free(path);
+	return NULL;
+}
+
 #pragma mark - Debug
 
 void retro_core_draw_mire(const uint16_t *frameBuffer, uint16_t width, uint16_t height) {
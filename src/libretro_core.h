@@ -19,9 +19,17 @@ extern libretro_callbacks_t libretroCallbacks;
 
 void retro_core_init_log(void);
 void retro_core_create_neogeo(const char *);
+void retro_core_wait_system_roms(void);
 void retro_core_poll_joypad_1(void);
 void retro_core_poll_joypad_2(void);
 
+#pragma mark - Core options
+
+void retro_core_set_variables(void);
+void retro_core_apply_variables(const char *game_path);
+// true when key is a core option and value one of its values
+bool retro_core_variable_is_valid(const char *key, const char *value);
+
 #pragma mark - Debug
 
 void retro_core_draw_mire(const uint16_t *frameBuffer, uint16_t width, uint16_t height);
@@ -0,0 +1,121 @@
+#include "log.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef struct log_async_line {
+	atomic_uint sequence;		// index + 1 once written, index + LOG_ASYNC_RING_SIZE once flushed
+	enum retro_log_level level;
+	char text[LOG_ASYNC_LINE_SIZE];
+} log_async_line_t;
+
+enum retro_log_level log_runtime_level = LOG_DEBUG;
+atomic_bool log_async_enabled = false;
+
+// multiple producers, the emulation and loading threads, one consumer, the flush thread
+static log_async_line_t ring[LOG_ASYNC_RING_SIZE];
+static atomic_uint ring_head;
+static unsigned ring_tail;
+static atomic_uint dropped_lines;
+static atomic_bool flush_quit;
+static pthread_t flush_thread;
+
+static void log_async_flush(void);
+static void *log_async_flush_main(void *argument);
+
+#pragma mark - Public
+
+void log_set_level(enum retro_log_level level) {
+	log_runtime_level = level;
+}
+
+bool log_set_async(bool enabled) {
+	if (enabled == atomic_load(&log_async_enabled)) {
+		return true;
+	}
+	if (enabled) {
+		for (unsigned index = 0; index < LOG_ASYNC_RING_SIZE; index++) {
+			atomic_store(&ring[index].sequence, index);
+		}
+		atomic_store(&ring_head, 0);
+		ring_tail = 0;
+		atomic_store(&dropped_lines, 0);
+		atomic_store(&flush_quit, false);
+		if (pthread_create(&flush_thread, NULL, log_async_flush_main, NULL) != 0) {
+			LOG(LOG_ERROR, "log_set_async: can't create the flush thread, logging synchronously\n");
+			return false;
+		}
+		atomic_store(&log_async_enabled, true);
+		return true;
+	}
+
+	// lines pushed by other threads after this point go straight to the frontend
+	atomic_store(&log_async_enabled, false);
+	atomic_store(&flush_quit, true);
+	pthread_join(flush_thread, NULL);
+	// the flush thread is gone, hand what it left in the ring over from here
+	log_async_flush();
+	return true;
+}
+
+void log_async_push(enum retro_log_level level, const char *format, ...) {
+	unsigned head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+	log_async_line_t *line;
+	while (true) {
+		line = &ring[head & (LOG_ASYNC_RING_SIZE - 1)];
+		int difference = (int)(atomic_load_explicit(&line->sequence, memory_order_acquire) - head);
+		if (difference == 0) {
+			if (atomic_compare_exchange_weak_explicit(&ring_head, &head, head + 1, memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			// never wait for the frontend on the emulation thread
+			atomic_fetch_add_explicit(&dropped_lines, 1, memory_order_relaxed);
+			return;
+		}
+		else {
+			head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+		}
+	}
+
+	va_list arguments;
+	va_start(arguments, format);
+	vsnprintf(line->text, LOG_ASYNC_LINE_SIZE, format, arguments);
+	va_end(arguments);
+	line->level = level;
+	atomic_store_explicit(&line->sequence, head + 1, memory_order_release);
+}
+
+#pragma mark - Private
+
+static void log_async_flush() {
+	while (true) {
+		log_async_line_t *line = &ring[ring_tail & (LOG_ASYNC_RING_SIZE - 1)];
+		if (atomic_load_explicit(&line->sequence, memory_order_acquire) != ring_tail + 1) {
+			break;
+		}
+		if (libretroCallbacks.log) {
+			libretroCallbacks.log(line->level, "%s", line->text);
+		}
+		atomic_store_explicit(&line->sequence, ring_tail + LOG_ASYNC_RING_SIZE, memory_order_release);
+		ring_tail++;
+	}
+
+	unsigned dropped = atomic_exchange_explicit(&dropped_lines, 0, memory_order_relaxed);
+	if (dropped && libretroCallbacks.log) {
+		libretroCallbacks.log(LOG_WARN, "log: %u lines dropped, the ring was full\n", dropped);
+	}
+}
+
+static void *log_async_flush_main(void *argument) {
+	struct timespec period = { 0, LOG_ASYNC_FLUSH_USEC * 1000 };
+	while (atomic_load(&flush_quit) == false) {
+		log_async_flush();
+		nanosleep(&period, NULL);
+	}
+	return NULL;
+}
@@ -3,10 +3,46 @@
 
 #import "libretro_core.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
+
 #define LOG_DEBUG RETRO_LOG_DEBUG
 #define LOG_INFO  RETRO_LOG_INFO
+#define LOG_WARN  RETRO_LOG_WARN
 #define LOG_ERROR RETRO_LOG_ERROR
 
-#define LOG(x, ...) if (libretroCallbacks.log) libretroCallbacks.log(x, __VA_ARGS__)
+/*
+ *	Lines below LOG_COMPILED_LEVEL are removed at compile time: debug lines are only in builds without NDEBUG,
+ *	cmake -DNEOGEO_LOG_LEVEL=DEBUG|INFO|WARN|ERROR overrides it
+ *	Lines below log_runtime_level are skipped before their arguments are formatted
+ *	In async mode lines are formatted in a lock free ring and a thread hands them to the frontend
+ */
+
+#ifndef LOG_COMPILED_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILED_LEVEL LOG_INFO
+#else
+#define LOG_COMPILED_LEVEL LOG_DEBUG
+#endif
+#endif
+
+#define LOG_ASYNC_RING_SIZE 256			// lines, power of 2, lines are dropped when the ring is full
+#define LOG_ASYNC_LINE_SIZE 256			// longer lines are truncated
+#define LOG_ASYNC_FLUSH_USEC 4000		// flush thread polling period when the ring is empty
+
+extern enum retro_log_level log_runtime_level;
+extern atomic_bool log_async_enabled;
+
+#define LOG(x, ...) do { \
+	if ((x) >= LOG_COMPILED_LEVEL && (x) >= log_runtime_level && libretroCallbacks.log) { \
+		if (atomic_load_explicit(&log_async_enabled, memory_order_acquire)) log_async_push(x, __VA_ARGS__); \
+		else libretroCallbacks.log(x, __VA_ARGS__); \
+	} \
+} while (0)
+
+void log_set_level(enum retro_log_level level);
+// Starting flushes the ring from a thread, stopping hands the remaining lines to the frontend before returning
+bool log_set_async(bool enabled);
+void log_async_push(enum retro_log_level level, const char *format, ...);
 
 #endif /* log_h */
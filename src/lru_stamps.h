@@ -0,0 +1,34 @@
+#ifndef lru_stamps_h
+#define lru_stamps_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ *	Least recently used bookkeeping shared by the small caches (tile cache, PCM blocks, ADPCM-A samples)
+ *	Every use stores the incremented counter in the stamp of the entry, 0 is never used
+ *	and the smallest stamp is the least recently used entry
+ */
+
+static inline void lru_stamps_touch(uint32_t *counter, uint32_t *stamps, size_t count, size_t index) {
+	if (++*counter == 0) {
+		// stamps wrapped around, restart LRU history
+		memset(stamps, 0, count * sizeof(uint32_t));
+		*counter = 1;
+	}
+	stamps[index] = *counter;
+}
+
+// Index of the least recently used of count stamps, the first one on ties
+static inline size_t lru_stamps_oldest(const uint32_t *stamps, size_t count) {
+	size_t oldest = 0;
+	for (size_t index = 1; index < count; index++) {
+		if (stamps[index] < stamps[oldest]) {
+			oldest = index;
+		}
+	}
+	return oldest;
+}
+
+#endif /* lru_stamps_h */
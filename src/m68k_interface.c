@@ -1,3 +1,5 @@
+#include "bus_heatmap.h"
+#include "memory_mapping.h"
 #include "memory_region.h"
 #include "neogeo.h"
 #include "rom_region.h"
@@ -6,6 +8,10 @@
 
 #include <stdint.h>
 
+unsigned int m68k_instructions_count = 0;
+
+static const memory_region_t *m68k_disassembler_region(uint32_t address);
+
 void m68ki_exception_bus_error(void) {
      LOG(LOG_ERROR, "Bus Error @ PC=%X.\n", REG_PPC);
 
@@ -36,6 +42,7 @@ void m68ki_exception_bus_error(void) {
 
 uint32_t m68k_read_memory_8(uint32_t address) {
 	const memory_region_t *memory_region = cpu_68k_memory_region_for_address(address);
+	BUS_HEATMAP_COUNT(address, memory_region, BUS_HEATMAP_READ, BUS_HEATMAP_BYTE);
 	if (!memory_region) {
 		LOG(LOG_DEBUG, "m68k_read_memory_8 missing region for address 0x%08X\n", address);
 		m68ki_exception_bus_error();
@@ -53,6 +60,7 @@ uint32_t m68k_read_memory_8(uint32_t address) {
 
 void m68k_write_memory_8(uint32_t address, uint32_t data) {
 	const memory_region_t *memory_region = cpu_68k_memory_region_for_address(address);
+	BUS_HEATMAP_COUNT(address, memory_region, BUS_HEATMAP_WRITE, BUS_HEATMAP_BYTE);
 	if (!memory_region) {
 		LOG(LOG_DEBUG, "m68k_write_memory_8 missing region for address 0x%08X\n", address);
 		m68ki_exception_bus_error();
@@ -69,6 +77,7 @@ void m68k_write_memory_8(uint32_t address, uint32_t data) {
 
 uint32_t m68k_read_memory_16(uint32_t address) {
 	const memory_region_t *memory_region = cpu_68k_memory_region_for_address(address);
+	BUS_HEATMAP_COUNT(address, memory_region, BUS_HEATMAP_READ, BUS_HEATMAP_WORD);
 	if (!memory_region) {
 		LOG(LOG_DEBUG, "m68k_read_memory_16 missing region for address 0x%08X\n", address);
 		m68ki_exception_bus_error();
@@ -86,6 +95,7 @@ uint32_t m68k_read_memory_16(uint32_t address) {
 
 void m68k_write_memory_16(uint32_t address, uint32_t data) {
 	const memory_region_t *memory_region = cpu_68k_memory_region_for_address(address);
+	BUS_HEATMAP_COUNT(address, memory_region, BUS_HEATMAP_WRITE, BUS_HEATMAP_WORD);
 	if (!memory_region) {
 		LOG(LOG_DEBUG, "m68k_write_memory_16 missing region for address 0x%08X\n", address);
 		m68ki_exception_bus_error();
@@ -102,6 +112,7 @@ void m68k_write_memory_16(uint32_t address, uint32_t data) {
 
 uint32_t m68k_read_memory_32(uint32_t address) {
 	const memory_region_t *memory_region = cpu_68k_memory_region_for_address(address);
+	BUS_HEATMAP_COUNT(address, memory_region, BUS_HEATMAP_READ, BUS_HEATMAP_DWORD);
 	if (!memory_region) {
 		LOG(LOG_DEBUG, "m68k_read_memory_32 missing region for address 0x%08X\n", address);
 		m68ki_exception_bus_error();
@@ -119,6 +130,7 @@ uint32_t m68k_read_memory_32(uint32_t address) {
 
 void m68k_write_memory_32(uint32_t address, uint32_t data) {
 	const memory_region_t *memory_region = cpu_68k_memory_region_for_address(address);
+	BUS_HEATMAP_COUNT(address, memory_region, BUS_HEATMAP_WRITE, BUS_HEATMAP_DWORD);
 	if (!memory_region) {
 		LOG(LOG_DEBUG, "m68k_write_memory_32 missing region for address 0x%08X\n", address);
 		m68ki_exception_bus_error();
@@ -132,3 +144,37 @@ void m68k_write_memory_32(uint32_t address, uint32_t data) {
 	}
 	memory_region->handlers.write_dword(address - memory_region->start_address, data);
 }
+
+#pragma mark - Disassembler
+
+// Same mapping without the bus error and heatmap, I/O registers aren't read as reads can have side effects
+static const memory_region_t *m68k_disassembler_region(uint32_t address) {
+	if (address >= IO_PORTS_START && address <= IO_PORTS_END) {
+		return NULL;
+	}
+	return cpu_68k_memory_region_for_address(address);
+}
+
+unsigned int m68k_read_disassembler_8(unsigned int address) {
+	const memory_region_t *memory_region = m68k_disassembler_region(address & 0xFFFFFF);
+	if (!memory_region || memory_region->handlers.read_byte == NULL) {
+		return 0;
+	}
+	return memory_region->handlers.read_byte((address & 0xFFFFFF) - memory_region->start_address);
+}
+
+unsigned int m68k_read_disassembler_16(unsigned int address) {
+	const memory_region_t *memory_region = m68k_disassembler_region(address & 0xFFFFFF);
+	if (!memory_region || memory_region->handlers.read_word == NULL) {
+		return 0;
+	}
+	return memory_region->handlers.read_word((address & 0xFFFFFF) - memory_region->start_address);
+}
+
+unsigned int m68k_read_disassembler_32(unsigned int address) {
+	const memory_region_t *memory_region = m68k_disassembler_region(address & 0xFFFFFF);
+	if (!memory_region || memory_region->handlers.read_dword == NULL) {
+		return 0;
+	}
+	return memory_region->handlers.read_dword((address & 0xFFFFFF) - memory_region->start_address);
+}
@@ -111,6 +111,37 @@ const memory_region_access_handlers_t memory_input_output_handlers = {
 	&input_output_write_dword
 };
 
+static const struct {
+	uint32_t address;
+	const char *name;
+} registers_names[] = {
+	{ REG_P1CNT, "P1CNT" }, { REG_DIPSW, "DIPSW" }, { REG_SYSTYPE, "SYSTYPE" },
+	{ REG_SOUND, "SOUND" }, { REG_STATUS_A, "STATUS_A" }, { REG_P2CNT, "P2CNT" },
+	{ REG_STATUS_B, "STATUS_B" }, { REG_POUTPUT, "POUTPUT" }, { REG_CRDBANK, "CRDBANK" },
+	{ REG_SLOT, "SLOT" }, { REG_LEDLATCHES, "LEDLATCHES" }, { REG_LEDDATA, "LEDDATA" },
+	{ REG_RTCCTRL, "RTCCTRL" }, { REG_RESETCC1, "RESETCC1" }, { REG_RESETCC2, "RESETCC2" },
+	{ REG_RESETCL1, "RESETCL1" }, { REG_RESETCL2, "RESETCL2" }, { REG_SETCC1, "SETCC1" },
+	{ REG_SETCC2, "SETCC2" }, { REG_SETCL1, "SETCL1" }, { REG_SETCL2, "SETCL2" },
+	{ REG_NOSHADOW, "NOSHADOW" }, { REG_SHADOW, "SHADOW" }, { REG_SWPBIOS, "SWPBIOS" },
+	{ REG_SWPROM, "SWPROM" }, { REG_CRDUNLOCK1, "CRDUNLOCK1" }, { REG_CRDLOCK1, "CRDLOCK1" },
+	{ REG_CRDLOCK2, "CRDLOCK2" }, { REG_CRDUNLOCK2, "CRDUNLOCK2" }, { REG_CRDREGSEL, "CRDREGSEL" },
+	{ REG_CRDNORMAL, "CRDNORMAL" }, { REG_BRDFIX, "BRDFIX" }, { REG_CRTFIX, "CRTFIX" },
+	{ REG_SRAMLOCK, "SRAMLOCK" }, { REG_SRAMULOCK, "SRAMULOCK" }, { REG_PALBANK1, "PALBANK1" },
+	{ REG_PALBANK0, "PALBANK0" },
+	{ REG_VRAMADDR, "VRAMADDR" }, { REG_VRAMRW, "VRAMRW" }, { REG_VRAMMOD, "VRAMMOD" },
+	{ REG_LSPCMODE, "LSPCMODE" }, { REG_TIMERHIGH, "TIMERHIGH" }, { REG_TIMERLOW, "TIMERLOW" },
+	{ REG_IRQACK, "IRQACK" }, { REG_TIMERSTOP, "TIMERSTOP" },
+};
+
+const char *memory_input_output_register_name(uint32_t address) {
+	for (size_t i = 0; i < sizeof(registers_names) / sizeof(registers_names[0]); i++) {
+		if (registers_names[i].address == address) {
+			return registers_names[i].name;
+		}
+	}
+	return NULL;
+}
+
 #pragma mark - internals
 #pragma mark I/O
 
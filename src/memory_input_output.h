@@ -8,4 +8,7 @@ extern uint8_t z80_result;
 
 extern const memory_region_access_handlers_t memory_input_output_handlers;
 
+// Name of the I/O, system or video register at address, NULL when nothing is mapped there
+const char *memory_input_output_register_name(uint32_t address);
+
 #endif /* memory_input_output_h */
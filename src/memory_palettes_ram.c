@@ -1,8 +1,10 @@
+#include "frame_counters.h"
 #include "memory_mapping.h"
 #include "memory_palettes_ram.h"
 #include "log.h"
 #include "neogeo.h"
 #include "video.h"
+#include "video_capture.h"
 
 #include <string.h>
 
@@ -12,6 +14,8 @@ memory_region_t palettes_ram2;
 
 memory_region_t palettes_ram_mirror;
 
+static void palettes_ram_capture(uint32_t index);
+
 #pragma mark - Palettes access
 
 static uint8_t palettes_ram_read_byte(uint32_t offset) {
@@ -30,23 +34,46 @@ static uint32_t palettes_ram_read_dword(uint32_t offset) {
 static void palettes_ram_write_byte(uint32_t offset, uint8_t data) {
 	current_palette_ram->data[offset] = data;
 	current_palette_ram->data[offset+1] = data;
+	frame_counters.palette_writes++;
 //	LOG(LOG_DEBUG, "palettes_ram_write_byte at offset 0x%08X - 0x%04X\n", offset, data);
 	video_convert_current_palette_color(offset/2);
+	if (video_capturing) {
+		// an odd offset also changes the next color
+		palettes_ram_capture(offset/2);
+		if (offset & 1) {
+			palettes_ram_capture(offset/2 + 1);
+		}
+	}
 }
 
 static void palettes_ram_write_word(uint32_t offset, uint16_t data) {
 	*((uint16_t *)(current_palette_ram->data + offset)) = data;
+	frame_counters.palette_writes++;
 //	LOG(LOG_DEBUG, "palettes_ram_write_word at offset 0x%08X - 0x%04X\n", offset, data);
 	video_convert_current_palette_color(offset/2);
+	if (video_capturing) {
+		palettes_ram_capture(offset/2);
+	}
 }
 
 static void palettes_ram_write_dword(uint32_t offset, uint32_t data) {
 	uint16_t * word_p = (uint16_t *)(current_palette_ram->data + offset);
 	*(word_p) = (uint16_t)(data >> 16);
 	*(word_p + 1) = (uint16_t)data;
+	frame_counters.palette_writes += 2;
 //	LOG(LOG_DEBUG, "palettes_ram_write_dword at offset 0x%08X - 0x%08X\n", offset, data);
 	video_convert_current_palette_color(offset/2);
 	video_convert_current_palette_color(offset/2 + 1);
+	if (video_capturing) {
+		palettes_ram_capture(offset/2);
+		palettes_ram_capture(offset/2 + 1);
+	}
+}
+
+static void palettes_ram_capture(uint32_t index) {
+	if (index < PALETTES_RAM_SIZE / 2) {
+		video_capture_command(VIDEO_CAPTURE_PALETTE_WRITE, (uint16_t)index, *((uint16_t *)(current_palette_ram->data + index * 2)));
+	}
 }
 
 #pragma mark - Palettes mirror access
@@ -1,5 +1,6 @@
 #include "aux_inputs.h"
 #include "endian.h"
+#include "frame_counters.h"
 #include "cartridge.h"
 #include "common_tools.h"
 #include "log.h"
@@ -10,11 +11,14 @@
 #include "memory_region.h"
 #include "memory_work_ram.h"
 #include "neogeo.h"
+#include "pc_sampler.h"
+#include "profile.h"
 #include "rom_region.h"
 #include "sound.h"
 #include "timer.h"
 #include "timers_group.h"
 #include "video.h"
+#include "video_capture.h"
 
 #include "3rdParty/musashi/m68kcpu.h"
 #include "3rdParty/pd4990a/pd4990a.h"
@@ -102,19 +106,23 @@ void neogeo_reset() {
 	
 	palettes_rams_reset();
 	current_palette_ram = &palettes_ram1;
+	video_convert_current_palette_bank();
 	
 	timers_group_reset();
 	remainingCyclesThisFrame = 0;
 	m68kCyclesThisFrame = 0;
 	z80_remaining_cycles = 0;
 	currentTimeSeconds = 0;
+	frame_counters_reset();
 	
 	LOG(LOG_DEBUG, "neogeo_reset pulse\n");
 	m68k_pulse_reset();
+	pending_interrupts = 0;
 	cpu_68k_set_interrupt(Reset);
 }
 
 void neogeo_runOneFrame() {
+	PROFILE_FRAME_BEGIN();
 	remainingCyclesThisFrame += MASTER_CYCLES_PER_FRAME;
 	LOG(LOG_DEBUG, "neogeo_runOneFrame for %lld cycles \n", remainingCyclesThisFrame);
 	
@@ -124,15 +132,21 @@ void neogeo_runOneFrame() {
 		uint32_t next_event_cycles = timer_group_cycles_before_next_event();
 		uint32_t cycles_slice = next_event_cycles < remainingCyclesThisFrame ? next_event_cycles : remainingCyclesThisFrame;
 		
-//		PROFILE(p_m68k, ProfilingCategory::CpuM68K);
-		uint32_t elapsed_cycles = m68kToMaster(m68k_execute(masterToM68k(cycles_slice)));
-//		PROFILE_END(p_m68k);
+		PROFILE(p_m68k, PROFILE_M68K);
+		int32_t m68k_cycles = m68k_execute(masterToM68k(cycles_slice));
+		PROFILE_END(p_m68k);
+		uint32_t elapsed_cycles = m68kToMaster(m68k_cycles);
+		frame_counters.m68k_cycles += m68k_cycles;
+		frame_counters.scheduler_slices++;
 
 		z80_remaining_cycles += elapsed_cycles;
 		if (z80_remaining_cycles > 0) {
 			uint32_t z80_elapsed;
-			//PROFILE(p_z80, ProfilingCategory::CpuZ80);
-			z80_elapsed = z80ToMaster(z80_execute(masterToZ80(z80_remaining_cycles)));
+			PROFILE(p_z80, PROFILE_Z80);
+			int32_t z80_cycles = z80_execute(masterToZ80(z80_remaining_cycles));
+			PROFILE_END(p_z80);
+			z80_elapsed = z80ToMaster(z80_cycles);
+			frame_counters.z80_cycles += z80_cycles;
 			z80_remaining_cycles -= z80_elapsed;
 		}
 		
@@ -140,12 +154,16 @@ void neogeo_runOneFrame() {
 		
 		currentTimeSeconds += masterToSeconds(elapsed_cycles);
 
-//		PROFILE(p_videoIRQ, ProfilingCategory::VideoAndIRQ);
+		PROFILE(p_scheduler, PROFILE_SCHEDULER);
 		timer_group_consume_cycles(elapsed_cycles);
-//		PROFILE_END(p_videoIRQ);
+		PROFILE_END(p_scheduler);
+
+		PC_SAMPLER_SLICE();
 	}
 	LOG(LOG_DEBUG, "68k cycles remaining: %d - z80 cycles remaining %d\n", remainingCyclesThisFrame, z80_remaining_cycles);
 	sound_finalize_one_frame();
+	frame_counters_end_frame();
+	PROFILE_FRAME_END();
 }
 
 bool neogeo_is_system_ready() {
@@ -163,12 +181,18 @@ bool neogeo_is_system_ready() {
 
 void neogeo_use_palette_bank_1() {
 	LOG(LOG_DEBUG, "neogeo_use_palette_bank_1\n");
+	if (video_capturing) {
+		video_capture_command(VIDEO_CAPTURE_PALETTE_BANK, 0, 0);
+	}
 	current_palette_ram = &palettes_ram1;
 	video_convert_current_palette_bank();
 }
 
 void neogeo_use_palette_bank_2() {
 	LOG(LOG_DEBUG, "neogeo_use_palette_bank_2\n");
+	if (video_capturing) {
+		video_capture_command(VIDEO_CAPTURE_PALETTE_BANK, 0, 1);
+	}
 	current_palette_ram = &palettes_ram2;
 	video_convert_current_palette_bank();
 }
@@ -178,6 +202,9 @@ void neogeo_use_palette_bank_2() {
 void neogeo_use_board_fix_rom() {
 	LOG(LOG_DEBUG, "neogeo_use_board_fix_rom\n");
 	current_fix_rom = &system_fix_rom;
+	if (video_capturing) {
+		video_capture_command(VIDEO_CAPTURE_FIX_ROM, 0, 0);
+	}
 	//TODO: M1 ROM too
 }
 
@@ -188,6 +215,9 @@ void neogeo_use_cartridge_fix_rom() {
 		return;
 	}
 	current_fix_rom = cartridge_get_first_fix_rom();
+	if (video_capturing) {
+		video_capture_command(VIDEO_CAPTURE_FIX_ROM, 0, 1);
+	}
 	//M1
 }
 
@@ -220,6 +250,7 @@ bool neogeo_set_system_Y_zoom_ROM(rom_region_t rom) {
 }
 
 bool neogeo_set_system_fix_ROM(rom_region_t rom) {
+	video_convert_fix_rom(rom.data, rom.size);
 	system_fix_rom = rom;
 	current_fix_rom = &system_fix_rom;
 	return true;
@@ -287,6 +318,24 @@ const memory_region_t* cpu_68k_memory_region_for_address(uint32_t address) {
 	return NULL;
 }
 
+const char *cpu_68k_memory_region_name(const memory_region_t *region) {
+	if (region == &p_rom_bank1_vector) return "P ROM vectors";
+	if (region == &p_rom_bank1) return "P ROM bank 1";
+	if (region == &work_ram) return "work RAM";
+	if (region == &work_ram_mirror) return "work RAM mirror";
+	if (region == &p_rom_bank2) return "P ROM bank 2";
+	if (region == &input_output) return "I/O";
+	if (region == &palettes_ram1) return "palettes RAM 1";
+	if (region == &palettes_ram2) return "palettes RAM 2";
+	if (region == &palettes_ram_mirror) return "palettes RAM mirror";
+	if (region == &memory_card) return "memory card";
+	if (region == &system_rom_vector) return "system ROM vectors";
+	if (region == &system_rom) return "system ROM";
+	if (region == &system_rom_mirror) return "system ROM mirror";
+	if (region == &backup_ram) return "backup RAM";
+	return "unknown";
+}
+
 void cpu_68k_update_interrupts() {
 	unsigned int level = 0;
 	if (pending_interrupts & VBlank) {
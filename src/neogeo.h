@@ -48,6 +48,7 @@ bool neogeo_is_system_ready(void);
 #pragma mark - 68K CPU bus access
 
 const memory_region_t* cpu_68k_memory_region_for_address(uint32_t address);
+const char *cpu_68k_memory_region_name(const memory_region_t *region);
 void cpu_68k_set_interrupt(cpu_68k_irq_m irq);
 void cpu_68k_ack_interrupt(cpu_68k_irq_m irq);
 int32_t cpu_68k_get_remaining_master_cycles(void);
@@ -0,0 +1,271 @@
+#include "pc_sampler.h"
+#include "log.h"
+#include "memory_mapping.h"
+#include "neogeo.h"
+#include "sound.h"
+
+#include "3rdParty/musashi/m68k.h"
+#include "3rdParty/z80/z80.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PC_SAMPLER_USED 0x80000000
+#define PC_SAMPLER_LINE_SIZE 128
+
+typedef struct pc_sampler_slot {
+	uint32_t address;		// PC_SAMPLER_USED | address
+	uint32_t count;
+} pc_sampler_slot_t;
+
+typedef struct pc_sampler_range {
+	uint32_t first;
+	uint32_t last;
+	uint64_t samples;
+} pc_sampler_range_t;
+
+bool pc_sampler_enabled = false;
+
+static uint32_t sampling_period = 1;
+static uint32_t slices_before_sample = 0;
+static pc_sampler_stats_t stats;
+
+// open addressing, the 68K programs span megabytes but few addresses are hot
+static pc_sampler_slot_t m68k_slots[PC_SAMPLER_68K_SLOTS];
+static uint32_t z80_counts[0x10000];
+
+static uint32_t pc_sampler_hash(uint32_t address);
+static uint32_t pc_sampler_m68k_count(uint32_t address);
+static size_t pc_sampler_m68k_ranges(pc_sampler_range_t **ranges);
+static size_t pc_sampler_z80_ranges(pc_sampler_range_t **ranges);
+static int pc_sampler_compare_addresses(const void *a, const void *b);
+static int pc_sampler_compare_ranges(const void *a, const void *b);
+static double pc_sampler_percent(uint64_t samples);
+static const char *pc_sampler_z80_region_name(uint32_t address);
+static void pc_sampler_report_m68k(FILE *file);
+static void pc_sampler_report_z80(FILE *file);
+
+#pragma mark - Public
+
+void pc_sampler_set_enabled(bool enabled, uint32_t period) {
+	if (enabled) {
+		memset(m68k_slots, 0, sizeof(m68k_slots));
+		memset(z80_counts, 0, sizeof(z80_counts));
+		memset(&stats, 0, sizeof(stats));
+		sampling_period = period ? period : 1;
+		slices_before_sample = 0;
+	}
+	pc_sampler_enabled = enabled;
+}
+
+void pc_sampler_sample() {
+	if (slices_before_sample) {
+		slices_before_sample--;
+		return;
+	}
+	slices_before_sample = sampling_period - 1;
+	stats.samples++;
+
+	uint32_t address = m68k_get_reg(NULL, M68K_REG_PC) & 0xFFFFFF;
+	uint32_t index = pc_sampler_hash(address);
+	for (uint32_t probe = 0; probe < PC_SAMPLER_68K_SLOTS; probe++) {
+		pc_sampler_slot_t *slot = &m68k_slots[index];
+		if (slot->address == (address | PC_SAMPLER_USED)) {
+			slot->count++;
+			break;
+		}
+		if (slot->address == 0) {
+			if (stats.m68k_addresses >= PC_SAMPLER_68K_SLOTS / 2) {
+				stats.m68k_dropped++;
+				break;
+			}
+			slot->address = address | PC_SAMPLER_USED;
+			slot->count = 1;
+			stats.m68k_addresses++;
+			break;
+		}
+		index = (index + 1) & (PC_SAMPLER_68K_SLOTS - 1);
+	}
+
+	stats.z80_addresses += z80_counts[Z80.pc.w.l] == 0;
+	z80_counts[Z80.pc.w.l]++;
+}
+
+pc_sampler_stats_t pc_sampler_get_stats() {
+	return stats;
+}
+
+bool pc_sampler_write_report(const char *path) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		LOG(LOG_ERROR, "pc_sampler_write_report: can't create %s\n", path);
+		return false;
+	}
+	fprintf(file, "%llu samples, one every %u scheduler slices\n", (unsigned long long)stats.samples, sampling_period);
+	fprintf(file, "68K: %llu addresses, %llu samples dropped once the table was full\n",
+			(unsigned long long)stats.m68k_addresses, (unsigned long long)stats.m68k_dropped);
+	fprintf(file, "Z80: %llu addresses\n", (unsigned long long)stats.z80_addresses);
+	pc_sampler_report_m68k(file);
+	pc_sampler_report_z80(file);
+	fclose(file);
+	return true;
+}
+
+#pragma mark - Private
+
+static uint32_t pc_sampler_hash(uint32_t address) {
+	// 68K instructions are word aligned
+	return ((address >> 1) * 2654435761u >> 16) & (PC_SAMPLER_68K_SLOTS - 1);
+}
+
+static uint32_t pc_sampler_m68k_count(uint32_t address) {
+	uint32_t index = pc_sampler_hash(address);
+	for (uint32_t probe = 0; probe < PC_SAMPLER_68K_SLOTS; probe++) {
+		if (m68k_slots[index].address == (address | PC_SAMPLER_USED)) {
+			return m68k_slots[index].count;
+		}
+		if (m68k_slots[index].address == 0) {
+			return 0;
+		}
+		index = (index + 1) & (PC_SAMPLER_68K_SLOTS - 1);
+	}
+	return 0;
+}
+
+// Sampled addresses close to each other and in the same memory region, hottest first
+static size_t pc_sampler_m68k_ranges(pc_sampler_range_t **ranges) {
+	uint32_t *addresses = malloc(sizeof(uint32_t) * (stats.m68k_addresses + 1));
+	*ranges = malloc(sizeof(pc_sampler_range_t) * (stats.m68k_addresses + 1));
+	if (addresses == NULL || *ranges == NULL) {
+		free(addresses);
+		free(*ranges);
+		*ranges = NULL;
+		return 0;
+	}
+	size_t addresses_count = 0;
+	for (uint32_t index = 0; index < PC_SAMPLER_68K_SLOTS; index++) {
+		if (m68k_slots[index].address) {
+			addresses[addresses_count++] = m68k_slots[index].address & ~PC_SAMPLER_USED;
+		}
+	}
+	qsort(addresses, addresses_count, sizeof(uint32_t), &pc_sampler_compare_addresses);
+
+	size_t ranges_count = 0;
+	const memory_region_t *range_region = NULL;
+	for (size_t index = 0; index < addresses_count; index++) {
+		uint32_t address = addresses[index];
+		const memory_region_t *region = cpu_68k_memory_region_for_address(address);
+		if (ranges_count == 0 || region != range_region || address - (*ranges)[ranges_count - 1].last > PC_SAMPLER_68K_RANGE_GAP) {
+			(*ranges)[ranges_count].first = address;
+			(*ranges)[ranges_count].samples = 0;
+			ranges_count++;
+			range_region = region;
+		}
+		(*ranges)[ranges_count - 1].last = address;
+		(*ranges)[ranges_count - 1].samples += pc_sampler_m68k_count(address);
+	}
+	free(addresses);
+	qsort(*ranges, ranges_count, sizeof(pc_sampler_range_t), &pc_sampler_compare_ranges);
+	return ranges_count;
+}
+
+static size_t pc_sampler_z80_ranges(pc_sampler_range_t **ranges) {
+	*ranges = malloc(sizeof(pc_sampler_range_t) * (stats.z80_addresses + 1));
+	if (*ranges == NULL) {
+		return 0;
+	}
+	size_t ranges_count = 0;
+	for (uint32_t address = 0; address < 0x10000; address++) {
+		if (z80_counts[address] == 0) {
+			continue;
+		}
+		if (ranges_count == 0 || pc_sampler_z80_region_name(address) != pc_sampler_z80_region_name((*ranges)[ranges_count - 1].last)
+			|| address - (*ranges)[ranges_count - 1].last > PC_SAMPLER_Z80_RANGE_GAP) {
+			(*ranges)[ranges_count].first = address;
+			(*ranges)[ranges_count].samples = 0;
+			ranges_count++;
+		}
+		(*ranges)[ranges_count - 1].last = address;
+		(*ranges)[ranges_count - 1].samples += z80_counts[address];
+	}
+	qsort(*ranges, ranges_count, sizeof(pc_sampler_range_t), &pc_sampler_compare_ranges);
+	return ranges_count;
+}
+
+static int pc_sampler_compare_addresses(const void *a, const void *b) {
+	uint32_t address_a = *(const uint32_t *)a;
+	uint32_t address_b = *(const uint32_t *)b;
+	return (address_a > address_b) - (address_a < address_b);
+}
+
+static int pc_sampler_compare_ranges(const void *a, const void *b) {
+	const pc_sampler_range_t *range_a = a;
+	const pc_sampler_range_t *range_b = b;
+	if (range_a->samples != range_b->samples) {
+		return range_a->samples < range_b->samples ? 1 : -1;
+	}
+	return (range_a->first > range_b->first) - (range_a->first < range_b->first);
+}
+
+static double pc_sampler_percent(uint64_t samples) {
+	return stats.samples ? 100.0 * samples / stats.samples : 0;
+}
+
+static const char *pc_sampler_z80_region_name(uint32_t address) {
+	if (address < Z80_BANK3_OFFSET) return "M1 ROM";
+	if (address < Z80_BANK2_OFFSET) return "M1 bank 3";
+	if (address < Z80_BANK1_OFFSET) return "M1 bank 2";
+	if (address < Z80_BANK0_OFFSET) return "M1 bank 1";
+	if (address < Z80_RAM_OFFSET) return "M1 bank 0";
+	return "Z80 RAM";
+}
+
+static void pc_sampler_report_m68k(FILE *file) {
+	pc_sampler_range_t *ranges;
+	size_t ranges_count = pc_sampler_m68k_ranges(&ranges);
+	char instruction[PC_SAMPLER_LINE_SIZE];
+
+	for (size_t index = 0; index < ranges_count && index < PC_SAMPLER_REPORT_RANGES; index++) {
+		const pc_sampler_range_t *range = &ranges[index];
+		const memory_region_t *region = cpu_68k_memory_region_for_address(range->first);
+		fprintf(file, "\n68K %06X-%06X %s+%X: %llu samples %.1f%%\n", range->first, range->last,
+				region ? cpu_68k_memory_region_name(region) : "unmapped", region ? range->first - region->start_address : range->first,
+				(unsigned long long)range->samples, pc_sampler_percent(range->samples));
+
+		// the range starts on a sampled PC, an instruction boundary
+		uint32_t address = range->first;
+		while (address <= range->last) {
+			unsigned int size = m68k_disassemble(instruction, address, M68K_CPU_TYPE_68000);
+			uint32_t count = pc_sampler_m68k_count(address);
+			if (count) {
+				fprintf(file, "  %06X %10u %5.1f%%  %s\n", address, count, pc_sampler_percent(count), instruction);
+			}
+			else {
+				fprintf(file, "  %06X                    %s\n", address, instruction);
+			}
+			address += size ? size : 2;
+		}
+	}
+	free(ranges);
+}
+
+// No Z80 disassembler in the tree, sampled addresses are listed with their opcode bytes
+static void pc_sampler_report_z80(FILE *file) {
+	pc_sampler_range_t *ranges;
+	size_t ranges_count = pc_sampler_z80_ranges(&ranges);
+
+	for (size_t index = 0; index < ranges_count && index < PC_SAMPLER_REPORT_RANGES; index++) {
+		const pc_sampler_range_t *range = &ranges[index];
+		fprintf(file, "\nZ80 %04X-%04X %s: %llu samples %.1f%%\n", range->first, range->last,
+				pc_sampler_z80_region_name(range->first), (unsigned long long)range->samples, pc_sampler_percent(range->samples));
+		for (uint32_t address = range->first; address <= range->last; address++) {
+			if (z80_counts[address] == 0) {
+				continue;
+			}
+			fprintf(file, "  %04X %10u %5.1f%%  %02X %02X %02X %02X\n", address, z80_counts[address], pc_sampler_percent(z80_counts[address]),
+					cpu_z80_read(address), cpu_z80_read((address + 1) & 0xFFFF), cpu_z80_read((address + 2) & 0xFFFF), cpu_z80_read((address + 3) & 0xFFFF));
+		}
+	}
+	free(ranges);
+}
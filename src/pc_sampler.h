@@ -0,0 +1,38 @@
+#ifndef pc_sampler_h
+#define pc_sampler_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *	Statistical profiler of the emulated programs: the 68K and Z80 program counters are sampled
+ *	at the end of every period-th scheduler slice, slices follow the timers so samples are spread in time
+ *	The report groups the sampled addresses in hot ranges, 68K ranges are disassembled with Musashi
+ *	Banked code is disassembled from the bank mapped when the report is written
+ */
+
+#define PC_SAMPLER_68K_SLOTS (1 << 16)		// hash table kept half empty, later addresses are only counted as dropped
+#define PC_SAMPLER_68K_RANGE_GAP 32			// bytes between two sampled addresses of the same range
+#define PC_SAMPLER_Z80_RANGE_GAP 16
+#define PC_SAMPLER_REPORT_RANGES 24			// hottest ranges of each CPU in the report
+
+typedef struct pc_sampler_stats {
+	uint64_t samples;
+	uint64_t m68k_addresses;
+	uint64_t m68k_dropped;
+	uint64_t z80_addresses;
+} pc_sampler_stats_t;
+
+extern bool pc_sampler_enabled;
+
+#define PC_SAMPLER_SLICE() if (pc_sampler_enabled) pc_sampler_sample()
+
+// Sampling starts over each time it is enabled
+void pc_sampler_set_enabled(bool enabled, uint32_t period);
+void pc_sampler_sample(void);
+
+pc_sampler_stats_t pc_sampler_get_stats(void);
+bool pc_sampler_write_report(const char *path);
+
+#endif /* pc_sampler_h */
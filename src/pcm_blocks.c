@@ -0,0 +1,160 @@
+#include "pcm_blocks.h"
+#include "log.h"
+#include "lru_stamps.h"
+#include "3rdParty/miniz/miniz.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PCM_BLOCKS_NO_SLOT 0xFF
+#define PCM_BLOCKS_COMPRESSION_LEVEL 1		// inflating speed doesn't depend on the level, loading time does
+
+static const uint8_t pcm_blocks_zeros[PCM_BLOCK_SIZE];
+
+static uint32_t pcm_blocks_length(const pcm_blocks_t *blocks, uint32_t block);
+static void pcm_blocks_inflate(const pcm_blocks_t *blocks, uint32_t block, uint8_t *destination);
+static uint8_t pcm_blocks_load_slot(pcm_blocks_t *blocks, uint32_t block, bool prefetched);
+
+#pragma mark - Public
+
+bool pcm_blocks_compress(pcm_blocks_t *blocks, const uint8_t *data, size_t size) {
+	memset(blocks, 0, sizeof(pcm_blocks_t));
+	if (data == NULL || size == 0) {
+		return true;
+	}
+	blocks->size = size;
+	blocks->blocks_count = (uint32_t)((size + PCM_BLOCK_SIZE - 1) >> PCM_BLOCK_SHIFT);
+	blocks->crc = (uint32_t)mz_crc32(MZ_CRC32_INIT, data, size);
+
+	// worst case every block is stored as is
+	blocks->offsets = malloc((blocks->blocks_count + 1) * sizeof(uint32_t));
+	blocks->data = malloc(size);
+	blocks->cache = malloc(PCM_BLOCKS_CACHE_SLOTS * PCM_BLOCK_SIZE);
+	blocks->block_slots = malloc(blocks->blocks_count);
+	tdefl_compressor *compressor = tdefl_compressor_alloc();
+	if (blocks->offsets == NULL || blocks->data == NULL || blocks->cache == NULL || blocks->block_slots == NULL || compressor == NULL) {
+		LOG(LOG_ERROR, "pcm_blocks_compress: can't allocate %zu KB\n", size / 1024);
+		tdefl_compressor_free(compressor);
+		pcm_blocks_release(blocks);
+		return false;
+	}
+
+	mz_uint flags = tdefl_create_comp_flags_from_zip_params(PCM_BLOCKS_COMPRESSION_LEVEL, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+	uint32_t offset = 0;
+	for (uint32_t block = 0; block < blocks->blocks_count; block++) {
+		size_t start = (size_t)block << PCM_BLOCK_SHIFT;
+		size_t length = size - start < PCM_BLOCK_SIZE ? size - start : PCM_BLOCK_SIZE;
+		size_t in_size = length;
+		size_t out_size = length - 1;
+		blocks->offsets[block] = offset;
+		tdefl_init(compressor, NULL, NULL, flags);
+		if (length > 1 && tdefl_compress(compressor, data + start, &in_size, blocks->data + offset, &out_size, TDEFL_FINISH) == TDEFL_STATUS_DONE) {
+			offset += (uint32_t)out_size;
+		}
+		else {
+			// a block as long as its uncompressed size is stored
+			memcpy(blocks->data + offset, data + start, length);
+			offset += (uint32_t)length;
+		}
+	}
+	blocks->offsets[blocks->blocks_count] = offset;
+	tdefl_compressor_free(compressor);
+
+	uint8_t *shrunk = realloc(blocks->data, offset);
+	if (shrunk != NULL) {
+		blocks->data = shrunk;
+	}
+	memset(blocks->block_slots, PCM_BLOCKS_NO_SLOT, blocks->blocks_count);
+	for (uint8_t slot = 0; slot < PCM_BLOCKS_CACHE_SLOTS; slot++) {
+		blocks->slot_blocks[slot] = UINT32_MAX;
+	}
+	blocks->stats.size = size;
+	blocks->stats.stored_size = offset + (blocks->blocks_count + 1) * sizeof(uint32_t) + blocks->blocks_count + PCM_BLOCKS_CACHE_SLOTS * PCM_BLOCK_SIZE;
+	return true;
+}
+
+void pcm_blocks_release(pcm_blocks_t *blocks) {
+	free(blocks->offsets);
+	free(blocks->data);
+	free(blocks->cache);
+	free(blocks->block_slots);
+	memset(blocks, 0, sizeof(pcm_blocks_t));
+}
+
+const uint8_t *pcm_blocks_read(pcm_blocks_t *blocks, uint32_t block) {
+	if (block >= blocks->blocks_count) {
+		return pcm_blocks_zeros;
+	}
+	blocks->stats.fetches++;
+	uint8_t slot = blocks->block_slots[block];
+	if (slot != PCM_BLOCKS_NO_SLOT && blocks->slot_prefetched[slot] == false) {
+		lru_stamps_touch(&blocks->use_counter, blocks->slot_last_use, PCM_BLOCKS_CACHE_SLOTS, slot);
+		return blocks->cache + ((size_t)slot << PCM_BLOCK_SHIFT);
+	}
+	if (slot == PCM_BLOCKS_NO_SLOT) {
+		blocks->stats.misses++;
+		slot = pcm_blocks_load_slot(blocks, block, false);
+	}
+	else {
+		blocks->stats.prefetch_hits++;
+		blocks->slot_prefetched[slot] = false;
+		lru_stamps_touch(&blocks->use_counter, blocks->slot_last_use, PCM_BLOCKS_CACHE_SLOTS, slot);
+	}
+
+	// first use of the block: a sample playing through it will need the next one
+	if (block + 1 < blocks->blocks_count && blocks->block_slots[block + 1] == PCM_BLOCKS_NO_SLOT) {
+		blocks->stats.prefetches++;
+		pcm_blocks_load_slot(blocks, block + 1, true);
+	}
+	return blocks->cache + ((size_t)slot << PCM_BLOCK_SHIFT);
+}
+
+void pcm_blocks_expand(pcm_blocks_t *blocks, uint8_t *destination) {
+	uint8_t inflated[PCM_BLOCK_SIZE];
+	for (uint32_t block = 0; block < blocks->blocks_count; block++) {
+		size_t start = (size_t)block << PCM_BLOCK_SHIFT;
+		size_t length = blocks->size - start < PCM_BLOCK_SIZE ? blocks->size - start : PCM_BLOCK_SIZE;
+		pcm_blocks_inflate(blocks, block, inflated);
+		memcpy(destination + start, inflated, length);
+	}
+}
+
+pcm_blocks_stats_t pcm_blocks_get_stats(const pcm_blocks_t *blocks) {
+	return blocks->stats;
+}
+
+#pragma mark - Private
+
+static uint32_t pcm_blocks_length(const pcm_blocks_t *blocks, uint32_t block) {
+	size_t start = (size_t)block << PCM_BLOCK_SHIFT;
+	return blocks->size - start < PCM_BLOCK_SIZE ? (uint32_t)(blocks->size - start) : PCM_BLOCK_SIZE;
+}
+
+// A whole PCM_BLOCK_SIZE is written, the last block is padded with zeros
+static void pcm_blocks_inflate(const pcm_blocks_t *blocks, uint32_t block, uint8_t *destination) {
+	uint32_t length = pcm_blocks_length(blocks, block);
+	uint32_t compressed_length = blocks->offsets[block + 1] - blocks->offsets[block];
+	const uint8_t *source = blocks->data + blocks->offsets[block];
+	if (compressed_length == length) {
+		memcpy(destination, source, length);
+	}
+	else if (tinfl_decompress_mem_to_mem(destination, length, source, compressed_length, 0) != length) {
+		LOG(LOG_ERROR, "pcm_blocks_inflate: block %u is corrupted\n", block);
+		memset(destination, 0, length);
+	}
+	memset(destination + length, 0, PCM_BLOCK_SIZE - length);
+}
+
+// Least recently used slot, the block asked for was just used so it is never the one evicted by its prefetch
+static uint8_t pcm_blocks_load_slot(pcm_blocks_t *blocks, uint32_t block, bool prefetched) {
+	uint8_t victim = (uint8_t)lru_stamps_oldest(blocks->slot_last_use, PCM_BLOCKS_CACHE_SLOTS);
+	if (blocks->slot_blocks[victim] != UINT32_MAX) {
+		blocks->block_slots[blocks->slot_blocks[victim]] = PCM_BLOCKS_NO_SLOT;
+	}
+	pcm_blocks_inflate(blocks, block, blocks->cache + ((size_t)victim << PCM_BLOCK_SHIFT));
+	blocks->slot_blocks[victim] = block;
+	blocks->slot_prefetched[victim] = prefetched;
+	lru_stamps_touch(&blocks->use_counter, blocks->slot_last_use, PCM_BLOCKS_CACHE_SLOTS, victim);
+	blocks->block_slots[block] = victim;
+	return victim;
+}
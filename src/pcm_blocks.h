@@ -0,0 +1,54 @@
+#ifndef pcm_blocks_h
+#define pcm_blocks_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *	PCM ROM kept in independently deflated blocks
+ *	ADPCM playback only streams through a few places of the V ROMs at a time, so blocks are inflated
+ *	on access into a small LRU cache, and the block following the one asked for is inflated ahead
+ *	Blocks that don't shrink are stored as is
+ */
+
+#define PCM_BLOCK_SHIFT 13								// 8 KB blocks
+#define PCM_BLOCK_SIZE (1 << PCM_BLOCK_SHIFT)
+#define PCM_BLOCKS_CACHE_SLOTS 32						// 256 KB of inflated blocks per ROM
+
+typedef struct pcm_blocks_stats {
+	uint64_t fetches;			// blocks asked for by the YM2610, each time it moves to another block
+	uint64_t misses;			// blocks inflated on demand
+	uint64_t prefetches;		// blocks inflated ahead
+	uint64_t prefetch_hits;		// blocks inflated ahead then asked for
+	size_t size;				// uncompressed ROM
+	size_t stored_size;			// compressed blocks, index and cache
+} pcm_blocks_stats_t;
+
+typedef struct pcm_blocks {
+	size_t size;
+	uint32_t blocks_count;
+	uint32_t *offsets;			// blocks_count + 1 offsets in data
+	uint8_t *data;
+	uint32_t crc;				// CRC-32 of the uncompressed ROM
+	uint8_t *cache;
+	uint8_t *block_slots;		// cache slot of every block, PCM_BLOCKS_NO_SLOT when not inflated
+	uint32_t slot_blocks[PCM_BLOCKS_CACHE_SLOTS];
+	uint32_t slot_last_use[PCM_BLOCKS_CACHE_SLOTS];
+	bool slot_prefetched[PCM_BLOCKS_CACHE_SLOTS];
+	uint32_t use_counter;
+	pcm_blocks_stats_t stats;
+} pcm_blocks_t;
+
+// Compresses size bytes of data, data is left untouched
+bool pcm_blocks_compress(pcm_blocks_t *blocks, const uint8_t *data, size_t size);
+void pcm_blocks_release(pcm_blocks_t *blocks);
+
+// Inflated block, valid until the next read. Blocks past the ROM read as zeros
+const uint8_t *pcm_blocks_read(pcm_blocks_t *blocks, uint32_t block);
+// Inflates the whole ROM to destination, size bytes long
+void pcm_blocks_expand(pcm_blocks_t *blocks, uint8_t *destination);
+
+pcm_blocks_stats_t pcm_blocks_get_stats(const pcm_blocks_t *blocks);
+
+#endif /* pcm_blocks_h */
@@ -0,0 +1,214 @@
+#include "profile.h"
+#include "log.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *profile_category_names[PROFILE_CATEGORIES_COUNT] = {
+	"68K", "Z80", "sprite list", "sprite draw", "fix", "YM synthesis", "scheduler", "ROM load"
+};
+
+#ifdef NEOGEO_PROFILE
+
+#define PROFILE_LOG_LINE_SIZE 1024
+
+bool profile_enabled = true;
+
+// Written from the loading workers too
+static atomic_uint_fast64_t pending_nsec[PROFILE_CATEGORIES_COUNT];
+static atomic_uint_fast64_t pending_calls[PROFILE_CATEGORIES_COUNT];
+
+static uint64_t frame_start;
+static uint32_t log_interval = 0;
+static profile_report_t report;
+
+// Since the last periodic log
+static uint64_t interval_frames;
+static uint64_t interval_frames_nsec;
+static uint64_t interval_nsec[PROFILE_CATEGORIES_COUNT];
+
+static uint32_t history_usec[PROFILE_HISTORY_FRAMES];
+static uint32_t history_next;
+
+static void profile_collect(uint64_t *nsec, uint64_t *calls);
+static uint32_t profile_histogram_percentile(const profile_report_t *frames_report, uint32_t percentile);
+static void profile_log(uint64_t frames, uint64_t frames_nsec, const uint64_t *categories_nsec);
+
+#pragma mark - Public
+
+bool profile_compiled() {
+	return true;
+}
+
+void profile_set_enabled(bool enabled) {
+	profile_enabled = enabled;
+}
+
+void profile_set_log_interval(uint32_t frames_interval) {
+	log_interval = frames_interval;
+}
+
+void profile_reset() {
+	for (uint8_t category = 0; category < PROFILE_CATEGORIES_COUNT; category++) {
+		atomic_store(&pending_nsec[category], 0);
+		atomic_store(&pending_calls[category], 0);
+	}
+	memset(&report, 0, sizeof(profile_report_t));
+	memset(interval_nsec, 0, sizeof(interval_nsec));
+	interval_frames = 0;
+	interval_frames_nsec = 0;
+	history_next = 0;
+}
+
+void profile_add(profile_category_t category, uint64_t nsec) {
+	atomic_fetch_add_explicit(&pending_nsec[category], nsec, memory_order_relaxed);
+	atomic_fetch_add_explicit(&pending_calls[category], 1, memory_order_relaxed);
+}
+
+void profile_frame_begin() {
+	frame_start = monotonic_time_nsec();
+}
+
+void profile_frame_end() {
+	uint64_t frame_nsec = monotonic_time_nsec() - frame_start;
+	uint64_t calls[PROFILE_CATEGORIES_COUNT];
+	profile_collect(report.last_frame_nsec, calls);
+	for (uint8_t category = 0; category < PROFILE_CATEGORIES_COUNT; category++) {
+		report.category_nsec[category] += report.last_frame_nsec[category];
+		report.category_calls[category] += calls[category];
+		interval_nsec[category] += report.last_frame_nsec[category];
+	}
+	report.frames++;
+	report.frames_nsec += frame_nsec;
+	interval_frames++;
+	interval_frames_nsec += frame_nsec;
+
+	// the oldest frame leaves the rolling window
+	uint32_t usec = (uint32_t)(frame_nsec / 1000);
+	uint32_t bucket = usec / PROFILE_HISTOGRAM_BUCKET_USEC;
+	if (report.window_frames == PROFILE_HISTORY_FRAMES) {
+		uint32_t oldest_bucket = history_usec[history_next] / PROFILE_HISTOGRAM_BUCKET_USEC;
+		report.histogram[oldest_bucket < PROFILE_HISTOGRAM_BUCKETS ? oldest_bucket : PROFILE_HISTOGRAM_BUCKETS - 1]--;
+	}
+	else {
+		report.window_frames++;
+	}
+	report.histogram[bucket < PROFILE_HISTOGRAM_BUCKETS ? bucket : PROFILE_HISTOGRAM_BUCKETS - 1]++;
+	history_usec[history_next] = usec;
+	history_next = (history_next + 1) % PROFILE_HISTORY_FRAMES;
+
+	if (log_interval != 0 && interval_frames >= log_interval) {
+		profile_log(interval_frames, interval_frames_nsec, interval_nsec);
+		memset(interval_nsec, 0, sizeof(interval_nsec));
+		interval_frames = 0;
+		interval_frames_nsec = 0;
+	}
+}
+
+profile_report_t profile_get_report() {
+	// ROM load happens between frames, it would only be collected by the next one
+	uint64_t calls[PROFILE_CATEGORIES_COUNT];
+	uint64_t nsec[PROFILE_CATEGORIES_COUNT];
+	profile_collect(nsec, calls);
+	for (uint8_t category = 0; category < PROFILE_CATEGORIES_COUNT; category++) {
+		report.category_nsec[category] += nsec[category];
+		report.category_calls[category] += calls[category];
+	}
+
+	profile_report_t current = report;
+	current.p50_usec = profile_histogram_percentile(&current, 50);
+	current.p90_usec = profile_histogram_percentile(&current, 90);
+	current.p99_usec = profile_histogram_percentile(&current, 99);
+	current.max_usec = 0;
+	for (uint32_t i = 0; i < current.window_frames; i++) {
+		current.max_usec = history_usec[i] > current.max_usec ? history_usec[i] : current.max_usec;
+	}
+	return current;
+}
+
+void profile_log_report() {
+	profile_report_t current = profile_get_report();
+	profile_log(current.frames, current.frames_nsec, current.category_nsec);
+}
+
+#pragma mark - Private
+
+static void profile_collect(uint64_t *nsec, uint64_t *calls) {
+	for (uint8_t category = 0; category < PROFILE_CATEGORIES_COUNT; category++) {
+		nsec[category] = atomic_exchange_explicit(&pending_nsec[category], 0, memory_order_relaxed);
+		calls[category] = atomic_exchange_explicit(&pending_calls[category], 0, memory_order_relaxed);
+	}
+}
+
+// Upper bound of the bucket holding the percentile
+static uint32_t profile_histogram_percentile(const profile_report_t *frames_report, uint32_t percentile) {
+	if (frames_report->window_frames == 0) {
+		return 0;
+	}
+	uint32_t rank = (frames_report->window_frames * percentile + 99) / 100;
+	uint32_t count = 0;
+	for (uint32_t bucket = 0; bucket < PROFILE_HISTOGRAM_BUCKETS; bucket++) {
+		count += frames_report->histogram[bucket];
+		if (count >= rank) {
+			return (bucket + 1) * PROFILE_HISTOGRAM_BUCKET_USEC;
+		}
+	}
+	return PROFILE_HISTOGRAM_BUCKETS * PROFILE_HISTOGRAM_BUCKET_USEC;
+}
+
+// Per frame averages of the categories, then frame times of the rolling window
+static void profile_log(uint64_t frames, uint64_t frames_nsec, const uint64_t *categories_nsec) {
+	if (frames == 0) {
+		return;
+	}
+	char line[PROFILE_LOG_LINE_SIZE];
+	int length = snprintf(line, sizeof(line), "profile: %llu frames, %.3f ms per frame -",
+						  (unsigned long long)frames, frames_nsec / 1e6 / frames);
+	for (uint8_t category = 0; category < PROFILE_ROM_LOAD && length < (int)sizeof(line); category++) {
+		length += snprintf(line + length, sizeof(line) - length, " %s %.3f", profile_category_names[category], categories_nsec[category] / 1e6 / frames);
+	}
+	LOG(LOG_INFO, "%s\n", line);
+
+	profile_report_t current = profile_get_report();
+	length = snprintf(line, sizeof(line), "profile: last %u frames p50 %.2f p90 %.2f p99 %.2f max %.2f ms -",
+					  current.window_frames, current.p50_usec / 1000.0, current.p90_usec / 1000.0,
+					  current.p99_usec / 1000.0, current.max_usec / 1000.0);
+	for (uint32_t bucket = 0; bucket < PROFILE_HISTOGRAM_BUCKETS && length < (int)sizeof(line); bucket++) {
+		if (current.histogram[bucket] != 0) {
+			length += snprintf(line + length, sizeof(line) - length, " %.2f:%u",
+							   bucket * PROFILE_HISTOGRAM_BUCKET_USEC / 1000.0, current.histogram[bucket]);
+		}
+	}
+	LOG(LOG_INFO, "%s\n", line);
+}
+
+#else
+
+bool profile_compiled() {
+	return false;
+}
+
+void profile_set_enabled(bool enabled) {
+}
+
+void profile_set_log_interval(uint32_t frames_interval) {
+}
+
+void profile_reset() {
+}
+
+profile_report_t profile_get_report() {
+	profile_report_t report;
+	memset(&report, 0, sizeof(profile_report_t));
+	return report;
+}
+
+void profile_log_report() {
+}
+
+#endif
+
+const char *profile_category_name(profile_category_t category) {
+	return category < PROFILE_CATEGORIES_COUNT ? profile_category_names[category] : "unknown";
+}
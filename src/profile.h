@@ -0,0 +1,88 @@
+#ifndef profile_h
+#define profile_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *	Hot path profiler, only built with NEOGEO_PROFILE defined (cmake -DNEOGEO_PROFILE=ON)
+ *	Without it the markers compile to nothing and the reports stay empty
+ *
+ *		PROFILE(p_m68k, PROFILE_M68K);
+ *		m68k_execute(cycles);
+ *		PROFILE_END(p_m68k);
+ *
+ *	Categories nest: the scheduler includes the lines drawing and the YM2610 synthesis done on timers,
+ *	the Z80 includes the synthesis its writes flush. ROM load is outside of the frames
+ *	With the neogeo_sound_thread option on, YM synthesis only measures what the emulation thread still renders,
+ *	the sound thread isn't profiled
+ */
+
+typedef enum profile_category {
+	PROFILE_M68K,
+	PROFILE_Z80,
+	PROFILE_SPRITE_LIST,
+	PROFILE_SPRITE_DRAW,
+	PROFILE_FIX,
+	PROFILE_YM_SYNTHESIS,
+	PROFILE_SCHEDULER,
+	PROFILE_ROM_LOAD,
+	PROFILE_CATEGORIES_COUNT
+} profile_category_t;
+
+#define PROFILE_HISTORY_FRAMES 600				// rolling window of frame times, 10 seconds
+#define PROFILE_HISTOGRAM_BUCKET_USEC 250
+#define PROFILE_HISTOGRAM_BUCKETS 128			// up to 32 ms, longer frames land in the last bucket
+
+typedef struct profile_report {
+	uint64_t frames;											// since profile_reset
+	uint64_t frames_nsec;
+	uint64_t category_nsec[PROFILE_CATEGORIES_COUNT];
+	uint64_t category_calls[PROFILE_CATEGORIES_COUNT];
+	uint64_t last_frame_nsec[PROFILE_CATEGORIES_COUNT];			// categories of the last frame alone
+	uint32_t window_frames;										// frames of the rolling window
+	uint32_t histogram[PROFILE_HISTOGRAM_BUCKETS];
+	uint32_t p50_usec;											// bucket upper bounds
+	uint32_t p90_usec;
+	uint32_t p99_usec;
+	uint32_t max_usec;
+} profile_report_t;
+
+#ifdef NEOGEO_PROFILE
+
+#include "common_tools.h"
+
+extern bool profile_enabled;
+
+#define PROFILE(name, category) const profile_category_t name##_category = (category); const uint64_t name##_start = profile_enabled ? monotonic_time_nsec() : 0
+#define PROFILE_END(name) if (name##_start != 0) profile_add(name##_category, monotonic_time_nsec() - name##_start)
+#define PROFILE_FRAME_BEGIN() if (profile_enabled) profile_frame_begin()
+#define PROFILE_FRAME_END() if (profile_enabled) profile_frame_end()
+
+void profile_add(profile_category_t category, uint64_t nsec);
+void profile_frame_begin(void);
+void profile_frame_end(void);
+
+#else
+
+#define PROFILE(name, category)
+#define PROFILE_END(name)
+#define PROFILE_FRAME_BEGIN()
+#define PROFILE_FRAME_END()
+
+#endif
+
+// false when built without NEOGEO_PROFILE, everything else is then a no-op
+bool profile_compiled(void);
+// Enabled by default in profiling builds
+void profile_set_enabled(bool enabled);
+// Logs a report every frames_interval frames, 0 never does
+void profile_set_log_interval(uint32_t frames_interval);
+void profile_reset(void);
+
+profile_report_t profile_get_report(void);
+const char *profile_category_name(profile_category_t category);
+void profile_log_report(void);
+
+#endif /* profile_h */
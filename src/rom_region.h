@@ -1,6 +1,9 @@
 #ifndef rom_region_h
 #define rom_region_h
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef struct rom_region {
 	uint8_t* data;
 	size_t size;
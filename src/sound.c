@@ -1,20 +1,40 @@
 #include "cartridge.h"
+#include "frame_counters.h"
 #include "log.h"
 #include "memory_mapping.h"
 #include "neogeo.h"
+#include "pcm_blocks.h"
+#include "profile.h"
 #include "sound.h"
 #include "timer.h"
 #include "timers_group.h"
+#include "ym2610_capture.h"
 #include "3rdParty/musashi/m68k.h"
 #include "3rdParty/ym/ym2610.h"
 #include "3rdParty/z80/z80.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <stdlib.h>
 
 void YM2610IrqHandler(int irq);
 void YM2610TimerHandler(int channel, int count, double steptime);
+static void sound_allocate_audio_buffer(void);
+static void sound_render_samples(int count);
+static const uint8_t *sound_read_pcm_block(void *param, uint32_t block);
+static int32_t sound_current_master_cycles(void);
+static void sound_count_ym2610_write(uint8_t value);
+static bool sound_ym2610_write_keys_on_adpcm(uint8_t value);
+static uint32_t sound_sample_at(int32_t master_cycles);
+static void sound_flush_ym2610_writes(uint32_t until_sample);
+static void sound_render_until(uint32_t sample);
+static bool sound_thread_start(void);
+static void sound_thread_stop(void);
+static void sound_thread_submit(uint32_t until_sample);
+static void sound_thread_sync(void);
+static void *sound_thread_main(void *argument);
 
 
 /// Buffer for the generated audio
@@ -27,12 +47,12 @@ double samplesThisFrameF;
 /// How many samples to generate this frame (this can vary because of rounding)
 uint32_t samplesThisFrame;
 
-/// The index of the sample corresponding to the current emulated time
-uint32_t currentSample;
-
 /// Write index for audio data
 uint32_t audioWritePointer;
 
+/// Output rate of the YM2610 and the libretro audio
+uint32_t audioSampleRate = AUDIO_SAMPLE_RATE_DEFAULT;
+
 bool z80NMIDisabled = true;
 
 #pragma mark - Z80 memory map
@@ -49,6 +69,71 @@ rom_region_t z80_work_ram;
 rom_region_t pcm_rom_a;
 rom_region_t pcm_rom_b;
 
+#pragma mark - YM2610 write queue
+
+/*
+ *	Z80 writes to the YM2610 are queued with their master cycles timestamp,
+ *	then applied at their exact sample position when samples are rendered:
+ *	once per frame, or every block of samples when a block size is set.
+ *	Timer registers writes and reads of the synthesis state force a catch up first.
+ */
+
+#define YM2610_WRITE_QUEUE_SIZE 1024
+
+typedef struct ym2610_queued_write {
+	int32_t master_cycles;		// since the frame start
+	uint8_t port;
+	uint8_t value;
+} ym2610_queued_write_t;
+
+static ym2610_queued_write_t ym2610_write_queue[YM2610_WRITE_QUEUE_SIZE];
+static uint32_t ym2610_write_queue_count = 0;
+static uint32_t ym2610_block_samples = 0;		// 0 renders once per frame
+static bool ym2610_flushing = false;
+static uint8_t ym2610_latched_address = 0;		// last address port write, queued or not
+static uint8_t ym2610_latched_port = 0;
+static uint32_t ym2610_requested_sample = 0;	// samples flushed so far this frame, rendered or still in the sound thread ring
+
+#pragma mark - YM2610 capture
+
+static ym2610_capture_t ym2610_capture;
+static char *ym2610_capture_path = NULL;		// the capture starts with the next reset
+static uint64_t ym2610_capture_frame_sample = 0;	// samples of the finished frames since the capture start
+
+#pragma mark - Sound thread
+
+/*
+ *	Optional YM2610 synthesis thread.
+ *	The Z80 and the YM2610 timers stay in lockstep with the 68K: REG_SOUND replies and NMIs
+ *	are cycle exact, a Z80 running ahead would make the 68K see different replies from one run to the other.
+ *	The thread takes the synthesis: flushed writes go through a single producer single consumer ring,
+ *	then get applied and rendered in the exact order the emulation thread would have used.
+ *	The ring size bounds how far the synthesis can lag behind, the emulation thread waits for it to drain
+ *	before touching the chip itself (timers writes, SSG and ADPCM status reads, CSM) and at the frame end.
+ *	Only the synthesis moves, the thread never updates statistics: the emulation thread waits for the PCM ROMs
+ *	before queuing an ADPCM key on, and the profiler doesn't see the thread's rendering.
+ */
+
+#define SOUND_THREAD_RING_SIZE 4096		// power of 2
+#define SOUND_THREAD_RENDER 0xff		// ring command port, renders up to the sample without writing
+
+typedef struct sound_thread_command {
+	uint32_t sample;
+	uint8_t port;
+	uint8_t value;
+} sound_thread_command_t;
+
+static sound_thread_command_t sound_thread_ring[SOUND_THREAD_RING_SIZE];
+static atomic_uint sound_thread_head;		// written by the emulation thread only
+static atomic_uint sound_thread_tail;		// written by the sound thread only
+static atomic_bool sound_thread_quit;
+static bool sound_thread_enabled = false;
+static bool sound_thread_running = false;
+static pthread_t sound_thread;
+static pthread_mutex_t sound_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sound_thread_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sound_thread_drained = PTHREAD_COND_INITIALIZER;
+
 #pragma mark - Lifecycle
 
 void sound_init() {
@@ -60,13 +145,32 @@ void sound_init() {
 	z80_work_ram.data = malloc(Z80_RAM_SIZE);
 	z80_work_ram.size = Z80_RAM_SIZE;
 	
-	audio_buffer_size = sizeof(FMSAMPLE) * 2 * ((AUDIO_SAMPLE_RATE / FRAME_RATE) + 1);
-	audioBuffer = malloc(audio_buffer_size);
+	sound_allocate_audio_buffer();
 	
 	z80_init(0, Z80_CLOCK, NULL, z80_irq_callback);
+	
+	// FM, ADPCM and SSG tables are built once, resets only reinitialize the registers
+	ym2610_init(YM2610_CLOCK, audioSampleRate, &YM2610TimerHandler, &YM2610IrqHandler);
+}
+
+void sound_set_sample_rate(uint32_t rate) {
+	if (rate == audioSampleRate) {
+		return;
+	}
+	sound_thread_sync();
+	LOG(LOG_INFO, "sound_set_sample_rate: %u Hz\n", rate);
+	audioSampleRate = rate;
+	sound_allocate_audio_buffer();
+	samplesThisFrameF = 0;
+	samplesThisFrame = 0;
+	audioWritePointer = 0;
+	// the FM, ADPCM and SSG steps and filters depend on the rate
+	ym2610_init(YM2610_CLOCK, audioSampleRate, &YM2610TimerHandler, &YM2610IrqHandler);
 }
 
 void sound_reset() {
+	sound_thread_sync();
+	
 	z80_bank_0_offset = 0xF000;
 	z80_bank_1_offset = 0xE000;
 	z80_bank_2_offset = 0xC000;
@@ -76,7 +180,6 @@ void sound_reset() {
 	
 	samplesThisFrameF = 0;
 	samplesThisFrame = 0;
-	currentSample = 0;
 	audioWritePointer = 0;
 	memset(audioBuffer, 0, audio_buffer_size);
 	
@@ -84,47 +187,161 @@ void sound_reset() {
 	
 	z80_reset();
 	
-	if (pcm_rom_a.data != NULL) {
-		free(pcm_rom_a.data);
-		pcm_rom_a.size = 0;
-	}
-	if (pcm_rom_b.data != NULL) {
-		free(pcm_rom_b.data);
-		pcm_rom_b.size = 0;
-	}
-	pcm_rom_a = cartridge_create_pcm_rom(0);
+	ym2610_write_queue_count = 0;
+	ym2610_latched_address = 0;
+	ym2610_latched_port = 0;
+	
+	// PCM ROMs are owned by the cartridge
+	pcm_rom_a = *cartridge_get_pcm_rom(0);
 	LOG(LOG_INFO, "sound_reset: found %d KB of PCM A\n", pcm_rom_a.size / 1024);
-	pcm_rom_b = cartridge_create_pcm_rom(1);
+	pcm_rom_b = *cartridge_get_pcm_rom(1);
 	LOG(LOG_INFO, "sound_reset: found %d KB of PCM B\n", pcm_rom_b.size / 1024);
 	
-	ym2610_init(YM2610_CLOCK, AUDIO_SAMPLE_RATE, pcm_rom_a.data, pcm_rom_a.size, pcm_rom_b.data, pcm_rom_b.size, &YM2610TimerHandler, &YM2610IrqHandler);
+	if (cartridge_pcm_roms_compressed()) {
+		ym2610_set_pcm_rom_blocks(pcm_rom_a.size, (void *)(intptr_t)0, pcm_rom_b.size, (void *)(intptr_t)1, PCM_BLOCK_SHIFT, &sound_read_pcm_block);
+	}
+	else {
+		ym2610_set_pcm_roms(pcm_rom_a.data, pcm_rom_a.size, pcm_rom_b.data, pcm_rom_b.size);
+	}
+	ym2610_reset();
+	
+	if (ym2610_capture_path != NULL) {
+		ym2610_capture_finish(&ym2610_capture, ym2610_capture_frame_sample);
+		ym2610_capture_create(&ym2610_capture, ym2610_capture_path, (uint32_t)YM2610_CLOCK, audioSampleRate,
+							  (uint32_t)pcm_rom_a.size, cartridge_get_pcm_rom_crc(0), (uint32_t)pcm_rom_b.size, cartridge_get_pcm_rom_crc(1));
+		ym2610_capture_frame_sample = 0;
+	}
+	
+	if (sound_thread_enabled && sound_thread_running == false) {
+		sound_thread_running = sound_thread_start();
+	}
 }
 
 void sound_start_one_frame()
 {
-	samplesThisFrameF += (double)AUDIO_SAMPLE_RATE / (double)FRAME_RATE;
+	samplesThisFrameF += (double)audioSampleRate / (double)FRAME_RATE;
 	samplesThisFrame = (uint32_t)ceil(samplesThisFrameF);
 	samplesThisFrameF -= samplesThisFrame;
 	audioWritePointer = 0;
+	ym2610_requested_sample = 0;
 }
 
-void sound_update_current_sample()
+void sound_finalize_one_frame()
 {
-	int32_t remaining_cycles = cpu_68k_get_remaining_master_cycles();
-	uint32_t positive_remaining_cycles = remaining_cycles > 0 ? remaining_cycles : 0;
-	currentSample = (uint32_t)(round((double)(MASTER_CYCLES_PER_FRAME - positive_remaining_cycles) * (samplesThisFrame - 1) / MASTER_CYCLES_PER_FRAME));
+	// Apply this frame's YM2610 writes and generate the remaining samples
+	sound_flush_ym2610_writes(samplesThisFrame);
+	sound_thread_sync();
+	ym2610_activity_t activity;
+	ym2610_take_activity(&activity);
+	frame_counters.fm_voices = activity.fm;
+	frame_counters.adpcma_voices = activity.adpcm_a;
+	frame_counters.adpcmb_voices = activity.adpcm_b;
+	frame_counters.ssg_voices = activity.ssg;
+	frame_counters.silent_samples = activity.silent_samples;
+	ym2610_capture_frame_sample += samplesThisFrame;
 }
 
-void sound_finalize_one_frame()
-{
-//	LOG(LOG_DEBUG, "sound_finalize_one_frame current samples = %u, already wrote %u\n", currentSample, audioWritePointer);
-	// Generate YM2610 samples
-	if (audioWritePointer < samplesThisFrame)
-		ym2610_update(samplesThisFrame - audioWritePointer);
+void sound_set_ym2610_block_size(uint32_t samples) {
+	ym2610_block_samples = samples;
+}
+
+void sound_set_thread_enabled(bool enabled) {
+	sound_thread_enabled = enabled;
+	if (enabled == false && sound_thread_running) {
+		sound_thread_stop();
+	}
+}
+
+void sound_set_ym2610_capture(const char *path) {
+	free(ym2610_capture_path);
+	ym2610_capture_path = path != NULL ? strdup(path) : NULL;
+	if (path == NULL) {
+		ym2610_capture_finish(&ym2610_capture, ym2610_capture_frame_sample);
+	}
+}
+
+void sound_set_adpcma_cache_budget(size_t bytes) {
+	ym2610_set_adpcma_cache_budget(bytes);
+}
+
+void sound_unload(void) {
+	if (sound_thread_running) {
+		sound_thread_stop();
+	}
+	ym2610_capture_finish(&ym2610_capture, ym2610_capture_frame_sample);
+	ym2610_adpcma_cache_stats_t stats = ym2610_get_adpcma_cache_stats();
+	uint64_t lookups = stats.hits + stats.misses;
+	if (lookups) {
+		LOG(LOG_INFO, "sound: ADPCM-A cache %llu hits, %llu misses, %llu evictions, %llu uncached (%.2f%% hit rate, %zu KB)\n",
+			(unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.evictions, (unsigned long long)stats.uncached,
+			(100.0 * stats.hits) / lookups, stats.bytes / 1024);
+	}
+	ym2610_release_adpcma_cache();
+}
+
+#pragma mark - YM2610 access
+
+void sound_ym2610_write(uint8_t port, uint8_t value) {
+	port &= 3;
+	int32_t master_cycles = sound_current_master_cycles();
+	if (ym2610_capture.file != NULL) {
+		ym2610_capture_add(&ym2610_capture, ym2610_capture_frame_sample + sound_sample_at(master_cycles), YM2610_CAPTURE_WRITE_PORT_0 + port, value);
+	}
+	if (port & 1) {
+		sound_count_ym2610_write(value);
+	}
+	if ((port & 1) == 0) {
+		ym2610_latched_address = value;
+		ym2610_latched_port = port >> 1;
+	}
+	else if (port == 1 && ym2610_latched_port == 0 && ym2610_latched_address >= 0x24 && ym2610_latched_address <= 0x27) {
+		// Timers run on the master clock, they can't wait for the next render
+		sound_flush_ym2610_writes(sound_sample_at(master_cycles));
+		sound_thread_sync();
+		ym2610_write(port, value);
+		return;
+	}
+	
+	if (sound_thread_running && (port & 1) && sound_ym2610_write_keys_on_adpcm(value)) {
+		// the sound thread must never wait for the background loading
+		cartridge_require_pcm_roms();
+	}
+	
+	if (ym2610_write_queue_count == YM2610_WRITE_QUEUE_SIZE) {
+		sound_flush_ym2610_writes(sound_sample_at(master_cycles));
+	}
+	ym2610_queued_write_t *write = &ym2610_write_queue[ym2610_write_queue_count++];
+	write->master_cycles = master_cycles;
+	write->port = port;
+	write->value = value;
 	
-//	LOG(LOG_DEBUG, "sound_finalize_one_frame %u samples this frame vs %u audio write pointer\n", samplesThisFrame, audioWritePointer);
+	if (ym2610_block_samples) {
+		uint32_t sample = sound_sample_at(master_cycles);
+		if (sample >= ym2610_requested_sample + ym2610_block_samples) {
+			sound_flush_ym2610_writes(sample);
+		}
+	}
+}
+
+uint8_t sound_ym2610_read(uint8_t port) {
+	port &= 3;
+	// Timers status is always up to date, SSG registers and ADPCM status need the queued writes and synthesis
+	if (port == 1 || port == 2) {
+		sound_flush_ym2610_writes(sound_sample_at(sound_current_master_cycles()));
+		sound_thread_sync();
+	}
+	return ym2610_read(port);
+}
+
+void sound_ym2610_timer_over(int channel) {
+	if (ym2610_capture.file != NULL) {
+		ym2610_capture_add(&ym2610_capture, ym2610_capture_frame_sample + sound_sample_at(sound_current_master_cycles()), channel ? YM2610_CAPTURE_TIMER_B : YM2610_CAPTURE_TIMER_A, 0);
+	}
+	ym2610_timerOver(channel);
 }
 
+#pragma mark - Z80 bus
+
 uint8_t cpu_z80_read(uint32_t address) {
 //	LOG(LOG_DEBUG, "cpu_z80_read at 0x%08X\n", address);
 	uint32_t offset = 0;
@@ -201,21 +418,215 @@ void cpu_z80_acknowledge_nmi() {
 
 #pragma mark - YM2610 callbacks
 
+// The YM2610 is about to change its state out of the write queue, synthesis must catch up first
 void ym2610_update_request(void)
 {
-	sound_update_current_sample();
-//	LOG(LOG_DEBUG, "YM2610UpdateRequest currentSample %u - writeptr %u \n", currentSample, audioWritePointer);
-	if (currentSample > audioWritePointer + 4)
-		ym2610_update(currentSample - audioWritePointer);
+	// the sound thread only calls it while applying writes
+	if (ym2610_flushing || (sound_thread_running && pthread_equal(pthread_self(), sound_thread))) {
+		return;
+	}
+	sound_flush_ym2610_writes(sound_sample_at(sound_current_master_cycles()));
+	sound_thread_sync();
 }
 
-void ym2610_update_audio_buffer(FMSAMPLE lt, FMSAMPLE rt)
-{
-	assert(audioWritePointer < samplesThisFrame);
-//	LOG(LOG_DEBUG, "YM2610UpdateAudioBuffer lt 0x%08X - rt 0x%08X\n", lt, rt);
-	audioBuffer[audioWritePointer * 2] = lt;
-	audioBuffer[audioWritePointer * 2 + 1] = rt;
-	audioWritePointer++;
+// Room for the largest frame at the current rate
+static void sound_allocate_audio_buffer(void) {
+	free(audioBuffer);
+	audio_buffer_size = sizeof(FMSAMPLE) * 2 * ((audioSampleRate / FRAME_RATE) + 1);
+	audioBuffer = malloc(audio_buffer_size);
+	memset(audioBuffer, 0, audio_buffer_size);
+}
+
+// The chip renders the interleaved stereo samples straight into the frame buffer
+static void sound_render_samples(int count) {
+	assert(audioWritePointer + count <= samplesThisFrame);
+	ym2610_update(audioBuffer + audioWritePointer * 2, count);
+	audioWritePointer += count;
+}
+
+// Compressed PCM ROMs, param is the cartridge_get_pcm_rom index
+static const uint8_t *sound_read_pcm_block(void *param, uint32_t block) {
+	return cartridge_read_pcm_block((int)(intptr_t)param, block);
+}
+
+// ADPCM-A key on is port B register 0x00, ADPCM-B start is port A register 0x10, bit 7 set means dump or reset
+static void sound_count_ym2610_write(uint8_t value) {
+	frame_counters.ym2610_writes++;
+	if (ym2610_latched_port == 1 && ym2610_latched_address == 0x00 && (value & 0x80) == 0) {
+		frame_counters.adpcma_key_ons += __builtin_popcount(value & 0x3F);
+	}
+	else if (ym2610_latched_port == 0 && ym2610_latched_address == 0x10 && (value & 0x81) == 0x80) {
+		frame_counters.adpcmb_key_ons++;
+	}
+}
+
+// ADPCM-A key on or ADPCM-B start, whatever its reset bit
+static bool sound_ym2610_write_keys_on_adpcm(uint8_t value) {
+	if (ym2610_latched_port == 1 && ym2610_latched_address == 0x00) {
+		return (value & 0x80) == 0 && (value & 0x3F) != 0;
+	}
+	return ym2610_latched_port == 0 && ym2610_latched_address == 0x10 && (value & 0x80) != 0;
+}
+
+static int32_t sound_current_master_cycles() {
+	int32_t remaining_cycles = cpu_68k_get_remaining_master_cycles();
+	return MASTER_CYCLES_PER_FRAME - (remaining_cycles > 0 ? remaining_cycles : 0);
+}
+
+static uint32_t sound_sample_at(int32_t master_cycles) {
+	if (master_cycles <= 0) {
+		return 0;
+	}
+	if (master_cycles >= MASTER_CYCLES_PER_FRAME) {
+		return samplesThisFrame;
+	}
+	return (uint32_t)(((uint64_t)master_cycles * samplesThisFrame) / MASTER_CYCLES_PER_FRAME);
+}
+
+// Renders up to until_sample, applying every queued write at its own sample
+static void sound_flush_ym2610_writes(uint32_t until_sample) {
+	if (until_sample > samplesThisFrame) {
+		until_sample = samplesThisFrame;
+	}
+	if (ym2610_write_queue_count) {
+		uint32_t last_sample = sound_sample_at(ym2610_write_queue[ym2610_write_queue_count - 1].master_cycles);
+		if (last_sample > ym2610_requested_sample) {
+			ym2610_requested_sample = last_sample;
+		}
+	}
+	if (until_sample > ym2610_requested_sample) {
+		ym2610_requested_sample = until_sample;
+	}
+	if (sound_thread_running) {
+		sound_thread_submit(until_sample);
+		return;
+	}
+	ym2610_flushing = true;
+	for (uint32_t i = 0; i < ym2610_write_queue_count; i++) {
+		const ym2610_queued_write_t *write = &ym2610_write_queue[i];
+		sound_render_until(sound_sample_at(write->master_cycles));
+		ym2610_write(write->port, write->value);
+	}
+	ym2610_write_queue_count = 0;
+	sound_render_until(until_sample);
+	ym2610_flushing = false;
+}
+
+// Emulation thread only, PCM ROMs may still be loading in the background and only ADPCM playback needs them
+static void sound_render_until(uint32_t sample) {
+	if (sample > audioWritePointer) {
+		if (ym2610_adpcm_active()) {
+			cartridge_require_pcm_roms();
+		}
+		PROFILE(p_ym2610, PROFILE_YM_SYNTHESIS);
+		sound_render_samples(sample - audioWritePointer);
+		PROFILE_END(p_ym2610);
+	}
+}
+
+#pragma mark - Sound thread
+
+static bool sound_thread_start(void) {
+	atomic_store(&sound_thread_head, 0);
+	atomic_store(&sound_thread_tail, 0);
+	atomic_store(&sound_thread_quit, false);
+	if (pthread_create(&sound_thread, NULL, sound_thread_main, NULL) != 0) {
+		LOG(LOG_ERROR, "sound_thread_start: can't create the sound thread, rendering on the emulation thread\n");
+		return false;
+	}
+	LOG(LOG_INFO, "sound_thread_start: YM2610 synthesis runs on its own thread\n");
+	return true;
+}
+
+static void sound_thread_stop(void) {
+	sound_thread_sync();
+	pthread_mutex_lock(&sound_thread_mutex);
+	atomic_store(&sound_thread_quit, true);
+	pthread_cond_signal(&sound_thread_work);
+	pthread_mutex_unlock(&sound_thread_mutex);
+	pthread_join(sound_thread, NULL);
+	sound_thread_running = false;
+}
+
+// Moves the queued writes to the ring, waits for room when the sound thread is too far behind
+static void sound_thread_submit(uint32_t until_sample) {
+	unsigned head = atomic_load_explicit(&sound_thread_head, memory_order_relaxed);
+	for (uint32_t i = 0; i <= ym2610_write_queue_count; i++) {
+		if (head - atomic_load_explicit(&sound_thread_tail, memory_order_acquire) == SOUND_THREAD_RING_SIZE) {
+			atomic_store_explicit(&sound_thread_head, head, memory_order_release);
+			pthread_mutex_lock(&sound_thread_mutex);
+			pthread_cond_signal(&sound_thread_work);
+			while (head - atomic_load_explicit(&sound_thread_tail, memory_order_acquire) == SOUND_THREAD_RING_SIZE) {
+				pthread_cond_wait(&sound_thread_drained, &sound_thread_mutex);
+			}
+			pthread_mutex_unlock(&sound_thread_mutex);
+		}
+		sound_thread_command_t *command = &sound_thread_ring[head & (SOUND_THREAD_RING_SIZE - 1)];
+		if (i < ym2610_write_queue_count) {
+			const ym2610_queued_write_t *write = &ym2610_write_queue[i];
+			command->sample = sound_sample_at(write->master_cycles);
+			command->port = write->port;
+			command->value = write->value;
+		}
+		else {
+			command->sample = until_sample;
+			command->port = SOUND_THREAD_RENDER;
+			command->value = 0;
+		}
+		head++;
+	}
+	ym2610_write_queue_count = 0;
+	atomic_store_explicit(&sound_thread_head, head, memory_order_release);
+	
+	pthread_mutex_lock(&sound_thread_mutex);
+	pthread_cond_signal(&sound_thread_work);
+	pthread_mutex_unlock(&sound_thread_mutex);
+}
+
+// Waits for the sound thread to apply everything submitted, the emulation thread owns the chip again after it
+static void sound_thread_sync(void) {
+	if (sound_thread_running == false) {
+		return;
+	}
+	unsigned head = atomic_load_explicit(&sound_thread_head, memory_order_relaxed);
+	if (atomic_load_explicit(&sound_thread_tail, memory_order_acquire) == head) {
+		return;
+	}
+	pthread_mutex_lock(&sound_thread_mutex);
+	while (atomic_load_explicit(&sound_thread_tail, memory_order_acquire) != head) {
+		pthread_cond_wait(&sound_thread_drained, &sound_thread_mutex);
+	}
+	pthread_mutex_unlock(&sound_thread_mutex);
+}
+
+static void *sound_thread_main(void *argument) {
+	unsigned tail = atomic_load_explicit(&sound_thread_tail, memory_order_relaxed);
+	while (true) {
+		unsigned head = atomic_load_explicit(&sound_thread_head, memory_order_acquire);
+		if (head == tail) {
+			pthread_mutex_lock(&sound_thread_mutex);
+			pthread_cond_broadcast(&sound_thread_drained);
+			while (atomic_load_explicit(&sound_thread_head, memory_order_acquire) == tail && atomic_load(&sound_thread_quit) == false) {
+				pthread_cond_wait(&sound_thread_work, &sound_thread_mutex);
+			}
+			pthread_mutex_unlock(&sound_thread_mutex);
+			if (atomic_load(&sound_thread_quit)) {
+				break;
+			}
+			continue;
+		}
+		for (; tail != head; tail++) {
+			const sound_thread_command_t *command = &sound_thread_ring[tail & (SOUND_THREAD_RING_SIZE - 1)];
+			if (command->sample > audioWritePointer) {
+				sound_render_samples(command->sample - audioWritePointer);
+			}
+			if (command->port != SOUND_THREAD_RENDER) {
+				ym2610_write(command->port, command->value);
+			}
+		}
+		atomic_store_explicit(&sound_thread_tail, tail, memory_order_release);
+	}
+	return NULL;
 }
 
 void YM2610TimerHandler(int channel, int count, double clock)
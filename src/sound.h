@@ -3,21 +3,43 @@
 
 #include "memory_region.h"
 #include "rom_region.h"
+#include "timer.h"
+#include "3rdParty/ym/ym2610.h"
 
 #include <stdio.h>
 
 
-static uint32_t AUDIO_SAMPLE_RATE = 44100;
+#define AUDIO_SAMPLE_RATE_DEFAULT 44100
+// the YM2610 FM output rate, clock / 144
+#define AUDIO_SAMPLE_RATE_NATIVE ((uint32_t)(YM2610_CLOCK / 144))
 
 extern bool z80NMIDisabled;
 extern int16_t *audioBuffer;
 extern uint32_t samplesThisFrame;
+extern uint32_t audioSampleRate;
 
 void sound_init(void);
 void sound_reset(void);
 
+// rebuilds the YM2610 for a new output rate, the machine must be reset after
+void sound_set_sample_rate(uint32_t rate);
+
 void sound_start_one_frame(void);
 void sound_finalize_one_frame(void);
+// YM2610 writes are rendered every block of samples, 0 for once per frame
+void sound_set_ym2610_block_size(uint32_t samples);
+// YM2610 synthesis on its own thread, the output is the same as without it
+void sound_set_thread_enabled(bool enabled);
+// decoded ADPCM-A samples memory, 0 decodes the PCM ROM every time
+void sound_set_adpcma_cache_budget(size_t bytes);
+// logs the ADPCM-A cache stats and releases it
+void sound_unload(void);
+
+void sound_ym2610_write(uint8_t port, uint8_t value);
+uint8_t sound_ym2610_read(uint8_t port);
+void sound_ym2610_timer_over(int channel);
+// records every YM2610 write and timer overflow from the next reset on, NULL stops
+void sound_set_ym2610_capture(const char *path);
 
 uint8_t cpu_z80_read(uint32_t address);
 void cpu_z80_write(uint32_t address, uint8_t data);
@@ -0,0 +1,120 @@
+#include "tile_cache.h"
+#include "cartridge.h"
+#include "log.h"
+#include "lru_stamps.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t TILE_CACHE_INVALID_TAG = 0xFFFFFFFF;
+
+typedef struct tile_cache_set {
+	uint32_t tags[TILE_CACHE_WAYS_COUNT];
+} tile_cache_set_t;
+
+bool tile_cache_enabled = false;
+
+static tile_cache_set_t *sets = NULL;
+static uint32_t *last_use = NULL;		// TILE_CACHE_WAYS_COUNT stamps per set
+static uint8_t *lines = NULL;
+static uint32_t sets_mask = 0;
+static uint32_t use_counter = 0;
+static tile_cache_stats_t stats;
+
+#pragma mark - Public
+
+bool tile_cache_init(size_t size) {
+	tile_cache_release();
+
+	size_t sets_count = size / (CHARACTER_TILE_BYTES * TILE_CACHE_WAYS_COUNT);
+	if (sets_count == 0) {
+		LOG(LOG_ERROR, "tile_cache_init: %zu bytes is too small for a tile cache\n", size);
+		return false;
+	}
+	// keep a power of two to index sets with a mask
+	while (sets_count & (sets_count - 1)) {
+		sets_count &= sets_count - 1;
+	}
+
+	sets = malloc(sets_count * sizeof(tile_cache_set_t));
+	last_use = malloc(sets_count * TILE_CACHE_WAYS_COUNT * sizeof(uint32_t));
+	lines = malloc(sets_count * TILE_CACHE_WAYS_COUNT * CHARACTER_TILE_BYTES);
+	if (sets == NULL || last_use == NULL || lines == NULL) {
+		LOG(LOG_ERROR, "tile_cache_init: can't allocate %zu sets\n", sets_count);
+		tile_cache_release();
+		return false;
+	}
+	sets_mask = (uint32_t)sets_count - 1;
+	tile_cache_invalidate();
+	tile_cache_enabled = true;
+
+	LOG(LOG_INFO, "tile_cache_init: %zu sets x %u ways (%zu KB)\n", sets_count, TILE_CACHE_WAYS_COUNT, (sets_count * TILE_CACHE_WAYS_COUNT * CHARACTER_TILE_BYTES) / 1024);
+	return true;
+}
+
+void tile_cache_release(void) {
+	free(sets);
+	free(last_use);
+	free(lines);
+	sets = NULL;
+	last_use = NULL;
+	lines = NULL;
+	sets_mask = 0;
+	tile_cache_enabled = false;
+}
+
+void tile_cache_invalidate(void) {
+	if (sets == NULL) {
+		return;
+	}
+	for (uint32_t set_index = 0; set_index <= sets_mask; set_index++) {
+		for (uint8_t way = 0; way < TILE_CACHE_WAYS_COUNT; way++) {
+			sets[set_index].tags[way] = TILE_CACHE_INVALID_TAG;
+		}
+	}
+	memset(last_use, 0, ((size_t)sets_mask + 1) * TILE_CACHE_WAYS_COUNT * sizeof(uint32_t));
+	use_counter = 0;
+	memset(&stats, 0, sizeof(tile_cache_stats_t));
+}
+
+const uint8_t *tile_cache_fetch(uint32_t tile_index) {
+	uint32_t set_index = tile_index & sets_mask;
+	tile_cache_set_t *set = &sets[set_index];
+	uint8_t *set_lines = lines + ((size_t)set_index * TILE_CACHE_WAYS_COUNT * CHARACTER_TILE_BYTES);
+	size_t set_stamps = (size_t)set_index * TILE_CACHE_WAYS_COUNT;
+	size_t stamps_count = ((size_t)sets_mask + 1) * TILE_CACHE_WAYS_COUNT;
+
+	for (uint8_t way = 0; way < TILE_CACHE_WAYS_COUNT; way++) {
+		if (set->tags[way] == tile_index) {
+			stats.hits++;
+			lru_stamps_touch(&use_counter, last_use, stamps_count, set_stamps + way);
+			return set_lines + (way * CHARACTER_TILE_BYTES);
+		}
+	}
+
+	// Least recently used way gets the decoded tile
+	uint8_t victim = (uint8_t)lru_stamps_oldest(last_use + set_stamps, TILE_CACHE_WAYS_COUNT);
+	stats.misses++;
+	if (set->tags[victim] != TILE_CACHE_INVALID_TAG) {
+		stats.evictions++;
+	}
+	uint8_t *line = set_lines + (victim * CHARACTER_TILE_BYTES);
+	cartridge_decode_sprite_tile(tile_index, line);
+	set->tags[victim] = tile_index;
+	lru_stamps_touch(&use_counter, last_use, stamps_count, set_stamps + victim);
+	return line;
+}
+
+tile_cache_stats_t tile_cache_get_stats(void) {
+	return stats;
+}
+
+void tile_cache_log_stats(void) {
+	if (tile_cache_enabled == false) {
+		return;
+	}
+	uint64_t accesses = stats.hits + stats.misses;
+	LOG(LOG_INFO, "tile_cache: %llu hits, %llu misses, %llu evictions (%.2f%% hit rate)\n",
+		(unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.evictions,
+		accesses ? (100.0 * stats.hits) / accesses : 0.0);
+}
@@ -0,0 +1,34 @@
+#ifndef tile_cache_h
+#define tile_cache_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *	Set associative cache of serialized sprite tiles
+ *	Tiles are decoded from the raw C ROMs on first use (see cartridge_decode_sprite_tile)
+ *	so big cartridges don't need the whole serialized sprites data in memory
+ */
+
+static const size_t TILE_CACHE_SIZE = 4 * 1024 * 1024;	// 32768 tiles of 128 bytes
+#define TILE_CACHE_WAYS_COUNT 4
+
+typedef struct tile_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+} tile_cache_stats_t;
+
+extern bool tile_cache_enabled;
+
+bool tile_cache_init(size_t size);
+void tile_cache_release(void);
+void tile_cache_invalidate(void);
+
+const uint8_t *tile_cache_fetch(uint32_t tile_index);
+
+tile_cache_stats_t tile_cache_get_stats(void);
+void tile_cache_log_stats(void);
+
+#endif /* tile_cache_h */
@@ -1,11 +1,12 @@
 #include "timers_group.h"
 #include "log.h"
 #include "neogeo.h"
+#include "profile.h"
+#include "sound.h"
 #include "video.h"
 
 #include "3rdParty/musashi/m68kcpu.h"
 #include "3rdParty/pd4990a/pd4990a.h"
-#include "3rdParty/ym/ym2610.h"
 
 
 timers_group_t timers;
@@ -40,14 +41,7 @@ static void vblank_callback(void) {
 	}
 	
 	cpu_68k_set_interrupt(VBlank);
-
-	if (!video.auto_animation_frame_counter)
-	{
-		video.auto_animation_frame_counter = video.auto_animation_speed;
-		video.auto_animation_counter++;
-	}
-	else
-		video.auto_animation_frame_counter--;
+	video_update_auto_animation();
 }
 
 static void video_timer_callback(void) {
@@ -70,28 +64,37 @@ static void draw_line_callback(void) {
 	if (scanline >= FIRST_ACTIVE_LINE && scanline < VBLANK_LINE) {
 		video_draw_empty_line(scanline);
 		
+		PROFILE(p_sprites_list, PROFILE_SPRITE_LIST);
 		video_create_sprites_list(scanline);
+		PROFILE_END(p_sprites_list);
+		PROFILE(p_sprites, PROFILE_SPRITE_DRAW);
 		video_draw_sprites(scanline);
+		PROFILE_END(p_sprites);
 		
+		PROFILE(p_fix, PROFILE_FIX);
 		video_draw_fix(scanline);
+		PROFILE_END(p_fix);
 	}
 	
 	scanline++;
 	if (scanline == VERTICAL_PIXELS) {
 		LOG(LOG_DEBUG, "draw_line_callback all line done, up to 0\n");
 		scanline = 0;
+		if (video_capturing) {
+			video_capture_next_frame();
+		}
 	}
 	timer_arm_relative(&drawline, pixelToMaster(HORIZONTAL_PIXELS));
 }
 
 static void ym2610TimerACallback(void)
 {
-	ym2610_timerOver(0);
+	sound_ym2610_timer_over(0);
 }
 
 static void ym2610TimerBCallback(void)
 {
-	ym2610_timerOver(1);
+	sound_ym2610_timer_over(1);
 }
 
 static void pd4990a_callback(void) {
@@ -136,6 +139,7 @@ void timers_group_reset() {
 	timer_arm(&watchdog, WATCHDOG_DELAY);
 	watchdog.active = false;
 	
+	scanline = 0;
 	timer_arm(&drawline, pixelToMaster(HORIZONTAL_PIXELS));
 	video_timer.active = false;
 	timer_arm(&pd4990a, MASTER_CLOCK / PD4990A_CLOCK);
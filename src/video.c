@@ -1,10 +1,12 @@
 #include "cartridge.h"
 #include "video.h"
 #include "endian.h"
+#include "frame_counters.h"
 #include "log.h"
 #include "memory_mapping.h"
 #include "neogeo.h"
 #include "timers_group.h"
+#include "video_capture.h"
 
 #include <assert.h>
 #include <string.h>
@@ -84,6 +86,11 @@ bool cartrigde_plugged_in = false;
 
 static uint8_t debug_log_vram = 0;
 
+bool video_capturing = false;
+static video_capture_t capture;
+static char *capture_path = NULL;			// the capture starts with the next reset
+static uint64_t capture_frame_line = 0;		// lines of the finished frames since the capture start
+
 #pragma mark - 68k Video Registers access
 
 static uint16_t vram_read_word(uint32_t offset) {
@@ -155,9 +162,15 @@ static void vram_write_word(uint32_t offset, uint16_t data) {
 			break;
 		case REG_VRAMMOD:
 			vram_modulo = data;
+			if (video_capturing) {
+				video_capture_command(VIDEO_CAPTURE_VRAM_MODULO, 0, data);
+			}
 //			LOG(LOG_DEBUG, "vram_write_word REG_VRAMMOD - 0x%04X\n", data);
 			break;
 		case REG_LSPCMODE:
+			if (video_capturing) {
+				video_capture_command(VIDEO_CAPTURE_LSPC_MODE, 0, data);
+			}
 			video.auto_animation_speed = data >> 8;
 			video.auto_animation_disabled = (data & 0x0008) != 0;
 			video.timer_control = (uint8_t)(data & 0x00F0);
@@ -223,6 +236,11 @@ void video_reset(void) {
 	video.auto_animation_speed = 0;
 	video.auto_animation_counter = 0;
 	video.auto_animation_disabled = false;
+	video.auto_animation_frame_counter = 0;
+	video.timer_control = 0;
+	video.timer_counter = 0;
+	timer_reg_high = 0;
+	timer_reg_low = 0;
 	
 	memset(_vram_data, 0, VRAM_SIZE);
 	vram_address = 0;
@@ -235,6 +253,15 @@ void video_reset(void) {
 	sprite_clipping = 32;
 	
 	cartrigde_plugged_in = cartridge_plugged_in();
+	
+	if (capture_path != NULL) {
+		video_capture_finish(&capture, capture_frame_line + timer_group_get_current_y_scanline());
+		uint32_t fix_rom_size = cartrigde_plugged_in ? (uint32_t)cartridge_get_first_fix_rom()->size : 0;
+		video_capturing = video_capture_create(&capture, capture_path, fix_rom_size, (uint32_t)serialized_c_roms.size);
+		capture_frame_line = 0;
+		// the line counter is reset after the video, the fix ROM was chosen before
+		video_capture_add(&capture, 0, VIDEO_CAPTURE_FIX_ROM, 0, cartrigde_plugged_in && current_fix_rom == cartridge_get_first_fix_rom());
+	}
 }
 
 uint32_t video_reload_timer(void) {
@@ -242,6 +269,16 @@ uint32_t video_reload_timer(void) {
 	return video.timer_counter;
 }
 
+void video_update_auto_animation(void) {
+	if (!video.auto_animation_frame_counter)
+	{
+		video.auto_animation_frame_counter = video.auto_animation_speed;
+		video.auto_animation_counter++;
+	}
+	else
+		video.auto_animation_frame_counter--;
+}
+
 #pragma mark Palette converter
 
 void video_convert_current_palette_bank(void)
@@ -314,6 +351,11 @@ void video_create_sprites_list(uint32_t scanline) {
 		if (activeCount >= MAX_SPRITES_PER_LINE)
 		break;
 	}
+	frame_counters.sprites_lines++;
+	frame_counters.sprites_total += activeCount;
+	if (activeCount > frame_counters.sprites_max_per_line) {
+		frame_counters.sprites_max_per_line = activeCount;
+	}
 	
 	if (scanline == 112 && debug_log_vram) {
 		LOG(LOG_DEBUG, "video_create_sprites_list: %d sprites on scanline %d - ", activeCount, scanline);
@@ -325,10 +367,10 @@ void video_create_sprites_list(uint32_t scanline) {
 	}
 }
 
-static inline void draw_sprite_line(uint32_t zoomX, int increment, uint8_t *pixels_base,
+static inline void draw_sprite_line(uint32_t zoomX, int increment, const uint8_t *pixels_base,
 									const uint16_t* paletteBase, uint16_t* frameBuffer_p)
 {
-	uint64_t pixels_pair = *(uint64_t *)pixels_base;
+	uint64_t pixels_pair = *(const uint64_t *)pixels_base;
 	uint8_t color_index = 0;
 	uint16_t shrinkX_table_index = zoomX * 16;
 	for (int i = 0; i < 16; ++i)
@@ -345,10 +387,10 @@ static inline void draw_sprite_line(uint32_t zoomX, int increment, uint8_t *pixe
 	}
 }
 
-static inline void draw_sprite_line_clipped(uint32_t zoomX, int increment, uint8_t *pixels_base, const uint16_t* paletteBase,
+static inline void draw_sprite_line_clipped(uint32_t zoomX, int increment, const uint8_t *pixels_base, const uint16_t* paletteBase,
 											uint16_t* frameBuffer_p, const uint16_t* low, const uint16_t* high)
 {
-	uint64_t pixels_pair = *(uint64_t *)pixels_base;
+	uint64_t pixels_pair = *(const uint64_t *)pixels_base;
 	uint8_t color_index = 0;
 	uint16_t shrinkX_table_index = zoomX * 16;
 	for (int i = 0; i < 16; ++i)
@@ -444,9 +486,8 @@ void video_draw_sprite(uint32_t spriteNumber, uint32_t x, uint32_t y, uint32_t z
 	}
 
 	const uint16_t* paletteBase = video.palettes_colors + ((tileControl >> 8) * PALETTE_COLOR_NBR);
-	uint32_t pixels_offset = (tileIndex * CHARACTER_TILE_BYTES) + (tileLine * 8);
-	assert(pixels_offset < serialized_c_roms.size);
-	uint8_t *pixels_base = serialized_c_roms.data + pixels_offset;
+	assert((tileIndex * CHARACTER_TILE_BYTES) + (tileLine * 8) < serialized_c_roms.size);
+	const uint8_t *pixels_base = cartridge_sprite_tile(tileIndex) + (tileLine * 8);
 
 	if (clipped)
 	{
@@ -477,6 +518,11 @@ void video_draw_sprites(uint32_t scanline)
 		spriteList = _vram_data + VRAM_SPRITES_EVEN_START;
 	}
 	
+	if (*spriteList) {
+		// sprites tiles may still be loading in the background
+		cartridge_require_sprites();
+	}
+	
 	for (uint16_t currentSprite = 0; currentSprite < VRAM_SPRITES_LIST_SIZE; currentSprite++)
 	{
 		uint16_t spriteNumber = *spriteList++;
@@ -533,9 +579,25 @@ static const uint16_t FIX_ROM_BYTES_PER_TILE = 32;		// 8*8 pixels * 4 bits = 32
   		17 - 1F - 07 - 0F
  
  So to find our scanline to draw, we need to advance for tile address (scanline % 8) bytes
+ 
+ Fix ROMs are converted once at load time (see video_convert_fix_rom) to row major tiles:
+ 4 bytes per scanline, left to right, with the same pixel pairs nibbles
  */
 static const uint8_t fix_framebuffer_offset_mapping[4] = {0x10, 0x18, 0x00, 0x08};
 
+void video_convert_fix_rom(uint8_t *data, size_t size) {
+	uint8_t tile[FIX_ROM_BYTES_PER_TILE];
+	for (size_t tile_offset = 0; tile_offset + FIX_ROM_BYTES_PER_TILE <= size; tile_offset += FIX_ROM_BYTES_PER_TILE) {
+		uint8_t *tile_base = data + tile_offset;
+		for (uint8_t line = 0; line < FIX_TILE_PIXELS_HEIGHT; line++) {
+			for (uint8_t index = 0; index < 4; index++) {
+				tile[(line * 4) + index] = tile_base[fix_framebuffer_offset_mapping[index] + line];
+			}
+		}
+		memcpy(tile_base, tile, FIX_ROM_BYTES_PER_TILE);
+	}
+}
+
 // Note: scanline between 16 and 240!
 void video_draw_fix(uint32_t scanline) {
 	uint16_t* videoRamPtr = _vram_data + VRAM_FIXMAP_START;
@@ -555,12 +617,11 @@ void video_draw_fix(uint32_t scanline) {
 //			continue;
 //		}
 		
-		uint8_t* fixBase = current_fix_rom->data + ((tile_number * FIX_ROM_BYTES_PER_TILE) + (scanline % FIX_TILE_PIXELS_HEIGHT));
+		const uint8_t* fixBase = current_fix_rom->data + ((tile_number * FIX_ROM_BYTES_PER_TILE) + ((scanline % FIX_TILE_PIXELS_HEIGHT) * 4));
 		uint16_t* colorsBase = video.palettes_colors + (palette_number * PALETTE_COLOR_NBR);
 		
 		for (uint8_t index = 0; index < 4; index++) {
-			uint8_t offset = fix_framebuffer_offset_mapping[index];
-			uint8_t pixel_pair = fixBase[offset];
+			uint8_t pixel_pair = fixBase[index];
 			uint8_t pixel_left_color_index = pixel_pair & 0x0F;
 			uint8_t pixel_right_color_index = pixel_pair >> 4;
 			
@@ -594,6 +655,25 @@ void video_draw_empty_line(uint32_t scanline) {
 	}
 }
 
+#pragma mark - Command log
+
+void video_set_capture(const char *path) {
+	free(capture_path);
+	capture_path = path != NULL ? strdup(path) : NULL;
+	if (path == NULL) {
+		video_capture_finish(&capture, capture_frame_line + timer_group_get_current_y_scanline());
+		video_capturing = false;
+	}
+}
+
+void video_capture_command(uint8_t kind, uint16_t address, uint16_t value) {
+	video_capture_add(&capture, capture_frame_line + timer_group_get_current_y_scanline(), kind, address, value);
+}
+
+void video_capture_next_frame(void) {
+	capture_frame_line += VERTICAL_PIXELS;
+}
+
 #pragma mark - Private
 
 static uint16_t read_vram() {
@@ -602,6 +682,10 @@ static uint16_t read_vram() {
 }
 
 static void write_vram(uint16_t data) {
+	frame_counters.vram_writes++;
+	if (video_capturing) {
+		video_capture_command(VIDEO_CAPTURE_VRAM_WRITE, vram_address, data);
+	}
 	
 	if (debug_log_vram) {
 //		LOG(LOG_DEBUG, "write_vram at 0x%08X - 0x%04X\n", vram_address, data);
@@ -3,7 +3,9 @@
 
 #include "memory_region.h"
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
 static const uint32_t FRAMEBUFFER_WIDTH = 320;
 static const uint32_t FRAMEBUFFER_HEIGHT = 224;
@@ -36,18 +38,36 @@ extern video_t video;
 void video_init(void);
 void video_reset(void);
 uint32_t video_reload_timer(void);
+// Once per frame, on the VBlank line
+void video_update_auto_animation(void);
 
 #pragma mark - Drawing
 
 void video_draw_empty_line(uint32_t scanline);
 void video_draw_fix(uint32_t scanline);
 
+// In place conversion of a S/SFIX ROM to row major tiles, done once when the ROM is loaded
+void video_convert_fix_rom(uint8_t *data, size_t size);
+
 void video_create_sprites_list(uint32_t scanline);
 void video_draw_sprites(uint32_t scanline);
+// One line of one sprite, x and y as in SCB3 and SCB4
+void video_draw_sprite(uint32_t spriteNumber, uint32_t x, uint32_t y, uint32_t zoomX, uint32_t zoomY, uint32_t scanline, uint32_t clipping);
 
 #pragma mark - Palettes helpers
 
 void video_convert_current_palette_bank(void);
 void video_convert_current_palette_color(uint32_t index);
 
+#pragma mark - Command log
+
+extern bool video_capturing;
+
+// The capture starts with the next reset, NULL stops it, see video_capture.h
+void video_set_capture(const char *path);
+// Records a write at the current line, a video_capture_event_kind_t
+void video_capture_command(uint8_t kind, uint16_t address, uint16_t value);
+// When the line counter wraps, lines count from the capture start
+void video_capture_next_frame(void);
+
 #endif /* video */
@@ -0,0 +1,93 @@
+#include "video_capture.h"
+#include "endian.h"
+#include "log.h"
+
+#include <string.h>
+
+static bool video_capture_has_address(uint8_t kind);
+
+#pragma mark - Writing
+
+bool video_capture_create(video_capture_t *capture, const char *path, uint32_t fix_rom_size, uint32_t sprites_size) {
+	video_capture_header_t header;
+	memset(&header, 0, sizeof(video_capture_header_t));
+	memcpy(header.magic, VIDEO_CAPTURE_MAGIC, VIDEO_CAPTURE_MAGIC_SIZE);
+	header.version = LITTLE_ENDIAN_DWORD(VIDEO_CAPTURE_VERSION);
+	header.fix_rom_size = LITTLE_ENDIAN_DWORD(fix_rom_size);
+	header.sprites_size = LITTLE_ENDIAN_DWORD(sprites_size);
+	if (capture_file_create(capture, path, &header, sizeof(video_capture_header_t)) == false) {
+		return false;
+	}
+
+	LOG(LOG_INFO, "video_capture_create: capturing video writes to %s\n", path);
+	return true;
+}
+
+void video_capture_add(video_capture_t *capture, uint64_t line, uint8_t kind, uint16_t address, uint16_t value) {
+	uint8_t payload[4];
+	size_t count = 0;
+	if (video_capture_has_address(kind)) {
+		payload[count++] = (uint8_t)address;
+		payload[count++] = (uint8_t)(address >> 8);
+	}
+	if (kind != VIDEO_CAPTURE_END) {
+		payload[count++] = (uint8_t)value;
+		payload[count++] = (uint8_t)(value >> 8);
+	}
+	capture_file_add(capture, line, kind, payload, count);
+}
+
+void video_capture_finish(video_capture_t *capture, uint64_t end_line) {
+	if (capture->file == NULL) {
+		return;
+	}
+	video_capture_add(capture, end_line, VIDEO_CAPTURE_END, 0, 0);
+	uint64_t lines = capture->last_position;
+	if (capture_file_close(capture) == false) {
+		LOG(LOG_ERROR, "video_capture_finish: can't write the capture\n");
+	}
+	LOG(LOG_INFO, "video_capture_finish: %llu lines captured\n", (unsigned long long)lines);
+}
+
+#pragma mark - Reading
+
+bool video_capture_open(video_capture_t *capture, const char *path, video_capture_header_t *header) {
+	if (capture_file_open(capture, path, header, sizeof(video_capture_header_t), VIDEO_CAPTURE_MAGIC, VIDEO_CAPTURE_VERSION, "video capture") == false) {
+		return false;
+	}
+	header->fix_rom_size = LITTLE_ENDIAN_DWORD(header->fix_rom_size);
+	header->sprites_size = LITTLE_ENDIAN_DWORD(header->sprites_size);
+	return true;
+}
+
+bool video_capture_next(video_capture_t *capture, video_capture_event_t *event) {
+	uint8_t kind;
+	if (capture_file_next(capture, &kind, &event->line) == false || kind > VIDEO_CAPTURE_END) {
+		return false;
+	}
+	uint8_t payload[4];
+	size_t count = video_capture_has_address(kind) ? 4 : (kind != VIDEO_CAPTURE_END ? 2 : 0);
+	if (capture_file_read(capture, payload, count) == false) {
+		return false;
+	}
+	event->address = 0;
+	event->value = 0;
+	if (count == 4) {
+		event->address = (uint16_t)(payload[0] | (payload[1] << 8));
+	}
+	if (count) {
+		event->value = (uint16_t)(payload[count - 2] | (payload[count - 1] << 8));
+	}
+	event->kind = kind;
+	return true;
+}
+
+void video_capture_close(video_capture_t *capture) {
+	capture_file_close(capture);
+}
+
+#pragma mark - Private
+
+static bool video_capture_has_address(uint8_t kind) {
+	return kind == VIDEO_CAPTURE_VRAM_WRITE || kind == VIDEO_CAPTURE_PALETTE_WRITE;
+}
@@ -0,0 +1,59 @@
+#ifndef video_capture_h
+#define video_capture_h
+
+#include "capture_file.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ *	Video command log (.vidlog)
+ *	Every VRAM, LSPC mode and palette RAM write, palette bank and fix ROM swap, with the line it happens before,
+ *	so frames can be rendered again without the CPUs.
+ *	Lines count from the capture start, VERTICAL_PIXELS per frame, events of a line apply before it is drawn.
+ *	Events are positioned in lines (see capture_file.h), they carry the little endian address for VRAM
+ *	and palette writes, then the little endian value.
+ */
+
+#define VIDEO_CAPTURE_MAGIC				"NGVIDLOG"
+#define VIDEO_CAPTURE_MAGIC_SIZE		CAPTURE_FILE_MAGIC_SIZE
+#define VIDEO_CAPTURE_VERSION			1
+
+typedef enum video_capture_event_kind {
+	VIDEO_CAPTURE_VRAM_WRITE = 0,		// VRAM address, data
+	VIDEO_CAPTURE_VRAM_MODULO,			// REG_VRAMMOD
+	VIDEO_CAPTURE_LSPC_MODE,			// REG_LSPCMODE
+	VIDEO_CAPTURE_PALETTE_WRITE,		// color index in the current bank, color as in palette RAM
+	VIDEO_CAPTURE_PALETTE_BANK,			// 0 or 1
+	VIDEO_CAPTURE_FIX_ROM,				// 0 for the board one, 1 for the cartridge one
+	VIDEO_CAPTURE_END,					// the capture lasts until its line
+} video_capture_event_kind_t;
+
+typedef struct video_capture_header {
+	char magic[VIDEO_CAPTURE_MAGIC_SIZE];
+	uint32_t version;
+	uint32_t fix_rom_size;			// cartridge S ROM, 0 without a cartridge
+	uint32_t sprites_size;			// serialized C ROMs
+} video_capture_header_t;
+
+typedef struct video_capture_event {
+	uint64_t line;					// since the capture start
+	uint8_t kind;
+	uint16_t address;
+	uint16_t value;
+} video_capture_event_t;
+
+typedef capture_file_t video_capture_t;
+
+// The video must have just been reset when a capture starts
+bool video_capture_create(video_capture_t *capture, const char *path, uint32_t fix_rom_size, uint32_t sprites_size);
+void video_capture_add(video_capture_t *capture, uint64_t line, uint8_t kind, uint16_t address, uint16_t value);
+// Adds the end event and closes the file
+void video_capture_finish(video_capture_t *capture, uint64_t end_line);
+
+bool video_capture_open(video_capture_t *capture, const char *path, video_capture_header_t *header);
+// false at the end of the file or on a truncated event
+bool video_capture_next(video_capture_t *capture, video_capture_event_t *event);
+void video_capture_close(video_capture_t *capture);
+
+#endif /* video_capture_h */
@@ -0,0 +1,80 @@
+#include "ym2610_capture.h"
+#include "endian.h"
+#include "log.h"
+
+#include <string.h>
+
+#pragma mark - Writing
+
+bool ym2610_capture_create(ym2610_capture_t *capture, const char *path, uint32_t clock, uint32_t sample_rate,
+						   uint32_t pcm_a_size, uint32_t pcm_a_crc, uint32_t pcm_b_size, uint32_t pcm_b_crc) {
+	ym2610_capture_header_t header;
+	memset(&header, 0, sizeof(ym2610_capture_header_t));
+	memcpy(header.magic, YM2610_CAPTURE_MAGIC, YM2610_CAPTURE_MAGIC_SIZE);
+	header.version = LITTLE_ENDIAN_DWORD(YM2610_CAPTURE_VERSION);
+	header.clock = LITTLE_ENDIAN_DWORD(clock);
+	header.sample_rate = LITTLE_ENDIAN_DWORD(sample_rate);
+	header.pcm_a_size = LITTLE_ENDIAN_DWORD(pcm_a_size);
+	header.pcm_a_crc = LITTLE_ENDIAN_DWORD(pcm_a_crc);
+	header.pcm_b_size = LITTLE_ENDIAN_DWORD(pcm_b_size);
+	header.pcm_b_crc = LITTLE_ENDIAN_DWORD(pcm_b_crc);
+	if (capture_file_create(capture, path, &header, sizeof(ym2610_capture_header_t)) == false) {
+		return false;
+	}
+
+	LOG(LOG_INFO, "ym2610_capture_create: capturing YM2610 writes to %s\n", path);
+	return true;
+}
+
+void ym2610_capture_add(ym2610_capture_t *capture, uint64_t sample, uint8_t kind, uint8_t value) {
+	// a write can't go back in time, it would have been applied at the current sample
+	capture_file_add(capture, sample, kind, &value, kind <= YM2610_CAPTURE_WRITE_PORT_3 ? 1 : 0);
+}
+
+void ym2610_capture_finish(ym2610_capture_t *capture, uint64_t end_sample) {
+	if (capture->file == NULL) {
+		return;
+	}
+	ym2610_capture_add(capture, end_sample, YM2610_CAPTURE_END, 0);
+	uint64_t samples = capture->last_position;
+	if (capture_file_close(capture) == false) {
+		LOG(LOG_ERROR, "ym2610_capture_finish: can't write the capture\n");
+	}
+	LOG(LOG_INFO, "ym2610_capture_finish: %llu samples captured\n", (unsigned long long)samples);
+}
+
+#pragma mark - Reading
+
+bool ym2610_capture_open(ym2610_capture_t *capture, const char *path, ym2610_capture_header_t *header) {
+	if (capture_file_open(capture, path, header, sizeof(ym2610_capture_header_t), YM2610_CAPTURE_MAGIC, YM2610_CAPTURE_VERSION, "YM2610 capture") == false) {
+		return false;
+	}
+	header->clock = LITTLE_ENDIAN_DWORD(header->clock);
+	header->sample_rate = LITTLE_ENDIAN_DWORD(header->sample_rate);
+	header->pcm_a_size = LITTLE_ENDIAN_DWORD(header->pcm_a_size);
+	header->pcm_a_crc = LITTLE_ENDIAN_DWORD(header->pcm_a_crc);
+	header->pcm_b_size = LITTLE_ENDIAN_DWORD(header->pcm_b_size);
+	header->pcm_b_crc = LITTLE_ENDIAN_DWORD(header->pcm_b_crc);
+	return true;
+}
+
+bool ym2610_capture_next(ym2610_capture_t *capture, ym2610_capture_event_t *event) {
+	uint8_t kind;
+	if (capture_file_next(capture, &kind, &event->sample) == false || kind > YM2610_CAPTURE_END) {
+		return false;
+	}
+	event->value = 0;
+	if (kind <= YM2610_CAPTURE_WRITE_PORT_3 && capture_file_read(capture, &event->value, 1) == false) {
+		return false;
+	}
+	event->kind = kind;
+	return true;
+}
+
+void ym2610_capture_rewind(ym2610_capture_t *capture) {
+	capture_file_rewind(capture);
+}
+
+void ym2610_capture_close(ym2610_capture_t *capture) {
+	capture_file_close(capture);
+}
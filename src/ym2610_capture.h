@@ -0,0 +1,60 @@
+#ifndef ym2610_capture_h
+#define ym2610_capture_h
+
+#include "capture_file.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ *	YM2610 register log (.ymlog)
+ *	Every register write and timer overflow reaching the chip, with the output sample it applies at,
+ *	so the synthesis can be replayed without the CPUs.
+ *	Events are positioned in samples (see capture_file.h), writes carry the register value.
+ */
+
+#define YM2610_CAPTURE_MAGIC			"YM2610LG"
+#define YM2610_CAPTURE_MAGIC_SIZE		CAPTURE_FILE_MAGIC_SIZE
+#define YM2610_CAPTURE_VERSION			1
+
+typedef enum ym2610_capture_event_kind {
+	YM2610_CAPTURE_WRITE_PORT_0 = 0,	// up to YM2610_CAPTURE_WRITE_PORT_3
+	YM2610_CAPTURE_WRITE_PORT_3 = 3,
+	YM2610_CAPTURE_TIMER_A,
+	YM2610_CAPTURE_TIMER_B,
+	YM2610_CAPTURE_END,					// the capture lasts until its sample
+} ym2610_capture_event_kind_t;
+
+typedef struct ym2610_capture_header {
+	char magic[YM2610_CAPTURE_MAGIC_SIZE];
+	uint32_t version;
+	uint32_t clock;
+	uint32_t sample_rate;
+	uint32_t pcm_a_size;
+	uint32_t pcm_a_crc;				// CRC-32 of the PCM ROMs the capture needs
+	uint32_t pcm_b_size;
+	uint32_t pcm_b_crc;
+} ym2610_capture_header_t;
+
+typedef struct ym2610_capture_event {
+	uint64_t sample;				// since the capture start
+	uint8_t kind;
+	uint8_t value;
+} ym2610_capture_event_t;
+
+typedef capture_file_t ym2610_capture_t;
+
+// The chip must have just been reset when a capture starts, the CRCs are the cartridge_get_pcm_rom_crc ones
+bool ym2610_capture_create(ym2610_capture_t *capture, const char *path, uint32_t clock, uint32_t sample_rate,
+						   uint32_t pcm_a_size, uint32_t pcm_a_crc, uint32_t pcm_b_size, uint32_t pcm_b_crc);
+void ym2610_capture_add(ym2610_capture_t *capture, uint64_t sample, uint8_t kind, uint8_t value);
+// Adds the end event and closes the file
+void ym2610_capture_finish(ym2610_capture_t *capture, uint64_t end_sample);
+
+bool ym2610_capture_open(ym2610_capture_t *capture, const char *path, ym2610_capture_header_t *header);
+// false at the end of the file or on a truncated event
+bool ym2610_capture_next(ym2610_capture_t *capture, ym2610_capture_event_t *event);
+void ym2610_capture_rewind(ym2610_capture_t *capture);
+void ym2610_capture_close(ym2610_capture_t *capture);
+
+#endif /* ym2610_capture_h */
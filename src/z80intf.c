@@ -17,16 +17,16 @@ uint16_t io_read_byte_8(uint16_t port)
 			return z80_command;
 			
 		case 0x04:  // Status port A
-			return ym2610_read(0);
+			return sound_ym2610_read(0);
 			
 		case 0x05:  // Read port A
-			return ym2610_read(1);
+			return sound_ym2610_read(1);
 			
 		case 0x06:  // Status port B
-			return ym2610_read(2);
+			return sound_ym2610_read(2);
 			
 		case 0x07: // Read port B
-			return ym2610_read(3);
+			return sound_ym2610_read(3);
 			
 		case 0x08:
 			cpu_z80_set_bank_offset(0, port >> 8);
@@ -59,19 +59,19 @@ void io_write_byte_8(uint16_t port, uint16_t value)
 			break;
 			
 		case 0x04:  // Control port A
-			ym2610_write(0, (uint8_t)value);
+			sound_ym2610_write(0, (uint8_t)value);
 			break;
 			
 		case 0x05:  // Data port A
-			ym2610_write(1, (uint8_t)value);
+			sound_ym2610_write(1, (uint8_t)value);
 			break;
 			
 		case 0x06:  // Control port B
-			ym2610_write(2, (uint8_t)value);
+			sound_ym2610_write(2, (uint8_t)value);
 			break;
 			
 		case 0x07:  // Data port B
-			ym2610_write(3, (uint8_t)value);
+			sound_ym2610_write(3, (uint8_t)value);
 			break;
 			
 		case 0x08: // NMI Enable
@@ -0,0 +1,147 @@
+#include "zip_workers.h"
+#include "log.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static const unsigned ZIP_WORKERS_MAX_THREADS = 8;
+
+struct zip_workers {
+	const char *path;
+	zip_workers_job_t *jobs;
+	size_t jobs_count;
+	atomic_size_t next_job;
+	atomic_bool failed;
+	atomic_uint running_threads;
+	zip_workers_finished_t finished;
+	void *context;
+	unsigned threads_count;
+	pthread_t threads[];
+};
+
+static void zip_workers_init(zip_workers_t *workers, const char *path, zip_workers_job_t *jobs, size_t jobs_count, unsigned threads_count, zip_workers_finished_t finished, void *context);
+static void *zip_workers_thread(void *argument);
+static void zip_workers_threads_exited(zip_workers_t *workers, unsigned count);
+
+#pragma mark - Public
+
+unsigned zip_workers_default_threads_count(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1) {
+		return 1;
+	}
+	return cpus > ZIP_WORKERS_MAX_THREADS ? ZIP_WORKERS_MAX_THREADS : (unsigned)cpus;
+#else
+	return 2;
+#endif
+}
+
+zip_workers_t *zip_workers_start(const char *path, zip_workers_job_t *jobs, size_t jobs_count, unsigned threads_count, zip_workers_finished_t finished, void *context) {
+	if (threads_count > jobs_count) {
+		threads_count = (unsigned)jobs_count;
+	}
+	if (threads_count == 0) {
+		threads_count = 1;
+	}
+	
+	zip_workers_t *workers = malloc(sizeof(zip_workers_t) + threads_count * sizeof(pthread_t));
+	if (workers == NULL) {
+		return NULL;
+	}
+	zip_workers_init(workers, path, jobs, jobs_count, threads_count, finished, context);
+	
+	for (unsigned i = 0; i < threads_count; i++) {
+		if (pthread_create(&workers->threads[i], NULL, zip_workers_thread, workers) != 0) {
+			LOG(LOG_ERROR, "zip_workers_start: can't create worker #%u\n", i);
+			break;
+		}
+		workers->threads_count++;
+	}
+	
+	if (workers->threads_count == 0) {
+		// no thread at all, inflate from the caller thread
+		atomic_store(&workers->running_threads, 1);
+		zip_workers_thread(workers);
+	}
+	else if (workers->threads_count < threads_count) {
+		zip_workers_threads_exited(workers, threads_count - workers->threads_count);
+	}
+	return workers;
+}
+
+bool zip_workers_wait(zip_workers_t *workers) {
+	if (workers == NULL) {
+		return false;
+	}
+	for (unsigned i = 0; i < workers->threads_count; i++) {
+		pthread_join(workers->threads[i], NULL);
+	}
+	bool success = !atomic_load(&workers->failed);
+	free(workers);
+	return success;
+}
+
+bool zip_workers_run(const char *path, zip_workers_job_t *jobs, size_t jobs_count) {
+	zip_workers_t workers;
+	zip_workers_init(&workers, path, jobs, jobs_count, 1, NULL, NULL);
+	zip_workers_thread(&workers);
+	return !atomic_load(&workers.failed);
+}
+
+#pragma mark - Private
+
+static void zip_workers_init(zip_workers_t *workers, const char *path, zip_workers_job_t *jobs, size_t jobs_count, unsigned threads_count, zip_workers_finished_t finished, void *context) {
+	workers->path = path;
+	workers->jobs = jobs;
+	workers->jobs_count = jobs_count;
+	atomic_init(&workers->next_job, 0);
+	atomic_init(&workers->failed, false);
+	atomic_init(&workers->running_threads, threads_count);
+	workers->finished = finished;
+	workers->context = context;
+	workers->threads_count = 0;
+}
+
+
+static void *zip_workers_thread(void *argument) {
+	zip_workers_t *workers = argument;
+	
+	mz_zip_archive zip_archive;
+	mz_zip_zero_struct(&zip_archive);
+	if (!mz_zip_reader_init_file(&zip_archive, workers->path, 0)) {
+		LOG(LOG_ERROR, "zip_workers: can't open %s - %s\n", workers->path, mz_zip_get_error_string(zip_archive.m_last_error));
+		atomic_store(&workers->failed, true);
+		zip_workers_threads_exited(workers, 1);
+		return NULL;
+	}
+	
+	for (;;) {
+		size_t job_index = atomic_fetch_add(&workers->next_job, 1);
+		if (job_index >= workers->jobs_count || atomic_load(&workers->failed)) {
+			break;
+		}
+		
+		zip_workers_job_t *job = &workers->jobs[job_index];
+		if (!mz_zip_reader_extract_to_mem(&zip_archive, job->file_index, job->destination, job->size, 0)) {
+			LOG(LOG_ERROR, "zip_workers: can't extract file #%u - %s\n", job->file_index, mz_zip_get_error_string(zip_archive.m_last_error));
+			atomic_store(&workers->failed, true);
+			break;
+		}
+		if (job->completion != NULL) {
+			job->completion(job);
+		}
+	}
+	
+	mz_zip_reader_end(&zip_archive);
+	zip_workers_threads_exited(workers, 1);
+	return NULL;
+}
+
+static void zip_workers_threads_exited(zip_workers_t *workers, unsigned count) {
+	if (atomic_fetch_sub(&workers->running_threads, count) == count && workers->finished != NULL) {
+		workers->finished(!atomic_load(&workers->failed), workers->context);
+	}
+}
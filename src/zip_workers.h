@@ -0,0 +1,37 @@
+#ifndef zip_workers_h
+#define zip_workers_h
+
+#include "3rdParty/miniz/miniz.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *	Pool of threads inflating zip archive entries concurrently
+ *	Each worker opens its own reader on the archive file and picks the next pending job
+ */
+
+typedef struct zip_workers zip_workers_t;
+
+typedef struct zip_workers_job {
+	mz_uint file_index;
+	uint8_t *destination;
+	size_t size;
+	void (*completion)(struct zip_workers_job *job);	// called from the worker thread once the entry is inflated
+	void *context;
+} zip_workers_job_t;
+
+// Called once from the last running worker, when every job is done or the pool failed
+typedef void (*zip_workers_finished_t)(bool success, void *context);
+
+unsigned zip_workers_default_threads_count(void);
+
+// jobs must stay valid until zip_workers_wait returns, finished can be NULL
+zip_workers_t *zip_workers_start(const char *path, zip_workers_job_t *jobs, size_t jobs_count, unsigned threads_count, zip_workers_finished_t finished, void *context);
+// Joins and releases the pool, false if any job failed
+bool zip_workers_wait(zip_workers_t *workers);
+// Inflates the jobs on the calling thread without allocating, for when no pool can be started
+bool zip_workers_run(const char *path, zip_workers_job_t *jobs, size_t jobs_count);
+
+#endif /* zip_workers_h */
@@ -0,0 +1,298 @@
+/*
+ *	Runs the core headless for a number of frames as fast as possible
+ *	Prints a JSON report: frames per second, frame time percentiles, what the emulated machine did per frame
+ *	and, in NEOGEO_PROFILE builds, where the frame time went
+ *
+ *	usage: neogeo_bench [-f frames] [-w warmup_frames] [-i input_script] [-o option=value]... [-q] [-v] [-m heatmap.txt] [-p pc_report.txt] [-s period] system_directory game.zip|game.ngi
+ *	the BIOS is read from system_directory/neogeo/neogeo.zip like the libretro core does
+ *	-o sets a core option, the key and value must be listed in core_variables, -q turns the profiler off for the lowest overhead
+ *	-v shows the core information logs on stderr, the periodic profiler logs among them
+ *	-m writes the 68K bus heatmap of the measured frames, in NEOGEO_BUS_HEATMAP builds
+ *	-p samples the 68K and Z80 program counters every period scheduler slices (1 by default) and writes the hot code report
+ *	the input script format is described in input_script.h, its frames count from the reset
+ */
+
+#include "bus_heatmap.h"
+#include "cartridge.h"
+#include "common_tools.h"
+#include "frame_counters.h"
+#include "input_script.h"
+#include "libretro_core.h"
+#include "log.h"
+#include "neogeo.h"
+#include "pc_sampler.h"
+#include "profile.h"
+#include "sound.h"
+#include "timer.h"
+#include "tool_harness.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// JSON keys of the per frame profile categories, ROM load is reported apart
+static const char *profile_keys[PROFILE_ROM_LOAD] = {
+	"m68k", "z80", "sprite_list", "sprite_draw", "fix", "ym_synthesis", "scheduler"
+};
+
+static input_script_t input_script;
+
+static int16_t bench_input_state(unsigned port, unsigned device, unsigned index, unsigned id) {
+	return input_script_state(&input_script, port, device, id);
+}
+
+// frame_counters_t summed over the measured frames
+typedef struct bench_counters {
+	uint64_t m68k_instructions;
+	uint64_t m68k_cycles;
+	uint64_t z80_instructions;
+	uint64_t z80_cycles;
+	uint64_t z80_idle_cycles;
+	uint64_t scheduler_slices;
+	uint64_t sprites_lines;
+	uint64_t sprites_total;
+	uint16_t sprites_max_per_line;
+	uint64_t vram_writes;
+	uint64_t palette_writes;
+	uint64_t p_rom_bank_switches;
+	uint64_t ym2610_writes;
+	uint64_t adpcma_key_ons;
+	uint64_t adpcmb_key_ons;
+	uint64_t fm_voices;
+	uint64_t adpcma_voices;
+	uint64_t adpcmb_voices;
+	uint64_t ssg_voices;
+	uint64_t silent_samples;
+} bench_counters_t;
+
+static void bench_add_counters(bench_counters_t *sums, frame_counters_t frame) {
+	sums->m68k_instructions += frame.m68k_instructions;
+	sums->m68k_cycles += frame.m68k_cycles;
+	sums->z80_instructions += frame.z80_instructions;
+	sums->z80_cycles += frame.z80_cycles;
+	sums->z80_idle_cycles += frame.z80_idle_cycles;
+	sums->scheduler_slices += frame.scheduler_slices;
+	sums->sprites_lines += frame.sprites_lines;
+	sums->sprites_total += frame.sprites_total;
+	sums->sprites_max_per_line = frame.sprites_max_per_line > sums->sprites_max_per_line ? frame.sprites_max_per_line : sums->sprites_max_per_line;
+	sums->vram_writes += frame.vram_writes;
+	sums->palette_writes += frame.palette_writes;
+	sums->p_rom_bank_switches += frame.p_rom_bank_switches;
+	sums->ym2610_writes += frame.ym2610_writes;
+	sums->adpcma_key_ons += frame.adpcma_key_ons;
+	sums->adpcmb_key_ons += frame.adpcmb_key_ons;
+	sums->fm_voices += frame.fm_voices;
+	sums->adpcma_voices += frame.adpcma_voices;
+	sums->adpcmb_voices += frame.adpcmb_voices;
+	sums->ssg_voices += frame.ssg_voices;
+	sums->silent_samples += frame.silent_samples;
+}
+
+static int bench_compare_nsec(const void *a, const void *b) {
+	uint64_t left = *(const uint64_t *)a;
+	uint64_t right = *(const uint64_t *)b;
+	return left < right ? -1 : left > right;
+}
+
+// Nearest rank percentile of sorted values
+static double bench_percentile_usec(const uint64_t *sorted, uint32_t count, double percentile) {
+	uint32_t rank = (uint32_t)(percentile / 100.0 * count + 0.5);
+	rank = rank == 0 ? 0 : rank - 1;
+	return sorted[rank < count ? rank : count - 1] / 1000.0;
+}
+
+static void bench_print_string(const char *string) {
+	putchar('"');
+	for (; *string; string++) {
+		if (*string == '"' || *string == '\\') {
+			putchar('\\');
+		}
+		putchar(*string);
+	}
+	putchar('"');
+}
+
+static void bench_usage(const char *name) {
+	fprintf(stderr, "usage: %s [-f frames] [-w warmup_frames] [-i input_script] [-o option=value]... [-q] [-v] [-m heatmap.txt] [-p pc_report.txt] [-s period] system_directory game.zip|game.ngi\n", name);
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t frames = 3600;
+	uint32_t warmup_frames = 60;
+	const char *input_path = NULL;
+	const char *heatmap_path = NULL;
+	const char *pc_report_path = NULL;
+	uint32_t pc_sampling_period = 1;
+	bool profiled = true;
+	int option;
+	tool_harness_init(LOG_WARN);
+	while ((option = getopt(argc, argv, "f:w:i:o:qvm:p:s:")) != -1) {
+		switch (option) {
+			case 'f':
+				frames = (uint32_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'w':
+				warmup_frames = (uint32_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'i':
+				input_path = optarg;
+				break;
+			case 'o':
+				if (tool_harness_add_option(optarg) == false) {
+					bench_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'q':
+				profiled = false;
+				break;
+			case 'v':
+				log_set_level(LOG_INFO);
+				break;
+			case 'm':
+				heatmap_path = optarg;
+				break;
+			case 'p':
+				pc_report_path = optarg;
+				break;
+			case 's':
+				pc_sampling_period = (uint32_t)strtoul(optarg, NULL, 10);
+				break;
+			default:
+				bench_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (argc - optind != 2 || frames == 0) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+	const char *system_directory = argv[optind];
+	const char *game_path = argv[optind + 1];
+	if (input_path != NULL && input_script_load(&input_script, input_path) == false) {
+		return 1;
+	}
+
+	libretroCallbacks.inputState = &bench_input_state;
+	if (tool_harness_load_system(system_directory) == false) {
+		return 1;
+	}
+
+	uint64_t load_start = monotonic_time_usec();
+	if (tool_harness_load_game(game_path) == false) {
+		return 1;
+	}
+	neogeo_reset();
+	uint64_t load_usec = monotonic_time_usec() - load_start;
+	profile_report_t load_report = profile_get_report();
+
+	uint64_t *frame_nsec = malloc(frames * sizeof(uint64_t));
+	if (frame_nsec == NULL) {
+		fprintf(stderr, "can't allocate %u frame times\n", frames);
+		return 1;
+	}
+	bench_counters_t counters;
+	memset(&counters, 0, sizeof(bench_counters_t));
+	uint64_t start = 0;
+	for (uint32_t frame = 0; frame < warmup_frames + frames; frame++) {
+		if (frame == warmup_frames) {
+			profile_reset();
+			bus_heatmap_reset();
+			pc_sampler_set_enabled(pc_report_path != NULL, pc_sampling_period);
+			profile_set_enabled(profiled);
+			start = monotonic_time_nsec();
+		}
+		input_script_advance(&input_script, frame);
+		retro_core_poll_joypad_1();
+		retro_core_poll_joypad_2();
+
+		uint64_t frame_start = monotonic_time_nsec();
+		neogeo_runOneFrame();
+		if (frame < warmup_frames) {
+			continue;
+		}
+		frame_nsec[frame - warmup_frames] = monotonic_time_nsec() - frame_start;
+		bench_add_counters(&counters, frame_counters_get_last());
+	}
+	uint64_t elapsed_nsec = monotonic_time_nsec() - start;
+	profile_report_t report = profile_get_report();
+
+	uint64_t total_nsec = 0;
+	for (uint32_t i = 0; i < frames; i++) {
+		total_nsec += frame_nsec[i];
+	}
+	qsort(frame_nsec, frames, sizeof(uint64_t), bench_compare_nsec);
+	double fps = frames * 1e9 / (elapsed_nsec ? elapsed_nsec : 1);
+
+	printf("{\n\t\"game\": ");
+	bench_print_string(game_path);
+	printf(",\n\t\"input\": ");
+	if (input_path != NULL) {
+		bench_print_string(input_path);
+	}
+	else {
+		printf("null");
+	}
+	printf(",\n\t\"options\": {");
+	for (size_t i = 0; i < tool_harness_options_count; i++) {
+		printf("%s", i ? ", " : "");
+		bench_print_string(tool_harness_options[i].key);
+		printf(": ");
+		bench_print_string(tool_harness_options[i].value);
+	}
+	printf("},\n");
+	printf("\t\"load_ms\": %.3f,\n", load_usec / 1000.0);
+	printf("\t\"warmup_frames\": %u,\n", warmup_frames);
+	printf("\t\"frames\": %u,\n", frames);
+	printf("\t\"seconds\": %.6f,\n", elapsed_nsec / 1e9);
+	printf("\t\"fps\": %.2f,\n", fps);
+	printf("\t\"speed\": %.3f,\n", fps / FRAME_RATE);
+	printf("\t\"frame_usec\": {\"mean\": %.3f, \"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+		   total_nsec / 1000.0 / frames, frame_nsec[0] / 1000.0, bench_percentile_usec(frame_nsec, frames, 50),
+		   bench_percentile_usec(frame_nsec, frames, 90), bench_percentile_usec(frame_nsec, frames, 99), frame_nsec[frames - 1] / 1000.0);
+	if (profile_compiled() && profiled && report.frames != 0) {
+		// per frame averages of nested categories, see profile.h
+		printf("\t\"profile_usec\": {");
+		for (uint8_t category = 0; category < PROFILE_ROM_LOAD; category++) {
+			printf("%s\"%s\": %.3f", category ? ", " : "", profile_keys[category], report.category_nsec[category] / 1000.0 / report.frames);
+		}
+		printf(", \"rom_load\": %.3f},\n", load_report.category_nsec[PROFILE_ROM_LOAD] / 1000.0);
+		printf("\t\"profile_window_usec\": {\"frames\": %u, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u},\n",
+			   report.window_frames, report.p50_usec, report.p90_usec, report.p99_usec, report.max_usec);
+	}
+	else {
+		printf("\t\"profile_usec\": null,\n");
+	}
+	printf("\t\"counters_per_frame\": {\"m68k_instructions\": %.1f, \"m68k_cycles\": %.1f, \"z80_instructions\": %.1f, \"z80_cycles\": %.1f, "
+		   "\"z80_idle_cycles\": %.1f, \"scheduler_slices\": %.1f, \"sprites_per_line\": %.2f, \"sprites_max_per_line\": %u, "
+		   "\"vram_writes\": %.1f, \"palette_writes\": %.1f, \"p_rom_bank_switches\": %.2f, \"ym2610_writes\": %.1f, "
+		   "\"adpcma_key_ons\": %.2f, \"adpcmb_key_ons\": %.2f, \"fm_voices\": %.2f, \"adpcma_voices\": %.2f, "
+		   "\"adpcmb_voices\": %.2f, \"ssg_voices\": %.2f, \"silent_samples\": %.1f},\n",
+		   (double)counters.m68k_instructions / frames, (double)counters.m68k_cycles / frames,
+		   (double)counters.z80_instructions / frames, (double)counters.z80_cycles / frames,
+		   (double)counters.z80_idle_cycles / frames, (double)counters.scheduler_slices / frames,
+		   counters.sprites_lines ? (double)counters.sprites_total / counters.sprites_lines : 0, counters.sprites_max_per_line,
+		   (double)counters.vram_writes / frames, (double)counters.palette_writes / frames,
+		   (double)counters.p_rom_bank_switches / frames, (double)counters.ym2610_writes / frames,
+		   (double)counters.adpcma_key_ons / frames, (double)counters.adpcmb_key_ons / frames,
+		   (double)counters.fm_voices / frames, (double)counters.adpcma_voices / frames,
+		   (double)counters.adpcmb_voices / frames, (double)counters.ssg_voices / frames,
+		   (double)counters.silent_samples / frames);
+	printf("\t\"peak_rss_mb\": %zu\n}\n", peak_resident_memory_size() / (1024 * 1024));
+
+	if (heatmap_path != NULL && bus_heatmap_write_report(heatmap_path) == false) {
+		fprintf(stderr, "no 68K bus heatmap, the core is built without NEOGEO_BUS_HEATMAP\n");
+	}
+	if (pc_report_path != NULL) {
+		pc_sampler_set_enabled(false, 0);
+		pc_sampler_write_report(pc_report_path);
+	}
+
+	free(frame_nsec);
+	input_script_release(&input_script);
+	sound_unload();
+	cartridge_unload();
+	log_set_async(false);
+	return 0;
+}
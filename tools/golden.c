@@ -0,0 +1,264 @@
+/*
+ *	Regression harness: runs the core headless for a number of frames and hashes every frame
+ *	of video.frameBuffer and of the audio rendered in audioBuffer
+ *
+ *	usage: neogeo_golden [-f frames] [-i input_script] [-o option=value]... [-p passes] [-w golden.txt | -c golden.txt] system_directory game.zip|game.ngi
+ *	-w writes the hashes of the first pass, -c compares them with a golden file written before
+ *	-p runs the frames again after a soft reset, each pass must match the first one:
+ *	state that survives neogeo_reset shows up there
+ *	the first divergent frame and subsystem are reported and the exit code is then 2
+ *
+ *	Each pass starts from the same machine: work and backup RAM as after loading and the RTC at a fixed date
+ *	Golden file lines are "frame video_hash audio_hash", lines starting with # are comments
+ */
+
+#include "cartridge.h"
+#include "input_script.h"
+#include "libretro_core.h"
+#include "log.h"
+#include "memory_backup_ram.h"
+#include "memory_work_ram.h"
+#include "neogeo.h"
+#include "sound.h"
+#include "tool_harness.h"
+#include "video.h"
+
+#include "3rdParty/pd4990a/pd4990a.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define GOLDEN_MAX_PASSES 8
+
+typedef struct golden_hashes {
+	uint64_t video;
+	uint64_t audio;
+} golden_hashes_t;
+
+static input_script_t input_script;
+
+static int16_t golden_input_state(unsigned port, unsigned device, unsigned index, unsigned id);
+static uint64_t golden_hash(const void *data, size_t size);
+static void golden_run_pass(golden_hashes_t *hashes, uint32_t frames, const uint8_t *work_ram_data, const uint8_t *backup_ram_data);
+static bool golden_write(const char *path, const golden_hashes_t *hashes, uint32_t frames, const char *game_path);
+static uint32_t golden_read(const char *path, golden_hashes_t *hashes, uint32_t frames);
+static bool golden_compare(const char *name, const golden_hashes_t *expected, const golden_hashes_t *hashes, uint32_t frames);
+static void golden_usage(const char *name);
+
+int main(int argc, char *argv[]) {
+	uint32_t frames = 600;
+	uint32_t passes = 1;
+	const char *input_path = NULL;
+	const char *write_path = NULL;
+	const char *compare_path = NULL;
+	int option;
+	tool_harness_init(LOG_WARN);
+	while ((option = getopt(argc, argv, "f:i:o:p:w:c:")) != -1) {
+		switch (option) {
+			case 'f':
+				frames = (uint32_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'i':
+				input_path = optarg;
+				break;
+			case 'o':
+				if (tool_harness_add_option(optarg) == false) {
+					golden_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'p':
+				passes = (uint32_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'w':
+				write_path = optarg;
+				break;
+			case 'c':
+				compare_path = optarg;
+				break;
+			default:
+				golden_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (argc - optind != 2 || frames == 0 || passes == 0 || passes > GOLDEN_MAX_PASSES || (write_path != NULL && compare_path != NULL)) {
+		golden_usage(argv[0]);
+		return 1;
+	}
+	const char *system_directory = argv[optind];
+	const char *game_path = argv[optind + 1];
+	if (input_path != NULL && input_script_load(&input_script, input_path) == false) {
+		return 1;
+	}
+
+	libretroCallbacks.inputState = &golden_input_state;
+	if (tool_harness_load_system(system_directory) == false || tool_harness_load_game(game_path) == false) {
+		return 1;
+	}
+	cartridge_wait_sprites();
+	cartridge_wait_pcm_roms();
+
+	// RAM the resets don't clear, as left by loading
+	uint8_t *work_ram_data = malloc(work_ram.size);
+	uint8_t *backup_ram_data = malloc(backup_ram.size);
+	golden_hashes_t *hashes = malloc(frames * sizeof(golden_hashes_t) * passes);
+	if (work_ram_data == NULL || backup_ram_data == NULL || hashes == NULL) {
+		fprintf(stderr, "can't allocate %u frames hashes\n", frames);
+		return 1;
+	}
+	memcpy(work_ram_data, work_ram.data, work_ram.size);
+	memcpy(backup_ram_data, backup_ram.data, backup_ram.size);
+
+	bool matching = true;
+	for (uint32_t pass = 0; pass < passes; pass++) {
+		golden_hashes_t *pass_hashes = hashes + (size_t)pass * frames;
+		golden_run_pass(pass_hashes, frames, work_ram_data, backup_ram_data);
+		if (pass > 0) {
+			char name[32];
+			snprintf(name, sizeof(name), "pass %u", pass + 1);
+			matching &= golden_compare(name, hashes, pass_hashes, frames);
+		}
+	}
+
+	if (write_path != NULL && golden_write(write_path, hashes, frames, game_path) == false) {
+		return 1;
+	}
+	if (compare_path != NULL) {
+		golden_hashes_t *expected = malloc(frames * sizeof(golden_hashes_t));
+		uint32_t expected_frames = expected ? golden_read(compare_path, expected, frames) : 0;
+		if (expected_frames == 0) {
+			fprintf(stderr, "no frame hashes in %s\n", compare_path);
+			return 1;
+		}
+		if (expected_frames < frames) {
+			fprintf(stderr, "%s has %u frames, comparing those\n", compare_path, expected_frames);
+		}
+		matching &= golden_compare(compare_path, expected, hashes, expected_frames);
+		free(expected);
+	}
+	if (matching) {
+		printf("%u frames, %u passes: video %016llx audio %016llx at the last frame\n", frames, passes,
+			   (unsigned long long)hashes[frames - 1].video, (unsigned long long)hashes[frames - 1].audio);
+	}
+
+	free(hashes);
+	free(work_ram_data);
+	free(backup_ram_data);
+	input_script_release(&input_script);
+	sound_unload();
+	video_set_capture(NULL);
+	cartridge_unload();
+	return matching ? 0 : 2;
+}
+
+#pragma mark - Frontend
+
+static int16_t golden_input_state(unsigned port, unsigned device, unsigned index, unsigned id) {
+	return input_script_state(&input_script, port, device, id);
+}
+
+#pragma mark - Hashes
+
+// FNV-1a
+static uint64_t golden_hash(const void *data, size_t size) {
+	const uint8_t *bytes = data;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static void golden_run_pass(golden_hashes_t *hashes, uint32_t frames, const uint8_t *work_ram_data, const uint8_t *backup_ram_data) {
+	// 2000-01-01 00:00:00, a Saturday
+	struct tm date;
+	memset(&date, 0, sizeof(struct tm));
+	date.tm_mday = 1;
+	date.tm_year = 100;
+	date.tm_wday = 6;
+	pd4990a_set_time(&date);
+	memcpy(work_ram.data, work_ram_data, work_ram.size);
+	memcpy(backup_ram.data, backup_ram_data, backup_ram.size);
+	input_script_rewind(&input_script);
+	neogeo_reset();
+
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		input_script_advance(&input_script, frame);
+		retro_core_poll_joypad_1();
+		retro_core_poll_joypad_2();
+		neogeo_runOneFrame();
+		hashes[frame].video = golden_hash(video.frameBuffer, FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT * sizeof(uint16_t));
+		hashes[frame].audio = golden_hash(audioBuffer, samplesThisFrame * 2 * sizeof(FMSAMPLE));
+	}
+}
+
+#pragma mark - Golden files
+
+static bool golden_write(const char *path, const golden_hashes_t *hashes, uint32_t frames, const char *game_path) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "can't create %s\n", path);
+		return false;
+	}
+	fprintf(file, "# %s, %u frames\n# frame video audio\n", game_path, frames);
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		fprintf(file, "%u %016llx %016llx\n", frame, (unsigned long long)hashes[frame].video, (unsigned long long)hashes[frame].audio);
+	}
+	fclose(file);
+	return true;
+}
+
+// Returns how many consecutive frames from 0 were read
+static uint32_t golden_read(const char *path, golden_hashes_t *hashes, uint32_t frames) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "can't open %s\n", path);
+		return 0;
+	}
+	uint32_t count = 0;
+	char line[128];
+	while (count < frames && fgets(line, sizeof(line), file) != NULL) {
+		unsigned frame;
+		unsigned long long video_hash, audio_hash;
+		if (line[0] == '#' || sscanf(line, "%u %llx %llx", &frame, &video_hash, &audio_hash) != 3) {
+			continue;
+		}
+		if (frame != count) {
+			fprintf(stderr, "%s: frame %u where %u was expected\n", path, frame, count);
+			break;
+		}
+		hashes[count].video = video_hash;
+		hashes[count].audio = audio_hash;
+		count++;
+	}
+	fclose(file);
+	return count;
+}
+
+// Reports the first divergent frame, video and audio apart
+static bool golden_compare(const char *name, const golden_hashes_t *expected, const golden_hashes_t *hashes, uint32_t frames) {
+	int64_t video_frame = -1;
+	int64_t audio_frame = -1;
+	for (uint32_t frame = 0; frame < frames && (video_frame < 0 || audio_frame < 0); frame++) {
+		if (video_frame < 0 && hashes[frame].video != expected[frame].video) {
+			video_frame = frame;
+		}
+		if (audio_frame < 0 && hashes[frame].audio != expected[frame].audio) {
+			audio_frame = frame;
+		}
+	}
+	if (video_frame >= 0) {
+		fprintf(stderr, "%s: video diverges at frame %lld\n", name, (long long)video_frame);
+	}
+	if (audio_frame >= 0) {
+		fprintf(stderr, "%s: audio diverges at frame %lld\n", name, (long long)audio_frame);
+	}
+	return video_frame < 0 && audio_frame < 0;
+}
+
+static void golden_usage(const char *name) {
+	fprintf(stderr, "usage: %s [-f frames] [-i input_script] [-o option=value]... [-p passes] [-w golden.txt | -c golden.txt] system_directory game.zip|game.ngi\n", name);
+}
@@ -0,0 +1,120 @@
+#include "input_script.h"
+#include "libretro.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define INPUT_SCRIPT_LINE_SIZE 256
+
+// Neo Geo buttons to the libretro ids the core maps them from, see joypads_map
+static const struct {
+	const char *name;
+	unsigned id;
+} input_script_buttons[] = {
+	{ "UP", RETRO_DEVICE_ID_JOYPAD_UP },
+	{ "DOWN", RETRO_DEVICE_ID_JOYPAD_DOWN },
+	{ "LEFT", RETRO_DEVICE_ID_JOYPAD_LEFT },
+	{ "RIGHT", RETRO_DEVICE_ID_JOYPAD_RIGHT },
+	{ "A", RETRO_DEVICE_ID_JOYPAD_B },
+	{ "B", RETRO_DEVICE_ID_JOYPAD_A },
+	{ "C", RETRO_DEVICE_ID_JOYPAD_Y },
+	{ "D", RETRO_DEVICE_ID_JOYPAD_X },
+	{ "START", RETRO_DEVICE_ID_JOYPAD_START },
+	{ "SELECT", RETRO_DEVICE_ID_JOYPAD_SELECT },
+};
+
+static bool input_script_parse_buttons(char *names, uint16_t *buttons) {
+	*buttons = 0;
+	if (strcmp(names, "-") == 0) {
+		return true;
+	}
+	for (char *name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+		size_t i = 0;
+		while (i < sizeof(input_script_buttons) / sizeof(input_script_buttons[0]) && strcasecmp(name, input_script_buttons[i].name) != 0) {
+			i++;
+		}
+		if (i == sizeof(input_script_buttons) / sizeof(input_script_buttons[0])) {
+			return false;
+		}
+		*buttons |= 1 << input_script_buttons[i].id;
+	}
+	return true;
+}
+
+bool input_script_load(input_script_t *script, const char *path) {
+	memset(script, 0, sizeof(input_script_t));
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "input_script_load: can't open %s\n", path);
+		return false;
+	}
+
+	size_t capacity = 0;
+	char line[INPUT_SCRIPT_LINE_SIZE];
+	unsigned line_number = 0;
+	uint32_t last_frame = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		line_number++;
+		char *start = line;
+		while (isspace((unsigned char)*start)) {
+			start++;
+		}
+		if (*start == '#' || *start == '\0') {
+			continue;
+		}
+		unsigned frame, port;
+		char names[INPUT_SCRIPT_LINE_SIZE];
+		uint16_t buttons;
+		if (sscanf(start, "%u %u %255s", &frame, &port, names) != 3 || port >= INPUT_SCRIPT_PORTS
+			|| frame < last_frame || input_script_parse_buttons(names, &buttons) == false) {
+			fprintf(stderr, "input_script_load: %s:%u is not a valid line\n", path, line_number);
+			input_script_release(script);
+			fclose(file);
+			return false;
+		}
+		if (script->count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			input_script_event_t *grown = realloc(script->events, capacity * sizeof(input_script_event_t));
+			if (grown == NULL) {
+				input_script_release(script);
+				fclose(file);
+				return false;
+			}
+			script->events = grown;
+		}
+		script->events[script->count].frame = frame;
+		script->events[script->count].port = (uint8_t)port;
+		script->events[script->count].buttons = buttons;
+		script->count++;
+		last_frame = frame;
+	}
+	fclose(file);
+	return true;
+}
+
+void input_script_release(input_script_t *script) {
+	free(script->events);
+	memset(script, 0, sizeof(input_script_t));
+}
+
+void input_script_rewind(input_script_t *script) {
+	script->next = 0;
+	memset(script->buttons, 0, sizeof(script->buttons));
+}
+
+void input_script_advance(input_script_t *script, uint32_t frame) {
+	while (script->next < script->count && script->events[script->next].frame <= frame) {
+		input_script_event_t *event = &script->events[script->next++];
+		script->buttons[event->port] = event->buttons;
+	}
+}
+
+int16_t input_script_state(const input_script_t *script, unsigned port, unsigned device, unsigned id) {
+	if (port >= INPUT_SCRIPT_PORTS || device != RETRO_DEVICE_JOYPAD || id > 15) {
+		return 0;
+	}
+	return (script->buttons[port] >> id) & 1;
+}
@@ -0,0 +1,45 @@
+#ifndef input_script_h
+#define input_script_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *	Joypads input for headless runs, one text line per change:
+ *
+ *		# frame port buttons
+ *		60 0 START
+ *		62 0 -
+ *		300 1 RIGHT,A
+ *
+ *	A port keeps its buttons until the next line for it, - releases everything
+ *	Buttons are UP DOWN LEFT RIGHT A B C D START SELECT, lines are sorted by frame
+ */
+
+#define INPUT_SCRIPT_PORTS 2
+
+typedef struct input_script_event {
+	uint32_t frame;
+	uint8_t port;
+	uint16_t buttons;		// RETRO_DEVICE_ID_JOYPAD_* bits
+} input_script_event_t;
+
+typedef struct input_script {
+	input_script_event_t *events;
+	size_t count;
+	size_t next;
+	uint16_t buttons[INPUT_SCRIPT_PORTS];
+} input_script_t;
+
+bool input_script_load(input_script_t *script, const char *path);
+void input_script_release(input_script_t *script);
+
+// Back to frame 0 with every button released
+void input_script_rewind(input_script_t *script);
+// Applies the changes up to frame, frames must be given in order
+void input_script_advance(input_script_t *script, uint32_t frame);
+// retro_input_state_t answer for the current frame
+int16_t input_script_state(const input_script_t *script, unsigned port, unsigned device, unsigned id);
+
+#endif /* input_script_h */
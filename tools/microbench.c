@@ -0,0 +1,467 @@
+/*
+ *	Times the core kernels one at a time on synthetic inputs, no BIOS or game needed
+ *	Prints one line per benchmark: name, best and median ns per operation of the runs, operations per run
+ *
+ *	usage: neogeo_microbench [-r runs] [-b benchmark] [-g baseline.txt] [-t tolerance_percent]
+ *	-b runs only the benchmarks whose name contains the given text
+ *	-g compares the best times with a previous output and exits with 2 when one is slower by more than the tolerance (10% by default)
+ *
+ *	sprite_line			one sprite line through draw_sprite_line, all zoom levels and flips
+ *	sprite_line_clipped	same across the screen edges through draw_sprite_line_clipped
+ *	fix_line			video_draw_fix, 40 random tiles
+ *	sprites_list		video_create_sprites_list with every sprite on the line, 96 are kept
+ *	c_rom_tile			cartridge_serialize_c_rom, per 16x16 tile
+ *	palette_bank		video_convert_current_palette_bank, 4096 colors
+ *	ym2610_sample		ym2610_update, per sample with 4 FM channels and 3 SSG channels playing
+ *	m68k_instruction	m68k_execute, per instruction of a loop of memory, ALU, shift and branch instructions
+ *	z80_instruction		z80_execute, per instruction of a similar loop in the Z80 RAM
+ */
+
+#include "cartridge.h"
+#include "common_tools.h"
+#include "log.h"
+#include "memory_mapping.h"
+#include "neogeo.h"
+#include "sound.h"
+#include "tool_harness.h"
+#include "video.h"
+
+#include "3rdParty/musashi/m68k.h"
+#include "3rdParty/ym/ym2610.h"
+#include "3rdParty/z80/z80.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MICROBENCH_MIN_RUN_NSEC 20000000ull		// iterations are doubled until a run lasts that long
+#define MICROBENCH_MAX_RUNS 64
+#define MICROBENCH_BASELINE_MAX 64
+#define MICROBENCH_CASES 1024					// precomputed sprite lines, scanlines...
+
+#define MICROBENCH_SPRITE_TILES 4096
+#define MICROBENCH_FIX_ROM_SIZE (128 * 1024)
+#define MICROBENCH_Y_ZOOM_ROM_SIZE (64 * 1024)
+#define MICROBENCH_YM2610_SAMPLES 1024
+
+// VRAM words, see video.c
+#define MICROBENCH_VRAM_FIXMAP	0x7000
+#define MICROBENCH_VRAM_SCB2	0x8000
+#define MICROBENCH_VRAM_SCB3	0x8200
+#define MICROBENCH_VRAM_SCB4	0x8400
+
+// 68K program in the system ROM, after the board type and nationality bytes at 0x400
+#define MICROBENCH_M68K_PROGRAM 0x1000
+#define MICROBENCH_Z80_PROGRAM 0xF800
+
+// Returns the operations done by the iterations
+typedef uint64_t (*microbench_run_t)(uint32_t iterations);
+
+typedef struct microbench {
+	const char *name;
+	microbench_run_t run;
+} microbench_t;
+
+typedef struct microbench_sprite_case {
+	uint16_t sprite;
+	uint16_t x;
+	uint16_t y;
+	uint8_t zoom_x;
+	uint8_t zoom_y;
+	uint16_t scanline;
+} microbench_sprite_case_t;
+
+typedef struct microbench_result {
+	char name[32];
+	double best_nsec;
+} microbench_result_t;
+
+static uint32_t random_state = 0x2545F491;
+static microbench_sprite_case_t sprite_cases[MICROBENCH_CASES];
+static microbench_sprite_case_t clipped_sprite_cases[MICROBENCH_CASES];
+static uint8_t *c_rom_odd;
+static uint8_t *c_rom_even;
+static uint8_t *serialized_tiles;
+static FMSAMPLE ym2610_buffer[MICROBENCH_YM2610_SAMPLES * 2];
+
+static uint32_t microbench_random(void);
+static void microbench_setup_system_roms(void);
+static void microbench_setup_video(void);
+static void microbench_setup_sprite_cases(microbench_sprite_case_t *cases, bool clipped);
+static void microbench_setup_ym2610(void);
+static void microbench_setup_z80(void);
+static uint64_t microbench_sprite_line(uint32_t iterations);
+static uint64_t microbench_sprite_line_clipped(uint32_t iterations);
+static uint64_t microbench_fix_line(uint32_t iterations);
+static uint64_t microbench_sprites_list(uint32_t iterations);
+static uint64_t microbench_c_rom_tile(uint32_t iterations);
+static uint64_t microbench_palette_bank(uint32_t iterations);
+static uint64_t microbench_ym2610_sample(uint32_t iterations);
+static uint64_t microbench_m68k_instruction(uint32_t iterations);
+static uint64_t microbench_z80_instruction(uint32_t iterations);
+static int microbench_compare_nsec(const void *a, const void *b);
+static size_t microbench_load_baseline(const char *path, microbench_result_t *baseline);
+
+static const microbench_t benchmarks[] = {
+	{ "sprite_line", &microbench_sprite_line },
+	{ "sprite_line_clipped", &microbench_sprite_line_clipped },
+	{ "fix_line", &microbench_fix_line },
+	{ "sprites_list", &microbench_sprites_list },
+	{ "c_rom_tile", &microbench_c_rom_tile },
+	{ "palette_bank", &microbench_palette_bank },
+	{ "ym2610_sample", &microbench_ym2610_sample },
+	{ "m68k_instruction", &microbench_m68k_instruction },
+	{ "z80_instruction", &microbench_z80_instruction },
+};
+
+int main(int argc, char *argv[]) {
+	uint32_t runs = 5;
+	const char *filter = NULL;
+	const char *baseline_path = NULL;
+	double tolerance = 10;
+	int option;
+	while ((option = getopt(argc, argv, "r:b:g:t:")) != -1) {
+		switch (option) {
+			case 'r':
+				runs = (uint32_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'b':
+				filter = optarg;
+				break;
+			case 'g':
+				baseline_path = optarg;
+				break;
+			case 't':
+				tolerance = strtod(optarg, NULL);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-r runs] [-b benchmark] [-g baseline.txt] [-t tolerance_percent]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (runs == 0 || runs > MICROBENCH_MAX_RUNS) {
+		fprintf(stderr, "runs must be between 1 and %u\n", MICROBENCH_MAX_RUNS);
+		return 1;
+	}
+	microbench_result_t baseline[MICROBENCH_BASELINE_MAX];
+	size_t baseline_count = 0;
+	if (baseline_path != NULL) {
+		baseline_count = microbench_load_baseline(baseline_path, baseline);
+		if (baseline_count == 0) {
+			fprintf(stderr, "no benchmark in %s\n", baseline_path);
+			return 1;
+		}
+	}
+
+	tool_harness_init(LOG_WARN);
+	neogeo_initialize();
+	microbench_setup_system_roms();
+	neogeo_reset();
+	microbench_setup_video();
+	microbench_setup_ym2610();
+	microbench_setup_z80();
+
+	bool regressed = false;
+	for (size_t index = 0; index < sizeof(benchmarks) / sizeof(microbench_t); index++) {
+		const microbench_t *benchmark = &benchmarks[index];
+		if (filter != NULL && strstr(benchmark->name, filter) == NULL) {
+			continue;
+		}
+
+		uint32_t iterations = 1;
+		while (true) {
+			uint64_t start = monotonic_time_nsec();
+			benchmark->run(iterations);
+			if (monotonic_time_nsec() - start >= MICROBENCH_MIN_RUN_NSEC || iterations >= (1u << 30)) {
+				break;
+			}
+			iterations *= 2;
+		}
+
+		double nsec[MICROBENCH_MAX_RUNS];
+		uint64_t operations = 0;
+		for (uint32_t run = 0; run < runs; run++) {
+			uint64_t start = monotonic_time_nsec();
+			operations = benchmark->run(iterations);
+			nsec[run] = (double)(monotonic_time_nsec() - start) / (operations ? operations : 1);
+		}
+		qsort(nsec, runs, sizeof(double), &microbench_compare_nsec);
+		printf("%-20s %10.2f %10.2f %12llu\n", benchmark->name, nsec[0], nsec[runs / 2], (unsigned long long)operations);
+
+		for (size_t entry = 0; entry < baseline_count; entry++) {
+			if (strcmp(baseline[entry].name, benchmark->name) == 0 && nsec[0] > baseline[entry].best_nsec * (1 + tolerance / 100)) {
+				fprintf(stderr, "%s regressed: %.2f ns per operation, %.2f in the baseline\n", benchmark->name, nsec[0], baseline[entry].best_nsec);
+				regressed = true;
+			}
+		}
+	}
+
+	free(c_rom_odd);
+	free(c_rom_even);
+	free(serialized_tiles);
+	return regressed ? 2 : 0;
+}
+
+#pragma mark - Setup
+
+// xorshift, the inputs are the same for every run
+static uint32_t microbench_random() {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+static void microbench_setup_system_roms() {
+	// reset vectors then the 68K loop, big endian
+	static const uint16_t program[] = {
+		0x0010, 0xF300,				// initial SSP
+		0x00C0, MICROBENCH_M68K_PROGRAM,	// initial PC
+	};
+	static const uint16_t loop[] = {
+		0x41F9, 0x0010, 0x0000,		// lea		$100000, a0
+		0x7000,						// moveq	#0, d0
+		0x323C, 0x00FF,				// move.w	#255, d1
+		0xD058,						// add.w	(a0)+, d0
+		0x3080,						// move.w	d0, (a0)
+		0xE548,						// lsl.w	#2, d0
+		0xB340,						// eor.w	d1, d0
+		0x51C9, 0xFFF6,				// dbra		d1, add.w
+		0x6000, 0xFFE6,				// bra		lea
+	};
+	rom_region_t system_rom;
+	system_rom.size = SYSTEM_ROM_SIZE;
+	system_rom.data = calloc(1, SYSTEM_ROM_SIZE);
+	for (size_t index = 0; index < sizeof(program) / sizeof(uint16_t); index++) {
+		system_rom.data[index * 2] = program[index] >> 8;
+		system_rom.data[index * 2 + 1] = program[index] & 0xFF;
+	}
+	for (size_t index = 0; index < sizeof(loop) / sizeof(uint16_t); index++) {
+		system_rom.data[MICROBENCH_M68K_PROGRAM + index * 2] = loop[index] >> 8;
+		system_rom.data[MICROBENCH_M68K_PROGRAM + index * 2 + 1] = loop[index] & 0xFF;
+	}
+	neogeo_set_system_ROM(system_rom);
+
+	rom_region_t fix_rom;
+	fix_rom.size = MICROBENCH_FIX_ROM_SIZE;
+	fix_rom.data = malloc(MICROBENCH_FIX_ROM_SIZE);
+	for (size_t index = 0; index < MICROBENCH_FIX_ROM_SIZE; index++) {
+		fix_rom.data[index] = (uint8_t)microbench_random();
+	}
+	neogeo_set_system_fix_ROM(fix_rom);
+
+	// line of the 256 lines sprite shown on each line at each zoom, like the L0 ROM
+	rom_region_t y_zoom_rom;
+	y_zoom_rom.size = MICROBENCH_Y_ZOOM_ROM_SIZE;
+	y_zoom_rom.data = malloc(MICROBENCH_Y_ZOOM_ROM_SIZE);
+	for (uint32_t zoom = 0; zoom < 256; zoom++) {
+		for (uint32_t line = 0; line < 256; line++) {
+			uint32_t source = line * 256 / (zoom + 1);
+			y_zoom_rom.data[zoom * 256 + line] = source > 255 ? 255 : (uint8_t)source;
+		}
+	}
+	neogeo_set_system_Y_zoom_ROM(y_zoom_rom);
+}
+
+static void microbench_setup_video() {
+	c_rom_odd = malloc(MICROBENCH_SPRITE_TILES * CHARACTER_TILE_BYTES / 2);
+	c_rom_even = malloc(MICROBENCH_SPRITE_TILES * CHARACTER_TILE_BYTES / 2);
+	serialized_tiles = calloc(MICROBENCH_SPRITE_TILES, CHARACTER_TILE_BYTES);
+	for (size_t index = 0; index < MICROBENCH_SPRITE_TILES * CHARACTER_TILE_BYTES / 2; index++) {
+		c_rom_odd[index] = (uint8_t)microbench_random();
+		c_rom_even[index] = (uint8_t)microbench_random();
+	}
+	cartridge_serialize_c_rom(c_rom_odd, c_rom_even, MICROBENCH_SPRITE_TILES, serialized_tiles);
+	serialized_c_roms.data = serialized_tiles;
+	serialized_c_roms.size = MICROBENCH_SPRITE_TILES * CHARACTER_TILE_BYTES;
+	atomic_store(&cartridge_sprites_loaded, true);
+
+	for (uint32_t index = 0; index < 4096; index++) {
+		current_palette_ram->handlers.write_word(index * 2, (uint16_t)microbench_random());
+	}
+
+	uint16_t *vram = (uint16_t *)video.vram.data;
+	for (uint32_t index = 0; index < MICROBENCH_VRAM_FIXMAP; index += 2) {
+		// random tile, palette and flips, no auto animation
+		vram[index] = microbench_random() % MICROBENCH_SPRITE_TILES;
+		vram[index + 1] = (uint16_t)(microbench_random() & 0xFF03);
+	}
+	for (uint32_t index = 0; index < 40 * 32; index++) {
+		vram[MICROBENCH_VRAM_FIXMAP + index] = (uint16_t)microbench_random();
+	}
+	for (uint32_t sprite = 0; sprite < MAX_SPRITES_PER_SCREEN; sprite++) {
+		// 32 tiles high, on every line
+		vram[MICROBENCH_VRAM_SCB2 + sprite] = (uint16_t)(((sprite % 16) << 8) | ((sprite * 7) % 256));
+		vram[MICROBENCH_VRAM_SCB3 + sprite] = (uint16_t)(((microbench_random() % 512) << 7) | 0x20);
+		vram[MICROBENCH_VRAM_SCB4 + sprite] = (uint16_t)((microbench_random() % 512) << 7);
+	}
+
+	microbench_setup_sprite_cases(sprite_cases, false);
+	microbench_setup_sprite_cases(clipped_sprite_cases, true);
+}
+
+static void microbench_setup_sprite_cases(microbench_sprite_case_t *cases, bool clipped) {
+	for (uint32_t index = 0; index < MICROBENCH_CASES; index++) {
+		microbench_sprite_case_t *sprite_case = &cases[index];
+		sprite_case->sprite = 1 + microbench_random() % (MAX_SPRITES_PER_SCREEN - 1);
+		sprite_case->zoom_x = index % 16;
+		sprite_case->zoom_y = (uint8_t)microbench_random();
+		sprite_case->y = microbench_random() % 512;
+		sprite_case->scanline = 16 + microbench_random() % FRAMEBUFFER_HEIGHT;
+		if (clipped) {
+			// half across the right edge, half across the left one
+			uint32_t inside = microbench_random() % (sprite_case->zoom_x + 1);
+			sprite_case->x = index & 1 ? FRAMEBUFFER_WIDTH - 1 - inside : 0x200 - 1 - inside;
+		}
+		else {
+			sprite_case->x = microbench_random() % (FRAMEBUFFER_WIDTH - 16);
+		}
+	}
+}
+
+static void microbench_setup_ym2610() {
+	static const uint8_t channels[4][2] = { { 0, 1 }, { 0, 2 }, { 2, 1 }, { 2, 2 } };	// port, channel
+	static const uint8_t key_on_codes[4] = { 1, 2, 5, 6 };
+	for (uint8_t channel = 0; channel < 4; channel++) {
+		uint8_t port = channels[channel][0];
+		uint8_t offset = channels[channel][1];
+		for (uint8_t slot = 0; slot < 4; slot++) {
+			static const uint8_t operators[][2] = { { 0x30, 0x71 }, { 0x40, 0x10 }, { 0x50, 0x1F }, { 0x60, 0x05 }, { 0x70, 0x02 }, { 0x80, 0x11 } };
+			for (uint8_t index = 0; index < 6; index++) {
+				ym2610_write(port, operators[index][0] + slot * 4 + offset);
+				ym2610_write(port + 1, operators[index][1]);
+			}
+		}
+		// block and frequency, feedback and algorithm, both speakers
+		static const uint8_t channel_registers[][2] = { { 0xA4, 0x22 }, { 0xA0, 0x69 }, { 0xB0, 0x32 }, { 0xB4, 0xC0 } };
+		for (uint8_t index = 0; index < 4; index++) {
+			ym2610_write(port, channel_registers[index][0] + offset);
+			ym2610_write(port + 1, channel_registers[index][1] + (index == 1 ? channel * 0x20 : 0));
+		}
+		ym2610_write(0, 0x28);
+		ym2610_write(1, 0xF0 | key_on_codes[channel]);
+	}
+
+	// SSG tones without noise
+	static const uint8_t ssg_registers[][2] = { { 0, 0x40 }, { 1, 0x01 }, { 2, 0x80 }, { 3, 0x00 }, { 4, 0xC0 }, { 5, 0x00 }, { 7, 0x38 }, { 8, 0x0F }, { 9, 0x0C }, { 10, 0x0A } };
+	for (uint8_t index = 0; index < sizeof(ssg_registers) / 2; index++) {
+		ym2610_write(0, ssg_registers[index][0]);
+		ym2610_write(1, ssg_registers[index][1]);
+	}
+}
+
+static void microbench_setup_z80() {
+	static const uint8_t program[] = {
+		0x21, 0x00, 0xFC,		// ld		hl, $FC00
+		0x11, 0x00, 0xFE,		// ld		de, $FE00
+		0x06, 0x00,				// ld		b, 0
+		0x7E,					// ld		a, (hl)
+		0x80,					// add		a, b
+		0x12,					// ld		(de), a
+		0x23,					// inc		hl
+		0x1C,					// inc		e
+		0xCB, 0x27,				// sla		a
+		0x10, 0xF7,				// djnz		ld a, (hl)
+		0xC3, 0x00, 0xF8,		// jp		ld hl
+	};
+	for (uint32_t index = 0; index < sizeof(program); index++) {
+		cpu_z80_write(MICROBENCH_Z80_PROGRAM + index, program[index]);
+	}
+	Z80.pc.w.l = MICROBENCH_Z80_PROGRAM;
+}
+
+#pragma mark - Benchmarks
+
+static uint64_t microbench_sprite_line(uint32_t iterations) {
+	for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+		const microbench_sprite_case_t *sprite_case = &sprite_cases[iteration % MICROBENCH_CASES];
+		video_draw_sprite(sprite_case->sprite, sprite_case->x, sprite_case->y, sprite_case->zoom_x, sprite_case->zoom_y, sprite_case->scanline, 0x20);
+	}
+	return iterations;
+}
+
+static uint64_t microbench_sprite_line_clipped(uint32_t iterations) {
+	for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+		const microbench_sprite_case_t *sprite_case = &clipped_sprite_cases[iteration % MICROBENCH_CASES];
+		video_draw_sprite(sprite_case->sprite, sprite_case->x, sprite_case->y, sprite_case->zoom_x, sprite_case->zoom_y, sprite_case->scanline, 0x20);
+	}
+	return iterations;
+}
+
+static uint64_t microbench_fix_line(uint32_t iterations) {
+	for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+		video_draw_fix(16 + iteration % FRAMEBUFFER_HEIGHT);
+	}
+	return iterations;
+}
+
+static uint64_t microbench_sprites_list(uint32_t iterations) {
+	for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+		video_create_sprites_list(16 + iteration % FRAMEBUFFER_HEIGHT);
+	}
+	return iterations;
+}
+
+static uint64_t microbench_c_rom_tile(uint32_t iterations) {
+	for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+		cartridge_serialize_c_rom(c_rom_odd, c_rom_even, MICROBENCH_SPRITE_TILES, serialized_tiles);
+	}
+	return (uint64_t)iterations * MICROBENCH_SPRITE_TILES;
+}
+
+static uint64_t microbench_palette_bank(uint32_t iterations) {
+	for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+		video_convert_current_palette_bank();
+	}
+	return iterations;
+}
+
+static uint64_t microbench_ym2610_sample(uint32_t iterations) {
+	for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+		ym2610_update(ym2610_buffer, MICROBENCH_YM2610_SAMPLES);
+	}
+	return (uint64_t)iterations * MICROBENCH_YM2610_SAMPLES;
+}
+
+static uint64_t microbench_m68k_instruction(uint32_t iterations) {
+	m68k_instructions_count = 0;
+	for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+		m68k_execute(10000);
+	}
+	return m68k_instructions_count;
+}
+
+static uint64_t microbench_z80_instruction(uint32_t iterations) {
+	z80_instructions_count = 0;
+	for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+		z80_execute(10000);
+	}
+	return z80_instructions_count;
+}
+
+#pragma mark - Results
+
+static int microbench_compare_nsec(const void *a, const void *b) {
+	double nsec_a = *(const double *)a;
+	double nsec_b = *(const double *)b;
+	return (nsec_a > nsec_b) - (nsec_a < nsec_b);
+}
+
+// A previous output, names and best times
+static size_t microbench_load_baseline(const char *path, microbench_result_t *baseline) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "can't open %s\n", path);
+		return 0;
+	}
+	size_t count = 0;
+	char line[256];
+	while (count < MICROBENCH_BASELINE_MAX && fgets(line, sizeof(line), file) != NULL) {
+		if (sscanf(line, "%31s %lf", baseline[count].name, &baseline[count].best_nsec) == 2) {
+			count++;
+		}
+	}
+	fclose(file);
+	return count;
+}
@@ -0,0 +1,33 @@
+/*
+ *	Builds a native cartridge image (.ngi) from a zipped cartridge
+ *	The zip goes through the regular core loader, converted ROMs are then written as is
+ *
+ *	usage: neogeo_ngi_convert game.zip game.ngi
+ */
+
+#include "cartridge.h"
+#include "log.h"
+#include "tool_harness.h"
+
+#include <stdio.h>
+
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s game.zip game.ngi\n", argv[0]);
+		return 1;
+	}
+	
+	tool_harness_init(LOG_INFO);
+	cartridge_init();
+	// whole sprites are serialized, the tile cache can't be written
+	cartridge_set_sprites_memory_budget(0);
+	
+	if (cartridge_load_roms(argv[1]) == false) {
+		fprintf(stderr, "can't load cartridge %s\n", argv[1]);
+		return 1;
+	}
+	bool written = cartridge_write_image(argv[2]);
+	cartridge_unload();
+	
+	return written ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+/*
+ *	Times neogeo_reset, the soft reset taken by retro_reset
+ *	A few frames are run between resets so every reset starts from a used machine
+ *
+ *	usage: neogeo_reset_bench system_directory game.zip|game.ngi [resets]
+ *	the BIOS is read from system_directory/neogeo/neogeo.zip like the libretro core does
+ */
+
+#include "cartridge.h"
+#include "common_tools.h"
+#include "log.h"
+#include "neogeo.h"
+#include "tool_harness.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RESET_BENCH_FRAMES_BETWEEN_RESETS 2
+
+int main(int argc, char *argv[]) {
+	if (argc < 3 || argc > 4) {
+		fprintf(stderr, "usage: %s system_directory game.zip|game.ngi [resets]\n", argv[0]);
+		return 1;
+	}
+	int resets = argc == 4 ? atoi(argv[3]) : 1000;
+	if (resets <= 0) {
+		resets = 1;
+	}
+
+	tool_harness_init(LOG_WARN);
+	if (tool_harness_load_system(argv[1]) == false || tool_harness_load_game(argv[2]) == false) {
+		return 1;
+	}
+
+	// the first reset after loading also catches up with the background loading
+	uint64_t start = monotonic_time_usec();
+	neogeo_reset();
+	uint64_t first_reset = monotonic_time_usec() - start;
+
+	uint64_t total = 0;
+	uint64_t slowest = 0;
+	for (int i = 0; i < resets; i++) {
+		for (int frame = 0; frame < RESET_BENCH_FRAMES_BETWEEN_RESETS; frame++) {
+			neogeo_runOneFrame();
+		}
+		start = monotonic_time_usec();
+		neogeo_reset();
+		uint64_t elapsed = monotonic_time_usec() - start;
+		total += elapsed;
+		if (elapsed > slowest) {
+			slowest = elapsed;
+		}
+	}
+
+	printf("first reset: %llu us\n", (unsigned long long)first_reset);
+	printf("%d resets: %.2f us average, %llu us slowest\n", resets, (double)total / resets, (unsigned long long)slowest);
+
+	cartridge_unload();
+	return 0;
+}
@@ -0,0 +1,640 @@
+/*
+ *	Generates a homebrew cartridge zip that loads through cartridge_load_roms, a worst case workload for the benchmarks
+ *	The same file is written on every run, nothing comes from a commercial ROM
+ *
+ *	usage: neogeo_stress_cart [-s system_directory] stress.zip
+ *	-s also writes system_directory/neogeo/neogeo.zip with a stub system ROM that starts the cartridge right away,
+ *	a Y zoom ROM and a fix ROM, so the cartridge runs without the licensed BIOS. An existing neogeo.zip is never replaced
+ *
+ *	68K program, every frame:
+ *	- the 381 sprites are 32 tiles high, on every line, in sticky chains of STRESS_CHAIN_LENGTH with moving heads
+ *	- every sprite zoom changes, the fix map is rewritten
+ *	- the P ROM bank switches and 256 colors are copied from the bank to the palettes RAM
+ *	- the raster timer flips the palette bank every 16 lines
+ *	- a sound command is sent
+ *	Z80 program: 4 FM channels with LFO, the 3 SSG channels, the 6 ADPCM-A voices and ADPCM-B on repeat
+ *	are started again every STRESS_Z80_STEP_DELAY loops, and the YM2610 timers run
+ *
+ *	The header follows the real cartridges, the stub system ROM only uses the USER entry point
+ */
+
+#include "memory_mapping.h"
+
+#include "3rdParty/miniz/miniz.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STRESS_NGH 0x0999
+#define STRESS_P_ROM_SIZE (3 * ROM_BANK1_SIZE)		// fixed bank then 2 switchable banks in P2
+#define STRESS_S_ROM_SIZE (128 * 1024)
+#define STRESS_M_ROM_SIZE (128 * 1024)
+#define STRESS_V_ROM_SIZE (1024 * 1024)
+#define STRESS_C_ROM_SIZE (2 * 1024 * 1024)		// per chip, 32768 tiles for the pair
+#define STRESS_Y_ZOOM_ROM_SIZE (128 * 1024)
+
+#define STRESS_CHAIN_LENGTH 8						// power of 2
+#define STRESS_TIMER_PIXELS (16 * 384)				// raster interrupt every 16 lines
+#define STRESS_ZIP_TIME 946684800					// 2000-01-01, the archive is the same on every run
+
+// 68K program, P ROM addresses
+#define STRESS_68K_SECURITY_CODE 0x000186
+#define STRESS_68K_SOFT_DIPS 0x000300
+#define STRESS_68K_USER 0x000400
+#define STRESS_68K_VBLANK 0x000600
+#define STRESS_68K_TIMER 0x000640
+#define STRESS_68K_RETURN 0x000680
+
+// work RAM used by the 68K program
+#define STRESS_FRAME 0x100000						// word, incremented by the vblank interrupt
+#define STRESS_PALETTE_BANK 0x100002				// byte, bit 0 toggled by the timer interrupt
+
+// stub system ROM, offsets from SYSTEM_ROM_START
+#define STRESS_BIOS_RESET 0x000500
+#define STRESS_BIOS_VBLANK 0x000580
+#define STRESS_BIOS_TIMER 0x000590
+#define STRESS_BIOS_HALT 0x0005A0
+
+// Z80 program, M1 ROM addresses
+#define STRESS_Z80_SEQUENCE 0x0180					// step tables addresses, 0 terminated
+#define STRESS_Z80_TABLES 0x0200					// setup table then step tables: port, register, value... 0
+#define STRESS_Z80_STEPS 8
+#define STRESS_Z80_STEP_DELAY 5128					// about 2 frames of dec bc loop
+
+typedef struct stress_rom {
+	const char *name;
+	uint8_t *data;
+	size_t size;
+} stress_rom_t;
+
+static uint32_t random_state = 0x9E3779B9;
+
+static uint32_t stress_random(void);
+static void stress_fill_random(uint8_t *data, size_t size);
+static void stress_write_words(uint8_t *data, uint32_t offset, const uint16_t *words, size_t count);
+static void stress_write_long(uint8_t *data, uint32_t offset, uint32_t value);
+static void stress_swap_words(uint8_t *data, size_t size);
+static void stress_build_p_rom(uint8_t *p_rom);
+static void stress_build_m_rom(uint8_t *m_rom);
+static uint32_t stress_ym_write(uint8_t *m_rom, uint32_t address, uint8_t port, uint8_t reg, uint8_t value);
+static void stress_build_system_rom(uint8_t *system_rom);
+static void stress_build_y_zoom_rom(uint8_t *y_zoom_rom);
+static bool stress_write_zip(const char *path, const stress_rom_t *roms, size_t count);
+static bool stress_write_cartridge(const char *path);
+static bool stress_write_system(const char *system_directory);
+static void stress_usage(const char *name);
+
+int main(int argc, char *argv[]) {
+	const char *system_directory = NULL;
+	int option;
+	while ((option = getopt(argc, argv, "s:")) != -1) {
+		switch (option) {
+			case 's':
+				system_directory = optarg;
+				break;
+			default:
+				stress_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (argc - optind != 1) {
+		stress_usage(argv[0]);
+		return 1;
+	}
+
+	if (stress_write_cartridge(argv[optind]) == false) {
+		return 1;
+	}
+	if (system_directory != NULL && stress_write_system(system_directory) == false) {
+		return 1;
+	}
+	return 0;
+}
+
+#pragma mark - Helpers
+
+static uint32_t stress_random() {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+static void stress_fill_random(uint8_t *data, size_t size) {
+	for (size_t index = 0; index < size; index++) {
+		data[index] = (uint8_t)stress_random();
+	}
+}
+
+// Big endian, as the 68K sees them
+static void stress_write_words(uint8_t *data, uint32_t offset, const uint16_t *words, size_t count) {
+	for (size_t index = 0; index < count; index++) {
+		data[offset + index * 2] = words[index] >> 8;
+		data[offset + index * 2 + 1] = words[index] & 0xFF;
+	}
+}
+
+static void stress_write_long(uint8_t *data, uint32_t offset, uint32_t value) {
+	uint16_t words[2] = { value >> 16, value & 0xFFFF };
+	stress_write_words(data, offset, words, 2);
+}
+
+// 68K ROMs are dumped with swapped bytes, byte_swap_p_rom_if_needed puts them back
+static void stress_swap_words(uint8_t *data, size_t size) {
+	for (size_t index = 0; index < size; index += 2) {
+		uint8_t byte = data[index];
+		data[index] = data[index + 1];
+		data[index + 1] = byte;
+	}
+}
+
+#pragma mark - Cartridge
+
+static void stress_build_p_rom(uint8_t *p_rom) {
+	// BIOS handlers but the vblank and timer interrupts
+	for (uint32_t vector = 8; vector < ROM_VECTOR_TABLE_SIZE; vector += 4) {
+		stress_write_long(p_rom, vector, SYSTEM_ROM_START + 0x426);
+	}
+	stress_write_long(p_rom, 0x00, 0x0010F300);
+	stress_write_long(p_rom, 0x04, SYSTEM_ROM_START + 0x402);
+	stress_write_long(p_rom, 0x08, SYSTEM_ROM_START + 0x408);
+	stress_write_long(p_rom, 0x0C, SYSTEM_ROM_START + 0x40E);
+	stress_write_long(p_rom, 0x10, SYSTEM_ROM_START + 0x40E);
+	stress_write_long(p_rom, 0x20, SYSTEM_ROM_START + 0x41A);
+	stress_write_long(p_rom, 0x24, SYSTEM_ROM_START + 0x420);
+	stress_write_long(p_rom, 0x60, SYSTEM_ROM_START + 0x432);
+	stress_write_long(p_rom, 0x64, STRESS_68K_VBLANK);
+	stress_write_long(p_rom, 0x68, STRESS_68K_TIMER);
+	stress_write_long(p_rom, 0x6C, 0);
+
+	// header
+	memcpy(p_rom + 0x100, "NEO-GEO", 8);
+	uint16_t ngh = STRESS_NGH;
+	stress_write_words(p_rom, 0x108, &ngh, 1);
+	stress_write_long(p_rom, 0x10A, STRESS_P_ROM_SIZE);
+	stress_write_long(p_rom, 0x10E, 0x00100100);		// backup RAM block, empty
+	p_rom[0x114] = 2;									// no eye catcher
+	for (uint32_t region = 0; region < 3; region++) {
+		stress_write_long(p_rom, 0x116 + region * 4, STRESS_68K_SOFT_DIPS);
+	}
+	const uint32_t entry_points[4] = { STRESS_68K_USER, STRESS_68K_RETURN, STRESS_68K_RETURN, STRESS_68K_RETURN };	// USER, PLAYER_START, DEMO_END, COIN_SOUND
+	for (uint32_t index = 0; index < 4; index++) {
+		uint16_t jmp = 0x4EF9;
+		stress_write_words(p_rom, 0x122 + index * 6, &jmp, 1);
+		stress_write_long(p_rom, 0x124 + index * 6, entry_points[index]);
+	}
+	stress_write_long(p_rom, 0x182, STRESS_68K_SECURITY_CODE);
+
+	// checked by the real system ROMs, as in every cartridge
+	static const uint16_t security_code[] = {
+		0x7600, 0x4A6D, 0x0A14, 0x6600, 0x003C, 0x206D, 0x0A04, 0x3E2D,
+		0x0A08, 0x13C0, 0x0030, 0x0001, 0x3210, 0x0C01, 0x00FF, 0x671A,
+		0x3028, 0x0002, 0xB02D, 0x0ACE, 0x6610, 0x3028, 0x0004, 0xB02D,
+		0x0ACF, 0x6606, 0xB22D, 0x0AD0, 0x6708, 0x5088, 0x51CF, 0xFFD4,
+		0x3607, 0x4E75, 0x206D, 0x0A04, 0x3E2D, 0x0A08, 0x3210, 0xE049,
+		0x0C01, 0x00FF, 0x671A, 0x3010, 0xB02D, 0x0ACE, 0x6612, 0x3028,
+		0x0002, 0xE048, 0xB02D, 0x0ACF, 0x6606, 0xB22D, 0x0AD0, 0x6708,
+		0x5888, 0x51CF, 0xFFD8, 0x3607, 0x4E75,
+	};
+	stress_write_words(p_rom, STRESS_68K_SECURITY_CODE, security_code, sizeof(security_code) / sizeof(uint16_t));
+
+	// soft DIPs: name, no time, count or option setting
+	memcpy(p_rom + STRESS_68K_SOFT_DIPS, "STRESS TEST     ", 16);
+	memset(p_rom + STRESS_68K_SOFT_DIPS + 16, 0xFF, 4);
+
+	static const uint16_t user[] = {
+		0x0C39, 0x0002, 0x0010, 0xFDAE,		// cmpi.b	#2, BIOS_USER_REQUEST
+		0x6400, 0x0008,						// bcc.w	move.w #$2700, sr
+		0x4EF9, 0x00C0, 0x0444,				// jmp		SYSTEM_RETURN, init and eye catcher requests
+		0x46FC, 0x2700,						// move.w	#$2700, sr
+		0x4FF9, 0x0010, 0xF300,				// lea		$10F300, sp
+		0x33FC, 0x0007, 0x003C, 0x000C,		// move.w	#7, REG_IRQACK
+		0x13FC, 0x0080, 0x0010, 0xFD80,		// move.b	#$80, BIOS_SYSTEM_MODE, the game handles vblank
+		0x45F9, 0x003C, 0x0002,				// lea		REG_VRAMRW, a2
+		0x33FC, 0x0001, 0x003C, 0x0004,		// move.w	#1, REG_VRAMMOD
+		0x33FC, 0x0040, 0x003C, 0x0000,		// move.w	#$40, REG_VRAMADDR, SCB1 of sprite 1
+		0x7000,								// moveq	#0, d0
+		0x7200,								// moveq	#0, d1
+		0x3E3C, 0x2F9F,						// move.w	#381*32-1, d7
+		0x3480,								// move.w	d0, (a2), tile
+		0x3481,								// move.w	d1, (a2), palette, auto animation and flips
+		0x0640, 0x0007,						// addi.w	#7, d0
+		0x0240, 0x7FFF,						// andi.w	#$7FFF, d0
+		0x0641, 0x0101,						// addi.w	#$0101, d1
+		0x0241, 0xFF0F,						// andi.w	#$FF0F, d1
+		0x51CF, 0xFFEA,						// dbra	d7, move.w d0, (a2)
+		0x13C0, 0x003A, 0x000F,				// move.b	d0, REG_PALBANK1
+		0x7A01,								// moveq	#1, d5
+		0x41F9, 0x0040, 0x0000,				// lea		PALETTES_RAM_START, a0
+		0x3E3C, 0x0FFF,						// move.w	#4095, d7
+		0x30C0,								// move.w	d0, (a0)+
+		0x0640, 0x1357,						// addi.w	#$1357, d0
+		0x51CF, 0xFFF8,						// dbra	d7, move.w d0, (a0)+
+		0x13C0, 0x003A, 0x001F,				// move.b	d0, REG_PALBANK0
+		0x51CD, 0xFFE4,						// dbra	d5, lea PALETTES_RAM_START
+		0x33FC, 0x0020, 0x003C, 0x0006,		// move.w	#$0020, REG_LSPCMODE, timer reloaded by REG_TIMERLOW
+		0x33FC, 0x0000, 0x003C, 0x0008,		// move.w	#0, REG_TIMERHIGH
+		0x33FC, STRESS_TIMER_PIXELS, 0x003C, 0x000A,	// move.w	#STRESS_TIMER_PIXELS, REG_TIMERLOW
+		0x33FC, 0x04F0, 0x003C, 0x0006,		// move.w	#$04F0, REG_LSPCMODE, timer interrupt, reloaded at vblank and when it expires
+		0x46FC, 0x2000,						// move.w	#$2000, sr
+		0x3C39, 0x0010, 0x0000,				// move.w	STRESS_FRAME, d6
+		0xBC79, 0x0010, 0x0000,				// cmp.w	STRESS_FRAME, d6
+		0x6700, 0xFFF8,						// beq.w	cmp.w STRESS_FRAME, d6
+		0x3C39, 0x0010, 0x0000,				// move.w	STRESS_FRAME, d6
+		0x13C0, 0x0030, 0x0001,				// move.b	d0, REG_DIPSW, watchdog
+		0x13C6, 0x0032, 0x0000,				// move.b	d6, REG_SOUND
+		0x3006,								// move.w	d6, d0
+		0x0240, 0x0001,						// andi.w	#1, d0
+		0x13C0, 0x002F, 0xFFF0,				// move.b	d0, $2FFFF0, P ROM bank
+		0x3206,								// move.w	d6, d1
+		0x0241, 0x0007,						// andi.w	#7, d1
+		0xE149,								// lsl.w	#8, d1
+		0xD241,								// add.w	d1, d1
+		0x41F9, 0x0020, 0x0000,				// lea		ROM_BANK2_START, a0
+		0x43F9, 0x0040, 0x0000,				// lea		PALETTES_RAM_START, a1
+		0xD0C1,								// adda.w	d1, a0
+		0xD2C1,								// adda.w	d1, a1
+		0x3E3C, 0x00FF,						// move.w	#255, d7
+		0x32D8,								// move.w	(a0)+, (a1)+
+		0x51CF, 0xFFFC,						// dbra	d7, move.w (a0)+, (a1)+
+		0x33FC, 0x8001, 0x003C, 0x0000,		// move.w	#$8001, REG_VRAMADDR, SCB2
+		0x3406,								// move.w	d6, d2
+		0x3E3C, 0x017C,						// move.w	#380, d7
+		0x3482,								// move.w	d2, (a2), zoom
+		0x0642, 0x0113,						// addi.w	#$0113, d2
+		0x0242, 0x0FFF,						// andi.w	#$0FFF, d2
+		0x51CF, 0xFFF4,						// dbra	d7, move.w d2, (a2)
+		0x33FC, 0x8201, 0x003C, 0x0000,		// move.w	#$8201, REG_VRAMADDR, SCB3
+		0x7600,								// moveq	#0, d3
+		0x3E3C, 0x017C,						// move.w	#380, d7
+		0x3003,								// move.w	d3, d0
+		0x0240, STRESS_CHAIN_LENGTH - 1,	// andi.w	#STRESS_CHAIN_LENGTH-1, d0
+		0x6600, 0x0010,						// bne.w	move.w #$40, d0
+		0x3006,								// move.w	d6, d0
+		0xD043,								// add.w	d3, d0
+		0xEF48,								// lsl.w	#7, d0
+		0x0040, 0x0020,						// ori.w	#$20, d0, chain head 32 tiles high
+		0x6000, 0x0006,						// bra.w	move.w d0, (a2)
+		0x303C, 0x0040,						// move.w	#$40, d0, sticky
+		0x3480,								// move.w	d0, (a2)
+		0x5243,								// addq.w	#1, d3
+		0x51CF, 0xFFDE,						// dbra	d7, move.w d3, d0
+		0x33FC, 0x8401, 0x003C, 0x0000,		// move.w	#$8401, REG_VRAMADDR, SCB4
+		0x7600,								// moveq	#0, d3
+		0x3E3C, 0x017C,						// move.w	#380, d7
+		0x3003,								// move.w	d3, d0
+		0xD040,								// add.w	d0, d0
+		0xD040,								// add.w	d0, d0
+		0xD043,								// add.w	d3, d0
+		0xD046,								// add.w	d6, d0
+		0xEF48,								// lsl.w	#7, d0
+		0x3480,								// move.w	d0, (a2)
+		0x5243,								// addq.w	#1, d3
+		0x51CF, 0xFFEE,						// dbra	d7, move.w d3, d0
+		0x33FC, 0x7000, 0x003C, 0x0000,		// move.w	#$7000, REG_VRAMADDR, fix map
+		0x3006,								// move.w	d6, d0
+		0x3E3C, 0x04FF,						// move.w	#1279, d7
+		0x3480,								// move.w	d0, (a2)
+		0x0640, 0x1003,						// addi.w	#$1003, d0
+		0x51CF, 0xFFF8,						// dbra	d7, move.w d0, (a2)
+		0x6000, 0xFF2A,						// bra.w	cmp.w STRESS_FRAME, d6
+	};
+	static const uint16_t vblank[] = {
+		0x0839, 0x0007, 0x0010, 0xFD80,		// btst		#7, BIOS_SYSTEM_MODE
+		0x6600, 0x0008,						// bne.w	move.w #4, REG_IRQACK
+		0x4EF9, 0x00C0, 0x0438,				// jmp		SYSTEM_INT1
+		0x33FC, 0x0004, 0x003C, 0x000C,		// move.w	#4, REG_IRQACK
+		0x5279, 0x0010, 0x0000,				// addq.w	#1, STRESS_FRAME
+		0x4E73,								// rte
+	};
+	static const uint16_t timer[] = {
+		0x33FC, 0x0002, 0x003C, 0x000C,		// move.w	#2, REG_IRQACK
+		0x0879, 0x0000, 0x0010, 0x0002,		// bchg		#0, STRESS_PALETTE_BANK
+		0x6700, 0x000A,						// beq.w	move.b d0, REG_PALBANK1
+		0x13C0, 0x003A, 0x001F,				// move.b	d0, REG_PALBANK0
+		0x4E73,								// rte
+		0x13C0, 0x003A, 0x000F,				// move.b	d0, REG_PALBANK1
+		0x4E73,								// rte
+	};
+	static const uint16_t rts = 0x4E75;
+	stress_write_words(p_rom, STRESS_68K_USER, user, sizeof(user) / sizeof(uint16_t));
+	stress_write_words(p_rom, STRESS_68K_VBLANK, vblank, sizeof(vblank) / sizeof(uint16_t));
+	stress_write_words(p_rom, STRESS_68K_TIMER, timer, sizeof(timer) / sizeof(uint16_t));
+	stress_write_words(p_rom, STRESS_68K_RETURN, &rts, 1);
+
+	// switchable banks, colors for the palettes copy
+	stress_fill_random(p_rom + ROM_BANK1_SIZE, STRESS_P_ROM_SIZE - ROM_BANK1_SIZE);
+}
+
+static void stress_build_m_rom(uint8_t *m_rom) {
+	static const uint8_t reset[] = {
+		0xF3,					// di
+		0x31, 0xFC, 0xFF,		// ld		sp, $FFFC
+		0xC3, 0x00, 0x01,		// jp		$0100
+	};
+	static const uint8_t nmi[] = {
+		0xF5,					// push		af
+		0xDB, 0x00,				// in		a, ($00)
+		0xD3, 0x0C,				// out		($0C), a, command echoed as the reply
+		0xF1,					// pop		af
+		0xED, 0x45,				// retn
+	};
+	static const uint8_t program[] = {
+		0x21, STRESS_Z80_TABLES & 0xFF, STRESS_Z80_TABLES >> 8,		// ld hl, STRESS_Z80_TABLES
+		0xCD, 0x21, 0x01,		// call		ld a, (hl)
+		0xD3, 0x08,				// out		($08), a, NMI enabled
+		0x11, STRESS_Z80_SEQUENCE & 0xFF, STRESS_Z80_SEQUENCE >> 8,	// ld de, STRESS_Z80_SEQUENCE
+		0x1A,					// ld		a, (de)
+		0x6F,					// ld		l, a
+		0x13,					// inc		de
+		0x1A,					// ld		a, (de)
+		0x67,					// ld		h, a
+		0x13,					// inc		de
+		0xB5,					// or		l
+		0x28, 0xF4,				// jr		z, ld de, STRESS_Z80_SEQUENCE
+		0xCD, 0x21, 0x01,		// call		ld a, (hl)
+		0x01, STRESS_Z80_STEP_DELAY & 0xFF, STRESS_Z80_STEP_DELAY >> 8,	// ld bc, STRESS_Z80_STEP_DELAY
+		0x0B,					// dec		bc
+		0x78,					// ld		a, b
+		0xB1,					// or		c
+		0x20, 0xFB,				// jr		nz, dec bc
+		0x18, 0xEA,				// jr		ld a, (de)
+		0x7E,					// ld		a, (hl), port of the table entry, 0 at the end
+		0xB7,					// or		a
+		0xC8,					// ret		z
+		0x4F,					// ld		c, a
+		0x23,					// inc		hl
+		0x7E,					// ld		a, (hl)
+		0xED, 0x79,				// out		(c), a, register
+		0x23,					// inc		hl
+		0x0C,					// inc		c
+		0x7E,					// ld		a, (hl)
+		0xED, 0x79,				// out		(c), a, value
+		0x23,					// inc		hl
+		0x18, 0xF0,				// jr		ld a, (hl)
+	};
+	memcpy(m_rom, reset, sizeof(reset));
+	memcpy(m_rom + 0x66, nmi, sizeof(nmi));
+	memcpy(m_rom + 0x100, program, sizeof(program));
+
+	// setup table
+	uint32_t address = STRESS_Z80_TABLES;
+	static const uint8_t ssg_registers[][2] = {
+		{ 0, 0x40 }, { 1, 0x01 }, { 2, 0x80 }, { 3, 0x00 }, { 4, 0xC0 }, { 5, 0x00 }, { 6, 0x1F },
+		{ 7, 0x30 }, { 8, 0x0F }, { 9, 0x0F }, { 10, 0x0F }
+	};	// tones and noise on A
+	for (uint8_t index = 0; index < sizeof(ssg_registers) / 2; index++) {
+		address = stress_ym_write(m_rom, address, 0, ssg_registers[index][0], ssg_registers[index][1]);
+	}
+	address = stress_ym_write(m_rom, address, 0, 0x22, 0x0B);		// LFO
+	static const uint8_t fm_channels[4][2] = { { 0, 1 }, { 0, 2 }, { 1, 1 }, { 1, 2 } };	// port, channel
+	for (uint8_t channel = 0; channel < 4; channel++) {
+		uint8_t port = fm_channels[channel][0];
+		uint8_t offset = fm_channels[channel][1];
+		for (uint8_t slot = 0; slot < 4; slot++) {
+			static const uint8_t operators[][2] = { { 0x30, 0x71 }, { 0x40, 0x10 }, { 0x50, 0x1F }, { 0x60, 0x85 }, { 0x70, 0x02 }, { 0x80, 0x11 }, { 0x90, 0x00 } };
+			for (uint8_t index = 0; index < sizeof(operators) / 2; index++) {
+				address = stress_ym_write(m_rom, address, port, operators[index][0] + slot * 4 + offset, operators[index][1]);
+			}
+		}
+		address = stress_ym_write(m_rom, address, port, 0xB0 + offset, 0x32);		// feedback and algorithm
+		address = stress_ym_write(m_rom, address, port, 0xB4 + offset, 0xF3);		// both speakers, AM and PM sensitivity
+	}
+	address = stress_ym_write(m_rom, address, 1, 0x01, 0x3F);		// ADPCM-A total level
+	for (uint8_t voice = 0; voice < 6; voice++) {
+		// 128KB per voice, in 256 bytes units
+		uint16_t start = voice * 0x200;
+		uint16_t end = start + 0x1FF;
+		address = stress_ym_write(m_rom, address, 1, 0x08 + voice, 0xDF);
+		address = stress_ym_write(m_rom, address, 1, 0x10 + voice, start & 0xFF);
+		address = stress_ym_write(m_rom, address, 1, 0x18 + voice, start >> 8);
+		address = stress_ym_write(m_rom, address, 1, 0x20 + voice, end & 0xFF);
+		address = stress_ym_write(m_rom, address, 1, 0x28 + voice, end >> 8);
+	}
+	// ADPCM-B over the whole V2 ROM
+	static const uint8_t adpcmb_registers[][2] = {
+		{ 0x10, 0x01 }, { 0x11, 0xC0 }, { 0x12, 0x00 }, { 0x13, 0x00 }, { 0x14, 0xFF }, { 0x15, 0x0F },
+		{ 0x19, 0x00 }, { 0x1A, 0xC0 }, { 0x1B, 0xFF }
+	};
+	for (uint8_t index = 0; index < sizeof(adpcmb_registers) / 2; index++) {
+		address = stress_ym_write(m_rom, address, 0, adpcmb_registers[index][0], adpcmb_registers[index][1]);
+	}
+	// timers A and B running, the Z80 never takes their interrupt
+	static const uint8_t timer_registers[][2] = { { 0x24, 0x80 }, { 0x25, 0x00 }, { 0x26, 0xC0 }, { 0x27, 0x3F } };
+	for (uint8_t index = 0; index < sizeof(timer_registers) / 2; index++) {
+		address = stress_ym_write(m_rom, address, 0, timer_registers[index][0], timer_registers[index][1]);
+	}
+	m_rom[address++] = 0;
+
+	// steps: new notes and every voice started again
+	static const uint8_t key_codes[4] = { 1, 2, 5, 6 };
+	for (uint32_t step = 0; step < STRESS_Z80_STEPS; step++) {
+		m_rom[STRESS_Z80_SEQUENCE + step * 2] = address & 0xFF;
+		m_rom[STRESS_Z80_SEQUENCE + step * 2 + 1] = address >> 8;
+		for (uint8_t channel = 0; channel < 4; channel++) {
+			uint8_t port = fm_channels[channel][0];
+			uint8_t offset = fm_channels[channel][1];
+			uint16_t number = 0x269 + step * 0x30 + channel * 0x50;
+			uint8_t block = 3 + (step + channel) % 3;
+			address = stress_ym_write(m_rom, address, 0, 0x28, key_codes[channel]);
+			address = stress_ym_write(m_rom, address, port, 0xA4 + offset, (block << 3) | (number >> 8));
+			address = stress_ym_write(m_rom, address, port, 0xA0 + offset, number & 0xFF);
+			address = stress_ym_write(m_rom, address, 0, 0x28, 0xF0 | key_codes[channel]);
+		}
+		for (uint8_t channel = 0; channel < 3; channel++) {
+			address = stress_ym_write(m_rom, address, 0, channel * 2, 0x40 + step * 0x18 + channel * 0x30);
+		}
+		address = stress_ym_write(m_rom, address, 1, 0x00, 0xBF);		// ADPCM-A voices dumped
+		address = stress_ym_write(m_rom, address, 1, 0x00, 0x3F);		// then started
+		if (step == 0) {
+			address = stress_ym_write(m_rom, address, 0, 0x10, 0x90);	// ADPCM-B started, repeating
+		}
+		m_rom[address++] = 0;
+	}
+	m_rom[STRESS_Z80_SEQUENCE + STRESS_Z80_STEPS * 2] = 0;
+	m_rom[STRESS_Z80_SEQUENCE + STRESS_Z80_STEPS * 2 + 1] = 0;
+}
+
+// port 0 is YM2610 port A (Z80 ports 4 and 5), 1 is port B (6 and 7)
+static uint32_t stress_ym_write(uint8_t *m_rom, uint32_t address, uint8_t port, uint8_t reg, uint8_t value) {
+	m_rom[address] = port ? 0x06 : 0x04;
+	m_rom[address + 1] = reg;
+	m_rom[address + 2] = value;
+	return address + 3;
+}
+
+static bool stress_write_cartridge(const char *path) {
+	uint8_t *p_rom = calloc(1, STRESS_P_ROM_SIZE);
+	uint8_t *s_rom = malloc(STRESS_S_ROM_SIZE);
+	uint8_t *m_rom = calloc(1, STRESS_M_ROM_SIZE);
+	uint8_t *v_roms = malloc(2 * STRESS_V_ROM_SIZE);
+	uint8_t *c_roms = malloc(2 * STRESS_C_ROM_SIZE);
+	bool written = false;
+	if (p_rom == NULL || s_rom == NULL || m_rom == NULL || v_roms == NULL || c_roms == NULL) {
+		fprintf(stderr, "can't allocate the cartridge ROMs\n");
+	}
+	else {
+		stress_build_p_rom(p_rom);
+		stress_swap_words(p_rom, STRESS_P_ROM_SIZE);
+		stress_build_m_rom(m_rom);
+		// random tiles and ADPCM nibbles, every pixel and sample has to be decoded
+		stress_fill_random(s_rom, STRESS_S_ROM_SIZE);
+		stress_fill_random(v_roms, 2 * STRESS_V_ROM_SIZE);
+		stress_fill_random(c_roms, 2 * STRESS_C_ROM_SIZE);
+
+		const stress_rom_t roms[] = {
+			{ "999-p1.p1", p_rom, ROM_BANK1_SIZE },
+			{ "999-p2.sp2", p_rom + ROM_BANK1_SIZE, STRESS_P_ROM_SIZE - ROM_BANK1_SIZE },
+			{ "999-s1.s1", s_rom, STRESS_S_ROM_SIZE },
+			{ "999-m1.m1", m_rom, STRESS_M_ROM_SIZE },
+			{ "999-v1.v1", v_roms, STRESS_V_ROM_SIZE },
+			{ "999-v2.v2", v_roms + STRESS_V_ROM_SIZE, STRESS_V_ROM_SIZE },
+			{ "999-c1.c1", c_roms, STRESS_C_ROM_SIZE },
+			{ "999-c2.c2", c_roms + STRESS_C_ROM_SIZE, STRESS_C_ROM_SIZE },
+		};
+		written = stress_write_zip(path, roms, sizeof(roms) / sizeof(stress_rom_t));
+	}
+	free(p_rom);
+	free(s_rom);
+	free(m_rom);
+	free(v_roms);
+	free(c_roms);
+	return written;
+}
+
+#pragma mark - System ROMs
+
+static void stress_build_system_rom(uint8_t *system_rom) {
+	for (uint32_t vector = 8; vector < ROM_VECTOR_TABLE_SIZE; vector += 4) {
+		stress_write_long(system_rom, vector, SYSTEM_ROM_START + 0x426);
+	}
+	stress_write_long(system_rom, 0x00, 0x0010F300);
+	stress_write_long(system_rom, 0x04, SYSTEM_ROM_START + 0x402);
+	stress_write_long(system_rom, 0x64, SYSTEM_ROM_START + 0x438);
+	stress_write_long(system_rom, 0x68, SYSTEM_ROM_START + STRESS_BIOS_TIMER);
+
+	// AES, Europe, like neo-epo.bin
+	system_rom[0x400] = 0x00;
+	system_rom[0x401] = 0x02;
+	// jump table of the real system ROMs, only reset and vblank do something
+	for (uint32_t entry = 0x402; entry <= 0x44A; entry += 6) {
+		uint32_t target = STRESS_BIOS_HALT;
+		if (entry == 0x402) {
+			target = STRESS_BIOS_RESET;
+		}
+		else if (entry == 0x438) {
+			target = STRESS_BIOS_VBLANK;
+		}
+		uint16_t jmp = 0x4EF9;
+		stress_write_words(system_rom, entry, &jmp, 1);
+		stress_write_long(system_rom, entry + 2, SYSTEM_ROM_START + target);
+	}
+
+	static const uint16_t reset[] = {
+		0x46FC, 0x2700,						// move.w	#$2700, sr
+		0x4FF9, 0x0010, 0xF300,				// lea		$10F300, sp
+		0x33FC, 0x0007, 0x003C, 0x000C,		// move.w	#7, REG_IRQACK, reset interrupt included
+		0x13C0, 0x003A, 0x0013,				// move.b	d0, REG_SWPROM, cartridge vectors
+		0x13C0, 0x003A, 0x001B,				// move.b	d0, REG_CRTFIX
+		0x13FC, 0x0080, 0x0010, 0xFD80,		// move.b	#$80, BIOS_SYSTEM_MODE
+		0x13FC, 0x0002, 0x0010, 0xFDAE,		// move.b	#2, BIOS_USER_REQUEST, demo
+		0x4EF9, 0x0000, 0x0122,				// jmp		USER
+	};
+	static const uint16_t vblank[] = {
+		0x33FC, 0x0004, 0x003C, 0x000C,		// move.w	#4, REG_IRQACK
+		0x4E73,								// rte
+	};
+	static const uint16_t timer[] = {
+		0x33FC, 0x0002, 0x003C, 0x000C,		// move.w	#2, REG_IRQACK
+		0x4E73,								// rte
+	};
+	static const uint16_t halt = 0x60FE;	// bra.s	*
+	stress_write_words(system_rom, STRESS_BIOS_RESET, reset, sizeof(reset) / sizeof(uint16_t));
+	stress_write_words(system_rom, STRESS_BIOS_VBLANK, vblank, sizeof(vblank) / sizeof(uint16_t));
+	stress_write_words(system_rom, STRESS_BIOS_TIMER, timer, sizeof(timer) / sizeof(uint16_t));
+	stress_write_words(system_rom, STRESS_BIOS_HALT, &halt, 1);
+}
+
+// Line of the 256 lines sprite shown on each line at each zoom: tile in the high nibble, tile line in the low one
+static void stress_build_y_zoom_rom(uint8_t *y_zoom_rom) {
+	for (uint32_t zoom = 0; zoom < 256; zoom++) {
+		for (uint32_t line = 0; line < 256; line++) {
+			uint32_t source = line * 256 / (zoom + 1);
+			y_zoom_rom[zoom * 256 + line] = source > 255 ? 255 : (uint8_t)source;
+		}
+	}
+}
+
+static bool stress_write_system(const char *system_directory) {
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/neogeo", system_directory);
+	if ((mkdir(system_directory, 0755) != 0 && errno != EEXIST) || (mkdir(path, 0755) != 0 && errno != EEXIST)) {
+		fprintf(stderr, "can't create %s\n", path);
+		return false;
+	}
+	snprintf(path, sizeof(path), "%s/neogeo/neogeo.zip", system_directory);
+	if (access(path, F_OK) == 0) {
+		fprintf(stderr, "%s already exists, not replaced\n", path);
+		return false;
+	}
+
+	uint8_t *system_rom = calloc(1, SYSTEM_ROM_SIZE);
+	uint8_t *fix_rom = malloc(STRESS_S_ROM_SIZE);
+	uint8_t *y_zoom_rom = calloc(1, STRESS_Y_ZOOM_ROM_SIZE);
+	bool written = false;
+	if (system_rom == NULL || fix_rom == NULL || y_zoom_rom == NULL) {
+		fprintf(stderr, "can't allocate the system ROMs\n");
+	}
+	else {
+		stress_build_system_rom(system_rom);
+		stress_swap_words(system_rom, SYSTEM_ROM_SIZE);
+		stress_fill_random(fix_rom, STRESS_S_ROM_SIZE);
+		stress_build_y_zoom_rom(y_zoom_rom);
+
+		const stress_rom_t roms[] = {
+			{ "neo-epo.bin", system_rom, SYSTEM_ROM_SIZE },
+			{ "sfix.sfix", fix_rom, STRESS_S_ROM_SIZE },
+			{ "000-lo.lo", y_zoom_rom, STRESS_Y_ZOOM_ROM_SIZE },
+		};
+		written = stress_write_zip(path, roms, sizeof(roms) / sizeof(stress_rom_t));
+	}
+	free(system_rom);
+	free(fix_rom);
+	free(y_zoom_rom);
+	return written;
+}
+
+#pragma mark - Zip
+
+static bool stress_write_zip(const char *path, const stress_rom_t *roms, size_t count) {
+	mz_zip_archive zip_archive;
+	mz_zip_zero_struct(&zip_archive);
+	if (mz_zip_writer_init_file(&zip_archive, path, 0) == MZ_FALSE) {
+		fprintf(stderr, "can't create %s - %s\n", path, mz_zip_get_error_string(zip_archive.m_last_error));
+		return false;
+	}
+	MZ_TIME_T time = STRESS_ZIP_TIME;
+	for (size_t index = 0; index < count; index++) {
+		if (mz_zip_writer_add_mem_ex_v2(&zip_archive, roms[index].name, roms[index].data, roms[index].size, NULL, 0, MZ_BEST_SPEED, 0, 0, &time, NULL, 0, NULL, 0) == MZ_FALSE) {
+			fprintf(stderr, "can't add %s to %s - %s\n", roms[index].name, path, mz_zip_get_error_string(zip_archive.m_last_error));
+			mz_zip_writer_end(&zip_archive);
+			return false;
+		}
+	}
+	bool finalized = mz_zip_writer_finalize_archive(&zip_archive);
+	if (finalized == false) {
+		fprintf(stderr, "can't write %s - %s\n", path, mz_zip_get_error_string(zip_archive.m_last_error));
+	}
+	mz_zip_writer_end(&zip_archive);
+	return finalized;
+}
+
+static void stress_usage(const char *name) {
+	fprintf(stderr, "usage: %s [-s system_directory] stress.zip\n", name);
+}
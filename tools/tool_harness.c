@@ -0,0 +1,92 @@
+#include "tool_harness.h"
+#include "cartridge.h"
+#include "cartridge_image.h"
+#include "libretro_core.h"
+#include "log.h"
+#include "neogeo.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+tool_harness_option_t tool_harness_options[TOOL_HARNESS_MAX_OPTIONS];
+size_t tool_harness_options_count = 0;
+
+static void tool_harness_log(enum retro_log_level level, const char *format, ...);
+static bool tool_harness_environment(unsigned command, void *data);
+
+#pragma mark - Public
+
+void tool_harness_init(enum retro_log_level level) {
+	libretroCallbacks.log = &tool_harness_log;
+	libretroCallbacks.environment = &tool_harness_environment;
+	log_set_level(level);
+}
+
+bool tool_harness_add_option(char *argument) {
+	char *separator = strchr(argument, '=');
+	if (separator == NULL) {
+		fprintf(stderr, "%s is not option=value\n", argument);
+		return false;
+	}
+	if (tool_harness_options_count == TOOL_HARNESS_MAX_OPTIONS) {
+		fprintf(stderr, "more than %u options\n", TOOL_HARNESS_MAX_OPTIONS);
+		return false;
+	}
+	*separator = '\0';
+	if (retro_core_variable_is_valid(argument, separator + 1) == false) {
+		fprintf(stderr, "%s=%s is not a core option\n", argument, separator + 1);
+		return false;
+	}
+	tool_harness_options[tool_harness_options_count].key = argument;
+	tool_harness_options[tool_harness_options_count].value = separator + 1;
+	tool_harness_options_count++;
+	return true;
+}
+
+bool tool_harness_load_system(const char *system_directory) {
+	retro_core_create_neogeo(system_directory);
+	retro_core_wait_system_roms();
+	if (neogeo_is_system_ready() == false) {
+		fprintf(stderr, "can't load the BIOS from %s/neogeo/neogeo.zip\n", system_directory);
+		return false;
+	}
+	return true;
+}
+
+bool tool_harness_load_game(const char *game_path) {
+	retro_core_apply_variables(game_path);
+	return tool_harness_load_cartridge(game_path);
+}
+
+bool tool_harness_load_cartridge(const char *game_path) {
+	bool loaded = cartridge_image_probe(game_path) ? cartridge_load_image(game_path) : cartridge_load_roms(game_path);
+	if (loaded == false) {
+		fprintf(stderr, "can't load cartridge %s\n", game_path);
+	}
+	return loaded;
+}
+
+#pragma mark - Frontend
+
+static void tool_harness_log(enum retro_log_level level, const char *format, ...) {
+	va_list arguments;
+	va_start(arguments, format);
+	vfprintf(stderr, format, arguments);
+	va_end(arguments);
+}
+
+// Only the core options are answered, as a frontend without any other feature
+static bool tool_harness_environment(unsigned command, void *data) {
+	if (command != RETRO_ENVIRONMENT_GET_VARIABLE) {
+		return false;
+	}
+	struct retro_variable *variable = data;
+	for (size_t i = 0; i < tool_harness_options_count; i++) {
+		if (strcmp(tool_harness_options[i].key, variable->key) == 0) {
+			variable->value = tool_harness_options[i].value;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,37 @@
+#ifndef tool_harness_h
+#define tool_harness_h
+
+#include "libretro.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ *	Headless frontend of the tools
+ *	Core logs go to stderr, the core options given with -o option=value are the only environment requests answered
+ *	and the BIOS and game are brought up like the libretro core does
+ */
+
+#define TOOL_HARNESS_MAX_OPTIONS 32
+
+typedef struct tool_harness_option {
+	const char *key;
+	const char *value;
+} tool_harness_option_t;
+
+extern tool_harness_option_t tool_harness_options[TOOL_HARNESS_MAX_OPTIONS];
+extern size_t tool_harness_options_count;
+
+// Installs the log and environment callbacks, lines below level are skipped
+void tool_harness_init(enum retro_log_level level);
+// option=value argument, split in place. false with the reason on stderr unless it is one of the core options
+bool tool_harness_add_option(char *argument);
+
+// BIOS from system_directory/neogeo/neogeo.zip
+bool tool_harness_load_system(const char *system_directory);
+// Applies the options then loads the game, a zip or a native cartridge image
+bool tool_harness_load_game(const char *game_path);
+// Without applying the options, for the tools that don't run the machine
+bool tool_harness_load_cartridge(const char *game_path);
+
+#endif /* tool_harness_h */
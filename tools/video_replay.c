@@ -0,0 +1,298 @@
+/*
+ *	Replays a video command log through the renderer alone, none of the CPUs run
+ *	Every line is drawn like the core does: sprites list, sprites then fix layer, auto animation on the VBlank line
+ *	Reports the rendering speed and the frame hashes, so renderer changes can be measured and checked
+ *	for bit exactness
+ *
+ *	usage: neogeo_video_replay [-i iterations] [-w hashes.txt | -c hashes.txt] capture.vidlog system_directory game.zip|game.ngi
+ *	the log is captured by the core with the neogeo_video_capture option, the BIOS provides the SFIX and Y zoom ROMs,
+ *	the game the S and C ROMs
+ *	-w writes the hash of every frame, -c compares them with a file written before or with a neogeo_golden file
+ *	of the captured run: the first divergent frame is reported and the exit code is then 2
+ */
+
+#include "cartridge.h"
+#include "common_tools.h"
+#include "log.h"
+#include "memory_mapping.h"
+#include "memory_palettes_ram.h"
+#include "neogeo.h"
+#include "timer.h"
+#include "tool_harness.h"
+#include "video.h"
+#include "video_capture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define REPLAY_VRAM_WORDS 0x8800		// write_vram drops the writes above
+
+static video_capture_event_t *replay_load_events(video_capture_t *capture, size_t *count);
+static void replay_apply(const video_capture_event_t *event);
+static void replay_draw_line(uint32_t scanline);
+static uint64_t replay_hash(const void *data, size_t size);
+static bool replay_write_hashes(const char *path, const uint64_t *hashes, uint32_t frames, const char *capture_path);
+static uint32_t replay_read_hashes(const char *path, uint64_t *hashes, uint32_t frames);
+static void replay_usage(const char *name);
+
+int main(int argc, char *argv[]) {
+	int iterations = 1;
+	const char *write_path = NULL;
+	const char *compare_path = NULL;
+	int option;
+	while ((option = getopt(argc, argv, "i:w:c:")) != -1) {
+		switch (option) {
+			case 'i':
+				iterations = atoi(optarg);
+				break;
+			case 'w':
+				write_path = optarg;
+				break;
+			case 'c':
+				compare_path = optarg;
+				break;
+			default:
+				replay_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (argc - optind != 3 || iterations <= 0 || (write_path != NULL && compare_path != NULL)) {
+		replay_usage(argv[0]);
+		return 1;
+	}
+	const char *capture_path = argv[optind];
+	const char *system_directory = argv[optind + 1];
+	const char *game_path = argv[optind + 2];
+	tool_harness_init(LOG_WARN);
+
+	video_capture_t capture;
+	video_capture_header_t header;
+	if (video_capture_open(&capture, capture_path, &header) == false) {
+		return 1;
+	}
+	size_t events_count;
+	video_capture_event_t *events = replay_load_events(&capture, &events_count);
+	video_capture_close(&capture);
+	if (events == NULL || events_count == 0) {
+		fprintf(stderr, "no events in %s\n", capture_path);
+		return 1;
+	}
+	// a log cut short ends with its last complete frame
+	uint32_t frames = (uint32_t)(events[events_count - 1].line / VERTICAL_PIXELS);
+	if (frames == 0) {
+		fprintf(stderr, "%s has no complete frame\n", capture_path);
+		return 1;
+	}
+
+	if (tool_harness_load_system(system_directory) == false || tool_harness_load_game(game_path) == false) {
+		return 1;
+	}
+	cartridge_wait_sprites();
+	if (cartridge_get_first_fix_rom()->size != header.fix_rom_size || serialized_c_roms.size != header.sprites_size) {
+		fprintf(stderr, "the game doesn't match the capture: S ROM %zu bytes, sprites %zu bytes instead of %u and %u bytes\n",
+				cartridge_get_first_fix_rom()->size, serialized_c_roms.size, header.fix_rom_size, header.sprites_size);
+		return 1;
+	}
+
+	uint64_t *hashes = malloc(frames * sizeof(uint64_t));
+	if (hashes == NULL) {
+		fprintf(stderr, "can't allocate %u frames hashes\n", frames);
+		return 1;
+	}
+	uint64_t start = monotonic_time_usec();
+	for (int iteration = 0; iteration < iterations; iteration++) {
+		// the video as neogeo_reset leaves it
+		video_reset();
+		palettes_rams_reset();
+		neogeo_use_palette_bank_1();
+
+		size_t event_index = 0;
+		uint64_t line = 0;
+		for (uint32_t frame = 0; frame < frames; frame++) {
+			for (uint32_t scanline = 0; scanline < VERTICAL_PIXELS; scanline++, line++) {
+				while (event_index < events_count && events[event_index].line <= line) {
+					replay_apply(&events[event_index++]);
+				}
+				replay_draw_line(scanline);
+			}
+			hashes[frame] = replay_hash(video.frameBuffer, FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT * sizeof(uint16_t));
+		}
+	}
+	uint64_t elapsed = monotonic_time_usec() - start;
+	if (elapsed == 0) {
+		elapsed = 1;
+	}
+
+	// FNV-1a over the frame hashes
+	uint64_t hash = replay_hash(hashes, frames * sizeof(uint64_t));
+	double frames_per_second = (double)frames * iterations * 1000000.0 / elapsed;
+	printf("%zu events, %u frames\n", events_count, frames);
+	printf("%.1f frames/s, %.2f ms per frame, %.1fx real time\n", frames_per_second, 1000.0 / frames_per_second, frames_per_second / 60.0);
+	printf("hash %016llx, last frame %016llx\n", (unsigned long long)hash, (unsigned long long)hashes[frames - 1]);
+
+	int status = 0;
+	if (write_path != NULL && replay_write_hashes(write_path, hashes, frames, capture_path) == false) {
+		status = 1;
+	}
+	if (compare_path != NULL) {
+		uint64_t *expected = malloc(frames * sizeof(uint64_t));
+		uint32_t expected_frames = expected ? replay_read_hashes(compare_path, expected, frames) : 0;
+		if (expected_frames == 0) {
+			fprintf(stderr, "no frame hashes in %s\n", compare_path);
+			status = 1;
+		}
+		else {
+			if (expected_frames < frames) {
+				fprintf(stderr, "%s has %u frames, comparing those\n", compare_path, expected_frames);
+			}
+			for (uint32_t frame = 0; frame < expected_frames; frame++) {
+				if (hashes[frame] != expected[frame]) {
+					fprintf(stderr, "%s: video diverges at frame %u\n", compare_path, frame);
+					status = 2;
+					break;
+				}
+			}
+		}
+		free(expected);
+	}
+
+	free(hashes);
+	free(events);
+	cartridge_unload();
+	return status;
+}
+
+#pragma mark - Replay
+
+static video_capture_event_t *replay_load_events(video_capture_t *capture, size_t *count) {
+	size_t capacity = 65536;
+	video_capture_event_t *events = malloc(capacity * sizeof(video_capture_event_t));
+	*count = 0;
+	while (events != NULL && video_capture_next(capture, &events[*count])) {
+		if (events[(*count)++].kind == VIDEO_CAPTURE_END) {
+			return events;
+		}
+		if (*count == capacity) {
+			capacity *= 2;
+			video_capture_event_t *grown = realloc(events, capacity * sizeof(video_capture_event_t));
+			if (grown == NULL) {
+				free(events);
+				return NULL;
+			}
+			events = grown;
+		}
+	}
+	return events;
+}
+
+// Through the same handlers as the 68K writes, LSPC mode apart
+static void replay_apply(const video_capture_event_t *event) {
+	switch (event->kind) {
+		case VIDEO_CAPTURE_VRAM_WRITE:
+			if (event->address < REPLAY_VRAM_WORDS) {
+				video.vram.handlers.write_word(REG_VRAMADDR - IO_PORTS_START, event->address);
+				video.vram.handlers.write_word(REG_VRAMRW - IO_PORTS_START, event->value);
+			}
+			break;
+		case VIDEO_CAPTURE_VRAM_MODULO:
+			video.vram.handlers.write_word(REG_VRAMMOD - IO_PORTS_START, event->value);
+			break;
+		case VIDEO_CAPTURE_LSPC_MODE:
+			// only the auto animation bits, the timer ones would interrupt a 68K that doesn't run
+			video.auto_animation_speed = event->value >> 8;
+			video.auto_animation_disabled = (event->value & 0x0008) != 0;
+			break;
+		case VIDEO_CAPTURE_PALETTE_WRITE:
+			current_palette_ram->handlers.write_word(event->address * 2, event->value);
+			break;
+		case VIDEO_CAPTURE_PALETTE_BANK:
+			if (event->value) {
+				neogeo_use_palette_bank_2();
+			}
+			else {
+				neogeo_use_palette_bank_1();
+			}
+			break;
+		case VIDEO_CAPTURE_FIX_ROM:
+			if (event->value) {
+				neogeo_use_cartridge_fix_rom();
+			}
+			else {
+				neogeo_use_board_fix_rom();
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+// As draw_line_callback
+static void replay_draw_line(uint32_t scanline) {
+	if (scanline == VBLANK_LINE) {
+		video_update_auto_animation();
+	}
+	if (scanline >= FIRST_ACTIVE_LINE && scanline < VBLANK_LINE) {
+		video_draw_empty_line(scanline);
+		video_create_sprites_list(scanline);
+		video_draw_sprites(scanline);
+		video_draw_fix(scanline);
+	}
+}
+
+#pragma mark - Hashes
+
+// FNV-1a
+static uint64_t replay_hash(const void *data, size_t size) {
+	const uint8_t *bytes = data;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static bool replay_write_hashes(const char *path, const uint64_t *hashes, uint32_t frames, const char *capture_path) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "can't create %s\n", path);
+		return false;
+	}
+	fprintf(file, "# %s, %u frames\n# frame video\n", capture_path, frames);
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		fprintf(file, "%u %016llx\n", frame, (unsigned long long)hashes[frame]);
+	}
+	fclose(file);
+	return true;
+}
+
+// Returns how many consecutive frames from 0 were read, an audio hash after the video one is ignored
+static uint32_t replay_read_hashes(const char *path, uint64_t *hashes, uint32_t frames) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "can't open %s\n", path);
+		return 0;
+	}
+	uint32_t count = 0;
+	char line[128];
+	while (count < frames && fgets(line, sizeof(line), file) != NULL) {
+		unsigned frame;
+		unsigned long long video_hash;
+		if (line[0] == '#' || sscanf(line, "%u %llx", &frame, &video_hash) != 2) {
+			continue;
+		}
+		if (frame != count) {
+			fprintf(stderr, "%s: frame %u where %u was expected\n", path, frame, count);
+			break;
+		}
+		hashes[count++] = video_hash;
+	}
+	fclose(file);
+	return count;
+}
+
+static void replay_usage(const char *name) {
+	fprintf(stderr, "usage: %s [-i iterations] [-w hashes.txt | -c hashes.txt] capture.vidlog system_directory game.zip|game.ngi\n", name);
+}
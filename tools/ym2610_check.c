@@ -0,0 +1,317 @@
+/*
+ *	Bit exactness check of the YM2610 synthesis, needs no game
+ *	Replays a synthetic register log through the synthesis alone: seeded pseudo random writes over every FM
+ *	algorithm, LFO AM and PM, 3 slot mode, SSG-EG, CSM, the SSG and both ADPCM units playing generated PCM ROMs
+ *	Every rate is rendered several times, with update calls sliced differently and with the ADPCM-A decode cache,
+ *	and each pass must give the hash stored below
+ *	The log without SSG writes gives what the engine rendering one sample at a time gave, the complete one
+ *	what the SSG gives since it renders at its native rate
+ *
+ *	usage: neogeo_ym2610_check [-w]
+ *	the exit code is 2 when a hash doesn't match, -w prints the hashes to store instead of comparing them
+ */
+
+#include "log.h"
+#include "tool_harness.h"
+#include "ym2610_capture.h"
+#include "3rdParty/ym/ym2610.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CHECK_CLOCK 8000000
+#define CHECK_SECONDS 10
+#define CHECK_SEED 0x2610
+#define CHECK_PCM_A_SIZE (1024 * 1024)
+#define CHECK_PCM_B_SIZE (512 * 1024)
+#define CHECK_CHUNK_SAMPLES 1024
+#define CHECK_ADPCMA_CACHE_BUDGET (256 * 1024)
+
+typedef enum check_log_kind {
+	CHECK_LOG_FM_ADPCM,			// no SSG writes
+	CHECK_LOG_COMPLETE,
+	CHECK_LOG_COUNT
+} check_log_kind_t;
+
+typedef struct check_rate {
+	uint32_t sample_rate;
+	uint64_t hashes[CHECK_LOG_COUNT];
+} check_rate_t;
+
+// neogeo_audio_sample_rate values, native is the chip clock / 144
+static const check_rate_t check_rates[] = {
+	{ 55555, { 0x409bda9b00044a06ULL, 0x96d318d3292d194cULL } },
+	{ 48000, { 0xda91b2ed77d431fbULL, 0x2386d093ce613aeaULL } },
+	{ 44100, { 0xfeff2136292255f0ULL, 0x561bdee2bc25ba7fULL } },
+	{ 22050, { 0x032e760d6452c72cULL, 0x8bd4d85a6ece5ba3ULL } },
+};
+
+static const char *check_log_names[CHECK_LOG_COUNT] = { "FM and ADPCM", "complete" };
+
+typedef enum check_slicing {
+	CHECK_SLICING_CHUNKS,		// long updates, as the replay does
+	CHECK_SLICING_RANDOM,		// 1 to 200 samples, every block boundary moves
+	CHECK_SLICING_CACHE,		// chunks with the ADPCM-A decode cache on
+	CHECK_SLICING_COUNT
+} check_slicing_t;
+
+static const char *check_slicing_names[CHECK_SLICING_COUNT] = { "chunks", "random slices", "ADPCM-A cache" };
+
+static uint32_t random_state;
+
+static void check_timer_handler(int channel, int count, double clock);
+static void check_irq_handler(int irq);
+static uint32_t check_random(void);
+static uint8_t *check_generate_pcm_rom(size_t size);
+static ym2610_capture_event_t *check_generate_log(uint32_t sample_rate, check_log_kind_t log, size_t *count);
+static void check_add_write(ym2610_capture_event_t *events, size_t *count, uint64_t sample, uint8_t port, uint8_t address, uint8_t value);
+static uint64_t check_replay(const ym2610_capture_event_t *events, size_t events_count, check_slicing_t slicing);
+static uint64_t check_render(uint64_t hash, FMSAMPLE *buffer, uint64_t samples);
+
+int main(int argc, char *argv[]) {
+	bool write_hashes = false;
+	int option;
+	while ((option = getopt(argc, argv, "w")) != -1) {
+		if (option != 'w') {
+			fprintf(stderr, "usage: %s [-w]\n", argv[0]);
+			return 1;
+		}
+		write_hashes = true;
+	}
+	tool_harness_init(LOG_WARN);
+
+	random_state = CHECK_SEED;
+	uint8_t *pcm_rom_a = check_generate_pcm_rom(CHECK_PCM_A_SIZE);
+	uint8_t *pcm_rom_b = check_generate_pcm_rom(CHECK_PCM_B_SIZE);
+	if (pcm_rom_a == NULL || pcm_rom_b == NULL) {
+		fprintf(stderr, "can't allocate the PCM ROMs\n");
+		return 1;
+	}
+
+	int status = 0;
+	for (size_t rate = 0; rate < sizeof(check_rates) / sizeof(check_rate_t); rate++) {
+		// writes never reach the core write queue here, its update requests have nothing to render
+		ym2610_init(CHECK_CLOCK, (int)check_rates[rate].sample_rate, &check_timer_handler, &check_irq_handler);
+		ym2610_set_pcm_roms(pcm_rom_a, CHECK_PCM_A_SIZE, pcm_rom_b, CHECK_PCM_B_SIZE);
+
+		uint64_t hashes[CHECK_LOG_COUNT];
+		for (check_log_kind_t log = 0; log < CHECK_LOG_COUNT; log++) {
+			size_t events_count;
+			ym2610_capture_event_t *events = check_generate_log(check_rates[rate].sample_rate, log, &events_count);
+			if (events == NULL) {
+				fprintf(stderr, "can't allocate the register log\n");
+				return 1;
+			}
+			for (check_slicing_t slicing = 0; slicing < CHECK_SLICING_COUNT; slicing++) {
+				uint64_t hash = check_replay(events, events_count, slicing);
+				if (slicing == CHECK_SLICING_CHUNKS) {
+					hashes[log] = hash;
+				}
+				if (write_hashes) {
+					continue;
+				}
+				bool match = hash == check_rates[rate].hashes[log];
+				printf("%u Hz, %s log, %s: %016llx %s\n", check_rates[rate].sample_rate, check_log_names[log],
+					   check_slicing_names[slicing], (unsigned long long)hash, match ? "ok" : "MISMATCH");
+				if (match == false) {
+					status = 2;
+				}
+			}
+			free(events);
+		}
+		if (write_hashes) {
+			printf("\t{ %u, { 0x%016llxULL, 0x%016llxULL } },\n", check_rates[rate].sample_rate,
+				   (unsigned long long)hashes[CHECK_LOG_FM_ADPCM], (unsigned long long)hashes[CHECK_LOG_COMPLETE]);
+		}
+		ym2610_release_adpcma_cache();
+	}
+
+	free(pcm_rom_a);
+	free(pcm_rom_b);
+	return status;
+}
+
+#pragma mark - Frontend
+
+// Timers and IRQs have no effect on the synthesis, overflows are part of the log
+static void check_timer_handler(int channel, int count, double clock) {
+}
+
+static void check_irq_handler(int irq) {
+}
+
+#pragma mark - Synthetic log
+
+// xorshift32, the log must not depend on the C library
+static uint32_t check_random() {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+// ADPCM nibbles are random, any byte is valid data
+static uint8_t *check_generate_pcm_rom(size_t size) {
+	uint8_t *rom = malloc(size);
+	if (rom == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < size; i++) {
+		rom[i] = (uint8_t)check_random();
+	}
+	return rom;
+}
+
+// The same seed for every log, so a log doesn't depend on what was checked before it
+static ym2610_capture_event_t *check_generate_log(uint32_t sample_rate, check_log_kind_t log, size_t *count) {
+	uint64_t samples = (uint64_t)sample_rate * CHECK_SECONDS;
+	uint64_t frame_samples = sample_rate / 60;
+	// up to 39 writes a frame, the largest is 2 address and data pairs
+	size_t capacity = (size_t)(samples / frame_samples + 1) * 40 * 4 + 1;
+	ym2610_capture_event_t *events = malloc(capacity * sizeof(ym2610_capture_event_t));
+	if (events == NULL) {
+		return NULL;
+	}
+	*count = 0;
+	random_state = CHECK_SEED;
+
+	for (uint64_t frame_start = 0; frame_start + frame_samples <= samples; frame_start += frame_samples) {
+		uint64_t sample = frame_start;
+		uint32_t writes = check_random() % 40;
+		for (uint32_t i = 0; i < writes; i++) {
+			// as many writes as a busy sound driver, anywhere in the frame
+			sample += check_random() % (frame_samples / 40);
+			uint8_t fm_port = check_random() & 1;
+			uint32_t kind = check_random() % 16;
+			if (kind < 7) {
+				// operator and channel registers of the 2 FM channels of the port, channels 0 and 3 don't exist
+				uint8_t address = 0x30 + check_random() % 0x88;
+				if ((address & 3) == 0) {
+					address |= 1 + check_random() % 2;
+				}
+				uint8_t value = (uint8_t)check_random();
+				if (address >= 0x40 && address < 0x50) {
+					// loud enough total levels
+					value &= 0x3F >> (check_random() % 3);
+				}
+				else if (address >= 0x90 && address < 0xA0 && check_random() % 2) {
+					// SSG-EG off half of the time
+					value = 0;
+				}
+				check_add_write(events, count, sample, fm_port, address, value);
+			}
+			else if (kind < 9) {
+				// key on and off, channels 1, 2, 5 and 6
+				uint8_t channel = (check_random() & 1) + 1 + ((check_random() & 1) << 2);
+				check_add_write(events, count, sample, 0, 0x28, (uint8_t)((check_random() & 0xF0) | channel));
+			}
+			else if (kind == 9) {
+				check_add_write(events, count, sample, 0, 0x22, check_random() & 0x0F);
+			}
+			else if (kind == 10) {
+				// 3 slot and CSM modes, then maybe a timer overflow, timer A keys on every slot in CSM mode
+				check_add_write(events, count, sample, 0, 0x27, (uint8_t)((check_random() & 0xC0) | 0x30));
+				if (check_random() % 2) {
+					events[(*count)++] = (ym2610_capture_event_t){ sample, YM2610_CAPTURE_TIMER_A + (check_random() & 1), 0 };
+				}
+			}
+			else if (kind == 11) {
+				// SSG tone, noise, mixer, volumes and envelope
+				if (log == CHECK_LOG_FM_ADPCM) {
+					continue;
+				}
+				check_add_write(events, count, sample, 0, check_random() % 14, (uint8_t)check_random());
+			}
+			else if (kind == 12) {
+				// ADPCM-A total level, channels level and pan, start and end addresses
+				uint8_t address = check_random() % 0x30;
+				uint8_t value = (uint8_t)check_random();
+				if (address >= 0x18 && address < 0x20) {
+					value &= 1;
+				}
+				else if (address >= 0x28) {
+					value = 0;
+				}
+				check_add_write(events, count, sample, 1, address, value);
+			}
+			else if (kind == 13) {
+				// ADPCM-A key on
+				check_add_write(events, count, sample, 1, 0x00, check_random() & 0x3F);
+			}
+			else if (kind == 14) {
+				// ADPCM-B control, pan, addresses, delta-N and level, no memory writes
+				static const uint8_t adpcmb_addresses[] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x19, 0x1A, 0x1B, 0x1C };
+				uint8_t address = adpcmb_addresses[check_random() % sizeof(adpcmb_addresses)];
+				uint8_t value = (uint8_t)check_random();
+				if (address == 0x13 || address == 0x15) {
+					value &= 3;
+				}
+				else if (address == 0x10) {
+					value &= 0xB0;
+				}
+				else if (address == 0x11) {
+					value |= 0xC0;
+				}
+				else if (address == 0x1C) {
+					value = 0;
+				}
+				check_add_write(events, count, sample, 0, address, value);
+			}
+			else {
+				// 3 slot mode frequencies
+				check_add_write(events, count, sample, 0, 0xA8 + check_random() % 3, (uint8_t)check_random());
+				check_add_write(events, count, sample, 0, 0xAC + check_random() % 3, check_random() & 0x3F);
+			}
+		}
+	}
+	events[(*count)++] = (ym2610_capture_event_t){ samples, YM2610_CAPTURE_END, 0 };
+	return events;
+}
+
+// An address then a data write, port 0 is A and 1 is B
+static void check_add_write(ym2610_capture_event_t *events, size_t *count, uint64_t sample, uint8_t port, uint8_t address, uint8_t value) {
+	events[(*count)++] = (ym2610_capture_event_t){ sample, YM2610_CAPTURE_WRITE_PORT_0 + port * 2, address };
+	events[(*count)++] = (ym2610_capture_event_t){ sample, YM2610_CAPTURE_WRITE_PORT_0 + port * 2 + 1, value };
+}
+
+#pragma mark - Replay
+
+// As neogeo_ym2610_replay, with the update calls sliced as asked
+static uint64_t check_replay(const ym2610_capture_event_t *events, size_t events_count, check_slicing_t slicing) {
+	FMSAMPLE buffer[CHECK_CHUNK_SAMPLES * 2];
+	ym2610_set_adpcma_cache_budget(slicing == CHECK_SLICING_CACHE ? CHECK_ADPCMA_CACHE_BUDGET : 0);
+	ym2610_reset();
+	random_state = CHECK_SEED;
+	uint64_t hash = 14695981039346656037ULL;
+	uint64_t samples = 0;
+	for (size_t i = 0; i < events_count; i++) {
+		const ym2610_capture_event_t *event = &events[i];
+		while (samples < event->sample) {
+			uint64_t count = event->sample - samples;
+			uint64_t slice = slicing == CHECK_SLICING_RANDOM ? 1 + check_random() % 200 : CHECK_CHUNK_SAMPLES;
+			if (count > slice) {
+				count = slice;
+			}
+			hash = check_render(hash, buffer, count);
+			samples += count;
+		}
+		if (event->kind <= YM2610_CAPTURE_WRITE_PORT_3) {
+			ym2610_write(event->kind - YM2610_CAPTURE_WRITE_PORT_0, event->value);
+		}
+		else if (event->kind == YM2610_CAPTURE_TIMER_A || event->kind == YM2610_CAPTURE_TIMER_B) {
+			ym2610_timerOver(event->kind == YM2610_CAPTURE_TIMER_B);
+		}
+	}
+	return hash;
+}
+
+// FNV-1a over the output samples, as neogeo_ym2610_replay
+static uint64_t check_render(uint64_t hash, FMSAMPLE *buffer, uint64_t samples) {
+	ym2610_update(buffer, (int)samples);
+	for (uint64_t i = 0; i < samples * 2; i++) {
+		hash ^= (uint16_t)buffer[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
@@ -0,0 +1,156 @@
+/*
+ *	Replays a YM2610 register log through the synthesis alone, none of the CPUs run
+ *	Reports the rendering speed and a hash of the output, so synthesis changes can be
+ *	measured and checked for bit exactness
+ *
+ *	usage: neogeo_ym2610_replay capture.ymlog game.zip|game.ngi [iterations] [ADPCM-A cache MB]
+ *	the log is captured by the core with the neogeo_ym2610_capture option, the game provides the PCM ROMs
+ *	the ADPCM-A decode cache is off by default, like the core option
+ */
+
+#include "cartridge.h"
+#include "common_tools.h"
+#include "log.h"
+#include "tool_harness.h"
+#include "ym2610_capture.h"
+#include "3rdParty/ym/ym2610.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REPLAY_CHUNK_SAMPLES 1024
+
+// Timers and IRQs have no effect on the synthesis, overflows are replayed from the log
+static void replay_timer_handler(int channel, int count, double clock) {
+}
+
+static void replay_irq_handler(int irq) {
+}
+
+static ym2610_capture_event_t *replay_load_events(ym2610_capture_t *capture, size_t *count) {
+	size_t capacity = 65536;
+	ym2610_capture_event_t *events = malloc(capacity * sizeof(ym2610_capture_event_t));
+	*count = 0;
+	while (events != NULL && ym2610_capture_next(capture, &events[*count])) {
+		if (events[(*count)++].kind == YM2610_CAPTURE_END) {
+			return events;
+		}
+		if (*count == capacity) {
+			capacity *= 2;
+			ym2610_capture_event_t *grown = realloc(events, capacity * sizeof(ym2610_capture_event_t));
+			if (grown == NULL) {
+				free(events);
+				return NULL;
+			}
+			events = grown;
+		}
+	}
+	// no end event, the capture was cut short: replay up to the last event
+	return events;
+}
+
+static bool replay_check_pcm_rom(const char *name, int index, uint32_t size, uint32_t crc) {
+	const rom_region_t *rom = cartridge_get_pcm_rom(index);
+	if (rom->size != size || cartridge_get_pcm_rom_crc(index) != crc) {
+		fprintf(stderr, "%s ROM doesn't match the capture: %zu bytes, CRC %08X instead of %u bytes, CRC %08X\n",
+				name, rom->size, cartridge_get_pcm_rom_crc(index), size, crc);
+		return false;
+	}
+	return true;
+}
+
+// FNV-1a over the output samples
+static uint64_t replay_render(uint64_t hash, FMSAMPLE *buffer, uint64_t samples) {
+	ym2610_update(buffer, (int)samples);
+	for (uint64_t i = 0; i < samples * 2; i++) {
+		hash ^= (uint16_t)buffer[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3 || argc > 5) {
+		fprintf(stderr, "usage: %s capture.ymlog game.zip|game.ngi [iterations] [ADPCM-A cache MB]\n", argv[0]);
+		return 1;
+	}
+	int iterations = argc >= 4 ? atoi(argv[3]) : 1;
+	if (iterations <= 0) {
+		iterations = 1;
+	}
+	int adpcma_cache_megabytes = argc == 5 ? atoi(argv[4]) : 0;
+	if (adpcma_cache_megabytes < 0) {
+		adpcma_cache_megabytes = 0;
+	}
+	tool_harness_init(LOG_WARN);
+
+	ym2610_capture_t capture;
+	ym2610_capture_header_t header;
+	if (ym2610_capture_open(&capture, argv[1], &header) == false) {
+		return 1;
+	}
+	size_t events_count;
+	ym2610_capture_event_t *events = replay_load_events(&capture, &events_count);
+	ym2610_capture_close(&capture);
+	if (events == NULL || events_count == 0) {
+		fprintf(stderr, "no events in %s\n", argv[1]);
+		return 1;
+	}
+
+	cartridge_init();
+	if (tool_harness_load_cartridge(argv[2]) == false) {
+		return 1;
+	}
+	cartridge_require_pcm_roms();
+	rom_region_t *pcm_rom_a = cartridge_get_pcm_rom(0);
+	rom_region_t *pcm_rom_b = cartridge_get_pcm_rom(1);
+	if (replay_check_pcm_rom("PCM A", 0, header.pcm_a_size, header.pcm_a_crc) == false
+		|| replay_check_pcm_rom("PCM B", 1, header.pcm_b_size, header.pcm_b_crc) == false) {
+		return 1;
+	}
+
+	// writes never reach the core write queue here, its update requests have nothing to render
+	ym2610_init((int)header.clock, (int)header.sample_rate, &replay_timer_handler, &replay_irq_handler);
+	ym2610_set_adpcma_cache_budget((size_t)adpcma_cache_megabytes * 1024 * 1024);
+	ym2610_set_pcm_roms(pcm_rom_a->data, pcm_rom_a->size, pcm_rom_b->data, pcm_rom_b->size);
+
+	FMSAMPLE buffer[REPLAY_CHUNK_SAMPLES * 2];
+	uint64_t hash = 0;
+	uint64_t samples = 0;
+	uint64_t start = monotonic_time_usec();
+	for (int iteration = 0; iteration < iterations; iteration++) {
+		ym2610_reset();
+		hash = 14695981039346656037ULL;
+		samples = 0;
+		for (size_t i = 0; i < events_count; i++) {
+			const ym2610_capture_event_t *event = &events[i];
+			while (samples < event->sample) {
+				uint64_t count = event->sample - samples;
+				if (count > REPLAY_CHUNK_SAMPLES) {
+					count = REPLAY_CHUNK_SAMPLES;
+				}
+				hash = replay_render(hash, buffer, count);
+				samples += count;
+			}
+			if (event->kind <= YM2610_CAPTURE_WRITE_PORT_3) {
+				ym2610_write(event->kind - YM2610_CAPTURE_WRITE_PORT_0, event->value);
+			}
+			else if (event->kind == YM2610_CAPTURE_TIMER_A || event->kind == YM2610_CAPTURE_TIMER_B) {
+				ym2610_timerOver(event->kind == YM2610_CAPTURE_TIMER_B);
+			}
+		}
+	}
+	uint64_t elapsed = monotonic_time_usec() - start;
+	if (elapsed == 0) {
+		elapsed = 1;
+	}
+
+	double samples_per_second = (double)samples * iterations * 1000000.0 / elapsed;
+	printf("%zu events, %llu samples at %u Hz (%.1f s)\n", events_count, (unsigned long long)samples, header.sample_rate, (double)samples / header.sample_rate);
+	printf("%.0f samples/s, %.1fx real time\n", samples_per_second, samples_per_second / header.sample_rate);
+	printf("hash %016llx\n", (unsigned long long)hash);
+
+	free(events);
+	cartridge_unload();
+	return 0;
+}